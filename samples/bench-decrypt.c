@@ -0,0 +1,116 @@
+/**
+ * Pajdeg
+ * Measure decryption throughput.
+ *
+ * This example times the AES-CBC decryption used for AESV2 and AESV3 encrypted PDFs,
+ * using the AES instructions of the processor (if it has them) as well as the portable
+ * implementation, and prints the throughput of each in MB/s.
+ *
+ * If given an encrypted PDF, it also passes it through Pajdeg, fetching (i.e. decrypting
+ * and decoding) every stream in it, and prints the time it took. The output goes to the
+ * given output file, or /dev/null.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../src/Pajdeg.h"
+#include "../src/PDParser.h"
+#include "../src/PDObject.h"
+#include "../src/pd_aes.h"
+
+// convenient way to scream and die
+#define die(msg...) do { fprintf(stderr, msg); exit(-1); } while (0)
+
+// amount of data decrypted per run, and number of runs, for the kernel benchmark
+#define BENCH_BYTES (16 << 20)
+#define BENCH_RUNS  8
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// decrypt BENCH_BYTES, BENCH_RUNS times, with the given key length, and return MB/s
+static double benchKernel(int keylen, PDBool hardware)
+{
+    unsigned char key[32];
+    unsigned char iv[16];
+    pd_aes_ctx ctx;
+    int i;
+
+    for (i = 0; i < 32; i++) key[i] = rand();
+    for (i = 0; i < 16; i++) iv[i] = rand();
+
+    pd_aes_init(&ctx, key, keylen);
+    // clearing the hw flag forces the portable implementation
+    if (! hardware) ctx.hw = false;
+
+    unsigned char *buf = malloc(BENCH_BYTES);
+    for (i = 0; i < BENCH_BYTES; i++) buf[i] = rand();
+
+    double start = now();
+    for (i = 0; i < BENCH_RUNS; i++)
+        pd_aes_cbc_decrypt(&ctx, iv, buf, buf, BENCH_BYTES);
+    double elapsed = now() - start;
+
+    free(buf);
+    return (double)BENCH_RUNS * BENCH_BYTES / (1 << 20) / elapsed;
+}
+
+// a mutator task that fetches every stream that goes through the pipe
+static PDInteger streams = 0;
+static PDInteger streamBytes = 0;
+
+PDTaskResult fetchStream(PDPipeRef pipe, PDTaskRef task, PDObjectRef object, void *info)
+{
+    if (PDObjectHasStream(object)) {
+        PDParserRef parser = PDPipeGetParser(pipe);
+        if (PDParserFetchCurrentObjectStream(parser, PDObjectGetObID(object))) {
+            streams++;
+            streamBytes += PDObjectGetExtractedStreamLength(object);
+        }
+    }
+    return PDTaskDone;
+}
+
+//
+// main program
+//
+
+int main(int argc, char *argv[])
+{
+    if (argc > 3) die("syntax: %s [<encrypted PDF file> [<output PDF name>]]\n", argv[0]);
+
+    printf("AES-CBC decryption, %d x %d MB\n", BENCH_RUNS, BENCH_BYTES >> 20);
+    if (pd_aes_hardware_available()) {
+        printf("- AES-128, hardware : %8.1f MB/s\n", benchKernel(16, true));
+        printf("- AES-256, hardware : %8.1f MB/s\n", benchKernel(32, true));
+    } else {
+        printf("- no hardware AES support\n");
+    }
+    printf("- AES-128, portable : %8.1f MB/s\n", benchKernel(16, false));
+    printf("- AES-256, portable : %8.1f MB/s\n", benchKernel(32, false));
+
+    if (argc < 2) return 0;
+
+    PDPipeRef pipe = PDPipeCreateWithFilePaths(argv[1], argc > 2 ? argv[2] : "/dev/null");
+    if (NULL == pipe) die("failed to create pipe\n");
+
+    PDTaskRef fetcher = PDTaskCreateMutator(fetchStream);
+    PDPipeAddTask(pipe, fetcher);
+
+    double start = now();
+    PDInteger obcount = PDPipeExecute(pipe);
+    double elapsed = now() - start;
+
+    printf("%s: %ld objects, %ld streams (%ld bytes decoded) in %.3f s\n", argv[1], obcount, streams, streamBytes, elapsed);
+
+    PDRelease(pipe);
+    PDRelease(fetcher);
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * Pajdeg
+ * Measure stream filter throughput.
+ *
+ * This example encodes a buffer with each of the lossless stream filters (FlateDecode,
+ * ASCIIHexDecode, ASCII85Decode, RunLengthDecode and LZWDecode), decodes the result again,
+ * and prints the throughput of each direction in MB/s of decoded data, so that the filters
+ * can be compared against the flate path. ASCIIHexDecode and ASCII85Decode are decoded with
+ * their vector (SSE2 or NEON) decoders, where available, as well as the portable ones.
+ *
+ * The buffer holds pseudo-random content stream operators interspersed with binary data,
+ * or the contents of the given file.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../src/Pajdeg.h"
+#include "../src/PDStreamFilter.h"
+#include "../src/PDStreamFilterASCIIHexDecode.h"
+#include "../src/PDStreamFilterASCII85Decode.h"
+#include "../src/pd_pdf_implementation.h"
+
+// convenient way to scream and die
+#define die(msg...) do { fprintf(stderr, msg); exit(-1); } while (0)
+
+// amount of generated data, and number of decoding runs
+#define BENCH_BYTES (16 << 20)
+#define BENCH_RUNS  4
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// fill buf with len bytes of text operators, with a run of binary data every now and then
+static void generate(unsigned char *buf, PDInteger len)
+{
+    PDInteger i = 0;
+    PDInteger n;
+    char op[64];
+
+    srand(1);
+    while (i < len) {
+        if (rand() % 8 == 0) {
+            for (n = 64 + rand() % 512; n > 0 && i < len; n--) buf[i++] = rand();
+        } else {
+            n = sprintf(op, "BT /F1 %d Tf %d %d Td (text %d) Tj ET\n", 8 + rand() % 16, rand() % 600, rand() % 800, rand() % 1000);
+            if (n > len - i) n = len - i;
+            memcpy(&buf[i], op, n);
+            i += n;
+        }
+    }
+}
+
+// read the file at path; returns a malloc()'d buffer and its length in *len
+static unsigned char *readFile(const char *path, PDInteger *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) die("failed to open %s\n", path);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *buf = malloc(*len > 0 ? *len : 1);
+    if (fread(buf, 1, *len, f) != (size_t)*len) die("failed to read %s\n", path);
+    fclose(f);
+    return buf;
+}
+
+// run src through the named filter; returns a malloc()'d buffer and its length in *outLen, and the time it took in *elapsed
+static unsigned char *runFilter(const char *name, PDBool inputEnd, unsigned char *src, PDInteger len, PDInteger *outLen, double *elapsed)
+{
+    PDStreamFilterRef filter = PDStreamFilterObtain((char *)name, inputEnd, NULL);
+    if (filter == NULL) die("no %s filter\n", name);
+
+    unsigned char *dst;
+    double start = now();
+    PDBool success = PDStreamFilterApply(filter, src, &dst, len, outLen, NULL);
+    *elapsed = now() - start;
+    PDRelease(filter);
+
+    if (! success) die("%s %s failed\n", name, inputEnd ? "decoding" : "encoding");
+    return dst;
+}
+
+// decode enc, BENCH_RUNS times, check the result against src, and return MB/s of decoded data
+static double benchDecode(const char *name, unsigned char *enc, PDInteger encLen, unsigned char *src, PDInteger len)
+{
+    PDInteger decLen;
+    double elapsed, total = 0;
+    int i;
+
+    for (i = 0; i < BENCH_RUNS; i++) {
+        unsigned char *dec = runFilter(name, true, enc, encLen, &decLen, &elapsed);
+        if (decLen != len || memcmp(dec, src, len)) die("%s: decoded data does not match the original\n", name);
+        free(dec);
+        total += elapsed;
+    }
+
+    return (double)BENCH_RUNS * len / (1 << 20) / total;
+}
+
+//
+// main program
+//
+
+int main(int argc, char *argv[])
+{
+    // the filters, with the vector decoder switches of those that have them
+    static const struct {
+        const char *name;
+        PDBool (*vectorAvailable)(void);
+        void (*setVectorEnabled)(PDBool enabled);
+    } filters[] = {
+        { "FlateDecode",     NULL, NULL },
+        { "ASCIIHexDecode",  PDStreamFilterASCIIHexDecodeVectorAvailable, PDStreamFilterASCIIHexDecodeSetVectorEnabled },
+        { "ASCII85Decode",   PDStreamFilterASCII85DecodeVectorAvailable, PDStreamFilterASCII85DecodeSetVectorEnabled },
+        { "RunLengthDecode", NULL, NULL },
+        { "LZWDecode",       NULL, NULL },
+    };
+    unsigned char *src, *enc;
+    PDInteger len, encLen;
+    double elapsed;
+    unsigned f;
+
+    if (argc > 2) die("syntax: %s [<input file>]\n", argv[0]);
+
+    if (argc > 1) {
+        src = readFile(argv[1], &len);
+    } else {
+        len = BENCH_BYTES;
+        src = malloc(len);
+        generate(src, len);
+    }
+
+    pd_pdf_implementation_use();
+
+    printf("%ld bytes, decoded %d times\n", len, BENCH_RUNS);
+    for (f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+        const char *name = filters[f].name;
+        enc = runFilter(name, false, src, len, &encLen, &elapsed);
+        printf("- %-16s: %5.1f%% of the original, encode %8.1f MB/s, decode", name, 100.0 * encLen / len, (double)len / (1 << 20) / elapsed);
+
+        if (filters[f].setVectorEnabled) {
+            if (filters[f].vectorAvailable()) {
+                filters[f].setVectorEnabled(true);
+                printf(" %8.1f MB/s (vector),", benchDecode(name, enc, encLen, src, len));
+            }
+            filters[f].setVectorEnabled(false);
+            printf(" %8.1f MB/s (portable)\n", benchDecode(name, enc, encLen, src, len));
+            filters[f].setVectorEnabled(true);
+        } else {
+            printf(" %8.1f MB/s\n", benchDecode(name, enc, encLen, src, len));
+        }
+
+        free(enc);
+    }
+
+    pd_pdf_implementation_discard();
+    free(src);
+    return 0;
+}
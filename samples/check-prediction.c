@@ -0,0 +1,239 @@
+/**
+ * Pajdeg
+ * Check the predictor filter against a reference implementation.
+ *
+ * This example runs the Predictor filter over pseudo-random image data (with a fixed seed, so
+ * runs are reproducible) for every PNG predictor and TIFF predictor 2, across a range of colors,
+ * bits per component and columns. Predicted output is compared to a straightforward per-byte
+ * implementation of the PNG and TIFF specifications, and is then unpredicted and compared to
+ * the original data. PNG data whose rows are tagged with a mix of filter types is unpredicted
+ * as well, as PDFs in the wild use these.
+ *
+ * Every configuration is checked twice: once with the vector (SSE2 or NEON) unpredictor kernels,
+ * where available, and once with the portable row functions.
+ *
+ * The program prints the number of configurations checked, and exits with a non-zero status
+ * after listing any mismatches.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../src/Pajdeg.h"
+#include "../src/PDStreamFilter.h"
+#include "../src/PDStreamFilterPrediction.h"
+#include "../src/PDDictionary.h"
+#include "../src/PDNumber.h"
+#include "../src/pd_pdf_implementation.h"
+
+// the parameters checked; TIFF predictor 2 only supports 8 and 16 bit components
+static const int colorsList[] = { 1, 2, 3, 4 };
+static const int bpcList[]    = { 1, 2, 4, 8, 16 };
+static const int columnsList[] = { 1, 2, 3, 5, 8, 17, 64, 251 };
+static const int predictors[] = { 2, 10, 11, 12, 13, 14, 15 };
+
+#define count(a) (sizeof(a) / sizeof(a[0]))
+
+static int checks = 0;
+static int failures = 0;
+static const char *kernels = "portable";
+
+#define fail(msg...) do { fprintf(stderr, msg); failures++; } while (0)
+
+//
+// reference implementation
+//
+
+// the PNG Paeth predictor, as given in the specification
+static unsigned char refPaeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// the prediction for byte i of a row with the given PNG filter type; left and upper left bytes outside the row are 0
+static unsigned char refPredict(int type, const unsigned char *raw, const unsigned char *prev, int i, int bpp)
+{
+    int a = i >= bpp ? raw[i - bpp] : 0;
+    int b = prev[i];
+    int c = i >= bpp ? prev[i - bpp] : 0;
+    switch (type) {
+        case 1: return a;
+        case 2: return b;
+        case 3: return (a + b) / 2;
+        case 4: return refPaeth(a, b, c);
+    }
+    return 0;
+}
+
+// PNG predict rows of rowBytes bytes, tagging row r with types[r]
+static void refPNG(unsigned char *out, const unsigned char *in, int rows, int rowBytes, int bpp, const int *types)
+{
+    unsigned char *prev = calloc(1, rowBytes);
+    int r, i;
+    for (r = 0; r < rows; r++) {
+        const unsigned char *raw = &in[r * rowBytes];
+        unsigned char *dst = &out[r * (rowBytes + 1)];
+        dst[0] = types[r];
+        for (i = 0; i < rowBytes; i++)
+            dst[i + 1] = raw[i] - refPredict(types[r], raw, prev, i, bpp);
+        memcpy(prev, raw, rowBytes);
+    }
+    free(prev);
+}
+
+// TIFF predict rows; each component is the difference to the same component of the pixel to its left
+static void refTIFF(unsigned char *out, const unsigned char *in, int rows, int rowBytes, int colors, int bpc)
+{
+    int r, i;
+    for (r = 0; r < rows; r++) {
+        const unsigned char *raw = &in[r * rowBytes];
+        unsigned char *dst = &out[r * rowBytes];
+        if (bpc == 8) {
+            for (i = 0; i < rowBytes; i++)
+                dst[i] = raw[i] - (i >= colors ? raw[i - colors] : 0);
+        } else {
+            for (i = 0; i + 1 < rowBytes; i += 2) {
+                unsigned cur = (raw[i] << 8) | raw[i + 1];
+                unsigned left = i >= 2 * colors ? (raw[i - 2 * colors] << 8) | raw[i - 2 * colors + 1] : 0;
+                cur -= left;
+                dst[i] = cur >> 8;
+                dst[i + 1] = cur;
+            }
+        }
+    }
+}
+
+//
+// filter
+//
+
+// run the Predictor filter over len bytes of src; returns a malloc()'d buffer and its length in *outLen, or NULL if the filter failed
+static unsigned char *runFilter(PDBool inputEnd, int predictor, int colors, int bpc, int columns, unsigned char *src, PDInteger len, PDInteger *outLen)
+{
+    PDDictionaryRef opts = PDDictionaryCreate();
+    PDDictionarySet(opts, "Predictor", PDNumberWithInteger(predictor));
+    PDDictionarySet(opts, "Colors", PDNumberWithInteger(colors));
+    PDDictionarySet(opts, "BitsPerComponent", PDNumberWithInteger(bpc));
+    PDDictionarySet(opts, "Columns", PDNumberWithInteger(columns));
+
+    PDStreamFilterRef filter = PDStreamFilterObtain("Predictor", inputEnd, opts);
+    PDRelease(opts);
+    if (filter == NULL) return NULL;
+
+    unsigned char *dst;
+    PDBool success = PDStreamFilterApply(filter, src, &dst, len, outLen, NULL);
+    PDRelease(filter);
+
+    if (! success) {
+        free(dst);
+        return NULL;
+    }
+    return dst;
+}
+
+static void compare(const char *what, int predictor, int colors, int bpc, int columns, unsigned char *expected, PDInteger expectedLen, unsigned char *got, PDInteger gotLen)
+{
+    PDInteger i;
+    checks++;
+    if (got == NULL) {
+        fail("%s (%s): Predictor %d, Colors %d, BitsPerComponent %d, Columns %d: filter failed\n", what, kernels, predictor, colors, bpc, columns);
+        return;
+    }
+    if (gotLen != expectedLen) {
+        fail("%s (%s): Predictor %d, Colors %d, BitsPerComponent %d, Columns %d: %ld bytes, expected %ld\n", what, kernels, predictor, colors, bpc, columns, gotLen, expectedLen);
+        return;
+    }
+    for (i = 0; i < gotLen && got[i] == expected[i]; i++) ;
+    if (i < gotLen)
+        fail("%s (%s): Predictor %d, Colors %d, BitsPerComponent %d, Columns %d: byte %ld is %d, expected %d\n", what, kernels, predictor, colors, bpc, columns, i, got[i], expected[i]);
+}
+
+static void check(int predictor, int colors, int bpc, int columns)
+{
+    int rowBytes = (columns * colors * bpc + 7) / 8;
+    int bpp = (colors * bpc + 7) / 8;
+    int rows = 1 + rand() % 24;
+    int tagged = predictor >= 10;
+    int r, i;
+    PDInteger len = rows * rowBytes;
+    PDInteger predLen = rows * (rowBytes + tagged);
+    PDInteger outLen;
+
+    unsigned char *raw = malloc(len);
+    unsigned char *expected = malloc(predLen);
+    int *types = malloc(rows * sizeof(int));
+
+    // a mix of random bytes and runs, so that the predictors see both noise and flat areas
+    for (i = 0; i < len; i++) raw[i] = rand() % 4 ? rand() : (i ? raw[i - 1] : 0);
+
+    // the filter tags every row with the predictor's type, with PNG Optimum falling back to Up
+    if (tagged) {
+        for (r = 0; r < rows; r++) types[r] = predictor == 15 ? 2 : predictor - 10;
+        refPNG(expected, raw, rows, rowBytes, bpp, types);
+    } else {
+        refTIFF(expected, raw, rows, rowBytes, colors, bpc);
+    }
+
+    unsigned char *pred = runFilter(false, predictor, colors, bpc, columns, raw, len, &outLen);
+    compare("predict", predictor, colors, bpc, columns, expected, predLen, pred, outLen);
+    free(pred);
+
+    unsigned char *unpred = runFilter(true, predictor, colors, bpc, columns, expected, predLen, &outLen);
+    compare("unpredict", predictor, colors, bpc, columns, raw, len, unpred, outLen);
+    free(unpred);
+
+    if (tagged) {
+        // the row tags, rather than the predictor option, decide how PNG rows are unpredicted
+        for (r = 0; r < rows; r++) types[r] = rand() % 5;
+        refPNG(expected, raw, rows, rowBytes, bpp, types);
+        unpred = runFilter(true, predictor, colors, bpc, columns, expected, predLen, &outLen);
+        compare("unpredict mixed", predictor, colors, bpc, columns, raw, len, unpred, outLen);
+        free(unpred);
+    }
+
+    free(types);
+    free(expected);
+    free(raw);
+}
+
+//
+// main program
+//
+
+int main(int argc, char *argv[])
+{
+    unsigned p, c, b, w;
+    int vector;
+
+    pd_pdf_implementation_use();
+
+    if (! PDStreamFilterPredictionVectorAvailable())
+        printf("vector kernels are not available; only the portable row functions are checked\n");
+
+    // both runs use the same data, so that a mismatch in only one of them points at its kernels
+    for (vector = PDStreamFilterPredictionVectorAvailable(); vector >= 0; vector--) {
+        PDStreamFilterPredictionSetVectorEnabled(vector);
+        kernels = vector ? "vector" : "portable";
+        srand(1);
+
+        for (p = 0; p < count(predictors); p++)
+            for (c = 0; c < count(colorsList); c++)
+                for (b = 0; b < count(bpcList); b++)
+                    for (w = 0; w < count(columnsList); w++) {
+                        if (predictors[p] == 2 && bpcList[b] < 8) continue;
+                        check(predictors[p], colorsList[c], bpcList[b], columnsList[w]);
+                    }
+    }
+
+    pd_pdf_implementation_discard();
+
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures > 0;
+}
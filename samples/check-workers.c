@@ -0,0 +1,172 @@
+/**
+ * Pajdeg
+ * Check streams set via PDObjectSetStreamFiltered() on a pipe with worker threads.
+ *
+ * This example passes a PDF through two pipes, one with worker threads and one without, replacing
+ * the stream of every object which has one (except for cross reference and object streams) with
+ * generated content via PDObjectSetStreamFiltered(). Every other stream is FlateDecode compressed
+ * and the rest also PNG predicted, so that filter chains are filtered on the worker threads too.
+ *
+ * The two outputs must be identical (unless the PDF is encrypted, as encryption is randomized),
+ * and every replaced stream, when read back from the output of the pipe with workers, must decode
+ * to the generated content. The program prints what it did and exits with a non-zero status if
+ * either is not the case.
+ *
+ * The output of the pipe without workers is written next to the given output file, with .sync
+ * appended to its name; it is overwritten when the streams are read back.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "../src/Pajdeg.h"
+#include "../src/PDParser.h"
+#include "../src/PDObject.h"
+#include "../src/PDDictionary.h"
+#include "../src/PDString.h"
+
+// convenient way to scream and die
+#define die(msg...) do { fprintf(stderr, msg); exit(-1); } while (0)
+
+// columns of the PNG predicted streams; their lengths are multiples of this
+#define PREDICTOR_COLUMNS 37
+
+// whether the input is encrypted
+static PDBool encrypted = false;
+
+// object IDs whose streams were replaced
+static PDBool *replaced = NULL;
+static PDInteger replacedCap = 0;
+static PDInteger replacements = 0;
+
+// the generated stream for the given object, which is malloc()'d
+static char *generateStream(PDInteger obid, PDInteger *len)
+{
+    PDInteger i;
+    *len = PREDICTOR_COLUMNS * (1 + (obid * 7919) % 4000);
+    char *buf = malloc(*len);
+    for (i = 0; i < *len; i++)
+        buf[i] = "Pajdeg stream filtered on a worker thread\n"[(i + obid) % 42] + (i / 1000) % 3;
+    return buf;
+}
+
+static PDBool replaceable(PDObjectRef object)
+{
+    if (! PDObjectHasStream(object)) return false;
+    PDStringRef type = PDDictionaryGet(PDObjectGetDictionary(object), "Type");
+    return ! (type && (PDStringEqualsCString(type, "XRef") || PDStringEqualsCString(type, "ObjStm")));
+}
+
+// a mutator task that replaces the stream of every object that goes through the pipe
+PDTaskResult replaceStream(PDPipeRef pipe, PDTaskRef task, PDObjectRef object, void *info)
+{
+    if (! replaceable(object)) return PDTaskDone;
+    encrypted = PDParserGetEncryptionState(PDPipeGetParser(pipe));
+
+    PDInteger obid = PDObjectGetObID(object);
+    PDInteger len;
+    char *stream = generateStream(obid, &len);
+
+    PDObjectSetFlateDecodedFlag(object, true);
+    if (obid % 2) PDObjectSetPredictionStrategy(object, PDPredictorPNG_UP, PREDICTOR_COLUMNS);
+    else          PDDictionaryDelete(PDObjectGetDictionary(object), "DecodeParms");
+
+    if (! PDObjectSetStreamFiltered(object, stream, len, true, false))
+        die("failed to set the stream of object %ld\n", obid);
+
+    if (obid >= replacedCap) {
+        PDInteger cap = obid * 2 + 16;
+        replaced = realloc(replaced, cap * sizeof(PDBool));
+        memset(&replaced[replacedCap], 0, (cap - replacedCap) * sizeof(PDBool));
+        replacedCap = cap;
+    }
+    replaced[obid] = true;
+    replacements++;
+
+    return PDTaskDone;
+}
+
+// a mutator task that compares the replaced streams to what they were replaced with
+static PDInteger checked = 0;
+static PDInteger mismatches = 0;
+
+PDTaskResult checkStream(PDPipeRef pipe, PDTaskRef task, PDObjectRef object, void *info)
+{
+    PDInteger obid = PDObjectGetObID(object);
+    if (! PDObjectHasStream(object) || obid >= replacedCap || ! replaced[obid]) return PDTaskDone;
+
+    PDInteger len;
+    char *expected = generateStream(obid, &len);
+    char *stream = PDParserFetchCurrentObjectStream(PDPipeGetParser(pipe), obid);
+
+    checked++;
+    if (stream == NULL || PDObjectGetExtractedStreamLength(object) != len || memcmp(stream, expected, len)) {
+        fprintf(stderr, "object %ld: stream does not match what it was replaced with\n", obid);
+        mismatches++;
+    }
+
+    free(expected);
+    return PDTaskDone;
+}
+
+static void run(const char *input, const char *output, PDInteger workers, PDTaskFunc func)
+{
+    PDPipeRef pipe = PDPipeCreateWithFilePaths(input, output);
+    if (NULL == pipe) die("failed to create pipe for %s\n", input);
+    PDPipeSetWorkerCount(pipe, workers);
+
+    PDTaskRef task = PDTaskCreateMutator(func);
+    PDPipeAddTask(pipe, task);
+    if (PDPipeExecute(pipe) < 0) die("failed to pass %s through pipe\n", input);
+
+    PDRelease(task);
+    PDRelease(pipe);
+}
+
+static char *readFile(const char *path, long *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (NULL == f) die("failed to open %s\n", path);
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(*len + 1);
+    if (*len != (long)fread(buf, 1, *len, f)) die("failed to read %s\n", path);
+    fclose(f);
+    return buf;
+}
+
+//
+// main program
+//
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 4) die("syntax: %s <input PDF file> <output PDF name> [<worker count>]\n", argv[0]);
+
+    PDInteger workers = argc > 3 ? atol(argv[3]) : 4;
+    char *syncOutput = malloc(strlen(argv[2]) + 6);
+    sprintf(syncOutput, "%s.sync", argv[2]);
+
+    run(argv[1], argv[2], workers, replaceStream);
+    PDInteger asyncReplacements = replacements;
+    replacements = 0;
+    run(argv[1], syncOutput, 0, replaceStream);
+    printf("%s: replaced %ld streams with %ld workers, %ld without\n", argv[1], asyncReplacements, workers, replacements);
+
+    long alen, slen;
+    char *async = readFile(argv[2], &alen);
+    char *sync = readFile(syncOutput, &slen);
+    PDBool identical = alen == slen && 0 == memcmp(async, sync, alen);
+    printf("outputs are %s%s\n", identical ? "identical" : "different", encrypted ? " (encrypted)" : "");
+    free(async);
+    free(sync);
+
+    run(argv[2], syncOutput, 0, checkStream);
+    printf("%ld of %ld replaced streams checked, %ld mismatches\n", checked, asyncReplacements, mismatches);
+
+    free(syncOutput);
+    free(replaced);
+    return ! (identical || encrypted) || checked != asyncReplacements || mismatches > 0;
+}
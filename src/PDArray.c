@@ -347,7 +347,7 @@ void PDArrayAttachCryptoInstance(PDArrayRef array, PDCryptoInstanceRef ci, PDBoo
     array->ci = PDRetain(ci);
     for (PDInteger i = 0; i < array->count; i++) {
         if (array->values[i]) 
-            (*PDInstanceCryptoExchanges[PDResolve(array->values[i])])(array->values[i], array->ci, false);
+            (*PDInstanceCryptoExchanges[PDResolve(array->values[i])])(array->values[i], array->ci, encrypted);
     }
 }
 
@@ -34,6 +34,7 @@
 #include "PDNumber.h"
 #include "PDString.h"
 #include "pd_pdf_implementation.h"
+#include "PDXTable.h"
 
 void PDPageReferenceDestroy(PDPageReference * page)
 {
@@ -171,6 +172,29 @@ PDCatalogRef PDCatalogCreateWithParserForObject(PDParserRef parser, PDObjectRef
     return catalog;
 }
 
+PDCatalogRef PDCatalogCreateWithParserForObjectAndPages(PDParserRef parser, PDObjectRef catalogObject, PDInteger count, PDInteger *pages)
+{
+    PDCatalogRef catalog = PDAlloc(sizeof(struct PDCatalog), PDCatalogDestroy, false);
+    catalog->parser = parser;
+    catalog->object = PDRetain(catalogObject);
+    catalog->count = count;
+    catalog->capacity = count;
+    catalog->kids = malloc(sizeof(PDInteger) * count);
+    memcpy(catalog->kids, pages, sizeof(PDInteger) * count);
+    
+    // the page tree structure is not retained, so we present the pages as a single, flat collection
+    catalog->pages.collection = true;
+    catalog->pages.count = count;
+    catalog->pages.kids = malloc(sizeof(PDPageReference) * count);
+    for (PDInteger i = 0; i < count; i++) {
+        catalog->pages.kids[i].collection = false;
+        catalog->pages.kids[i].obid = pages[i];
+        catalog->pages.kids[i].genid = PDXTypeUsed == PDXTableGetTypeForID(parser->mxt, pages[i]) ? PDXTableGetGenForID(parser->mxt, pages[i]) : 0;
+    }
+    
+    return catalog;
+}
+
 PDInteger PDCatalogGetObjectIDForPage(PDCatalogRef catalog, PDInteger pageNumber)
 {
     PDAssert(pageNumber > 0 && pageNumber <= catalog->count);
@@ -60,6 +60,19 @@
  */
 extern PDCatalogRef PDCatalogCreateWithParserForObject(PDParserRef parser, PDObjectRef catalog);
 
+/**
+ Set up a catalog with a PDParser, a catalog object, and a known list of page object IDs.
+ 
+ Unlike PDCatalogCreateWithParserForObject(), this does not walk the page tree; the pages are taken as is, e.g. from a previously saved parser index.
+ 
+ @param parser  The PDParserRef instance.
+ @param catalog The catalog object.
+ @param count   The number of pages.
+ @param pages   The object IDs of the pages, in page order. The array is copied.
+ @return The PDCatalog instance.
+ */
+extern PDCatalogRef PDCatalogCreateWithParserForObjectAndPages(PDParserRef parser, PDObjectRef catalog, PDInteger count, PDInteger *pages);
+
 /**
  Determine the object ID for the given page number, or throw an assertion if the page number is out of bounds.
  
@@ -34,6 +34,10 @@
 #include "PDString.h"
 #include "PDNumber.h"
 
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
 /*
  TABLE A.1 PDF content stream operators [PDF spec 1.7, p. 985 - 988]
  ------------------------------------------------------------------------------------------------------------------
@@ -405,6 +409,44 @@ PDOperatorState PDContentStreamPrinter_EI(PDContentStreamRef cs, PDContentStream
     return PDOperatorStatePop;
 }
 
+#define KEY_BPC 0
+#define KEY_CS  1
+#define KEY_H   2
+#define KEY_W   3
+
+static PDDictionaryRef entryMapping = NULL;
+#ifdef PD_SUPPORT_THREADS
+static pthread_once_t entryMappingOnce = PTHREAD_ONCE_INIT;
+#endif
+
+static void PDContentStreamPrinterSetupEntryMapping()
+{
+    PDNumberRef refs[5];
+    refs[0] = PDNumberWithInteger(0);
+    refs[1] = PDNumberWithInteger(1);
+    refs[2] = PDNumberWithInteger(2);
+    refs[3] = PDNumberWithInteger(3);
+    refs[4] = PDNumberWithInteger(4);
+    entryMapping = PDDictionaryCreateWithKeyValueDefinition
+    (PDDef(
+           "BPC", refs[KEY_BPC],
+           "BitsPerComponent", refs[KEY_BPC],
+           "CS", refs[KEY_CS],
+           "ColorSpace", refs[KEY_CS],
+           "H", refs[KEY_H],
+           "Height", refs[KEY_H],
+           "W", refs[KEY_W],
+           "Width", refs[KEY_W],
+           
+           "DeviceGray", refs[1],
+           "G", refs[1],
+           "DeviceRGB", refs[3],
+           "RGB", refs[3],
+           "DeviceCMYK", refs[4],
+           "CMYK", refs[4]
+           ));
+}
+
 PDOperatorState PDContentStreamPrinter_ID(PDContentStreamRef cs, PDContentStreamPrinterUIRef userInfo, PDArrayRef args, pd_stack inState, pd_stack *outState)
 {
     // args is a pair-wise list of settings for this image; we are interested in /H, /W, /BPC, and /CS
@@ -412,37 +454,12 @@ PDOperatorState PDContentStreamPrinter_ID(PDContentStreamRef cs, PDContentStream
     // we can define the # of bytes to seek by taking
     //  /H * /W * (/BPC / 8) * colorspace_bytes(/CS)
     // where colorspace_bytes() is 3 for /RGB
-#define KEY_BPC 0
-#define KEY_CS  1
-#define KEY_H   2
-#define KEY_W   3
-    static PDDictionaryRef entryMapping = NULL;
-    if (entryMapping == NULL) {
-        PDNumberRef refs[5];
-        refs[0] = PDNumberWithInteger(0);
-        refs[1] = PDNumberWithInteger(1);
-        refs[2] = PDNumberWithInteger(2);
-        refs[3] = PDNumberWithInteger(3);
-        refs[4] = PDNumberWithInteger(4);
-        entryMapping = PDDictionaryCreateWithKeyValueDefinition
-        (PDDef(
-               "BPC", refs[KEY_BPC],
-               "BitsPerComponent", refs[KEY_BPC],
-               "CS", refs[KEY_CS],
-               "ColorSpace", refs[KEY_CS],
-               "H", refs[KEY_H],
-               "Height", refs[KEY_H],
-               "W", refs[KEY_W],
-               "Width", refs[KEY_W],
-               
-               "DeviceGray", refs[1],
-               "G", refs[1],
-               "DeviceRGB", refs[3],
-               "RGB", refs[3],
-               "DeviceCMYK", refs[4],
-               "CMYK", refs[4]
-               ));
-    }
+#ifdef PD_SUPPORT_THREADS
+    // content streams may be processed on several threads at once
+    pthread_once(&entryMappingOnce, PDContentStreamPrinterSetupEntryMapping);
+#else
+    if (entryMapping == NULL) PDContentStreamPrinterSetupEntryMapping();
+#endif
     
     PDInteger h = 1;
     PDInteger w = 1;
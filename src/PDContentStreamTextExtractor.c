@@ -37,6 +37,10 @@
 #include "PDFont.h"
 #include "PDCMap.h"
 
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
 /*
  TABLE A.1 PDF content stream operators [PDF spec 1.7, p. 985 - 988]
  -------------------------------------------------------------------------------
@@ -349,6 +353,44 @@ PDOperatorState PDContentStreamTextExtractor_EI(PDContentStreamRef cs, PDContent
     return PDOperatorStatePop;
 }
 
+#define KEY_BPC 0
+#define KEY_CS  1
+#define KEY_H   2
+#define KEY_W   3
+
+static PDDictionaryRef entryMapping = NULL;
+#ifdef PD_SUPPORT_THREADS
+static pthread_once_t entryMappingOnce = PTHREAD_ONCE_INIT;
+#endif
+
+static void PDContentStreamTextExtractorSetupEntryMapping()
+{
+    PDNumberRef refs[5];
+    refs[0] = PDNumberWithInteger(0);
+    refs[1] = PDNumberWithInteger(1);
+    refs[2] = PDNumberWithInteger(2);
+    refs[3] = PDNumberWithInteger(3);
+    refs[4] = PDNumberWithInteger(4);
+    entryMapping = PDDictionaryCreateWithKeyValueDefinition
+    (PDDef(
+           "BPC", refs[KEY_BPC],
+           "BitsPerComponent", refs[KEY_BPC],
+           "CS", refs[KEY_CS],
+           "ColorSpace", refs[KEY_CS],
+           "H", refs[KEY_H],
+           "Height", refs[KEY_H],
+           "W", refs[KEY_W],
+           "Width", refs[KEY_W],
+           
+           "DeviceGray", refs[1],
+           "G", refs[1],
+           "DeviceRGB", refs[3],
+           "RGB", refs[3],
+           "DeviceCMYK", refs[4],
+           "CMYK", refs[4]
+           ));
+}
+
 PDOperatorState PDContentStreamTextExtractor_ID(PDContentStreamRef cs, PDContentStreamTextExtractorUI userInfo, PDArrayRef args, pd_stack inState, pd_stack *outState)
 {
     PDAssert(userInfo->inlineImage);
@@ -358,37 +400,12 @@ PDOperatorState PDContentStreamTextExtractor_ID(PDContentStreamRef cs, PDContent
     // we can define the # of bytes to seek by taking
     //  /H * /W * (/BPC / 8) * colorspace_bytes(/CS)
     // where colorspace_bytes() is 3 for /RGB
-#define KEY_BPC 0
-#define KEY_CS  1
-#define KEY_H   2
-#define KEY_W   3
-    static PDDictionaryRef entryMapping = NULL;
-    if (entryMapping == NULL) {
-        PDNumberRef refs[5];
-        refs[0] = PDNumberWithInteger(0);
-        refs[1] = PDNumberWithInteger(1);
-        refs[2] = PDNumberWithInteger(2);
-        refs[3] = PDNumberWithInteger(3);
-        refs[4] = PDNumberWithInteger(4);
-        entryMapping = PDDictionaryCreateWithKeyValueDefinition
-        (PDDef(
-               "BPC", refs[KEY_BPC],
-               "BitsPerComponent", refs[KEY_BPC],
-               "CS", refs[KEY_CS],
-               "ColorSpace", refs[KEY_CS],
-               "H", refs[KEY_H],
-               "Height", refs[KEY_H],
-               "W", refs[KEY_W],
-               "Width", refs[KEY_W],
-               
-               "DeviceGray", refs[1],
-               "G", refs[1],
-               "DeviceRGB", refs[3],
-               "RGB", refs[3],
-               "DeviceCMYK", refs[4],
-               "CMYK", refs[4]
-               ));
-    }
+#ifdef PD_SUPPORT_THREADS
+    // content streams may be processed on several threads at once
+    pthread_once(&entryMappingOnce, PDContentStreamTextExtractorSetupEntryMapping);
+#else
+    if (entryMapping == NULL) PDContentStreamTextExtractorSetupEntryMapping();
+#endif
     
     PDInteger h = 1;
     PDInteger w = 1;
@@ -38,10 +38,27 @@
 #define PD_SUPPORT_ZLIB
 
 /**
- Support cryptography in PDFs. Currently includes RC4/MD5, but not AES.
+ @def PD_SUPPORT_LIBDEFLATE
+ Use libdeflate for FlateDecode when the entire input is available up front.
+ 
+ libdeflate is considerably faster than zlib for whole-buffer compression and decompression, which is the common case for PDStreamFilterApply(). Streaming (chained or incremental) filtering still goes through zlib, so PD_SUPPORT_ZLIB must remain defined. For faster streaming, zlib-ng can be linked in place of zlib in its zlib compatible mode without any changes to Pajdeg.
+ 
+ Requires linking with libdeflate.
+ */
+// #define PD_SUPPORT_LIBDEFLATE
+
+/**
+ Support cryptography in PDFs. Includes RC4/MD5 and AES-128/AES-256, the latter using the AES instructions of x86 processors where available.
  */
 #define PD_SUPPORT_CRYPTO
 
+/**
+ Support worker threads (via pthreads) for parallelizable work, such as recompressing streams while a pipe is executing.
+ 
+ Worker threads are only used if requested, e.g. via PDPipeSetWorkerCount(). Without this define, work is performed synchronously on the calling thread.
+ */
+#define PD_SUPPORT_THREADS
+
 /**
  @def DEBUG
  Turn on all assertions and warnings.
@@ -169,6 +186,16 @@
  */
 #define PD_DEPRECATED(introduce_version, deprecate_version) __deprecated
 
+/**
+ @def PD_THREAD_LOCAL
+ Storage class for global state which is kept separately for each thread, such as the autorelease pool, so that separate pipes may be executed on separate threads at the same time.
+ */
+#ifdef PD_SUPPORT_THREADS
+#   define PD_THREAD_LOCAL __thread
+#else
+#   define PD_THREAD_LOCAL 
+#endif
+
 /**
  @defgroup CORE_GRP Core types
  @brief Internal type definitions.
@@ -424,6 +451,7 @@ typedef enum {
     pd_crypto_method_none  = 0,
     pd_crypto_method_rc4   = 1,
     pd_crypto_method_aesv2 = 2,
+    pd_crypto_method_aesv3 = 3,
 } pd_crypto_method;
 
 /**
@@ -445,6 +473,13 @@ typedef enum {
  */
 typedef struct pd_crypto    *pd_crypto;
 
+/**
+ Conversion state for encrypting or decrypting a single stream in pieces.
+ 
+ @ingroup pd_crypto
+ */
+typedef struct pd_crypto_stream *pd_crypto_stream;
+
 /**
  A (very) simple hash table implementation.
  
@@ -507,6 +542,15 @@ typedef PDBool (*PDTextSearchOperatorFunc)(PDSelectionRef selection);
  */
 typedef struct PDObject *PDObjectRef;
 
+/**
+ Stream producer signature.
+ 
+ Used to produce the content of an object stream in pieces, as the object is written to the output. The producer fills buf with up to capacity bytes and returns the number of bytes produced; returning 0 ends the stream.
+ 
+ @ingroup PDOBJECT
+ */
+typedef PDInteger (*PDObjectStreamProducer)(PDObjectRef object, char *buf, PDInteger capacity, void *info);
+
 /**
  A PDF page.
  
@@ -739,6 +783,39 @@ typedef struct PDString  *PDStringRef;
  */
 typedef struct PDPipe       *PDPipeRef;
 
+/**
+ A batch of pipes, sharing a set of tasks.
+ 
+ @ingroup PDPIPEBATCH
+ */
+typedef struct PDPipeBatch  *PDPipeBatchRef;
+
+/**
+ A document, opened for random access editing.
+ 
+ @ingroup PDDOCUMENT
+ */
+typedef struct PDDocument   *PDDocumentRef;
+
+/**
+ The outcome of a document in a pipe batch.
+ 
+ @ingroup PDPIPEBATCH
+ */
+typedef enum {
+    PDPipeBatchStatusPending = 0,   ///< The document has not been executed yet
+    PDPipeBatchStatusDone,          ///< The document was piped through successfully
+    PDPipeBatchStatusOpenFailed,    ///< The input could not be read as a PDF, or the output could not be written
+    PDPipeBatchStatusFailed,        ///< A task failed, or the PDF could not be parsed in its entirety
+} PDPipeBatchStatus;
+
+/**
+ Pipe batch setup function signature, for configuring the pipe of a document before its tasks are added.
+ 
+ @ingroup PDPIPEBATCH
+ */
+typedef void (*PDPipeBatchSetupFunc)(PDPipeBatchRef batch, PDPipeRef pipe, PDInteger index, void *info);
+
 /**
  A task.
  
@@ -817,6 +894,31 @@ typedef PDTaskResult (*PDTaskFunc)(PDPipeRef pipe, PDTaskRef task, PDObjectRef o
  */
 typedef struct PDParser     *PDParserRef;
 
+/**
+ A chunked reader of the parser's current object stream.
+ 
+ @ingroup PDPARSER
+ */
+typedef struct PDParserStreamReader *PDParserStreamReaderRef;
+
+/**
+ A function run on a worker thread for an object handed off with PDParserShardCurrentObject(), before the object is written.
+ 
+ @ingroup PDPARSER
+ 
+ Returning false fails the parser.
+ */
+typedef PDBool (*PDParserShardFunc)(PDParserRef parser, PDObjectRef object, void *info);
+
+/**
+ A function run on a worker thread for a page visited by PDParserForEachPageParallel().
+ 
+ @ingroup PDPARSER
+ 
+ The parser is the worker's own reader, which the page belongs to. Returning false stops the iteration once the pages already being visited by other workers are done.
+ */
+typedef PDBool (*PDParserPageFunc)(PDParserRef parser, PDPageRef page, PDInteger pageNumber, void *info);
+
 /**
  A catalog object.
  
@@ -848,6 +950,22 @@ typedef enum {
     PDTwinStreamReversed,       ///< reads from the end of the input file, filling the heap from the end up towards the beginning
 } PDTwinStreamMethod;
 
+/**
+ Deferred output function, called once the work item of a deferred output segment has completed.
+
+ @ingroup PDTWINSTREAM
+
+ If emit is true, the function writes its content using PDTwinStreamInsertContent(); if false, the output is being torn down and the function should only release its resources.
+ */
+typedef void (*PDTwinStreamDeferredFunc)(PDTwinStreamRef ts, void *info, PDBool emit);
+
+/**
+ Called when the actual output offset of a deferred offset becomes known.
+
+ @ingroup PDTWINSTREAM
+ */
+typedef void (*PDTwinStreamOffsetResolver)(void *info, PDInteger key, PDOffset offset);
+
 /**
  Prediction filter type, i.e. which strategy to use. 
  
@@ -873,6 +991,27 @@ typedef enum {
  */
 typedef struct PDStreamFilter *PDStreamFilterRef;
 
+/**
+ A queue of work items executed by a pool of worker threads.
+ 
+ @ingroup PDWORKQUEUE
+ */
+typedef struct PDWorkQueue *PDWorkQueueRef;
+
+/**
+ A work item in a work queue.
+ 
+ @ingroup PDWORKQUEUE
+ */
+typedef struct PDWorkItem *PDWorkItemRef;
+
+/**
+ Work item function signature.
+ 
+ @ingroup PDWORKQUEUE
+ */
+typedef void (*PDWorkFunc)(void *info);
+
 /**
  @defgroup PDSCANNER_CONCEPT Symbol scanning
  
@@ -522,6 +522,11 @@ void pd_hm_encrypt(void *key, void *val, PDCryptoInstanceRef ci, PDBool *shouldS
     (*PDInstanceCryptoExchanges[PDResolve(val)])(val, ci, false);
 }
 
+void pd_hm_encrypted(void *key, void *val, PDCryptoInstanceRef ci, PDBool *shouldStop)
+{
+    (*PDInstanceCryptoExchanges[PDResolve(val)])(val, ci, true);
+}
+
 void PDDictionaryAttachCrypto(PDDictionaryRef hm, pd_crypto crypto, PDInteger objectID, PDInteger genNumber)
 {
     hm->ci = PDCryptoInstanceCreate(crypto, objectID, genNumber);
@@ -531,7 +536,8 @@ void PDDictionaryAttachCrypto(PDDictionaryRef hm, pd_crypto crypto, PDInteger ob
 void PDDictionaryAttachCryptoInstance(PDDictionaryRef hm, PDCryptoInstanceRef ci, PDBool encrypted)
 {
     hm->ci = PDRetain(ci);
-    PDDictionaryIterate(hm, (PDHashIterator)pd_hm_encrypt, hm->ci);
+    // values read from the input are still encrypted, and must not be encrypted again when written
+    PDDictionaryIterate(hm, (PDHashIterator)(encrypted ? pd_hm_encrypted : pd_hm_encrypt), hm->ci);
 }
 
 #endif
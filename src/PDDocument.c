@@ -0,0 +1,425 @@
+//
+// PDDocument.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <sys/stat.h>
+
+#include "Pajdeg.h"
+#include "pd_internal.h"
+#include "PDDocument.h"
+#include "pd_stack.h"
+#include "pd_pdf_implementation.h"
+#include "PDTwinStream.h"
+#include "PDXTable.h"
+#include "PDSplayTree.h"
+#include "PDDictionary.h"
+#include "PDString.h"
+
+#define PDDocumentCopyChunkSize (1024 * 1024)   ///< Amount of input copied per round when writing the objects which are not dirty
+#define PDDocumentTrimWindow    1024            ///< Amount of input searched for the final endobj of a run of objects followed by something other than an object
+
+/**
+ A position in the input, at which an object, an XREF section, or the end of the file is found.
+ */
+typedef struct PDDocumentMark {
+    PDOffset offset;                    ///< The position in the input
+    PDInteger obid;                     ///< The ID of the object which is copied from this position, or 0 if nothing is copied from it
+    PDBool object;                      ///< Whether an object (possibly an old revision of one) begins at this position
+} PDDocumentMark;
+
+void PDDocumentDestroy(PDDocumentRef doc)
+{
+    PDRelease(doc->dirty);
+    PDRelease(doc->parser);
+    PDRelease(doc->stream);
+    if (doc->fi) PDPipeCloseFileStream(doc->fi);
+    free(doc->pi);
+}
+
+PDDocumentRef PDDocumentCreateWithFilePath(const char *inputFilePath)
+{
+    if (inputFilePath == NULL) return NULL;
+    
+    FILE *fi = PDPipeOpenInputStream(inputFilePath);
+    if (NULL == fi) {
+        PDNotice("unable to open input stream for path: %s", inputFilePath);
+        return NULL;
+    }
+    
+    PDDocumentRef doc = PDAlloc(sizeof(struct PDDocument), PDDocumentDestroy, true);
+    doc->pi = strdup(inputFilePath);
+    doc->fi = fi;
+    
+    // the stream has no output until the document is written; whatever the parser passes through while setting up is discarded
+    doc->stream = PDTwinStreamCreate(fi, NULL);
+    doc->parser = PDParserCreateWithStream(doc->stream);
+    if (NULL == doc->parser) {
+        PDRelease(doc);
+        return NULL;
+    }
+    
+    doc->dirty = PDSplayTreeCreateWithDeallocator(PDReleaseFunc);
+    
+    return doc;
+}
+
+PDParserRef PDDocumentGetParser(PDDocumentRef doc)
+{
+    return doc->parser;
+}
+
+PDObjectRef PDDocumentGetObject(PDDocumentRef doc, PDInteger obid)
+{
+    PDXTableRef mxt = doc->parser->mxt;
+    
+    if (obid <= 0 || (PDSize)obid >= mxt->count || PDXTypeFreed == PDXTableGetTypeForID(mxt, obid))
+        return NULL;
+    
+    // the parser holds on to objects fetched at random, so the same instance is handed out every time
+    PDObjectRef ob = PDParserLocateAndCreateObject(doc->parser, obid, true);
+    PDRelease(ob);
+    return ob;
+}
+
+void PDDocumentMarkObjectDirty(PDDocumentRef doc, PDObjectRef object)
+{
+    if (object == PDSplayTreeGet(doc->dirty, object->obid))
+        return;
+    
+    PDSplayTreeInsert(doc->dirty, object->obid, PDRetain(object));
+}
+
+/**
+ Move objects created through the parser into the dirty set.
+ */
+static void PDDocumentCollectCreatedObjects(PDDocumentRef doc)
+{
+    PDParserRef parser = doc->parser;
+    PDObjectRef ob;
+    
+    while (parser->inserts || parser->appends) {
+        ob = pd_stack_pop_object(parser->inserts ? &parser->inserts : &parser->appends);
+        PDDocumentMarkObjectDirty(doc, ob);
+        PDRelease(ob);
+    }
+}
+
+PDObjectRef PDDocumentCreateObject(PDDocumentRef doc)
+{
+    PDObjectRef ob = PDParserCreateAppendedObject(doc->parser);
+    PDDocumentCollectCreatedObjects(doc);
+    return ob;
+}
+
+static int PDDocumentMarkCompare(const void *a, const void *b)
+{
+    const PDDocumentMark *ma = a;
+    const PDDocumentMark *mb = b;
+    if (ma->offset != mb->offset) return ma->offset < mb->offset ? -1 : 1;
+    // objects which are copied come first
+    return (mb->obid > 0) - (ma->obid > 0);
+}
+
+static inline void PDDocumentAddMark(PDDocumentMark **marks, PDInteger *count, PDInteger *cap, PDOffset offset, PDInteger obid, PDBool object)
+{
+    if (*count == *cap) {
+        *cap = *cap ? *cap << 1 : 256;
+        *marks = realloc(*marks, *cap * sizeof(PDDocumentMark));
+    }
+    (*marks)[(*count)++] = (PDDocumentMark) {offset, obid, object};
+}
+
+/**
+ Determine whether the object at the given input position is a linearization dictionary.
+ */
+static PDBool PDDocumentIsLinearizationDictionary(PDDocumentRef doc, PDOffset offset)
+{
+    char buf[PDDocumentTrimWindow + 1];
+    PDSize bytes = PDTwinStreamReadInput(doc->stream, (PDSize)offset, PDDocumentTrimWindow, buf);
+    buf[bytes] = 0;
+    
+    char *end = strstr(buf, "endobj");
+    if (end) *end = 0;
+    return NULL != strstr(buf, "/Linearized");
+}
+
+/**
+ Copy the given range of the input to the output.
+ 
+ If trim is set, the range is cut short right after its final endobj keyword (and line break), as it is followed by an XREF section, a trailer, or the end of the file, rather than by another object.
+ */
+static PDBool PDDocumentCopyRange(PDDocumentRef doc, PDOffset start, PDOffset end, PDBool trim, char *buf)
+{
+    PDTwinStreamRef stream = doc->stream;
+    PDSize bytes;
+    
+    if (trim) {
+        PDOffset tail = end - start > PDDocumentTrimWindow ? end - PDDocumentTrimWindow : start;
+        bytes = PDTwinStreamReadInput(stream, (PDSize)tail, (PDInteger)(end - tail), buf);
+        for (PDInteger i = (PDInteger)bytes - 6; i >= 0; i--) {
+            if (! strncmp(&buf[i], "endobj", 6)) {
+                for (i += 6; i < (PDInteger)bytes && (buf[i] == '\r' || buf[i] == '\n'); i++) ;
+                end = tail + i;
+                break;
+            }
+        }
+    }
+    
+    while (start < end) {
+        bytes = PDTwinStreamReadInput(stream, (PDSize)start, end - start < PDDocumentCopyChunkSize ? (PDInteger)(end - start) : PDDocumentCopyChunkSize, buf);
+        if (bytes == 0) {
+            PDError("unexpected end of input at offset %lld", (long long)start);
+            return false;
+        }
+        PDTwinStreamInsertContent(stream, bytes, buf);
+        start += bytes;
+    }
+    
+    return true;
+}
+
+/**
+ Copy the header, and every object which is not dirty, from the input to the output, pointing the master XREF table at the copies.
+ 
+ Objects are copied in the order in which they appear in the input, in runs of consecutive objects, each run in one go. A run ends where something which is not copied begins: a dirty object, an object which is left out, an earlier revision of an object, an XREF section, or the end of the file.
+ */
+static PDBool PDDocumentCopyCleanObjects(PDDocumentRef doc)
+{
+    PDParserRef parser = doc->parser;
+    PDXTableRef ixt = parser->ixt;
+    PDXTableRef mxt = parser->mxt;
+    PDDocumentMark *marks = NULL;
+    PDInteger count = 0;
+    PDInteger cap = 0;
+    PDInteger i, j, k;
+    PDSize obid;
+    pd_stack iter;
+    struct stat st;
+    
+    if (0 != fstat(fileno(doc->fi), &st)) {
+        PDError("unable to determine the size of %s", doc->pi);
+        return false;
+    }
+    PDOffset size = (PDOffset)st.st_size;
+    
+    // XREF streams of the input are superseded by the output's own XREF section
+    PDSplayTreeRef dropped = PDSplayTreeCreateWithDeallocator(PDDeallocatorNull);
+    pd_stack_for_each(parser->xstack, iter) {
+        PDXTableRef table = iter->info;
+        if (table->format == PDXTableFormatBinary && table->obid > 0)
+            PDSplayTreeInsert(dropped, table->obid, (void *)table->obid);
+    }
+    if (ixt->format == PDXTableFormatBinary && parser->trailer->obid > 0)
+        PDSplayTreeInsert(dropped, parser->trailer->obid, (void *)parser->trailer->obid);
+    
+    // objects of the current revision, which are copied unless they are dirty or left out
+    PDOffset first = size;
+    PDInteger firstID = 0;
+    for (obid = 1; obid < ixt->count; obid++) {
+        if (PDXTypeUsed != PDXTableGetTypeForID(ixt, obid)) continue;
+        PDOffset offset = PDXTableGetOffsetForID(ixt, obid);
+        if (offset <= 0 || offset >= size) {
+            PDNotice("object %zu is outside of the input (offset %lld), and is left out", obid, (long long)offset);
+            PDSplayTreeInsert(dropped, obid, (void *)obid);
+            continue;
+        }
+        if (offset < first) {
+            first = offset;
+            firstID = obid;
+        }
+    }
+    
+    // a linearization dictionary would no longer describe the file once objects move around
+    if (firstID && NULL == PDSplayTreeGet(doc->dirty, firstID) && PDDocumentIsLinearizationDictionary(doc, first))
+        PDSplayTreeInsert(dropped, firstID, (void *)firstID);
+    
+    for (obid = 1; obid < ixt->count; obid++) {
+        if (PDXTypeUsed != PDXTableGetTypeForID(ixt, obid)) continue;
+        PDOffset offset = PDXTableGetOffsetForID(ixt, obid);
+        if (offset <= 0 || offset >= size) continue;
+        PDBool copied = NULL == PDSplayTreeGet(doc->dirty, obid) && NULL == PDSplayTreeGet(dropped, obid);
+        PDDocumentAddMark(&marks, &count, &cap, offset, copied ? obid : 0, true);
+    }
+    
+    // earlier revisions of objects and XREF sections end runs as well
+    pd_stack_for_each(parser->xstack, iter) {
+        PDXTableRef table = iter->info;
+        for (obid = 1; obid < table->count; obid++) {
+            if (PDXTypeUsed == PDXTableGetTypeForID(table, obid))
+                PDDocumentAddMark(&marks, &count, &cap, PDXTableGetOffsetForID(table, obid), 0, true);
+        }
+        if (table->pos > 0)
+            PDDocumentAddMark(&marks, &count, &cap, (PDOffset)table->pos, 0, false);
+    }
+    if (ixt->pos > 0)
+        PDDocumentAddMark(&marks, &count, &cap, (PDOffset)ixt->pos, 0, false);
+    PDDocumentAddMark(&marks, &count, &cap, size, 0, false);
+    
+    qsort(marks, count, sizeof(PDDocumentMark), PDDocumentMarkCompare);
+    
+    char *buf = malloc(PDDocumentCopyChunkSize);
+    PDBool success = true;
+    
+    // the header is whatever precedes the first object
+    if (first < size) {
+        success = PDDocumentCopyRange(doc, 0, first, false, buf);
+    } else {
+        PDTwinStreamInsertContent(doc->stream, 15, "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n");
+    }
+    
+    PDOffset runStart = -1;
+    PDOffset runOutput = 0;
+    for (i = 0; success && i < count; i = j) {
+        for (j = i + 1; j < count && marks[j].offset == marks[i].offset; j++) ;
+    
+        if (marks[i].obid > 0) {
+            if (runStart < 0) {
+                runStart = marks[i].offset;
+                runOutput = (PDOffset)PDTwinStreamGetOutputOffset(doc->stream);
+            }
+            for (k = i; k < j && marks[k].obid > 0; k++)
+                PDXTableSetOffsetForID(mxt, marks[k].obid, runOutput + marks[i].offset - runStart);
+        } else if (runStart >= 0) {
+            PDBool object = false;
+            for (k = i; k < j; k++) object |= marks[k].object;
+            success = PDDocumentCopyRange(doc, runStart, marks[i].offset, ! object, buf);
+            runStart = -1;
+        }
+    }
+    
+    free(buf);
+    free(marks);
+    
+    // objects which are left out are free in the output
+    PDInteger dropCount = PDSplayTreeGetCount(dropped);
+    PDInteger *obids = malloc(sizeof(PDInteger) * (dropCount + 1));
+    PDSplayTreePopulateKeys(dropped, obids);
+    for (i = 0; i < dropCount; i++) {
+        if (obids[i] < (PDInteger)mxt->count && NULL == PDSplayTreeGet(doc->dirty, obids[i])) {
+            PDXTableSetTypeForID(mxt, obids[i], PDXTypeFreed);
+            PDXTableSetOffsetForID(mxt, obids[i], 0);
+        }
+    }
+    free(obids);
+    PDRelease(dropped);
+    
+    return success;
+}
+
+/**
+ Write the XREF section, trailer and end fluff.
+ */
+static void PDDocumentWriteXRef(PDDocumentRef doc)
+{
+    PDParserRef parser = doc->parser;
+    PDXTableRef mxt = parser->mxt;
+    PDSize obid;
+    char obuf[64];
+    PDInteger len;
+    
+    // objects inside of object streams can only be referred to from an XREF stream, which is what hybrid files (with an /XRefStm) end up with
+    if (mxt->format == PDXTableFormatText) {
+        for (obid = 1; obid < mxt->count && PDXTypeComp != PDXTableGetTypeForID(mxt, obid); obid++) ;
+        if (obid < mxt->count) {
+            mxt->format = PDXTableFormatBinary;
+            PDDictionarySet(PDObjectGetDictionary(parser->trailer), "Type", PDStringWithName(strdup("/XRef")));
+        }
+    }
+    
+    PDSize startxref = (PDSize)PDTwinStreamGetOutputOffset(doc->stream);
+    
+    if (mxt->format == PDXTableFormatText) {
+        PDXTableInsert(parser);
+    } else {
+        // the complete table, in a section of its own
+        PDInteger count = (PDInteger)mxt->count;
+        PDInteger *obids = malloc(sizeof(PDInteger) * count);
+        for (obid = 0; obid < mxt->count; obid++)
+            obids[obid] = obid;
+        PDXTableInsertUpdate(parser, obids, count, 0);
+        free(obids);
+    }
+    
+    len = sprintf(obuf, "startxref\n%zu\n%%%%EOF\n", startxref);
+    PDTwinStreamInsertContent(doc->stream, len, obuf);
+}
+
+PDBool PDDocumentWriteToFile(PDDocumentRef doc, const char *outputFilePath)
+{
+    PDParserRef parser = doc->parser;
+    PDObjectRef ob;
+    PDInteger i;
+    
+    if (doc->written) {
+        PDWarn("document %s has been written already", doc->pi);
+        return false;
+    }
+    
+    if (outputFilePath == NULL || ! strcmp(outputFilePath, doc->pi)) {
+        PDWarn("the output of document %s must be a different file", doc->pi);
+        return false;
+    }
+    
+    FILE *fo = PDPipeOpenOutputStream(outputFilePath);
+    if (NULL == fo) {
+        PDNotice("unable to open output stream for path: %s", outputFilePath);
+        return false;
+    }
+    
+    doc->written = true;
+    PDTwinStreamSetOutput(doc->stream, fo);
+    
+    PDDocumentCollectCreatedObjects(doc);
+    
+    PDBool success = PDDocumentCopyCleanObjects(doc);
+    
+    if (success) {
+        PDInteger count = PDSplayTreeGetCount(doc->dirty);
+        PDInteger *obids = malloc(sizeof(PDInteger) * (count + 1));
+        PDSplayTreePopulateKeys(doc->dirty, obids);
+        for (i = 0; i < count; i++) {
+            PDParserWriteObject(parser, PDSplayTreeGet(doc->dirty, obids[i]));
+        }
+        free(obids);
+    
+        // objects created along the way (the /Length objects of produced streams) go in last
+        while (parser->inserts || parser->appends) {
+            ob = pd_stack_pop_object(parser->inserts ? &parser->inserts : &parser->appends);
+            PDParserWriteObject(parser, ob);
+            PDRelease(ob);
+        }
+    
+        PDDocumentWriteXRef(doc);
+    }
+    
+    PDTwinStreamSetOutput(doc->stream, NULL);
+    
+    success &= 0 == fflush(fo) && ! ferror(fo);
+    PDPipeCloseFileStream(fo);
+    
+    if (! success) {
+        PDWarn("document %s could not be written to %s", doc->pi, outputFilePath);
+    }
+    
+    return success;
+}
@@ -0,0 +1,117 @@
+//
+// PDDocument.h
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+/**
+ @file PDDocument.h Document header file.
+ 
+ @ingroup PDDOCUMENT
+ 
+ @defgroup PDDOCUMENT PDDocument
+ 
+ @brief A PDF opened for editing objects in any order.
+ 
+ @ingroup PDPIPE_CONCEPT
+ 
+ Unlike a pipe, which passes through the input from start to end and can only modify objects before it has reached them, a document gives access to any object at any time. Objects are loaded lazily, using the input's XREF table to find them, and may be modified in any order, as often as needed.
+ 
+ Modified objects must be marked dirty (see PDDocumentMarkObjectDirty()). When the document is written, the byte ranges of all other objects are copied from the input as they are, and only the dirty objects are serialized, so the cost of writing is determined by the number of changes, rather than by the size of the document.
+ 
+ @code
+ PDDocumentRef doc = PDDocumentCreateWithFilePath("in.pdf");
+ PDObjectRef info = PDParserGetInfoObject(PDDocumentGetParser(doc));
+ PDDictionarySet(PDObjectGetDictionary(info), "Producer", PDStringWithCString(strdup("Pajdeg")));
+ PDDocumentMarkObjectDirty(doc, info);
+ PDDocumentWriteToFile(doc, "out.pdf");
+ PDRelease(doc);
+ @endcode
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PDDocument_h
+#define INCLUDED_PDDocument_h
+
+#include "PDDefines.h"
+
+/**
+ Open the PDF at the given path as a document.
+ 
+ Only the XREF tables and trailer are read; objects are loaded as they are requested.
+ 
+ @param inputFilePath Path to the PDF.
+ @return The document, or NULL if the file could not be opened or read as a PDF.
+ */
+extern PDDocumentRef PDDocumentCreateWithFilePath(const char *inputFilePath);
+
+/**
+ Get the parser of the document, e.g. to get at the root object or the catalog, or to fetch the stream of an object (see PDParserLocateAndFetchObjectStreamForObject()).
+ 
+ @param doc The document.
+ */
+extern PDParserRef PDDocumentGetParser(PDDocumentRef doc);
+
+/**
+ Get the object with the given ID, loading it from the input if it has not been loaded already.
+ 
+ The same object is returned every time it is requested, so changes made to it are seen by everyone holding on to it. Changes are only written out if the object is marked dirty (see PDDocumentMarkObjectDirty()).
+ 
+ @param doc The document.
+ @param obid The object ID.
+ @return The object, which is not retained, or NULL if there is no object with the given ID.
+ */
+extern PDObjectRef PDDocumentGetObject(PDDocumentRef doc, PDInteger obid);
+
+/**
+ Create a new object in the document, using the first free object ID. The object is dirty from the start.
+ 
+ @param doc The document.
+ @return The new, retained object.
+ */
+extern PDObjectRef PDDocumentCreateObject(PDDocumentRef doc);
+
+/**
+ Mark an object as modified, so that it is serialized when the document is written, rather than copied from the input.
+ 
+ This includes objects which have been deleted (see PDObjectDelete()), which have their XREF entry marked as free instead, and objects whose stream has been replaced.
+ 
+ @param doc The document.
+ @param object The object, as returned by PDDocumentGetObject(), or by one of the parser's object functions.
+ */
+extern void PDDocumentMarkObjectDirty(PDDocumentRef doc, PDObjectRef object);
+
+/**
+ Write the document to the given path.
+ 
+ The output begins with the objects which are not dirty, copied verbatim from the input in the order they appear in it, followed by the dirty objects, and a single XREF section of the same format as the input's. Earlier revisions of objects (from incremental updates), the input's XREF streams, and the linearization dictionary, if the input is linearized, are left out.
+ 
+ @note A document is written once; it can be read from afterwards, but not written again.
+ 
+ @param doc The document.
+ @param outputFilePath Path to the output PDF, which must not be the same as the input path.
+ @return true if the output was written in its entirety.
+ */
+extern PDBool PDDocumentWriteToFile(PDDocumentRef doc, const char *outputFilePath);
+
+#endif
+
+/** @} */
@@ -50,6 +50,7 @@ void PDObjectDestroy(PDObjectRef object)
     if (object->ovrDef) free(object->ovrDef);
     if (object->ovrStream && object->ovrStreamAlloc)
         free(object->ovrStream);
+    PDRelease(object->ovrStreamFilter);
     if (object->refString) free(object->refString);
     if (object->extractedLen != -1) free(object->streamBuf);
 }
@@ -81,18 +82,13 @@ void PDObjectSetSynchronizationCallback(PDObjectRef object, PDSynchronizer callb
 
 void PDObjectDelete(PDObjectRef object)
 {
-    if (object->obclass != PDObjectClassCompressed) {
-        object->skipObject = object->deleteObject = true;
-    } else {
-        PDError("Objects inside of object streams cannot be deleted");
-    }
+    // objects inside of object streams are left out when their object stream is committed
+    object->skipObject = object->deleteObject = true;
 }
 
 void PDObjectUndelete(PDObjectRef object)
 {
-    if (object->obclass != PDObjectClassCompressed) {
-        object->skipObject = object->deleteObject = false;
-    }
+    object->skipObject = object->deleteObject = false;
 }
 
 PDInteger PDObjectGetObID(PDObjectRef object)
@@ -306,49 +302,79 @@ void PDObjectSetStream(PDObjectRef object, char *str, PDInteger len, PDBool incl
             str = res;
             allocated = true;
         }
-        pd_crypto_convert(object->crypto, object->obid, object->genid, str, len);
+        len = pd_crypto_encrypt_data(object->crypto, object->obid, object->genid, &str, len);
     }
 #endif
     
     if (object->ovrStreamAlloc) {
         free(object->ovrStream);
     }
+    PDRelease(object->ovrStreamFilter);
+    object->ovrStreamFilter = NULL;
     object->ovrStream = str;
     object->ovrStreamLen = len;
     object->ovrStreamAlloc = allocated;
+    object->ovrProducer = NULL;
     if (includeLength)  {
         PDDictionarySet(PDObjectGetDictionary(object), "Length", PDNumberWithInteger(len));
     }
 }
 
+void PDObjectSetStreamProducer(PDObjectRef object, PDObjectStreamProducer producer, void *info)
+{
+    if (object->ovrStreamAlloc) {
+        free(object->ovrStream);
+    }
+    PDRelease(object->ovrStreamFilter);
+    object->ovrStreamFilter = NULL;
+    object->ovrStream = NULL;
+    object->ovrStreamLen = 0;
+    object->ovrStreamAlloc = false;
+    object->ovrProducer = producer;
+    object->ovrProducerInfo = info;
+}
+
 PDBool PDObjectSetStreamFiltered(PDObjectRef object, char *str, PDInteger len, PDBool allocated, PDBool encrypted)
 {
     // Need to get /Filter and /DecodeParms
     PDDictionaryRef obdict = PDObjectGetDictionary(object);
-    PDStringRef filter = PDDictionaryGetString(obdict, "Filter");
+    void *filters = PDDictionaryGet(obdict, "Filter");
     
-    if (NULL == filter) {
+    if (NULL == filters || (PDResolve(filters) == PDInstanceTypeArray && PDArrayGetCount(filters) == 0)) {
         // no filter
         PDObjectSetStream(object, str, len, true, allocated, encrypted);
         return true;
     } 
 
-    PDDictionaryRef decodeParms = PDDictionaryGetDictionary(obdict, "DecodeParms");
-    
     PDBool success = true;
-    PDStreamFilterRef sf = PDStreamFilterObtain(PDStringEscapedValue(filter, false, NULL), false, decodeParms);
+    PDStreamFilterRef sf = PDStreamFilterObtainChain(filters, PDDictionaryGet(obdict, "DecodeParms"), false);
     if (NULL == sf) {
         // we don't support this filter; that means we've been handed the filtered value, because we were not able to extract it either, so we can pass it over to PDObjectSetStream
         PDObjectSetStream(object, str, len, true, allocated, true);
         return true;
     } 
     
+    PDStreamFilterSetCompressionLevel(sf, object->compressionLevel);
+    
     if (success) success = PDStreamFilterInit(sf);
     // if !success, filter did not initialize properly
 
     success &= sf->compatible;
     // if !success, filter was not compatible with options
 
+    if (success && object->deferFiltering) {
+        // the parser filters the stream on its work queue as the object is written, so we hang on to the unfiltered stream until then
+        if (! allocated) {
+            char *res = malloc(len);
+            memcpy(res, str, len);
+            str = res;
+        }
+        PDObjectSetStream(object, str, len, false, true, true);
+        object->ovrStreamFilter = sf;
+        object->ovrStreamEncrypted = encrypted;
+        return true;
+    }
+
     char *filtered = NULL;
     PDInteger flen = 0;
     if (success) success = PDStreamFilterApply(sf, (unsigned char *)str, (unsigned char **)&filtered, len, &flen, NULL);
@@ -363,6 +389,41 @@ PDBool PDObjectSetStreamFiltered(PDObjectRef object, char *str, PDInteger len, P
     return success;
 }
 
+PDBool PDObjectApplyStreamFilter(PDObjectRef object)
+{
+    PDStreamFilterRef sf = object->ovrStreamFilter;
+    if (sf == NULL) return true;
+    
+    char *filtered = NULL;
+    PDInteger flen = 0;
+    PDBool success = PDStreamFilterApply(sf, (unsigned char *)object->ovrStream, (unsigned char **)&filtered, object->ovrStreamLen, &flen, NULL);
+    object->ovrStreamFilter = NULL;
+    PDRelease(sf);
+    
+    PDObjectCompleteStreamFilter(object, success, filtered, flen);
+    return success;
+}
+
+void PDObjectCompleteStreamFilter(PDObjectRef object, PDBool success, char *filtered, PDInteger flen)
+{
+    // PDObjectSetStream() would free the unfiltered stream, which we may still need
+    char *str = object->ovrStream;
+    PDInteger len = object->ovrStreamLen;
+    PDBool allocated = object->ovrStreamAlloc;
+    object->ovrStream = NULL;
+    object->ovrStreamAlloc = false;
+    
+    if (success) {
+        PDObjectSetStream(object, filtered, flen, true, true, object->ovrStreamEncrypted);
+        if (allocated) free(str);
+    } else {
+        PDWarn("failed to filter stream of object %ld; writing it unfiltered", object->obid);
+        free(filtered);
+        PDObjectSetFlateDecodedFlag(object, false);
+        PDObjectSetStream(object, str, len, true, allocated, object->ovrStreamEncrypted);
+    }
+}
+
 void PDObjectSetFlateDecodedFlag(PDObjectRef object, PDBool state)
 {
     if (object->inst == NULL) PDObjectGetDictionary(object);
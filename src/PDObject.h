@@ -113,6 +113,8 @@ extern void PDObjectSetSynchronizationCallback(PDObjectRef object, PDSynchronize
 /**
  Delete this object, thus excluding it from the output PDF file, and marking it as freed in the XREF table.
  
+ Objects inside of object streams are left out of their object stream when it is written.
+ 
  @param object The object to remove.
  */
 extern void PDObjectDelete(PDObjectRef object);
@@ -315,7 +317,7 @@ extern void PDObjectSkipStream(PDObjectRef object);
 extern void PDObjectSetStream(PDObjectRef object, char *str, PDInteger len, PDBool includeLength, PDBool allocated, PDBool encrypted);
 
 /**
- *  Replaces the stream with given data, filtered according to the object's /Filter and /DecodeParams settings.
+ *  Replaces the stream with given data, filtered according to the object's /Filter and /DecodeParams settings, which may be arrays of filters (and their parameters).
  *  
  *  @note Pajdeg only supports a limited number of filters. If the object's filter settings are not supported, the operation is aborted.
  *  
@@ -337,6 +339,21 @@ extern void PDObjectSetStream(PDObjectRef object, char *str, PDInteger len, PDBo
  */
 extern PDBool PDObjectSetStreamFiltered(PDObjectRef object, char *str, PDInteger len, PDBool allocated, PDBool encrypted);
 
+/**
+ *  Replaces the stream with content produced by the given producer as the object is written to the output. 
+ *  
+ *  The produced content is filtered according to the object's /Filter and /DecodeParms settings (as with PDObjectSetStreamFiltered()), encrypted if the PDF is encrypted, and written to the output in pieces, so the stream never has to be held in memory in its entirety. As the length of the stream is not known until it has been produced, the object's /Length entry is replaced with a reference to a new object, which is appended to the output.
+ *  
+ *  @note If the object's filter settings are not supported, the produced content is presumed to be filtered (and encrypted) already, and is written as is. 
+ *  
+ *  @see PDObjectSetStreamFiltered
+ *  
+ *  @param object   The object.
+ *  @param producer The producer, which is called from the pipe's thread when the object is written.
+ *  @param info     User info passed to the producer.
+ */
+extern void PDObjectSetStreamProducer(PDObjectRef object, PDObjectStreamProducer producer, void *info);
+
 /**
  Enable or disable compression (FlateDecode) filter flag for the object stream.
  
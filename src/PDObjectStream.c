@@ -52,7 +52,7 @@ void PDObjectStreamDestroy(PDObjectStreamRef obstm)
     PDInteger i;
     PDObjectStreamElementRef elements = obstm->elements;
     for (i = 0; i < obstm->n; i++)
-        if (elements[i].type == PDObjectTypeString)
+        if (elements[i].raw)
             free(elements[i].def);
         else
             pd_stack_destroy((pd_stack *)&elements[i].def);
@@ -74,19 +74,7 @@ PDObjectStreamRef PDObjectStreamCreateWithObject(PDObjectRef object)
     obstm->first = PDDictionaryGetInteger(obd, "First");
     obstm->constructs = PDSplayTreeCreateWithDeallocator(PDReleaseFunc);
     
-    PDStringRef filterName = PDDictionaryGetString(obd, "Filter");
-//    const char *filterName = PDDictionaryGet(PDObjectGetDictionary(object), "Filter");
-    if (filterName) {
-        const char *filterString = PDStringEscapedValue(filterName, false, NULL);
-//        filterName = &filterName[1]; // get rid of name slash
-//        pd_stack decodeParms = pd_stack_get_dict_key(object->def, "DecodeParms", false);
-        PDDictionaryRef decodeParms = PDDictionaryGetDictionary(obd, "DecodeParms");
-//        if (decodeParms) 
-//            decodeParms = PDStreamFilterGenerateOptionsFromDictionary(decodeParms);
-        obstm->filter = PDStreamFilterObtain(filterString, true, decodeParms);
-    } else {
-        obstm->filter = NULL;
-    }
+    obstm->filter = PDStreamFilterObtainChain(PDDictionaryGet(obd, "Filter"), PDDictionaryGet(obd, "DecodeParms"), true);
     
     obstm->elements = NULL;
     
@@ -149,10 +137,12 @@ void PDObjectStreamParseExtractedObjectStream(PDObjectStreamRef obstm, char *buf
     
     // read definitions 
     for (i = 0; i < n; i++) {
+        elements[i].raw = false;
         if (PDScannerPopStack(osScanner, (pd_stack *)&elements[i].def)) {
             elements[i].type = PDObjectTypeFromIdentifier(as(pd_stack, elements[i].def)->info);
         } else {
             elements[i].type = PDObjectTypeString;
+            elements[i].raw = true;
             char *str;
             if (PDScannerPopString(osScanner, &str)) {
                 elements[i].def = str;
@@ -218,6 +208,20 @@ PDObjectRef PDObjectStreamGetObjectAtIndex(PDObjectStreamRef obstm, PDInteger in
     //pd_btree_fetch(obstm->constructs, elements[index].obid);
 }
 
+void PDObjectStreamAppendDefinition(PDObjectStreamRef obstm, PDInteger obid, char *definition)
+{
+    PDObjectStreamElementRef el;
+    
+    obstm->elements = realloc(obstm->elements, sizeof(struct PDObjectStreamElement) * (obstm->n + 1));
+    el = &obstm->elements[obstm->n++];
+    el->obid = obid;
+    el->offset = 0;
+    el->length = 0;
+    el->type = PDObjectTypeString;
+    el->def = definition;
+    el->raw = true;
+}
+
 void PDObjectStreamCommit(PDObjectStreamRef obstm)
 {
     PDInteger i;
@@ -238,17 +242,31 @@ void PDObjectStreamCommit(PDObjectStreamRef obstm)
     offs = 0;
     headerlen = 0;
     
-    // stringify and update offsets
+    // deleted objects are left out; their definitions are held by their constructs
+    for (i = len = 0; i < n; i++) {
+        if (elements[i].def == NULL && as(PDObjectRef, PDSplayTreeGet(obstm->constructs, elements[i].obid))->deleteObject) 
+            continue;
+        elements[len++] = elements[i];
+    }
+    n = obstm->n = len;
+    
+    // stringify and update offsets; definitions which were stacks are kept as strings from here on
     for (i = 0; i < n; i++) {
         if (elements[i].def == NULL) {
             PDObjectRef ob = PDSplayTreeGet(obstm->constructs, elements[i].obid);
             len = PDObjectGenerateDefinition(ob, (char**)&elements[i].def, 0);
             len--; // objects add \n after def; don't want two \n's
         } else {
-//            if (PDObjectTypeString != elements[i].type) {
+            if (! elements[i].raw) {
                 pd_stack def = elements[i].def;
-                elements[i].def = PDStringFromComplex(&def);
-//            }
+                pd_stack iter = def;
+                pd_stack_set_global_preserve_flag(true);
+                elements[i].def = PDStringFromComplex(&iter);
+                pd_stack_set_global_preserve_flag(false);
+                pd_stack_destroy(&def);
+                elements[i].type = PDObjectTypeString;
+                elements[i].raw = true;
+            }
             len = strlen(elements[i].def);
         }
         len++; // add a \n after every def
@@ -261,13 +279,13 @@ void PDObjectStreamCommit(PDObjectStreamRef obstm)
     // update keys
 //    sprintf(hbuf, "%ld", headerlen);
     PDDictionaryRef obd = PDObjectGetDictionary(streamOb);
+    PDDictionarySet(obd, "N", PDNumberWithInteger(n));
     PDDictionarySet(obd, "First", PDNumberWithInteger(headerlen));
 //    PDDictionarySet(PDObjectGetDictionary(streamOb), "First", hbuf);
     
     // generate stream
     len = headerlen + offs;
-    if (len == 0) return; // CLANG warnings
-    content = malloc(len);
+    content = malloc(len + 1); // sprintf terminates; also, the stream is empty if every object was deleted
     
     // header
     offs = 0;
@@ -276,8 +294,8 @@ void PDObjectStreamCommit(PDObjectStreamRef obstm)
     }
     
     // change final space to a newline to be cleanly
-    PDAssert(offs > 0);
-    content[offs-1] = '\n';
+    PDAssert(offs > 0 || n == 0);
+    if (offs > 0) content[offs-1] = '\n';
     
     // content
     for (i = 0; i < n; i++) {
@@ -289,10 +307,19 @@ void PDObjectStreamCommit(PDObjectStreamRef obstm)
     
     PDAssert(offs == len);
     
+    // constructs are regenerated on every commit
+    for (i = 0; i < n; i++) {
+        if (PDSplayTreeGet(obstm->constructs, elements[i].obid)) {
+            free(elements[i].def);
+            elements[i].def = NULL;
+        }
+    }
+    
     // filter (if necessary)
     if (obstm->filter) {
         char *filteredBuf;
         PDStreamFilterRef inversionFilter = PDStreamFilterCreateInversionForFilter(obstm->filter);
+        PDStreamFilterSetCompressionLevel(inversionFilter, streamOb->compressionLevel);
         if (! PDStreamFilterApply(inversionFilter, (unsigned char *)content, (unsigned char **)&filteredBuf, len, &len, NULL)) {
             PDWarn("PDStreamFilterApply failed!\n");
             PDAssert(0);
@@ -52,6 +52,31 @@
  */
 extern PDParserRef PDParserCreateWithStream(PDTwinStreamRef stream);
 
+/**
+ Set up a parser with a twin stream and an index file.
+ 
+ If the index file exists and matches the input file (by size, modification time, file serial number, and a hash of the trailing bytes holding the trailer and startxref) and was written on a machine with the same byte order and integer widths, the XREF tables, trailer, and page list are loaded from it, and the input XREF tables are never read. Otherwise the parser is set up as with PDParserCreateWithStream(), and the index file is (re-)written via PDParserSaveIndex().
+ 
+ @note Object stream membership is recorded in the XREF tables themselves (via compressed entries), and is thus part of the index.
+ 
+ @param stream    The stream to use.
+ @param indexPath The index file path, or NULL to not use an index.
+ */
+extern PDParserRef PDParserCreateWithStreamAndIndex(PDTwinStreamRef stream, const char *indexPath);
+
+/**
+ Save the parser's XREF tables, trailer, and page list to an index file, which may then be used by PDParserCreateWithStreamAndIndex() to skip XREF parsing and page tree walking for the same input file.
+ 
+ The page tree is not walked for the sake of the index. If the parser's catalog has not been set up yet, the index is written without a page list, which is added to the file when the catalog is first set up (e.g. via PDParserGetCatalog()). The same goes for index files loaded without a page list.
+ 
+ @note This must be called before the parser iterates past the first object, as output offsets replace input offsets in the master XREF table as objects are written.
+ 
+ @param parser    The parser.
+ @param indexPath The index file path.
+ @return true if the index was written.
+ */
+extern PDBool PDParserSaveIndex(PDParserRef parser, const char *indexPath);
+
 /**
  Iterate to the next (living) object.
  
@@ -98,6 +123,37 @@ extern PDObjectRef PDParserCreateAppendedObject(PDParserRef parser);
  */
 extern char *PDParserFetchCurrentObjectStream(PDParserRef parser, PDInteger obid);
 
+/**
+ Open a reader for the current object's stream, which decodes the stream in chunks as it is read, rather than fetching it into memory in its entirety.
+ 
+ The raw stream is read directly from the input, and the parser state is not affected, i.e. the original stream is passed through as is unless the object is given a new stream. If the stream was already fetched, the reader hands out the fetched data. Streams of encrypted documents are decrypted a chunk at a time as they are read.
+ 
+ @note The reader must be released before the parser moves on to the next object.
+ 
+ @param parser The parser.
+ @param obid The object ID of the current object. Assertion is thrown if it does not match the parser's expected ID, or if the current object is not in the original PDF (e.g. from PDParserCreateNewObject()).
+ @return A reader, which must be released with PDRelease(), or NULL if the stream's filters could not be set up, or if the stream was fetched by a sharded object but could not be decoded.
+ */
+extern PDParserStreamReaderRef PDParserOpenCurrentObjectStreamReader(PDParserRef parser, PDInteger obid);
+
+/**
+ Read the next chunk of decoded stream data.
+ 
+ @param reader The reader.
+ @param dest The buffer to read into.
+ @param capacity The capacity of dest.
+ @return The number of bytes read, or 0 once the stream has been read in its entirety (or the filters failed).
+ */
+extern PDInteger PDParserStreamReaderRead(PDParserStreamReaderRef reader, char *dest, PDInteger capacity);
+
+/**
+ Determine whether the reader's filters failed to decode the stream.
+ 
+ @param reader The reader.
+ @return true if decoding failed.
+ */
+extern PDBool PDParserStreamReaderIsFailing(PDParserStreamReaderRef reader);
+
 /**
  Fetch the object stream of the given object.
  
@@ -117,6 +173,69 @@ extern const char *PDParserLocateAndFetchObjectStreamForObject(PDParserRef parse
  */
 extern PDBool PDParserGetEncryptionState(PDParserRef parser);
 
+/**
+ Re-filter updated streams on the given number of worker threads.
+ 
+ Output is held back in memory while streams are being filtered, and written in order as the workers finish. XREF offsets of objects following a pending stream are resolved once the stream has been written.
+ 
+ @param parser The parser.
+ @param count The number of worker threads.
+ */
+extern void PDParserSetWorkerCount(PDParserRef parser, PDInteger count);
+
+/**
+ Read and decode the streams of the given objects on the parser's worker threads, ahead of the parser reaching them.
+ 
+ When the parser does reach one of the objects, PDParserFetchCurrentObjectStream() hands out the already decoded stream rather than reading it from the input. Objects without streams, objects inside object streams, and objects which the parser has already passed are ignored. Decoded streams are kept in memory until their objects are reached (or the parser is destroyed), so this is meant for a limited set of objects, such as those targeted by tasks.
+ 
+ @note This has no effect unless the parser has worker threads (see PDParserSetWorkerCount()).
+ 
+ @param parser The parser.
+ @param obids The object IDs.
+ @param count The number of object IDs.
+ */
+extern void PDParserPrefetchStreams(PDParserRef parser, PDInteger *obids, PDInteger count);
+
+/**
+ Hand the current object off to the parser's worker threads, where func is run on it before it is written to the output.
+
+ Consecutive objects are gathered into shards, each of which is processed by a single work item; the objects are written in order, once their shard is done. The raw stream of the object, if any, is taken along; calling PDParserFetchCurrentObjectStream() or PDParserOpenCurrentObjectStreamReader() with the object's ID from within func decodes it on the worker thread. Streams which are not fetched are written as they are.
+
+ @warning func must not touch anything but the object it is given; in particular, it must not call any other parser functions, create objects, or set stream producers (see PDObjectSetStreamProducer()), as the parser moves on to the following objects (and other shards) on other threads while func is running.
+
+ @note This has no effect unless the parser has worker threads (see PDParserSetWorkerCount()), and is not supported for objects which have been mutated already, for the encryption dictionary, or for XREF streams.
+
+ @param parser The parser.
+ @param func The function to run on the object.
+ @param info Info passed to func.
+ @param deallocator Deallocator for info, called once the object has been dealt with; it is not called if the object could not be handed off.
+ @return true if the object was handed off; false if it remains the parser's current object.
+ */
+extern PDBool PDParserShardCurrentObject(PDParserRef parser, PDParserShardFunc func, void *info, PDDeallocator deallocator);
+
+/**
+ Visit every page of the input on the given number of worker threads, calling func for each one.
+ 
+ Each worker has its own reader parser, with its own stream, scanner and object cache, which reads objects from the input the same way PDParserLocateAndCreateObject() does. The readers share the parser's input XREF table, page list and crypto instance, none of which are modified while the pages are visited, so read-only page work such as text extraction (see PDContentStreamCreateTextExtractor()) or font lookups (see PDPageGetFont()) runs on all workers at once. Pages are handed out in order, one at a time, to whichever worker is free.
+ 
+ Before the first page is visited, the workers decode and parse every object stream in the input, once, and the readers then take the objects in them from these, rather than each reader decoding the object streams it comes across on its own. The parsed object streams are held in memory until every page has been visited.
+ 
+ Objects are read from the input as it is; changes made to the parser's objects, or to the objects given to func, are not seen by the other workers, and are never written. Objects autoreleased in func are released once func returns.
+ 
+ @warning func must only touch the page and the objects of the reader it is given, plus whatever state info points to, which it must guard itself. Pajdeg objects must not be passed between workers, as retain counts are not thread safe.
+ 
+ @note If the input is not a file with a descriptor (e.g. a memory stream), or threads is 0, the pages are visited on the calling thread.
+ 
+ @note Visiting pages in parallel pays off when func does real work for each page, such as text extraction. Each worker sets up a reader of its own, and reads and parses the objects it needs (other than those in object streams) itself, so for light work, such as looking only at the page dictionaries, or for documents with few pages, visiting the pages on the calling thread (threads = 0) is as fast or faster. Threads beyond the number of available cores only add overhead.
+ 
+ @param parser The parser.
+ @param threads The number of worker threads.
+ @param func The function to call for each page.
+ @param info Info passed to func.
+ @return true if every page was visited, false if func stopped the iteration or the document has no catalog.
+ */
+extern PDBool PDParserForEachPageParallel(PDParserRef parser, PDInteger threads, PDParserPageFunc func, void *info);
+
 /**
  Fetch the definition (as a pd_stack) of the object with the given id. 
  
@@ -152,6 +271,39 @@ extern PDObjectRef PDParserLocateAndCreateObject(PDParserRef parser, PDInteger o
  */
 extern void PDParserDone(PDParserRef parser);
 
+/// @name Incremental updates
+
+/**
+ Begin an incremental (append-only) update of the input PDF.
+ 
+ The output is set up as a verbatim copy of the input, sharing its data with the input where the file system supports it. Objects written with PDParserWriteIncrementalObject() are appended to it, and PDParserFinishIncrementalUpdate() ends it with an XREF section referring back to the input's. 
+ 
+ If the output has been completed already (see PDParserDone()), the update is appended to it instead, with its XREF section referring back to the output's. This is how objects are modified after they have been written.
+ 
+ @note The parser does not iterate during an incremental update; objects are obtained using PDParserLocateAndCreateObject() (with master set), and PDParserFetchCurrentObjectStream() accepts any object ID.
+ 
+ @param parser The parser.
+ @return true if the input was copied to the output.
+ */
+extern PDBool PDParserBeginIncrementalUpdate(PDParserRef parser);
+
+/**
+ Append the given object to the incremental update in progress.
+ 
+ The object's definition is written as it currently is. Its stream is re-filtered if it was fetched, written as is if it was replaced, and otherwise copied from the input untouched. Deleted objects are not written, but are marked as free in the update's XREF section.
+ 
+ @param parser The parser.
+ @param ob The object, which should not be modified afterwards.
+ */
+extern void PDParserWriteIncrementalObject(PDParserRef parser, PDObjectRef ob);
+
+/**
+ Write objects created during the incremental update, followed by the XREF section, trailer and end fluff.
+ 
+ @param parser The parser.
+ */
+extern void PDParserFinishIncrementalUpdate(PDParserRef parser);
+
 /**
  Determine if object with given id has already been written to output stream (i.e. has become immutable).
  
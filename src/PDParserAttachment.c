@@ -37,7 +37,7 @@ extern void PDParserClarifyObjectStreamExistence(PDParserRef parser, PDObjectRef
 // Imports and parser attachments
 // 
 
-static PDParserAttachmentRef PDParserAttachmentHead = NULL, PDParserAttachmentTail = NULL;
+static PD_THREAD_LOCAL PDParserAttachmentRef PDParserAttachmentHead = NULL, PDParserAttachmentTail = NULL;
 
 struct PDParserAttachment {
     PDParserAttachmentRef prev, next;
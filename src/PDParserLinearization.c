@@ -0,0 +1,862 @@
+//
+// PDParserLinearization.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Pajdeg.h"
+
+#include "pd_internal.h"
+#include "PDTwinStream.h"
+#include "PDReference.h"
+#include "PDDictionary.h"
+#include "PDArray.h"
+#include "PDNumber.h"
+#include "PDString.h"
+#include "PDCatalog.h"
+#include "PDXTable.h"
+
+//
+// Linearization (PDF 1.7, Annex F)
+//
+// The linearized output is laid out as follows, where the numbers are the parts of the file as named in the specification:
+//
+//   header, linearization dictionary, first page XREF table and trailer (1-3)
+//   catalog and document level objects (4)
+//   primary hint stream (5)
+//   first page objects (6)
+//   objects of each of the remaining pages, page by page (7)
+//   objects shared by several pages (8)
+//   everything else (9)
+//   main XREF table and trailer (10-11)
+//
+// The objects in parts 7 through 11 are numbered 1 and up, and the first page section is numbered after them, so that the main XREF table is a single subsection starting at 0.
+//
+
+#define PDLinearPartDocument    4       ///< catalog and document level objects
+#define PDLinearPartFirstPage   6       ///< first page objects
+#define PDLinearPartPages       7       ///< objects used by one of the remaining pages only
+#define PDLinearPartShared      8       ///< objects used by several pages
+#define PDLinearPartOther       9       ///< everything else
+
+#define PDLinearInheritedCount  4       ///< number of inheritable page attributes
+
+static const char *PDLinearInherited[PDLinearInheritedCount] = {"Resources", "MediaBox", "CropBox", "Rotate"};
+
+/**
+ An object in the input, as seen by linearization.
+ */
+typedef struct PDLinearEntry {
+    PDObjectRef ob;                 ///< the object, or NULL if there is no such object, or if it is left out of the output (object streams and XREF streams)
+    PDSize position;                ///< input position of the raw stream of the object, or 0 if it has no stream
+    PDInteger *refs;                ///< IDs of the objects referenced by the object, not counting its parent
+    PDInteger refCount;             ///< number of references
+    PDInteger refCap;               ///< capacity of refs
+    PDBool barrier;                 ///< whether the object is a page, page tree node or catalog; the objects of pages are not looked for beyond these
+    PDInteger users;                ///< number of pages using the object
+    PDInteger mark;                 ///< 1 + the index of the page whose objects were last looked for in the object
+    PDInteger part;                 ///< the part of the output the object is written in, or 0 if it has not been placed yet
+    PDInteger newid;                ///< object ID in the output
+    PDInteger shared;               ///< index of the object in the shared object hint table, or -1
+    char *def;                      ///< the object as it is written, up to and including the stream keyword, if it has a stream
+    PDInteger defLen;               ///< length of def
+    PDSize length;                  ///< length of the object in the output
+    PDOffset offset;                ///< offset of the object in the output, as if the hint stream was not there
+} PDLinearEntry;
+
+/**
+ A list of object IDs.
+ */
+typedef struct PDLinearList {
+    PDInteger *obids;               ///< the object IDs
+    PDInteger count;                ///< number of object IDs
+    PDInteger cap;                  ///< capacity of obids
+} PDLinearList;
+
+/**
+ Linearization state.
+ */
+typedef struct PDLinear {
+    PDParserRef parser;             ///< the parser
+    PDInteger count;                ///< number of entries; this is the capacity of the input XREF table
+    PDLinearEntry *entries;         ///< entries, by input object ID
+    PDInteger pageCount;            ///< number of pages
+    PDInteger *pages;               ///< input object IDs of the pages
+    void **inherited;               ///< values inherited by each page, PDLinearInheritedCount per page, or NULL for attributes the page has itself
+    PDLinearList closure;           ///< objects used by each page, page by page, beginning with the page itself
+    PDInteger *closureStart;        ///< index of the first object of each page in closure, with a final index at the end
+    PDInteger *pageObjects;         ///< number of objects in the part of each page
+    PDSize *pageLength;             ///< length of the part of each page
+    PDLinearList parts[10];         ///< placed objects, by part
+    PDInteger *queue;               ///< scratch queue for searching objects
+} PDLinear;
+
+/**
+ Bit writer, for the hint tables.
+ */
+typedef struct PDLinearBits {
+    unsigned char *buf;             ///< the written bytes
+    PDInteger len;                  ///< number of bytes written
+    PDInteger cap;                  ///< capacity of buf
+    unsigned int acc;               ///< bits not yet written
+    int nbits;                      ///< number of bits in acc
+} PDLinearBits;
+
+static void PDLinearBitsWrite(PDLinearBits *bits, PDSize value, int nbits)
+{
+    while (nbits-- > 0) {
+        bits->acc = (bits->acc << 1) | ((value >> nbits) & 1);
+        if (++bits->nbits == 8) {
+            if (bits->len == bits->cap) {
+                bits->cap = bits->cap ? bits->cap * 2 : 256;
+                bits->buf = realloc(bits->buf, bits->cap);
+            }
+            bits->buf[bits->len++] = bits->acc;
+            bits->acc = 0;
+            bits->nbits = 0;
+        }
+    }
+}
+
+/**
+ Pad the written bits with zeros up to the next byte boundary.
+ */
+static void PDLinearBitsAlign(PDLinearBits *bits)
+{
+    if (bits->nbits > 0)
+        PDLinearBitsWrite(bits, 0, 8 - bits->nbits);
+}
+
+/**
+ The number of bits needed to represent the given value.
+ */
+static inline int PDLinearBitsFor(PDSize value)
+{
+    int n = 0;
+    for (; value; value >>= 1) n++;
+    return n;
+}
+
+/**
+ Add the references in the given value to the entry.
+ 
+ @param top The object, if value is the object's value, or NULL.
+ */
+static void PDLinearAddReferences(PDLinearEntry *entry, void *value, PDObjectRef top)
+{
+    PDInteger i, count;
+
+    switch (PDResolve(value)) {
+        case PDInstanceTypeDict: {
+            count = PDDictionaryGetCount(value);
+            char **keys = malloc(count * sizeof(char *));
+            PDDictionaryPopulateKeys(value, keys);
+            for (i = 0; i < count; i++)
+                // the parent of an object never belongs to the object, and stream lengths are written directly
+                if (! top || (strcmp(keys[i], "Parent") && (! top->hasStream || strcmp(keys[i], "Length"))))
+                    PDLinearAddReferences(entry, PDDictionaryGet(value, keys[i]), NULL);
+            free(keys);
+            break;
+        }
+
+        case PDInstanceTypeArray:
+            count = PDArrayGetCount(value);
+            for (i = 0; i < count; i++)
+                PDLinearAddReferences(entry, PDArrayGetElement(value, i), NULL);
+            break;
+
+        case PDInstanceTypeRef:
+            if (entry->refCount == entry->refCap) {
+                entry->refCap = entry->refCap ? entry->refCap * 2 : 4;
+                entry->refs = realloc(entry->refs, entry->refCap * sizeof(PDInteger));
+            }
+            entry->refs[entry->refCount++] = PDReferenceGetObjectID(value);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void PDLinearScanObject(PDParserRef parser, PDObjectRef object, PDInteger containerID, void *info)
+{
+    PDLinear *lin = info;
+    PDInteger obid = object->obid;
+    if (obid <= 0 || obid >= lin->count) return;
+
+    PDLinearEntry *entry = &lin->entries[obid];
+    void *value = PDObjectGetValue(object);
+    PDObjectDetermineType(object);
+
+    if (PDResolve(value) == PDInstanceTypeDict) {
+        // object streams are unpacked, and the XREF stream is replaced by XREF tables
+        PDStringRef type = PDDictionaryGetString(value, "Type");
+        if (type && (PDStringEqualsCString(type, "ObjStm") || PDStringEqualsCString(type, "XRef")))
+            return;
+        entry->barrier = type && (PDStringEqualsCString(type, "Page") || PDStringEqualsCString(type, "Pages") || PDStringEqualsCString(type, "Catalog"));
+    }
+
+    if (object->hasStream) {
+        entry->position = PDParserLocateStreamData(parser, obid, NULL);
+        if (entry->position == 0) {
+            PDNotice("unable to locate the stream of object %ld; it is left out", obid);
+            return;
+        }
+    }
+
+    entry->ob = PDRetain(object);
+    PDLinearAddReferences(entry, value, object);
+}
+
+static inline PDDictionaryRef PDLinearGetDictionary(PDLinear *lin, PDInteger obid)
+{
+    if (obid <= 0 || obid >= lin->count || NULL == lin->entries[obid].ob) return NULL;
+    void *value = PDObjectGetValue(lin->entries[obid].ob);
+    return PDResolve(value) == PDInstanceTypeDict ? value : NULL;
+}
+
+/**
+ Look up the attributes each page inherits from the page tree. The values are put into the pages once the objects have been renumbered; until then, only their references are added to the pages.
+ */
+static void PDLinearResolveInheritance(PDLinear *lin)
+{
+    PDInteger i, k, depth;
+
+    lin->inherited = calloc(lin->pageCount * PDLinearInheritedCount, sizeof(void *));
+
+    for (i = 0; i < lin->pageCount; i++) {
+        PDDictionaryRef page = PDLinearGetDictionary(lin, lin->pages[i]);
+        for (k = 0; k < PDLinearInheritedCount; k++) {
+            if (PDDictionaryGet(page, PDLinearInherited[k])) continue;
+
+            void *value = NULL;
+            PDDictionaryRef node = page;
+            for (depth = 0; NULL == value && node && depth < lin->count; depth++) {
+                PDReferenceRef parent = PDDictionaryGetTyped(node, "Parent", PDInstanceTypeRef);
+                node = parent ? PDLinearGetDictionary(lin, PDReferenceGetObjectID(parent)) : NULL;
+                if (node) value = PDDictionaryGet(node, PDLinearInherited[k]);
+            }
+
+            if (value) {
+                lin->inherited[i * PDLinearInheritedCount + k] = PDRetain(value);
+                PDLinearAddReferences(&lin->entries[lin->pages[i]], value, NULL);
+            }
+        }
+    }
+}
+
+/**
+ Find the objects used by the page with the given index, beginning with the page itself, and append them to the closure list.
+ */
+static void PDLinearCollectPage(PDLinear *lin, PDInteger index)
+{
+    PDLinearEntry *entries = lin->entries;
+    PDInteger head = 0, tail = 0;
+    PDInteger obid, refid, i;
+
+    obid = lin->pages[index];
+    entries[obid].mark = index + 1;
+    lin->queue[tail++] = obid;
+
+    while (head < tail) {
+        obid = lin->queue[head++];
+        if (lin->closure.count == lin->closure.cap) {
+            lin->closure.cap = lin->closure.cap ? lin->closure.cap * 2 : 64;
+            lin->closure.obids = realloc(lin->closure.obids, lin->closure.cap * sizeof(PDInteger));
+        }
+        lin->closure.obids[lin->closure.count++] = obid;
+        entries[obid].users++;
+
+        for (i = 0; i < entries[obid].refCount; i++) {
+            refid = entries[obid].refs[i];
+            if (refid <= 0 || refid >= lin->count || NULL == entries[refid].ob || entries[refid].barrier || entries[refid].mark == index + 1)
+                continue;
+            entries[refid].mark = index + 1;
+            lin->queue[tail++] = refid;
+        }
+    }
+}
+
+static inline void PDLinearPlace(PDLinear *lin, PDInteger obid, PDInteger part)
+{
+    lin->entries[obid].part = part;
+    lin->parts[part].obids[lin->parts[part].count++] = obid;
+}
+
+/**
+ Sort the objects into the parts of the output.
+ */
+static void PDLinearPlaceObjects(PDLinear *lin)
+{
+    PDLinearEntry *entries = lin->entries;
+    PDInteger i, j, obid, refid, head, tail;
+
+    for (i = PDLinearPartDocument; i <= PDLinearPartOther; i++)
+        lin->parts[i].obids = malloc(lin->count * sizeof(PDInteger));
+
+    // the first page takes everything it uses, shared or not
+    for (j = lin->closureStart[0]; j < lin->closureStart[1]; j++)
+        PDLinearPlace(lin, lin->closure.obids[j], PDLinearPartFirstPage);
+    lin->pageObjects[0] = lin->parts[PDLinearPartFirstPage].count;
+
+    // the remaining pages take their page objects and the objects only they use
+    for (i = 1; i < lin->pageCount; i++) {
+        PDInteger start = lin->parts[PDLinearPartPages].count;
+        for (j = lin->closureStart[i]; j < lin->closureStart[i+1]; j++) {
+            obid = lin->closure.obids[j];
+            if (entries[obid].part == 0 && (j == lin->closureStart[i] || entries[obid].users == 1))
+                PDLinearPlace(lin, obid, PDLinearPartPages);
+        }
+        lin->pageObjects[i] = lin->parts[PDLinearPartPages].count - start;
+    }
+
+    // objects used by several pages follow, in the order the pages use them
+    for (j = 0; j < lin->closure.count; j++) {
+        obid = lin->closure.obids[j];
+        if (entries[obid].part == 0)
+            PDLinearPlace(lin, obid, PDLinearPartShared);
+    }
+
+    // the catalog and the document level objects which are needed to display the first page go at the very beginning
+    PDInteger rootID = PDReferenceGetObjectID(lin->parser->rootRef);
+    PDLinearEntry catalogRefs = {0};
+    PDDictionaryRef catalog = PDLinearGetDictionary(lin, rootID);
+    const char *documentKeys[] = {"ViewerPreferences", "PageMode", "Threads", "OpenAction", "AcroForm"};
+    for (i = 0; i < 5; i++)
+        PDLinearAddReferences(&catalogRefs, PDDictionaryGet(catalog, documentKeys[i]), NULL);
+
+    head = tail = 0;
+    PDLinearPlace(lin, rootID, PDLinearPartDocument);
+    for (i = 0; i < catalogRefs.refCount; i++) {
+        refid = catalogRefs.refs[i];
+        if (refid > 0 && refid < lin->count && entries[refid].ob && ! entries[refid].barrier && entries[refid].part == 0) {
+            PDLinearPlace(lin, refid, PDLinearPartDocument);
+            lin->queue[tail++] = refid;
+        }
+    }
+    free(catalogRefs.refs);
+    while (head < tail) {
+        obid = lin->queue[head++];
+        for (i = 0; i < entries[obid].refCount; i++) {
+            refid = entries[obid].refs[i];
+            if (refid > 0 && refid < lin->count && entries[refid].ob && ! entries[refid].barrier && entries[refid].part == 0) {
+                PDLinearPlace(lin, refid, PDLinearPartDocument);
+                lin->queue[tail++] = refid;
+            }
+        }
+    }
+
+    // and everything else (the page tree, the info dictionary, outlines, and so on) goes at the end
+    for (obid = 1; obid < lin->count; obid++)
+        if (entries[obid].ob && entries[obid].part == 0)
+            PDLinearPlace(lin, obid, PDLinearPartOther);
+
+    // the shared object hint table lists the first page objects, followed by the objects used by several pages
+    PDInteger shared = 0;
+    for (obid = 1; obid < lin->count; obid++)
+        entries[obid].shared = -1;
+    for (i = PDLinearPartFirstPage; i <= PDLinearPartShared; i += PDLinearPartShared - PDLinearPartFirstPage)
+        for (j = 0; j < lin->parts[i].count; j++)
+            entries[lin->parts[i].obids[j]].shared = shared++;
+}
+
+/**
+ Replace references to input objects in the given value with references to the corresponding output objects. References to objects which are not in the output are pointed past the end of the output XREF table, which makes them null references.
+
+ @return A reference to put in place of value, if value itself is a reference, or NULL.
+ */
+static PDReferenceRef PDLinearRewriteValue(PDLinear *lin, void *value, PDInteger missingID)
+{
+    PDInteger i, count;
+    PDReferenceRef replacement;
+
+    switch (PDResolve(value)) {
+        case PDInstanceTypeDict: {
+            count = PDDictionaryGetCount(value);
+            char **keys = malloc(count * sizeof(char *));
+            PDDictionaryPopulateKeys(value, keys);
+            for (i = 0; i < count; i++) {
+                if ((replacement = PDLinearRewriteValue(lin, PDDictionaryGet(value, keys[i]), missingID))) {
+                    PDDictionarySet(value, keys[i], replacement);
+                    PDRelease(replacement);
+                }
+            }
+            free(keys);
+            return NULL;
+        }
+
+        case PDInstanceTypeArray:
+            count = PDArrayGetCount(value);
+            for (i = 0; i < count; i++) {
+                if ((replacement = PDLinearRewriteValue(lin, PDArrayGetElement(value, i), missingID))) {
+                    PDArrayReplaceAtIndex(value, i, replacement);
+                    PDRelease(replacement);
+                }
+            }
+            return NULL;
+
+        case PDInstanceTypeRef: {
+            PDInteger refid = PDReferenceGetObjectID(value);
+            PDBool exists = refid > 0 && refid < lin->count && lin->entries[refid].ob;
+            return PDReferenceCreate(exists ? lin->entries[refid].newid : missingID, 0);
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+/**
+ Renumber the objects in the order they are written, rewrite their references, and generate their definitions.
+
+ @param firstPageID The first object ID of the first page section.
+ @param size The number of objects in the output, plus one.
+ */
+static void PDLinearRenumberObjects(PDLinear *lin, PDInteger firstPageID, PDInteger size)
+{
+    PDLinearEntry *entries = lin->entries;
+    PDInteger i, j, k, obid;
+
+    PDInteger newid = 1;
+    for (i = PDLinearPartPages; i <= PDLinearPartOther; i++)
+        for (j = 0; j < lin->parts[i].count; j++)
+            entries[lin->parts[i].obids[j]].newid = newid++;
+
+    // the hint stream sits between the document level objects and the first page objects
+    newid = firstPageID + 1;
+    for (j = 0; j < lin->parts[PDLinearPartDocument].count; j++)
+        entries[lin->parts[PDLinearPartDocument].obids[j]].newid = newid++;
+    newid++;
+    for (j = 0; j < lin->parts[PDLinearPartFirstPage].count; j++)
+        entries[lin->parts[PDLinearPartFirstPage].obids[j]].newid = newid++;
+
+    for (obid = 1; obid < lin->count; obid++) {
+        if (NULL == entries[obid].ob) continue;
+        PDReferenceRef replacement = PDLinearRewriteValue(lin, PDObjectGetValue(entries[obid].ob), size);
+        if (replacement) {
+            PDObjectSetValue(entries[obid].ob, replacement);
+            PDRelease(replacement);
+        }
+    }
+
+    // inherited dictionaries and arrays have been renumbered as part of the page tree, but inherited references were replaced rather than changed, so they are renumbered as they are moved into the pages
+    for (i = 0; i < lin->pageCount; i++) {
+        PDDictionaryRef page = PDLinearGetDictionary(lin, lin->pages[i]);
+        for (k = 0; k < PDLinearInheritedCount; k++) {
+            void *value = lin->inherited[i * PDLinearInheritedCount + k];
+            if (NULL == value) continue;
+            PDReferenceRef replacement = PDResolve(value) == PDInstanceTypeRef ? PDLinearRewriteValue(lin, value, size) : NULL;
+            PDDictionarySet(page, PDLinearInherited[k], replacement ? replacement : value);
+            PDRelease(replacement);
+        }
+    }
+    for (obid = 1; obid < lin->count; obid++) {
+        PDDictionaryRef node = PDLinearGetDictionary(lin, obid);
+        PDStringRef type = node ? PDDictionaryGetString(node, "Type") : NULL;
+        if (type && PDStringEqualsCString(type, "Pages"))
+            for (k = 0; k < PDLinearInheritedCount; k++)
+                PDDictionaryDelete(node, PDLinearInherited[k]);
+    }
+
+    for (obid = 1; obid < lin->count; obid++) {
+        PDLinearEntry *entry = &entries[obid];
+        PDObjectRef ob = entry->ob;
+        if (NULL == ob) continue;
+
+        ob->obclass = PDObjectClassRegular;
+        ob->obid = entry->newid;
+        ob->genid = 0;
+
+        // stream lengths are written directly, as the objects holding indirect lengths may be anywhere
+        if (ob->hasStream)
+            PDDictionarySet(PDObjectGetDictionary(ob), "Length", PDNumberWithInteger(ob->streamLen));
+
+        entry->def = NULL;
+        entry->defLen = PDObjectGenerateDefinition(ob, &entry->def, 0);
+        const char *trail = ob->hasStream ? "stream\n" : "endobj\n";
+        entry->def = realloc(entry->def, entry->defLen + 8);
+        memcpy(&entry->def[entry->defLen], trail, 8);
+        entry->defLen += 7;
+        //                                                 0123456789 0123456 7
+        entry->length = entry->defLen + (ob->hasStream ? 18 + ob->streamLen : 0);
+
+        PDFlush();
+    }
+}
+
+/**
+ Build the (unfiltered) primary hint stream, i.e. the page offset hint table followed by the shared object hint table, from the object offsets and lengths.
+
+ @param sharedOffset Set to the offset of the shared object hint table in the stream.
+ */
+static PDLinearBits PDLinearBuildHints(PDLinear *lin, PDInteger *sharedOffset)
+{
+    PDLinearEntry *entries = lin->entries;
+    PDLinearBits bits = {0};
+    PDInteger i, j, obid;
+
+    // page offset hint table
+    PDInteger minObjects = lin->pageObjects[0], maxObjects = minObjects;
+    PDSize minLength = lin->pageLength[0], maxLength = minLength;
+    PDInteger maxShared = 0, sharedCount;
+    PDInteger *pageShared = calloc(lin->pageCount, sizeof(PDInteger));
+    for (i = 0; i < lin->pageCount; i++) {
+        if (lin->pageObjects[i] < minObjects) minObjects = lin->pageObjects[i];
+        if (lin->pageObjects[i] > maxObjects) maxObjects = lin->pageObjects[i];
+        if (lin->pageLength[i] < minLength) minLength = lin->pageLength[i];
+        if (lin->pageLength[i] > maxLength) maxLength = lin->pageLength[i];
+        for (j = lin->closureStart[i] + 1; j < lin->closureStart[i+1]; j++)
+            pageShared[i] += entries[lin->closure.obids[j]].users > 1;
+        if (pageShared[i] > maxShared) maxShared = pageShared[i];
+    }
+    sharedCount = lin->parts[PDLinearPartFirstPage].count + lin->parts[PDLinearPartShared].count;
+
+    int objectBits = PDLinearBitsFor(maxObjects - minObjects);
+    int lengthBits = PDLinearBitsFor(maxLength - minLength);
+    int sharedBits = PDLinearBitsFor(maxShared);
+    int identifierBits = PDLinearBitsFor(sharedCount - 1);
+
+    PDLinearBitsWrite(&bits, minObjects, 32);                                   // least number of objects in a page
+    PDLinearBitsWrite(&bits, entries[lin->pages[0]].offset, 32);                // location of the first page's page object
+    PDLinearBitsWrite(&bits, objectBits, 16);                                   // bits needed for the difference in number of objects
+    PDLinearBitsWrite(&bits, minLength, 32);                                    // least length of a page
+    PDLinearBitsWrite(&bits, lengthBits, 16);                                   // bits needed for the difference in page length
+    PDLinearBitsWrite(&bits, 0, 32);                                            // least offset to the start of the content stream
+    PDLinearBitsWrite(&bits, 0, 16);                                            // bits needed for the difference in content stream offset
+    PDLinearBitsWrite(&bits, minLength, 32);                                    // least content stream length; the page is treated as a whole
+    PDLinearBitsWrite(&bits, lengthBits, 16);                                   // bits needed for the difference in content stream length
+    PDLinearBitsWrite(&bits, sharedBits, 16);                                   // bits needed for the number of shared object references
+    PDLinearBitsWrite(&bits, identifierBits, 16);                               // bits needed for a shared object identifier
+    PDLinearBitsWrite(&bits, 0, 16);                                            // bits needed for the numerator of the fractional position
+    PDLinearBitsWrite(&bits, 1, 16);                                            // denominator of the fractional position
+
+    for (i = 0; i < lin->pageCount; i++)
+        PDLinearBitsWrite(&bits, lin->pageObjects[i] - minObjects, objectBits);
+    PDLinearBitsAlign(&bits);
+    for (i = 0; i < lin->pageCount; i++)
+        PDLinearBitsWrite(&bits, lin->pageLength[i] - minLength, lengthBits);
+    PDLinearBitsAlign(&bits);
+    for (i = 0; i < lin->pageCount; i++)
+        PDLinearBitsWrite(&bits, pageShared[i], sharedBits);
+    PDLinearBitsAlign(&bits);
+    for (i = 0; i < lin->pageCount; i++) {
+        for (j = lin->closureStart[i] + 1; j < lin->closureStart[i+1]; j++) {
+            obid = lin->closure.obids[j];
+            if (entries[obid].users > 1)
+                PDLinearBitsWrite(&bits, entries[obid].shared, identifierBits);
+        }
+    }
+    PDLinearBitsAlign(&bits);
+    // numerators take up no bits, and content stream offsets are all 0
+    for (i = 0; i < lin->pageCount; i++)
+        PDLinearBitsWrite(&bits, lin->pageLength[i] - minLength, lengthBits);
+    PDLinearBitsAlign(&bits);
+
+    free(pageShared);
+
+    // shared object hint table, with one object per group
+    *sharedOffset = bits.len;
+
+    PDSize minGroup = 0, maxGroup = 0;
+    for (i = 0; i < sharedCount; i++) {
+        PDInteger part = i < lin->parts[PDLinearPartFirstPage].count ? PDLinearPartFirstPage : PDLinearPartShared;
+        PDInteger index = part == PDLinearPartFirstPage ? i : i - lin->parts[PDLinearPartFirstPage].count;
+        PDSize length = entries[lin->parts[part].obids[index]].length;
+        if (i == 0 || length < minGroup) minGroup = length;
+        if (length > maxGroup) maxGroup = length;
+    }
+    int groupBits = PDLinearBitsFor(maxGroup - minGroup);
+
+    PDLinearList *sharedPart = &lin->parts[PDLinearPartShared];
+    PDLinearBitsWrite(&bits, sharedPart->count ? entries[sharedPart->obids[0]].newid : 0, 32);  // first object in the shared objects section
+    PDLinearBitsWrite(&bits, sharedPart->count ? entries[sharedPart->obids[0]].offset : 0, 32); // location of the first object in the shared objects section
+    PDLinearBitsWrite(&bits, lin->parts[PDLinearPartFirstPage].count, 32);      // number of shared object entries for the first page
+    PDLinearBitsWrite(&bits, sharedCount, 32);                                  // number of shared object entries
+    PDLinearBitsWrite(&bits, 0, 16);                                            // bits needed for the number of objects in a group
+    PDLinearBitsWrite(&bits, minGroup, 32);                                     // least length of a group
+    PDLinearBitsWrite(&bits, groupBits, 16);                                    // bits needed for the difference in group length
+
+    for (i = 0; i < sharedCount; i++) {
+        PDInteger part = i < lin->parts[PDLinearPartFirstPage].count ? PDLinearPartFirstPage : PDLinearPartShared;
+        PDInteger index = part == PDLinearPartFirstPage ? i : i - lin->parts[PDLinearPartFirstPage].count;
+        PDLinearBitsWrite(&bits, entries[lin->parts[part].obids[index]].length - minGroup, groupBits);
+    }
+    PDLinearBitsAlign(&bits);
+    // no groups have signatures, and all groups have a single object
+    for (i = 0; i < sharedCount; i++)
+        PDLinearBitsWrite(&bits, 0, 1);
+    PDLinearBitsAlign(&bits);
+
+    return bits;
+}
+
+/**
+ Write the given object to the output, copying its stream from the input.
+ */
+static void PDLinearWriteObject(PDLinear *lin, PDLinearEntry *entry)
+{
+    PDTwinStreamRef stream = lin->parser->stream;
+
+    PDTwinStreamInsertContent(stream, entry->defLen, entry->def);
+    if (! entry->ob->hasStream) return;
+
+    PDInteger remain = entry->ob->streamLen;
+    PDSize position = entry->position;
+    PDInteger chunk = remain < 65536 ? remain : 65536;
+    char *buf = malloc(chunk > 0 ? chunk : 1);
+    while (remain > 0) {
+        PDInteger bytes = remain < chunk ? remain : chunk;
+        PDInteger read = (PDInteger)PDTwinStreamReadInput(stream, position, bytes, buf);
+        if (read < bytes) {
+            PDWarn("stream of object %ld ends prematurely in the input", entry->newid);
+            memset(&buf[read], 0, bytes - read);
+            lin->parser->success = false;
+        }
+        PDTwinStreamInsertContent(stream, bytes, buf);
+        position += bytes;
+        remain -= bytes;
+    }
+    free(buf);
+    //                                                0123456789 0123456 7
+    PDTwinStreamInsertContent(stream, 18, "\nendstream\nendobj\n");
+}
+
+static void PDLinearDestroy(PDLinear *lin)
+{
+    PDInteger i;
+    for (i = 0; i < lin->count; i++) {
+        PDRelease(lin->entries[i].ob);
+        free(lin->entries[i].refs);
+        free(lin->entries[i].def);
+    }
+    if (lin->inherited)
+        for (i = 0; i < lin->pageCount * PDLinearInheritedCount; i++)
+            PDRelease(lin->inherited[i]);
+    for (i = 0; i < 10; i++)
+        free(lin->parts[i].obids);
+    free(lin->inherited);
+    free(lin->entries);
+    free(lin->pages);
+    free(lin->closure.obids);
+    free(lin->closureStart);
+    free(lin->pageObjects);
+    free(lin->pageLength);
+    free(lin->queue);
+}
+
+#define PDLinearWidth   10      ///< width of the values in the linearization dictionary and first page trailer which are only known once everything has been laid out
+
+PDBool PDParserWriteLinearized(PDParserRef parser)
+{
+    PDTwinStreamRef stream = parser->stream;
+    PDInteger i, j, obid;
+
+    if (PDParserGetEncryptionState(parser)) {
+        PDNotice("encrypted documents cannot be linearized");
+        return false;
+    }
+
+    PDCatalogRef catalog = parser->rootRef ? PDParserGetCatalog(parser) : NULL;
+    if (NULL == catalog || PDCatalogGetPageCount(catalog) == 0) {
+        PDNotice("documents without pages cannot be linearized");
+        return false;
+    }
+
+    PDLinear lin = {0};
+    lin.parser = parser;
+    lin.count = parser->ixt->cap;
+    lin.entries = calloc(lin.count, sizeof(PDLinearEntry));
+    lin.queue = malloc(lin.count * sizeof(PDInteger));
+
+    PDParserScanObjects(parser, PDLinearScanObject, &lin);
+
+    PDInteger rootID = PDReferenceGetObjectID(parser->rootRef);
+    PDBool success = rootID > 0 && rootID < lin.count && PDLinearGetDictionary(&lin, rootID);
+
+    lin.pageCount = PDCatalogGetPageCount(catalog);
+    lin.pages = malloc(lin.pageCount * sizeof(PDInteger));
+    for (i = 0; success && i < lin.pageCount; i++) {
+        obid = lin.pages[i] = PDCatalogGetObjectIDForPage(catalog, i + 1);
+        success = NULL != PDLinearGetDictionary(&lin, obid) && ! lin.entries[obid].mark;
+        if (success) {
+            lin.entries[obid].barrier = true;
+            lin.entries[obid].mark = -1;
+        }
+    }
+    if (! success) {
+        PDNotice("the catalog or page tree is broken or has pages appearing more than once; the document cannot be linearized");
+        lin.pageCount = i;
+        PDLinearDestroy(&lin);
+        return false;
+    }
+
+    PDLinearResolveInheritance(&lin);
+
+    // the objects used by each page are looked for page by page, which also tells which of them are shared
+    lin.closureStart = malloc((lin.pageCount + 1) * sizeof(PDInteger));
+    for (i = 0; i < lin.pageCount; i++) {
+        lin.closureStart[i] = lin.closure.count;
+        PDLinearCollectPage(&lin, i);
+    }
+    lin.closureStart[lin.pageCount] = lin.closure.count;
+    
+    lin.pageObjects = calloc(lin.pageCount, sizeof(PDInteger));
+    lin.pageLength = calloc(lin.pageCount, sizeof(PDSize));
+    PDLinearPlaceObjects(&lin);
+    
+    PDLinearList *parts = lin.parts;
+    PDInteger firstPageID = parts[PDLinearPartPages].count + parts[PDLinearPartShared].count + parts[PDLinearPartOther].count + 1;
+    PDInteger hintID = firstPageID + 1 + parts[PDLinearPartDocument].count;
+    PDInteger size = hintID + 1 + parts[PDLinearPartFirstPage].count;
+    PDLinearRenumberObjects(&lin, firstPageID, size);
+    
+    // everything up to the first page XREF table is written with the values in the linearization dictionary and first page trailer left blank, to find out where everything goes
+    PDOffset headerLength = PDTwinStreamGetOutputOffset(stream);
+    if (headerLength == 0) {
+        PDTwinStreamInsertContent(stream, 15, "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n");
+        headerLength = 15;
+    }
+    
+    PDDictionaryRef trailer = PDObjectGetDictionary(parser->trailer);
+    PDArrayRef ids = PDDictionaryGetTyped(trailer, "ID", PDInstanceTypeArray);
+    char *idString = ids ? PDArrayToString(ids) : NULL;
+    PDInteger infoID = parser->infoRef ? PDReferenceGetObjectID(parser->infoRef) : 0;
+    char infoString[32] = "";
+    if (infoID > 0 && infoID < lin.count && lin.entries[infoID].ob) 
+        sprintf(infoString, " /Info %ld 0 R", lin.entries[infoID].newid);
+    
+    PDInteger firstPageCount = size - firstPageID;
+    char *linDef = malloc(200 + (idString ? strlen(idString) : 0));
+    char *trailerDef = malloc(200 + (idString ? strlen(idString) : 0));
+    char xrefHeader[64];
+    PDOffset L = 0, E = 0, T = 0, H = 0, hintLen = 0, mainXref = 0;
+    PDInteger linLen = 0, trailerLen = 0;
+    
+#define PDLinearFormatHead() \
+    linLen = sprintf(linDef, "%ld 0 obj\n<< /Linearized 1 /L %-*lld /H [ %-*lld %-*lld ] /O %ld /E %-*lld /N %ld /T %-*lld >>\nendobj\n", \
+                     firstPageID, PDLinearWidth, L, PDLinearWidth, H, PDLinearWidth, hintLen, lin.entries[lin.pages[0]].newid, PDLinearWidth, E, lin.pageCount, PDLinearWidth, T); \
+    trailerLen = sprintf(trailerDef, "trailer\n<< /Size %ld /Prev %-*lld /Root %ld 0 R%s%s%s >>\nstartxref\n0\n%%%%EOF\n", \
+                         size, PDLinearWidth, mainXref, lin.entries[rootID].newid, infoString, idString ? " /ID " : "", idString ? idString : "")
+    
+    PDLinearFormatHead();
+    PDInteger xrefHeaderLen = sprintf(xrefHeader, "xref\n%ld %ld\n", firstPageID, firstPageCount);
+    PDOffset firstPageXref = headerLength + linLen;
+    PDOffset offset = firstPageXref + xrefHeaderLen + 20 * firstPageCount + trailerLen;
+    
+    // offsets are first determined as if the hint stream was not there, which is how the hint tables express them
+    for (i = PDLinearPartDocument; i <= PDLinearPartOther; i++) {
+        if (i == PDLinearPartFirstPage) H = offset;
+        for (j = 0; j < parts[i].count; j++) {
+            PDLinearEntry *entry = &lin.entries[parts[i].obids[j]];
+            entry->offset = offset;
+            offset += entry->length;
+        }
+    }
+    mainXref = offset;
+    
+    for (j = 0; j < parts[PDLinearPartFirstPage].count; j++) 
+        lin.pageLength[0] += lin.entries[parts[PDLinearPartFirstPage].obids[j]].length;
+    for (i = 1, j = 0; i < lin.pageCount; i++) 
+        for (PDInteger k = 0; k < lin.pageObjects[i]; k++, j++) 
+            lin.pageLength[i] += lin.entries[parts[PDLinearPartPages].obids[j]].length;
+    
+    PDInteger sharedOffset;
+    PDLinearBits bits = PDLinearBuildHints(&lin, &sharedOffset);
+    
+    PDObjectRef hint = PDObjectCreate(hintID, 0);
+    hint->compressionLevel = parser->compressionLevel;
+    PDObjectSetFlateDecodedFlag(hint, true);
+    PDDictionarySet(PDObjectGetDictionary(hint), "S", PDNumberWithInteger(sharedOffset));
+    success = PDObjectSetStreamFiltered(hint, (char *)bits.buf, bits.len, true, false);
+    char *hintDef = NULL;
+    PDInteger hintDefLen = PDObjectGenerateDefinition(hint, &hintDef, 0);
+    //                         012345 6              0123456789 0123456 7
+    hintLen = hintDefLen + 7 + hint->ovrStreamLen + 18;
+    
+    // with the hint stream in place, everything after it moves ahead by its length
+    E = H + hintLen;
+    for (j = 0; j < parts[PDLinearPartFirstPage].count; j++) 
+        E += lin.entries[parts[PDLinearPartFirstPage].obids[j]].length;
+    mainXref += hintLen;
+    PDInteger mainHeaderLen = sprintf(xrefHeader, "xref\n0 %ld\n", firstPageID);
+    T = mainXref + mainHeaderLen - 1;
+    
+    char mainTrailer[128];
+    PDInteger mainTrailerLen = sprintf(mainTrailer, "trailer\n<< /Size %ld >>\nstartxref\n%lld\n%%%%EOF\n", size, firstPageXref);
+    L = T + 1 + 20 * firstPageID + mainTrailerLen;
+    
+    PDInteger blankLinLen = linLen, blankTrailerLen = trailerLen;
+    PDLinearFormatHead();
+    if (linLen != blankLinLen || trailerLen != blankTrailerLen) {
+        PDNotice("the output is too large to be linearized");
+        success = false;
+    }
+#undef PDLinearFormatHead
+    
+    if (success) {
+        char entry[21];
+        
+        PDTwinStreamInsertContent(stream, linLen, linDef);
+        PDTwinStreamInsertContent(stream, sprintf(xrefHeader, "xref\n%ld %ld\n", firstPageID, firstPageCount), xrefHeader);
+        PDTwinStreamInsertContent(stream, sprintf(entry, "%010lld %05d n \n", headerLength, 0), entry);
+        for (j = 0; j < parts[PDLinearPartDocument].count; j++) 
+            PDTwinStreamInsertContent(stream, sprintf(entry, "%010lld %05d n \n", lin.entries[parts[PDLinearPartDocument].obids[j]].offset, 0), entry);
+        PDTwinStreamInsertContent(stream, sprintf(entry, "%010lld %05d n \n", H, 0), entry);
+        for (j = 0; j < parts[PDLinearPartFirstPage].count; j++) 
+            PDTwinStreamInsertContent(stream, sprintf(entry, "%010lld %05d n \n", lin.entries[parts[PDLinearPartFirstPage].obids[j]].offset + hintLen, 0), entry);
+        PDTwinStreamInsertContent(stream, trailerLen, trailerDef);
+        
+        for (j = 0; j < parts[PDLinearPartDocument].count; j++) 
+            PDLinearWriteObject(&lin, &lin.entries[parts[PDLinearPartDocument].obids[j]]);
+        
+        PDTwinStreamInsertContent(stream, hintDefLen, hintDef);
+        PDTwinStreamInsertContent(stream, 7, "stream\n");
+        PDTwinStreamInsertContent(stream, hint->ovrStreamLen, hint->ovrStream);
+        PDTwinStreamInsertContent(stream, 18, "\nendstream\nendobj\n");
+        
+        for (i = PDLinearPartFirstPage; i <= PDLinearPartOther; i++) 
+            for (j = 0; j < parts[i].count; j++) 
+                PDLinearWriteObject(&lin, &lin.entries[parts[i].obids[j]]);
+        
+        PDTwinStreamInsertContent(stream, sprintf(xrefHeader, "xref\n0 %ld\n", firstPageID), xrefHeader);
+        PDTwinStreamInsertContent(stream, 20, "0000000000 65535 f \n");
+        for (i = PDLinearPartPages; i <= PDLinearPartOther; i++) 
+            for (j = 0; j < parts[i].count; j++) 
+                PDTwinStreamInsertContent(stream, sprintf(entry, "%010lld %05d n \n", lin.entries[parts[i].obids[j]].offset + hintLen, 0), entry);
+        PDTwinStreamInsertContent(stream, mainTrailerLen, mainTrailer);
+        
+        PDOffset written = PDTwinStreamGetOutputOffset(stream);
+        success = parser->success;
+        if (success && written != L) {
+            PDWarn("linearized output is %lld bytes rather than the expected %lld", written, L);
+            success = false;
+        }
+    }
+    
+    PDRelease(hint);
+    free(hintDef);
+    free(linDef);
+    free(trailerDef);
+    free(idString);
+    PDLinearDestroy(&lin);
+    
+    return success;
+}
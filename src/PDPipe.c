@@ -36,15 +36,33 @@
 #include "PDObjectStream.h"
 #include "PDXTable.h"
 #include "PDString.h"
+#include "PDWorkQueue.h"
+#include "PDArray.h"
+#include "pd_sha2.h"
 
 static char *PDFTypeStrings[_PDFTypeCount] = {kPDFTypeStrings};
 
 static int PDPipeFileDescriptorBalance = 0;
 
+#ifdef PD_SUPPORT_THREADS
+static pthread_mutex_t PDPipeFileDescriptorLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static inline int PDPipeFileDescriptorBalanceAdd(int delta)
+{
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_lock(&PDPipeFileDescriptorLock);
+#endif
+    int balance = PDPipeFileDescriptorBalance += delta;
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_unlock(&PDPipeFileDescriptorLock);
+#endif
+    return balance;
+}
+
 void PDPipeCloseFileStream(FILE *stream)
 {
-    PDPipeFileDescriptorBalance--;
-    if (PDPipeFileDescriptorBalance > 64) {
+    if (PDPipeFileDescriptorBalanceAdd(-1) > 64) {
         PDError("Excess file descriptors -- PDPipeRefs are probably leaking!");
     }
     fclose(stream);
@@ -52,13 +70,13 @@ void PDPipeCloseFileStream(FILE *stream)
 
 FILE *PDPipeOpenInputStream(const char *path)
 {
-    PDPipeFileDescriptorBalance++;
+    PDPipeFileDescriptorBalanceAdd(1);
     return fopen(path, "r");
 }
 
 FILE *PDPipeOpenOutputStream(const char *path)
 {
-    PDPipeFileDescriptorBalance++;
+    PDPipeFileDescriptorBalanceAdd(1);
     return fopen(path, "w+");
 }
 
@@ -78,7 +96,9 @@ void PDPipeDestroy(PDPipeRef pipe)
     }
     free(pipe->pi);
     free(pipe->po);
+    free(pipe->px);
     PDRelease(pipe->filter);
+    PDRelease(pipe->deferred);
     PDRelease(pipe->attachments);
     
     for (int i = 0; i < _PDFTypeCount; i++) {
@@ -129,9 +149,10 @@ PDTaskResult PDPipeObStreamMutation(PDPipeRef pipe, PDTaskRef task, PDObjectRef
     pd_stack mutators;
     pd_stack iter;
     char *stmbuf;
+    PDInteger i;
     
     obstm = PDObjectStreamCreateWithObject(object);
-    stmbuf = PDParserFetchCurrentObjectStream(pipe->parser, object->obid);
+    stmbuf = (char *)PDParserLocateAndFetchObjectStreamForObject(pipe->parser, object);
     PDObjectStreamParseExtractedObjectStream(obstm, stmbuf);
     
     mutators = info;
@@ -146,11 +167,25 @@ PDTaskResult PDPipeObStreamMutation(PDPipeRef pipe, PDTaskRef task, PDObjectRef
         if (PDTaskFailure == PDTaskExec(subTask->child, pipe, ob)) {
             return PDTaskFailure;
         }
+        
+        // deleted objects are left out of the object stream when it is committed; the entry is freed, with the generation number it would have if it was reused
+        if (ob->deleteObject) {
+            PDXTableSetTypeForID(pipe->parser->mxt, ob->obid, PDXTypeFreed);
+            PDXTableSetOffsetForID(pipe->parser->mxt, ob->obid, 0);
+            PDXTableSetGenForID(pipe->parser->mxt, ob->obid, 1);
+        }
+        
         iter = iter->prev;
     }
     
     PDObjectStreamCommit(obstm);
     
+    // leaving out deleted objects shifts the indices of the remaining ones
+    for (i = 0; i < obstm->n; i++) {
+        if (PDXTypeComp == PDXTableGetTypeForID(pipe->parser->mxt, obstm->elements[i].obid))
+            PDXTableSetGenForID(pipe->parser->mxt, obstm->elements[i].obid, i);
+    }
+    
     return PDTaskDone;
 }
 
@@ -197,16 +232,27 @@ void PDPipeAddTask(PDPipeRef pipe, PDTaskRef task)
         
         // if this is a reference to an object inside an object stream, we have to pull that open
         PDInteger containerOb = PDParserGetContainerObjectIDForObject(pipe->parser, key);
+        
+        // objects which have been written already (or which are being written in an incremental update) are mutated in an incremental update at the end
+        PDSplayTreeRef filter = pipe->filter;
+        if (key > 0 && (pipe->parser->updates || ! PDParserIsObjectStillMutable(pipe->parser, key))) {
+            if (! pipe->parser->updates) 
+                PDNotice("object %ld has already been written; its mutation is deferred to an incremental update", key);
+            if (NULL == pipe->deferred) 
+                pipe->deferred = PDSplayTreeCreateWithDeallocator(PDReleaseFunc);
+            filter = pipe->deferred;
+        }
+        
         if (containerOb != -1) {
             // force the value into the task, in case this was a root or info req
             task->value = key;
-            PDTaskRef containerTask = PDSplayTreeGet(pipe->filter, containerOb);
+            PDTaskRef containerTask = PDSplayTreeGet(filter, containerOb);
             //pd_btree_fetch(pipe->filter, containerOb);
             if (NULL == containerTask) {
                 // no container task yet so we set one up
                 containerTask = PDTaskCreateMutator(PDPipeObStreamMutation);
-                pipe->filterCount++;
-                PDSplayTreeInsert(pipe->filter, containerOb, containerTask);
+                if (filter == pipe->filter) pipe->filterCount++;
+                PDSplayTreeInsert(filter, containerOb, containerTask);
                 //pd_btree_insert(&pipe->filter, containerOb, containerTask);
                 containerTask->info = NULL;
             }
@@ -214,24 +260,17 @@ void PDPipeAddTask(PDPipeRef pipe, PDTaskRef task)
             return;
         }
         
-        PDTaskRef sibling = PDSplayTreeGet(pipe->filter, key);
+        PDTaskRef sibling = PDSplayTreeGet(filter, key);
         //pd_btree_fetch(pipe->filter, key);
         if (sibling) {
             // same filters; merge
             PDTaskAppendTask(sibling, task->child);
         } else {
             // not same filters; include
-            pipe->filterCount++;
-            PDSplayTreeInsert(pipe->filter, key, PDRetain(task->child));
+            if (filter == pipe->filter) pipe->filterCount++;
+            PDSplayTreeInsert(filter, key, PDRetain(task->child));
             //pd_btree_insert(&pipe->filter, key, PDRetain(task->child));
         }
-        
-        if (pipe->opened && ! PDParserIsObjectStillMutable(pipe->parser, key)) {
-            // pipe's open and we've already passed the object being filtered
-            PDError("*** object %ld cannot be accessed as it has already been written ***\n", key);
-            PDParserIsObjectStillMutable(pipe->parser, key);
-            PDAssert(0); // crash = logic is flawed; object in question should be fetched after preparing pipe rather than dynamically appending filters as data is obtained; worst case, do two passes (one where the id of the offending object is determined and one where the mutations are made)
-        }
     } else {
         // task executes on every iteration
         pd_stack_push_identifier(&pipe->typeTasks[0], (PDID)PDRetain(task));
@@ -256,6 +295,66 @@ PDObjectRef PDPipeGetRootObject(PDPipeRef pipe)
     return PDParserGetRootObject(pipe->parser);
 }
 
+void PDPipeSetIndexFilePath(PDPipeRef pipe, const char *indexPath)
+{
+    PDAssert(! pipe->opened); // crash = the index must be set before the pipe is prepared
+    free(pipe->px);
+    pipe->px = indexPath ? strdup(indexPath) : NULL;
+}
+
+void PDPipeSetCompressionLevel(PDPipeRef pipe, PDInteger level)
+{
+    pipe->compressionLevel = level;
+    if (pipe->parser) pipe->parser->compressionLevel = level;
+}
+
+void PDPipeSetWorkerCount(PDPipeRef pipe, PDInteger count)
+{
+    PDAssert(! pipe->opened); // crash = the worker count must be set before the pipe is prepared
+    pipe->workerCount = count;
+}
+
+void PDPipeSetStreamPrefetching(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->prefetchStreams = enabled;
+}
+
+void PDPipeSetIncrementalUpdate(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->incrementalUpdate = enabled;
+}
+
+void PDPipeSetSharding(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->sharding = enabled;
+}
+
+void PDPipeSetDeduplication(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->deduplicate = enabled;
+}
+
+PDSize PDPipeGetDeduplicationSavings(PDPipeRef pipe, PDInteger *objectCount)
+{
+    if (objectCount) *objectCount = pipe->dedupObjects;
+    return pipe->dedupBytes;
+}
+
+void PDPipeSetGarbageCollection(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->collectGarbage = enabled;
+}
+
+void PDPipeSetObjectStreamPacking(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->packObjects = enabled;
+}
+
+void PDPipeSetLinearization(PDPipeRef pipe, PDBool enabled)
+{
+    pipe->linearize = enabled;
+}
+
 PDBool PDPipePrepare(PDPipeRef pipe)
 {
     if (pipe->opened) {
@@ -278,19 +377,12 @@ PDBool PDPipePrepare(PDPipeRef pipe)
     pipe->opened = true;
     
     pipe->stream = PDTwinStreamCreate(pipe->fi, pipe->fo);
-    pipe->parser = PDParserCreateWithStream(pipe->stream);
+    pipe->parser = PDParserCreateWithStreamAndIndex(pipe->stream, pipe->px);
     
     if (pipe->parser) {
-#ifdef PD_SUPPORT_CRYPTO
-        if (pipe->parser->crypto) {
-            if (pipe->parser->crypto->cfMethod == pd_crypto_method_aesv2) {
-                // we don't support AES right now
-                PDWarn("AES unsupported; pipe prepare failed for input file %s", pipe->pi);
-                return false;
-            }
-        }
-#endif
-            
+        pipe->parser->compressionLevel = pipe->compressionLevel;
+        if (pipe->workerCount > 0) 
+            PDParserSetWorkerCount(pipe->parser, pipe->workerCount);
         pipe->filter = PDSplayTreeCreateWithDeallocator(PDReleaseFunc);
     }
 
@@ -329,22 +421,947 @@ static inline PDBool PDPipeRunStackedTasks(PDPipeRef pipe, PDParserRef parser, p
     return true;
 }
 
+/**
+ Determine the index of the current object's type in the pipe's type tasks.
+ 
+ @return The index, or 0 if the object is not of a type which tasks exist for.
+ */
+static int PDPipeGetTypeIndex(PDPipeRef pipe)
+{
+    // @todo this really needs to be streamlined; for starters, a PDState object could be used to set up types instead of O(n)'ing
+    PDObjectRef obj = PDParserConstructObject(pipe->parser);
+    if (PDObjectTypeDictionary != PDObjectGetType(obj)) 
+        return 0;
+    
+    PDStringRef pt = PDDictionaryGet(PDObjectGetDictionary(obj), "Type");
+    if (pt) {
+        for (int pti = 1; pti < _PDFTypeCount; pti++) // not = 0, because 0 = NULL and is reserved for 'unfiltered'
+            if (PDStringEqualsCString(pt, PDFTypeStrings[pti]))
+                return pti;
+    }
+    return 0;
+}
+
+/**
+ The tasks of a sharded object.
+ */
+typedef struct PDPipeShardTasks {
+    PDPipeRef pipe;                 ///< the pipe
+    PDTaskRef *tasks;               ///< the task chains, in the order they are run
+    PDInteger count;                ///< number of task chains
+    PDInteger cap;                  ///< capacity of tasks
+} PDPipeShardTasks;
+
+static void PDPipeShardTasksDestroy(void *info)
+{
+    PDPipeShardTasks *st = info;
+    free(st->tasks);
+    free(st);
+}
+
+/**
+ Add a task chain to the given shard tasks.
+ 
+ @return true if every task in the chain is independent.
+ */
+static PDBool PDPipeShardTasksAdd(PDPipeShardTasks *st, PDTaskRef task)
+{
+    if (st->count == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 4;
+        st->tasks = realloc(st->tasks, sizeof(PDTaskRef) * st->cap);
+    }
+    st->tasks[st->count++] = task;
+    
+    for (; task; task = task->child) 
+        if (! task->isIndependent) return false;
+    return true;
+}
+
+static PDBool PDPipeShardTasksAddStacked(PDPipeShardTasks *st, pd_stack stack)
+{
+    PDBool independent = true;
+    pd_stack iter;
+    
+    pd_stack_for_each(stack, iter) {
+        independent &= PDPipeShardTasksAdd(st, iter->info);
+    }
+    return independent;
+}
+
+/**
+ Run the tasks of a sharded object. This is on a worker thread, which is why tasks are not unloaded; other threads may be running them.
+ */
+static PDBool PDPipeRunShardedTasks(PDParserRef parser, PDObjectRef object, void *info)
+{
+    PDPipeShardTasks *st = info;
+    PDTaskRef task;
+    PDTaskResult result;
+    
+    for (PDInteger i = 0; i < st->count; i++) {
+        for (task = st->tasks[i]; task; task = task->child) {
+            result = task->isActive ? (*task->func)(st->pipe, task, object, task->info) : PDTaskDone;
+            if (PDTaskFailure == result) return false;
+            if (PDTaskSkipRest == result) break;
+        }
+    }
+    return true;
+}
+
+/**
+ Hand the current object over to the parser's worker threads, if it has tasks, and they are all independent.
+ 
+ @return true if the object was dealt with, i.e. it was handed over or it has no tasks; false if its tasks have to be run on this thread.
+ */
+static PDBool PDPipeShardCurrentObject(PDPipeRef pipe, PDStaticHashRef sht)
+{
+    PDParserRef parser = pipe->parser;
+    PDTaskRef task;
+    int pti;
+    
+    // the tasks are gathered in the same order as they are run in, when not sharding
+    PDPipeShardTasks *st = calloc(1, sizeof(PDPipeShardTasks));
+    st->pipe = pipe;
+    
+    PDBool independent = PDPipeShardTasksAddStacked(st, pipe->typeTasks[0]);
+    if (pipe->dynamicFiltering || PDStaticHashValueForKey(sht, parser->obid)) {
+        task = PDSplayTreeGet(pipe->filter, parser->obid);
+        if (task) 
+            independent &= PDPipeShardTasksAdd(st, task);
+        
+        if (pipe->typedTasks && (pti = PDPipeGetTypeIndex(pipe))) 
+            independent &= PDPipeShardTasksAddStacked(st, pipe->typeTasks[pti]);
+    }
+    
+    if (st->count > 0 && independent && PDParserShardCurrentObject(parser, PDPipeRunShardedTasks, st, PDPipeShardTasksDestroy)) 
+        return true;
+    
+    PDBool handled = st->count == 0;
+    PDPipeShardTasksDestroy(st);
+    return handled;
+}
+
+static PDTaskResult PDPipeDeleteObject(PDPipeRef pipe, PDTaskRef task, PDObjectRef object, void *info)
+{
+    PDObjectDelete(object);
+    return PDTaskDone;
+}
+
+/**
+ An object in the input, as seen by garbage collection.
+ */
+typedef struct PDPipeGCEntry {
+    PDInteger *refs;                ///< IDs of the objects referenced by the object
+    PDInteger refCount;             ///< number of references
+    PDInteger refCap;               ///< capacity of refs
+    PDInteger containerID;          ///< ID of the object stream containing the object, or 0
+    PDBool scanned;                 ///< whether the object was scanned, i.e. whether refs is known
+    PDBool root;                    ///< whether the object is reachable no matter what, e.g. because it is an XREF stream
+} PDPipeGCEntry;
+
+/**
+ Garbage collection state of a pipe.
+ */
+typedef struct PDPipeGC {
+    PDInteger count;                ///< number of entries; this is the capacity of the input XREF table
+    PDPipeGCEntry *entries;         ///< entries, by object ID
+    PDBool *reached;                ///< whether each object has been reached, by object ID
+    PDInteger *queue;               ///< IDs of the reached objects, in the order they were reached
+    PDInteger queued;               ///< number of reached objects
+} PDPipeGC;
+
+static inline void PDPipeGCReach(PDPipeGC *gc, PDInteger obid)
+{
+    if (obid > 0 && obid < gc->count && ! gc->reached[obid]) {
+        gc->reached[obid] = true;
+        gc->queue[gc->queued++] = obid;
+    }
+}
+
+static void PDPipeGCAddReferences(PDPipeGCEntry *entry, void *value)
+{
+    PDInteger i, count;
+    
+    switch (PDResolve(value)) {
+        case PDInstanceTypeDict: {
+            count = PDDictionaryGetCount(value);
+            char **keys = malloc(count * sizeof(char *));
+            PDDictionaryPopulateKeys(value, keys);
+            for (i = 0; i < count; i++) 
+                PDPipeGCAddReferences(entry, PDDictionaryGet(value, keys[i]));
+            free(keys);
+            break;
+        }
+            
+        case PDInstanceTypeArray:
+            count = PDArrayGetCount(value);
+            for (i = 0; i < count; i++) 
+                PDPipeGCAddReferences(entry, PDArrayGetElement(value, i));
+            break;
+            
+        case PDInstanceTypeRef:
+            if (entry->refCount == entry->refCap) {
+                entry->refCap = entry->refCap ? entry->refCap * 2 : 4;
+                entry->refs = realloc(entry->refs, entry->refCap * sizeof(PDInteger));
+            }
+            entry->refs[entry->refCount++] = PDReferenceGetObjectID(value);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+static void PDPipeGCScanObject(PDParserRef parser, PDObjectRef object, PDInteger containerID, void *info)
+{
+    PDPipeGC *gc = info;
+    PDInteger obid = object->obid;
+    if (obid <= 0 || obid >= gc->count) return;
+    
+    PDPipeGCEntry *entry = &gc->entries[obid];
+    void *value = PDObjectGetValue(object);
+    
+    entry->scanned = true;
+    entry->containerID = containerID;
+    PDPipeGCAddReferences(entry, value);
+    
+    // XREF streams are not referenced by anything, but their dictionaries are trailers
+    if (PDResolve(value) == PDInstanceTypeDict) {
+        PDStringRef type = PDDictionaryGetString(value, "Type");
+        entry->root = type && PDStringEqualsCString(type, "XRef");
+    }
+}
+
+/**
+ Find the objects in the input which cannot be reached from the trailer, and leave them out of the output.
+ 
+ Objects which are not compressed are dropped by the parser, without being read; objects inside of object streams which are kept are given tasks deleting them.
+ */
+static void PDPipeCollectGarbage(PDPipeRef pipe)
+{
+    PDParserRef parser = pipe->parser;
+    PDXTableRef ixt = parser->ixt;
+    PDInteger i, j, count = ixt->cap;
+    PDInteger dropped;
+    
+    PDPipeGC gc;
+    gc.count = count;
+    gc.entries = calloc(count, sizeof(PDPipeGCEntry));
+    gc.reached = calloc(count, sizeof(PDBool));
+    gc.queue = malloc(count * sizeof(PDInteger));
+    gc.queued = 0;
+    
+    PDParserScanObjects(parser, PDPipeGCScanObject, &gc);
+    
+    // the objects referred to by the trailer, and objects targeted by tasks, are where the search begins
+    PDReferenceRef trailerRefs[] = {parser->rootRef, parser->infoRef, parser->encryptRef};
+    for (i = 0; i < 3; i++) 
+        if (trailerRefs[i]) 
+            PDPipeGCReach(&gc, PDReferenceGetObjectID(trailerRefs[i]));
+    
+    PDInteger *obids = malloc(pipe->filterCount * sizeof(PDInteger));
+    PDSplayTreePopulateKeys(pipe->filter, obids);
+    for (i = 0; i < pipe->filterCount; i++) {
+        PDTaskRef task = PDSplayTreeGet(pipe->filter, obids[i]);
+        PDPipeGCReach(&gc, obids[i]);
+        if (task->func == PDPipeObStreamMutation) {
+            pd_stack iter;
+            pd_stack_for_each((pd_stack)task->info, iter) 
+                PDPipeGCReach(&gc, as(PDTaskRef, iter->info)->value);
+        }
+    }
+    free(obids);
+    
+    for (i = 1; i < count; i++) 
+        if (gc.entries[i].root) 
+            PDPipeGCReach(&gc, i);
+    
+    // object streams are kept for as long as anything inside of them is
+    PDBool complete = true;
+    for (i = 0; i < gc.queued; i++) {
+        PDPipeGCEntry *entry = &gc.entries[gc.queue[i]];
+        if (! entry->scanned && PDXTypeFreed != PDXTableGetTypeForID(ixt, gc.queue[i])) 
+            complete = false;
+        for (j = 0; j < entry->refCount; j++) 
+            PDPipeGCReach(&gc, entry->refs[j]);
+        PDPipeGCReach(&gc, entry->containerID);
+    }
+    
+    dropped = 0;
+    if (! complete) {
+        // the references of some reachable object are unknown, so anything could be reachable
+        PDNotice("some objects could not be scanned; unreachable objects are not left out");
+    } else {
+        pipe->unreachable = calloc(count, sizeof(PDBool));
+        for (i = 1; i < count; i++) {
+            if (gc.reached[i] || ! gc.entries[i].scanned) continue;
+            
+            pipe->unreachable[i] = true;
+            dropped++;
+            
+            // the objects inside of unreachable object streams go with them
+            PDInteger containerID = gc.entries[i].containerID;
+            if (containerID && ! gc.reached[containerID]) {
+                PDXTableSetTypeForID(parser->mxt, i, PDXTypeFreed);
+                PDXTableSetOffsetForID(parser->mxt, i, 0);
+                PDXTableSetGenForID(parser->mxt, i, 1);
+                continue;
+            }
+            
+            if (containerID || ! PDParserDropObject(parser, i)) {
+                PDTaskRef task = PDTaskCreateMutatorForObject(i, PDPipeDeleteObject);
+                PDTaskSetIndependent(task, true);
+                PDPipeAddTask(pipe, task);
+                PDRelease(task);
+            }
+        }
+        PDNotice("garbage collection left out %ld unreachable objects", dropped);
+    }
+    
+    for (i = 0; i < count; i++) 
+        free(gc.entries[i].refs);
+    free(gc.entries);
+    free(gc.reached);
+    free(gc.queue);
+}
+
+#define PDPipeDedupMaxPasses    32      ///< Number of passes after which deduplication settles for what it has found
+
+/**
+ An object in the input, as seen by deduplication.
+ */
+typedef struct PDPipeDedupEntry {
+    char *canon;                    ///< canonical definition of the object, with references left out, or NULL if the object was not scanned
+    PDInteger canonLen;             ///< length of canon
+    PDInteger *refs;                ///< IDs of the objects referenced by the object, in order, followed by the positions in canon at which they were left out
+    PDInteger refCount;             ///< number of references
+    PDInteger genid;                ///< generation number of the object
+    PDSize size;                    ///< approximate number of bytes the object takes up in the output
+    PDBool candidate;               ///< whether the object may be replaced by, or replace, an identical object
+    PDBool hasStream;               ///< whether the object has a stream
+    unsigned char streamDigest[32]; ///< digest of the decoded stream, if the object has a stream
+} PDPipeDedupEntry;
+
+/**
+ Deduplication state of a pipe.
+ */
+struct PDPipeDedup {
+    PDPipeRef pipe;                 ///< the pipe (not retained)
+    PDInteger count;                ///< number of entries; this is the capacity of the input XREF table
+    PDPipeDedupEntry *entries;      ///< entries, by object ID
+    PDInteger *survivors;           ///< the object replacing each object, by object ID; objects which are kept replace themselves
+    PDBool *excluded;               ///< whether objects must be left alone, e.g. because they have tasks, by object ID
+    PDInteger *streams;             ///< IDs of the candidates with streams
+    PDInteger streamCount;          ///< number of candidates with streams
+    PDInteger streamCap;            ///< capacity of streams
+};
+
+/**
+ Canonical definition of an object being built.
+ */
+typedef struct PDPipeDedupCanon {
+    char *buf;                      ///< the definition
+    PDInteger len;                  ///< length of the definition
+    PDInteger cap;                  ///< capacity of buf
+    PDInteger *refs;                ///< referenced object IDs
+    PDInteger *refPos;              ///< positions of the references in buf
+    PDInteger refCount;             ///< number of references
+    PDInteger refCap;               ///< capacity of refs and refPos
+    PDBool encrypted;               ///< whether strings are encrypted, and thus cannot be compared
+    PDBool comparable;              ///< whether the definition can be compared to that of other objects
+} PDPipeDedupCanon;
+
+static void PDPipeDedupDestroy(struct PDPipeDedup *dd)
+{
+    for (PDInteger i = 0; i < dd->count; i++) {
+        free(dd->entries[i].canon);
+        free(dd->entries[i].refs);
+    }
+    free(dd->entries);
+    free(dd->survivors);
+    free(dd->excluded);
+    free(dd->streams);
+    free(dd);
+}
+
+static int PDPipeDedupCompareKeys(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void PDPipeDedupCanonAppend(PDPipeDedupCanon *c, const char *str, PDInteger len)
+{
+    if (c->cap - c->len < len) {
+        c->cap = (c->cap + len) * 2;
+        c->buf = realloc(c->buf, c->cap);
+    }
+    memcpy(&c->buf[c->len], str, len);
+    c->len += len;
+}
+
+/**
+ Append the canonical form of the given value, which is the way it is printed except that dictionary keys are sorted and references are left out (and recorded).
+ 
+ @param skipLength Whether the /Length key is left out, if value is a dictionary.
+ */
+static void PDPipeDedupCanonicalize(PDPipeDedupCanon *c, void *value, PDBool skipLength)
+{
+    PDInteger i, count;
+    
+    switch (PDResolve(value)) {
+        case PDInstanceTypeDict: {
+            PDDictionaryRef dict = value;
+            count = PDDictionaryGetCount(dict);
+            char **keys = malloc(count * sizeof(char *));
+            PDDictionaryPopulateKeys(dict, keys);
+            qsort(keys, count, sizeof(char *), PDPipeDedupCompareKeys);
+            PDPipeDedupCanonAppend(c, "<<", 2);
+            for (i = 0; i < count; i++) {
+                if (skipLength && ! strcmp(keys[i], "Length")) continue;
+                PDPipeDedupCanonAppend(c, "/", 1);
+                PDPipeDedupCanonAppend(c, keys[i], strlen(keys[i]));
+                PDPipeDedupCanonAppend(c, " ", 1);
+                PDPipeDedupCanonicalize(c, PDDictionaryGet(dict, keys[i]), false);
+            }
+            PDPipeDedupCanonAppend(c, ">>", 2);
+            free(keys);
+            break;
+        }
+            
+        case PDInstanceTypeArray:
+            count = PDArrayGetCount(value);
+            PDPipeDedupCanonAppend(c, "[", 1);
+            for (i = 0; i < count; i++) 
+                PDPipeDedupCanonicalize(c, PDArrayGetElement(value, i), false);
+            PDPipeDedupCanonAppend(c, "]", 1);
+            break;
+            
+        case PDInstanceTypeRef:
+            if (c->refCount == c->refCap) {
+                c->refCap = c->refCap ? c->refCap * 2 : 8;
+                c->refs = realloc(c->refs, c->refCap * sizeof(PDInteger));
+                c->refPos = realloc(c->refPos, c->refCap * sizeof(PDInteger));
+            }
+            c->refs[c->refCount] = PDReferenceGetObjectID(value);
+            c->refPos[c->refCount++] = c->len;
+            PDPipeDedupCanonAppend(c, "R ", 2);
+            break;
+            
+        case PDInstanceTypeString:
+        case PDInstanceTypeNumber:
+        case PDInstanceTypeNull:
+            // strings of encrypted objects are encrypted with the key of the object, so identical strings are not identical
+            if (c->encrypted && PDResolve(value) == PDInstanceTypeString && PDStringGetType(value) != PDStringTypeName) 
+                c->comparable = false;
+            c->len = (*PDInstancePrinters[PDResolve(value)])(value, &c->buf, c->len, &c->cap);
+            PDPipeDedupCanonAppend(c, " ", 1);
+            break;
+            
+        default:
+            c->comparable = false;
+            break;
+    }
+}
+
+/**
+ Record the definition of a scanned object, and determine whether it may be deduplicated.
+ */
+static void PDPipeDedupScanObject(PDParserRef parser, PDObjectRef object, PDInteger containerID, void *info)
+{
+    struct PDPipeDedup *dd = info;
+    PDInteger obid = object->obid;
+    if (obid <= 0 || obid >= dd->count) return;
+    
+    PDPipeDedupEntry *entry = &dd->entries[obid];
+    void *value = PDObjectGetValue(object);
+    
+    PDPipeDedupCanon c = {0};
+    c.encrypted = PDParserGetEncryptionState(parser);
+    c.comparable = true;
+    PDPipeDedupCanonicalize(&c, value, object->hasStream);
+    
+    entry->canon = c.buf;
+    entry->canonLen = c.len;
+    entry->refCount = c.refCount;
+    if (c.refCount > 0) {
+        entry->refs = malloc(2 * c.refCount * sizeof(PDInteger));
+        memcpy(entry->refs, c.refs, c.refCount * sizeof(PDInteger));
+        memcpy(&entry->refs[c.refCount], c.refPos, c.refCount * sizeof(PDInteger));
+    }
+    free(c.refs);
+    free(c.refPos);
+    
+    entry->genid = containerID ? 0 : object->genid;
+    entry->hasStream = object->hasStream;
+    entry->size = c.len + 8 * c.refCount + (containerID ? 8 : 24) + (object->hasStream ? object->streamLen + 18 : 0);
+    entry->candidate = c.comparable && ! dd->excluded[obid];
+    
+    // indirect stream lengths are left out of the canonical form, so references to them are never rewritten, and they must stay
+    if (object->hasStream) {
+        void *length = PDDictionaryGet(value, "Length");
+        if (length && PDResolve(length) == PDInstanceTypeRef) {
+            PDInteger lengthID = PDReferenceGetObjectID(length);
+            if (lengthID > 0 && lengthID < dd->count) {
+                dd->excluded[lengthID] = true;
+                dd->entries[lengthID].candidate = false;
+            }
+        }
+    }
+    
+    if (entry->candidate && PDResolve(value) == PDInstanceTypeDict) {
+        // the page tree and annotations are referred to from one place only, and anything with a parent is part of a tree
+        PDStringRef type = PDDictionaryGetString(value, "Type");
+        if (PDDictionaryGet(value, "Parent") || PDDictionaryGet(value, "P")) 
+            entry->candidate = false;
+        else if (type && (PDStringEqualsCString(type, "Catalog") || PDStringEqualsCString(type, "Pages") || PDStringEqualsCString(type, "Page") || PDStringEqualsCString(type, "Annot") || PDStringEqualsCString(type, "ObjStm") || PDStringEqualsCString(type, "XRef"))) 
+            entry->candidate = false;
+        else if (type && dd->pipe->typedTasks) {
+            // objects which may be changed by typed tasks are left alone
+            for (int pti = 1; pti < _PDFTypeCount; pti++) 
+                if (dd->pipe->typeTasks[pti] && PDStringEqualsCString(type, PDFTypeStrings[pti])) 
+                    entry->candidate = false;
+        }
+    }
+    
+    if (entry->candidate && entry->hasStream) {
+        if (dd->streamCount == dd->streamCap) {
+            dd->streamCap = dd->streamCap ? dd->streamCap * 2 : 64;
+            dd->streams = realloc(dd->streams, dd->streamCap * sizeof(PDInteger));
+        }
+        dd->streams[dd->streamCount++] = obid;
+    }
+}
+
+static inline PDInteger PDPipeDedupResolve(struct PDPipeDedup *dd, PDInteger obid)
+{
+    // objects are always replaced by objects with lower IDs, so this ends
+    while (obid > 0 && obid < dd->count && dd->survivors[obid] != obid) 
+        obid = dd->survivors[obid];
+    return obid;
+}
+
+/**
+ A candidate and its digest, in a deduplication pass.
+ */
+typedef struct PDPipeDedupDigest {
+    unsigned char digest[32];       ///< the digest of the canonical definition, with references resolved, and the stream
+    PDInteger obid;                 ///< the object ID
+} PDPipeDedupDigest;
+
+static int PDPipeDedupCompareDigests(const void *a, const void *b)
+{
+    const PDPipeDedupDigest *da = a;
+    const PDPipeDedupDigest *db = b;
+    int cmp = memcmp(da->digest, db->digest, 32);
+    return cmp ? cmp : (da->obid < db->obid ? -1 : da->obid > db->obid);
+}
+
+static void PDPipeDedupDigestEntry(struct PDPipeDedup *dd, PDInteger obid, unsigned char *digest)
+{
+    PDPipeDedupEntry *entry = &dd->entries[obid];
+    PDInteger pos = 0;
+    pd_sha256_ctx ctx;
+    
+    pd_sha256_init(&ctx);
+    pd_sha256_update(&ctx, (unsigned char *)&entry->hasStream, sizeof(PDBool));
+    if (entry->hasStream) 
+        pd_sha256_update(&ctx, entry->streamDigest, 32);
+    
+    // references are digested as the IDs of the objects they will refer to
+    for (PDInteger i = 0; i < entry->refCount; i++) {
+        PDInteger refPos = entry->refs[entry->refCount + i];
+        PDInteger refid = PDPipeDedupResolve(dd, entry->refs[i]);
+        pd_sha256_update(&ctx, (unsigned char *)&entry->canon[pos], refPos - pos);
+        pd_sha256_update(&ctx, (unsigned char *)&refid, sizeof(PDInteger));
+        pos = refPos;
+    }
+    pd_sha256_update(&ctx, (unsigned char *)&entry->canon[pos], entry->canonLen - pos);
+    pd_sha256_final(digest, &ctx);
+}
+
+/**
+ Replace objects by identical objects with lower IDs.
+ 
+ Objects referring to objects which have been replaced may turn out to be identical after the fact, so this is repeated until nothing more is found.
+ */
+static void PDPipeDedupFindDuplicates(struct PDPipeDedup *dd)
+{
+    PDPipeDedupDigest *digests = malloc(dd->count * sizeof(PDPipeDedupDigest));
+    PDInteger merged, pass, i, n;
+    
+    for (pass = 0, merged = 1; merged > 0 && pass < PDPipeDedupMaxPasses; pass++) {
+        n = 0;
+        for (i = 1; i < dd->count; i++) {
+            if (dd->entries[i].candidate && dd->survivors[i] == i) {
+                digests[n].obid = i;
+                PDPipeDedupDigestEntry(dd, i, digests[n++].digest);
+            }
+        }
+        
+        qsort(digests, n, sizeof(PDPipeDedupDigest), PDPipeDedupCompareDigests);
+        
+        merged = 0;
+        for (i = 1; i < n; i++) {
+            if (! memcmp(digests[i].digest, digests[i-1].digest, 32)) {
+                dd->survivors[digests[i].obid] = dd->survivors[digests[i-1].obid];
+                merged++;
+            }
+        }
+    }
+    
+    free(digests);
+}
+
+/**
+ Replace references to replaced objects in the given value.
+ 
+ @return A reference to put in place of value, if value itself is a reference to a replaced object, or NULL.
+ */
+static PDReferenceRef PDPipeDedupRewriteValue(struct PDPipeDedup *dd, void *value)
+{
+    PDInteger i, count;
+    PDReferenceRef replacement;
+    
+    switch (PDResolve(value)) {
+        case PDInstanceTypeDict: {
+            count = PDDictionaryGetCount(value);
+            char **keys = malloc(count * sizeof(char *));
+            PDDictionaryPopulateKeys(value, keys);
+            for (i = 0; i < count; i++) {
+                if ((replacement = PDPipeDedupRewriteValue(dd, PDDictionaryGet(value, keys[i])))) {
+                    PDDictionarySet(value, keys[i], replacement);
+                    PDRelease(replacement);
+                }
+            }
+            free(keys);
+            return NULL;
+        }
+            
+        case PDInstanceTypeArray:
+            count = PDArrayGetCount(value);
+            for (i = 0; i < count; i++) {
+                if ((replacement = PDPipeDedupRewriteValue(dd, PDArrayGetElement(value, i)))) {
+                    PDArrayReplaceAtIndex(value, i, replacement);
+                    PDRelease(replacement);
+                }
+            }
+            return NULL;
+            
+        case PDInstanceTypeRef: {
+            PDInteger refid = PDReferenceGetObjectID(value);
+            PDInteger survivor = PDPipeDedupResolve(dd, refid);
+            return survivor == refid ? NULL : PDReferenceCreate(survivor, dd->entries[survivor].genid);
+        }
+            
+        default:
+            return NULL;
+    }
+}
+
+static PDTaskResult PDPipeDedupRewriteReferences(PDPipeRef pipe, PDTaskRef task, PDObjectRef object, void *info)
+{
+    PDReferenceRef replacement = PDPipeDedupRewriteValue(info, PDObjectGetValue(object));
+    if (replacement) {
+        PDObjectSetValue(object, replacement);
+        PDRelease(replacement);
+    }
+    return PDTaskDone;
+}
+
+/**
+ Find the objects in the input which are identical to other objects, and set up tasks deleting them, and rewriting the references to them.
+ */
+static void PDPipeDeduplicate(PDPipeRef pipe)
+{
+    PDParserRef parser = pipe->parser;
+    PDInteger i, j, count = parser->ixt->cap;
+    
+    struct PDPipeDedup *dd = pipe->dedup = calloc(1, sizeof(struct PDPipeDedup));
+    dd->pipe = pipe;
+    dd->count = count;
+    dd->entries = calloc(count, sizeof(PDPipeDedupEntry));
+    dd->survivors = malloc(count * sizeof(PDInteger));
+    dd->excluded = calloc(count, sizeof(PDBool));
+    for (i = 0; i < count; i++) 
+        dd->survivors[i] = i;
+    
+    // the objects referred to by the trailer, and objects targeted by tasks, are left alone
+    PDReferenceRef trailerRefs[] = {parser->rootRef, parser->infoRef, parser->encryptRef};
+    for (i = 0; i < 3; i++) 
+        if (trailerRefs[i] && PDReferenceGetObjectID(trailerRefs[i]) < count) 
+            dd->excluded[PDReferenceGetObjectID(trailerRefs[i])] = true;
+    
+    PDInteger *obids = malloc(pipe->filterCount * sizeof(PDInteger));
+    PDSplayTreePopulateKeys(pipe->filter, obids);
+    for (i = 0; i < pipe->filterCount; i++) {
+        PDTaskRef task = PDSplayTreeGet(pipe->filter, obids[i]);
+        if (obids[i] > 0 && obids[i] < count) 
+            dd->excluded[obids[i]] = true;
+        if (task->func == PDPipeObStreamMutation) {
+            pd_stack iter;
+            pd_stack_for_each((pd_stack)task->info, iter) {
+                PDInteger obid = as(PDTaskRef, iter->info)->value;
+                if (obid > 0 && obid < count) 
+                    dd->excluded[obid] = true;
+            }
+        }
+    }
+    free(obids);
+    
+    // unreachable objects are on their way out anyway, and must not be kept in place of others
+    if (pipe->unreachable) 
+        for (i = 0; i < count; i++) 
+            dd->excluded[i] |= pipe->unreachable[i];
+    
+    PDParserScanObjects(parser, PDPipeDedupScanObject, dd);
+    
+    // streams are compared by the digests of their decoded content
+    if (dd->streamCount > 0) {
+        unsigned char *digests = malloc(32 * dd->streamCount);
+        PDBool *digested = malloc(dd->streamCount * sizeof(PDBool));
+        PDParserDigestStreams(parser, dd->streams, dd->streamCount, digests, digested);
+        for (i = 0; i < dd->streamCount; i++) {
+            PDPipeDedupEntry *entry = &dd->entries[dd->streams[i]];
+            entry->candidate = digested[i];
+            memcpy(entry->streamDigest, &digests[32 * i], 32);
+        }
+        free(digests);
+        free(digested);
+    }
+    
+    PDPipeDedupFindDuplicates(dd);
+    
+    // the tasks go through PDPipeAddTask(), so that objects inside of object streams are dealt with
+    for (i = 1; i < count; i++) {
+        PDPipeDedupEntry *entry = &dd->entries[i];
+        PDTaskFunc func = NULL;
+        
+        if (pipe->unreachable && pipe->unreachable[i]) continue;
+        
+        if (dd->survivors[i] != i) {
+            func = PDPipeDeleteObject;
+            pipe->dedupBytes += entry->size;
+            pipe->dedupObjects++;
+        } else {
+            for (j = 0; j < entry->refCount && ! func; j++) 
+                if (PDPipeDedupResolve(dd, entry->refs[j]) != entry->refs[j]) 
+                    func = PDPipeDedupRewriteReferences;
+        }
+        
+        if (func) {
+            PDTaskRef task = PDTaskCreateMutatorForObject(i, func);
+            PDTaskSetInfo(task, dd);
+            PDTaskSetIndependent(task, true);
+            PDPipeAddTask(pipe, task);
+            PDRelease(task);
+        }
+    }
+    
+    PDNotice("deduplication left out %ld objects (about %llu bytes)", pipe->dedupObjects, (unsigned long long)pipe->dedupBytes);
+}
+
+static void PDPipeClose(PDPipeRef pipe)
+{
+    PDRelease(pipe->filter);
+    PDRelease(pipe->deferred);
+    PDRelease(pipe->parser);
+    PDRelease(pipe->stream);
+    if (pipe->dedup) PDPipeDedupDestroy(pipe->dedup);
+    free(pipe->unreachable);
+    
+    pipe->filter = NULL;
+    pipe->deferred = NULL;
+    pipe->dedup = NULL;
+    pipe->unreachable = NULL;
+    pipe->parser = NULL;
+    pipe->stream = NULL;
+    
+    PDPipeCloseFileStream(pipe->fi);
+    PDPipeCloseFileStream(pipe->fo);
+    pipe->opened = false;
+}
+
+/**
+ Replace the (closed) output of the pipe with a linearized version of it. The output is left as it is if it cannot be linearized.
+ */
+static void PDPipeLinearizeOutput(PDPipeRef pipe)
+{
+    char *path = malloc(strlen(pipe->po) + 5);
+    sprintf(path, "%s.lin", pipe->po);
+    
+    FILE *fi = PDPipeOpenInputStream(pipe->po);
+    FILE *fo = fi ? PDPipeOpenOutputStream(path) : NULL;
+    if (NULL == fo) {
+        PDNotice("unable to open streams for linearizing %s", pipe->po);
+        if (fi) PDPipeCloseFileStream(fi);
+        free(path);
+        return;
+    }
+    
+    PDTwinStreamRef stream = PDTwinStreamCreate(fi, fo);
+    PDParserRef parser = PDParserCreateWithStream(stream);
+    if (parser) parser->compressionLevel = pipe->compressionLevel;
+    PDBool success = parser && PDParserWriteLinearized(parser);
+    PDRelease(parser);
+    PDRelease(stream);
+    PDFlush();
+    
+    PDPipeCloseFileStream(fi);
+    PDPipeCloseFileStream(fo);
+    
+    if (success && 0 == rename(path, pipe->po)) {
+        free(path);
+        return;
+    }
+    
+    PDWarn("%s could not be linearized, and is left as it is", pipe->po);
+    remove(path);
+    free(path);
+}
+
+/**
+ Run the given tasks on their objects, and write the objects to the incremental update in progress.
+ 
+ @param seen Incremented for every object visited.
+ */
+static PDBool PDPipeRunIncrementalTasks(PDPipeRef pipe, PDSplayTreeRef tasks, PDInteger *seen)
+{
+    PDParserRef parser = pipe->parser;
+    PDObjectRef ob;
+    PDTaskRef task;
+    PDBool proceed = true;
+    
+    // only the objects with tasks are visited, in no particular order
+    PDInteger *obids = malloc(PDSplayTreeGetCount(tasks) * sizeof(PDInteger));
+    PDInteger count = PDSplayTreePopulateKeys(tasks, obids);
+    for (PDInteger i = 0; proceed && i < count; i++) {
+        if (obids[i] <= 0) continue;
+        
+        // tasks may target objects which are not in the PDF at all
+        if ((PDSize)obids[i] >= parser->mxt->count || PDXTypeFreed == PDXTableGetTypeForID(parser->mxt, obids[i])) {
+            PDNotice("object %ld does not exist; its tasks are skipped", obids[i]);
+            continue;
+        }
+        
+        ob = PDParserLocateAndCreateObject(parser, obids[i], true);
+        if (NULL == ob) {
+            PDWarn("object %ld could not be located and is left out of the update", obids[i]);
+            continue;
+        }
+        
+        task = PDSplayTreeGet(tasks, obids[i]);
+        proceed = PDTaskFailure != PDTaskExec(task, pipe, ob);
+        if (proceed) 
+            PDParserWriteIncrementalObject(parser, ob);
+        
+        PDRelease(ob);
+        (*seen)++;
+    }
+    free(obids);
+    
+    return proceed;
+}
+
+/**
+ Run the deferred tasks, including tasks deferred while doing so, in the incremental update in progress.
+ */
+static PDBool PDPipeRunDeferredTasks(PDPipeRef pipe, PDInteger *seen)
+{
+    PDBool proceed = true;
+    while (proceed && pipe->deferred) {
+        PDSplayTreeRef deferred = pipe->deferred;
+        pipe->deferred = NULL;
+        proceed = PDPipeRunIncrementalTasks(pipe, deferred, seen);
+        PDRelease(deferred);
+    }
+    return proceed;
+}
+
+static PDInteger PDPipeExecuteIncrementalUpdate(PDPipeRef pipe)
+{
+    PDParserRef parser = pipe->parser;
+    PDInteger seen = 0;
+    
+    // tasks added along the way are deferred, and run once the ones we have are done
+    PDBool proceed = (PDParserBeginIncrementalUpdate(parser) 
+                      && PDPipeRunIncrementalTasks(pipe, pipe->filter, &seen) 
+                      && PDPipeRunDeferredTasks(pipe, &seen));
+    
+    if (proceed) 
+        PDParserFinishIncrementalUpdate(parser);
+    
+    PDPipeClose(pipe);
+    
+    return proceed ? seen : -1;
+}
+
 PDInteger PDPipeExecute(PDPipeRef pipe)
 {
     // if pipe is closed, we need to prepare
     if (! pipe->opened && ! PDPipePrepare(pipe)) 
         return -1;
     
+    pipe->dedupBytes = 0;
+    pipe->dedupObjects = 0;
+    
+    if (pipe->incrementalUpdate) {
+        if (NULL == pipe->typeTasks[0] && ! pipe->typedTasks) {
+            if (pipe->deduplicate) 
+                PDNotice("deduplication is not done in incremental updates; ignoring");
+            if (pipe->collectGarbage) 
+                PDNotice("garbage collection is not done in incremental updates; ignoring");
+            if (pipe->packObjects) 
+                PDNotice("objects are not packed into object streams in incremental updates; ignoring");
+            if (pipe->linearize) 
+                PDNotice("incremental updates are not linearized; ignoring");
+            return PDPipeExecuteIncrementalUpdate(pipe);
+        }
+        PDWarn("incremental updates only support tasks for specific objects; rewriting the PDF instead");
+    }
+    
     PDStaticHashRef sht = NULL;
     PDParserRef parser = pipe->parser;
     PDTaskRef task;
-    PDObjectRef obj;
-    PDStringRef pt;
     int pti;
     
     // at this point, we set up a static hash table for O(1) filtering before the O(n) tree fetch; the SHT implementation here triggers false positives and cannot be used on its own
     pipe->dynamicFiltering = pipe->typedTasks;
     
+    // unreachable objects are looked for first; the ones inside of object streams are given tasks, and the rest are dropped by the parser
+    if (pipe->collectGarbage) 
+        PDPipeCollectGarbage(pipe);
+    
+    // identical objects are looked for next, as the objects replaced by others, and the objects referring to them, are given tasks
+    if (pipe->deduplicate) {
+        if (pipe->typeTasks[0]) 
+            PDNotice("deduplication is not done for pipes with tasks for all objects; ignoring");
+        else 
+            PDPipeDeduplicate(pipe);
+    }
+    
+    // the parser packs objects as they are written; it tells us if it can't
+    PDParserSetObjectStreamPacking(parser, pipe->packObjects);
+    
+    // objects are renumbered by linearization, which is not possible for encrypted documents, as the keys of their objects depend on their numbers
+    PDBool linearize = pipe->linearize;
+    if (linearize && PDParserGetEncryptionState(parser)) {
+        PDNotice("encrypted documents are not linearized; ignoring");
+        linearize = false;
+    }
+    
+    PDBool sharding = pipe->sharding;
+    if (sharding && (parser->workQueue == NULL || ! PDWorkQueueIsAsynchronous(parser->workQueue))) {
+        PDNotice("sharding requires worker threads; ignoring");
+        sharding = false;
+    }
+    
+    // streams of objects with tasks are read and decoded up front, in parallel, if the pipe is set up for it; sharded streams are decoded by the workers anyway
+    if (pipe->prefetchStreams && pipe->filterCount > 0 && ! sharding) {
+        PDInteger *obids = malloc(pipe->filterCount * sizeof(PDInteger));
+        PDSplayTreePopulateKeys(pipe->filter, obids);
+        PDParserPrefetchStreams(parser, obids, pipe->filterCount);
+        free(obids);
+    }
+    
     if (! pipe->dynamicFiltering) {
         PDInteger entries = pipe->filterCount;
         void **keys = malloc(entries * sizeof(void*));
@@ -362,6 +1379,9 @@ PDInteger PDPipeExecute(PDPipeRef pipe)
         PDFlush();
         
         seen++;
+        
+        // objects with independent tasks only are handed to the worker threads
+        if (sharding && PDPipeShardCurrentObject(pipe, sht)) continue;
 
         // run unfiltered tasks
         if (! (proceed &= PDPipeRunStackedTasks(pipe, parser, &pipe->typeTasks[0]))) break;
@@ -376,28 +1396,14 @@ PDInteger PDPipeExecute(PDPipeRef pipe)
                 if (! (proceed &= PDTaskFailure != PDTaskExec(task, pipe, PDParserConstructObject(parser)))) break;
             
             // by type
-            if (proceed && pipe->typedTasks) {
-                // @todo this really needs to be streamlined; for starters, a PDState object could be used to set up types instead of O(n)'ing
-                obj = PDParserConstructObject(parser);
-                if (PDObjectTypeDictionary == PDObjectGetType(obj)) {
-                    pt = PDDictionaryGet(PDObjectGetDictionary(obj), "Type");
-                    if (pt) {
-                        //printf("pt = %s\n", pt);
-                        for (pti = 1; pti < _PDFTypeCount; pti++) // not = 0, because 0 = NULL and is reserved for 'unfiltered'
-                            if (PDStringEqualsCString(pt, PDFTypeStrings[pti]))
-                                break;
-                        
-                        if (pti < _PDFTypeCount) 
-                            proceed &= PDPipeRunStackedTasks(pipe, parser, &pipe->typeTasks[pti]);
-                    }
-                }
-            }
+            if (proceed && pipe->typedTasks && (pti = PDPipeGetTypeIndex(pipe))) 
+                proceed &= PDPipeRunStackedTasks(pipe, parser, &pipe->typeTasks[pti]);
 
         } else { 
             //tneg++;
             PDAssert(!PDSplayTreeGet(pipe->filter, parser->obid));
         }
-    } while (proceed && PDParserIterate(parser));
+    } while (proceed && parser->success && PDParserIterate(parser));
     PDRelease(sht);
     PDFlush();
     
@@ -409,17 +1415,19 @@ PDInteger PDPipeExecute(PDPipeRef pipe)
     if (proceed) 
         PDParserDone(parser);
     
-    PDRelease(pipe->filter);
-    PDRelease(parser);
-    PDRelease(pipe->stream);
+    // tasks for objects which had already been written when the tasks were added are applied in an incremental update
+    if (proceed && pipe->deferred) {
+        PDInteger revisited = 0;
+        proceed = PDParserBeginIncrementalUpdate(parser) && PDPipeRunDeferredTasks(pipe, &revisited);
+        if (proceed) 
+            PDParserFinishIncrementalUpdate(parser);
+    }
     
-    pipe->filter = NULL;
-    pipe->parser = NULL;
-    pipe->stream = NULL;
+    PDPipeClose(pipe);
     
-    PDPipeCloseFileStream(pipe->fi);
-    PDPipeCloseFileStream(pipe->fo);
-    pipe->opened = false;
+    // the output is linearized in a second pass, as where the objects of each page go is not known until all of them have been written
+    if (proceed && linearize) 
+        PDPipeLinearizeOutput(pipe);
     
     return proceed ? seen : -1;
 }
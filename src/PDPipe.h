@@ -98,6 +98,8 @@ extern PDPipeRef PDPipeCreateWithFilePaths(const char * inputFilePath, const cha
  @param task The task to add.
  
  @note In the current implementation, non-filter tasks which are added directly to the pipe will be triggered *once* when PDPipePrepare() is called, not once per object iteration.
+ 
+ @note Filter tasks may be added while the pipe is executing, e.g. from other tasks. If the object in question has already been written, the task is deferred: once the pipe has written the PDF, the task is run on the object as it was in the input, and the object is appended to the output in an incremental update. The task must therefore not rely on changes made to the object earlier in the pipe.
  */
 extern void PDPipeAddTask(PDPipeRef pipe, PDTaskRef task);
 
@@ -111,6 +113,145 @@ extern void PDPipeAddTask(PDPipeRef pipe, PDTaskRef task);
  */
 extern PDBool PDPipePrepare(PDPipeRef pipe);
 
+/**
+ Use an index file for the pipe's parser.
+ 
+ When the pipe is prepared, the XREF tables, trailer, and page list are loaded from the index file, if it is present and up to date with the input file; otherwise they are read from the input file as normal, and the index file is written for subsequent pipes over the same input. The page list is only added to the index once something asks for the pipe's page tree.
+ 
+ @note This must be called before the pipe is prepared.
+ 
+ @param pipe      The pipe.
+ @param indexPath The index file path, or NULL to not use an index.
+ 
+ @see PDParserCreateWithStreamAndIndex
+ */
+extern void PDPipeSetIndexFilePath(PDPipeRef pipe, const char *indexPath);
+
+/**
+ Set the compression level used for streams which are compressed during the pipe's execution.
+ 
+ This applies to objects whose streams are set via PDObjectSetStreamFiltered() and to object streams which are regenerated. Lower levels trade output size for speed, which is useful for throughput oriented jobs.
+ 
+ @param pipe  The pipe.
+ @param level The compression level, from 1 (fastest) to 9 (smallest), or 0 for the default.
+ */
+extern void PDPipeSetCompressionLevel(PDPipeRef pipe, PDInteger level);
+
+/**
+ Set the number of worker threads used to re-filter streams during the pipe's execution.
+ 
+ Streams are normally filtered on the calling thread, one at a time. With workers, the streams of objects from the input which are re-encoded after being fetched, as well as streams set via PDObjectSetStreamFiltered() on such objects, are filtered on the worker threads while the pipe moves on to the following objects; the output is written in the original order regardless. This is mostly useful for pipes which recompress a lot of streams.
+ 
+ Streams of objects appended to the pipe, streams set via PDObjectSetStream() or PDObjectSetStreamProducer(), and regenerated object streams are still filtered on the calling thread. Task functions are always called on the calling thread.
+ 
+ @note This must be called before the pipe is prepared, and has no effect unless PD_SUPPORT_THREADS is defined.
+ 
+ @param pipe  The pipe.
+ @param count The number of worker threads, or 0 (the default) to re-filter streams on the calling thread.
+ */
+extern void PDPipeSetWorkerCount(PDPipeRef pipe, PDInteger count);
+
+/**
+ Set whether the streams of objects targeted by tasks are read and decoded on the worker threads before execution begins.
+ 
+ Pipes with many object ID tasks (see PDTaskCreateMutatorForObject()) which fetch streams normally spend most of their time decoding those streams one at a time, as the pipe reaches each object. With prefetching, all of them are read straight from their XREF offsets and decoded in parallel, and are ready by the time the tasks are run. Decoded streams are held in memory until their objects are reached.
+ 
+ @note This has no effect unless the pipe has worker threads (see PDPipeSetWorkerCount()).
+ 
+ @param pipe    The pipe.
+ @param enabled Whether streams should be prefetched; the default is false.
+ */
+extern void PDPipeSetStreamPrefetching(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Set whether objects whose tasks are all independent (see PDTaskSetIndependent()) are processed on the worker threads.
+
+ Normally, tasks are run on the calling thread, one object at a time. With sharding, the pipe hands consecutive objects, along with their raw streams, to the worker threads in shards, and moves on to the following objects while the workers decode streams, run the tasks, and serialize the objects. The output is written in the original order regardless, and XREF offsets are resolved as each shard is written. Objects with tasks which are not independent, such as tasks for objects inside object streams, are processed on the calling thread as usual.
+
+ This is mostly useful for pipes which do a lot of work per object, e.g. by rewriting every stream in the PDF; scanning the input is comparatively cheap.
+
+ @note This has no effect unless the pipe has worker threads (see PDPipeSetWorkerCount()). Stream prefetching (see PDPipeSetStreamPrefetching()) is not done when sharding, as sharded streams are decoded on the worker threads as it is.
+
+ @param pipe    The pipe.
+ @param enabled Whether independent tasks should be run on the worker threads; the default is false.
+ */
+extern void PDPipeSetSharding(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Set whether objects which are identical to other objects are left out of the output.
+ 
+ Before execution begins, every object in the input is read, and objects which are identical, i.e. which have the same definition and the same decoded stream, when references to identical objects are taken to be the same, are looked for. One of each is kept, and references to the others are changed to refer to it. This is mostly useful for PDFs which have been put together from other PDFs, where the same fonts, images and ICC profiles often appear many times over.
+ 
+ The page tree, annotations, objects with parents, the objects referred to by the trailer, and objects targeted by tasks are left alone. Objects added during execution are not deduplicated.
+ 
+ @note Deduplication is not done for pipes with tasks for all objects, or for pipes which write incremental updates (see PDPipeSetIncrementalUpdate()). Streams are decoded on the worker threads, if the pipe has any (see PDPipeSetWorkerCount()).
+ 
+ @param pipe    The pipe.
+ @param enabled Whether identical objects should be left out; the default is false.
+ 
+ @see PDPipeGetDeduplicationSavings
+ */
+extern void PDPipeSetDeduplication(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Get the savings of deduplication, once the pipe has been executed.
+ 
+ @param pipe        The pipe.
+ @param objectCount Pointer to an integer which is set to the number of objects left out of the output, or NULL.
+ @return The approximate number of bytes the left out objects would have taken up in the output, not counting the compression of object streams.
+ 
+ @see PDPipeSetDeduplication
+ */
+extern PDSize PDPipeGetDeduplicationSavings(PDPipeRef pipe, PDInteger *objectCount);
+
+/**
+ Set whether objects which cannot be reached from the trailer are left out of the output.
+ 
+ PDFs often carry objects which nothing refers to any longer, such as resources left behind when pages or annotations were removed or replaced in an update. Before execution begins, the references of every object in the input are read, and every object which cannot be reached from the root, info or encryption dictionaries, or from an object targeted by a task, is left out. The parser passes over these objects without reading them, so they cost close to nothing to get rid of.
+ 
+ @note Tasks are not run on objects which are left out, including tasks for all objects, and tasks for objects of a given type. Garbage collection is not done for pipes which write incremental updates (see PDPipeSetIncrementalUpdate()).
+ 
+ @param pipe    The pipe.
+ @param enabled Whether unreachable objects should be left out; the default is false.
+ */
+extern void PDPipeSetGarbageCollection(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Set whether loose objects are packed into new object streams in the output.
+ 
+ PDFs with XREF streams may keep objects inside of compressed object streams, but many PDFs only do so for some of their objects, or not at all. With packing enabled, dictionaries and arrays which would otherwise be written on their own are collected into new object streams of up to 100 objects each, which are compressed with the pipe's compression level. Objects which are already inside object streams in the input stay where they are.
+ 
+ @note Objects with streams, objects with a generation number other than 0, and numbers, strings and nulls, which may be the lengths of streams, are never packed, and neither are objects which are handed to the worker threads by sharding (see PDPipeSetSharding()). Packing is not done for PDFs with XREF tables rather than XREF streams, for encrypted PDFs, or for pipes which write incremental updates (see PDPipeSetIncrementalUpdate()).
+ 
+ @param pipe    The pipe.
+ @param enabled Whether loose objects should be packed into object streams; the default is false.
+ */
+extern void PDPipeSetObjectStreamPacking(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Set whether the output is linearized ("fast web view"), so that viewers can display the first page, and then any other page, before the whole PDF has been downloaded.
+ 
+ Linearization is done once the pipe has written its output, by reading the output back in and writing it anew with the objects of the first page at the beginning, followed by the objects of the remaining pages, page by page, with the linearization dictionary and hint tables describing where everything is. Objects are renumbered in the process, and inherited page attributes are copied into the pages themselves.
+ 
+ @note The linearized output uses XREF tables, and objects inside of object streams are written on their own, so object stream packing (see PDPipeSetObjectStreamPacking()) is of no use together with linearization. Encrypted PDFs are not linearized, and neither is the output of pipes which write incremental updates (see PDPipeSetIncrementalUpdate()). If the output cannot be linearized, it is left as it was written.
+ 
+ @param pipe    The pipe.
+ @param enabled Whether the output should be linearized; the default is false.
+ */
+extern void PDPipeSetLinearization(PDPipeRef pipe, PDBool enabled);
+
+/**
+ Set whether the pipe writes an incremental update rather than rewriting the PDF.
+ 
+ In an incremental update, the output is the input, byte for byte, followed by the objects touched by tasks and a new XREF section referring back to the input's. Where the file system supports it (e.g. btrfs, XFS), the copy of the input shares its data with the input, so the cost of executing the pipe depends on the size of the changes rather than the size of the PDF.
+ 
+ @note Only tasks targeting specific objects (see PDTaskCreateMutatorForObject() and friends) are supported; if the pipe has tasks for all objects, or for objects of a given type, it falls back to rewriting the PDF.
+ 
+ @param pipe    The pipe.
+ @param enabled Whether an incremental update should be written; the default is false.
+ */
+extern void PDPipeSetIncrementalUpdate(PDPipeRef pipe, PDBool enabled);
+
 /**
  Get parser instance for pipe.
  
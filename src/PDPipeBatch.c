@@ -0,0 +1,168 @@
+//
+// PDPipeBatch.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "Pajdeg.h"
+#include "pd_internal.h"
+#include "PDPipeBatch.h"
+#include "PDWorkQueue.h"
+#include "pd_pdf_implementation.h"
+
+void PDPipeBatchDestroy(PDPipeBatchRef batch)
+{
+    PDInteger i;
+    
+    for (i = 0; i < batch->count; i++) {
+        free(batch->docs[i].pi);
+        free(batch->docs[i].po);
+    }
+    free(batch->docs);
+    
+    for (i = 0; i < batch->taskCount; i++) 
+        PDRelease(batch->tasks[i]);
+    free(batch->tasks);
+    
+    pd_pdf_implementation_discard();
+}
+
+PDPipeBatchRef PDPipeBatchCreate(PDInteger threads)
+{
+    PDPipeBatchRef batch = PDAlloc(sizeof(struct PDPipeBatch), PDPipeBatchDestroy, true);
+    batch->threads = threads;
+    
+    // the batch is a user of the implementation, so the grammar and filter pools survive the pipes coming and going
+    pd_pdf_implementation_use();
+    
+    return batch;
+}
+
+PDInteger PDPipeBatchAddDocument(PDPipeBatchRef batch, const char *inputFilePath, const char *outputFilePath)
+{
+    if (batch->count == batch->cap) {
+        batch->cap = batch->cap ? batch->cap << 1 : 16;
+        batch->docs = realloc(batch->docs, batch->cap * sizeof(struct PDPipeBatchDocument));
+    }
+    
+    struct PDPipeBatchDocument *doc = &batch->docs[batch->count];
+    doc->batch = batch;
+    doc->index = batch->count;
+    doc->pi = inputFilePath ? strdup(inputFilePath) : NULL;
+    doc->po = outputFilePath ? strdup(outputFilePath) : NULL;
+    doc->status = PDPipeBatchStatusPending;
+    doc->objects = -1;
+    
+    return batch->count++;
+}
+
+void PDPipeBatchAddTask(PDPipeBatchRef batch, PDTaskRef task)
+{
+    batch->tasks = realloc(batch->tasks, (batch->taskCount + 1) * sizeof(PDTaskRef));
+    batch->tasks[batch->taskCount++] = PDRetain(task);
+}
+
+void PDPipeBatchSetSetupFunc(PDPipeBatchRef batch, PDPipeBatchSetupFunc setup, void *info)
+{
+    batch->setup = setup;
+    batch->setupInfo = info;
+}
+
+/**
+ Pipe a document through, with copies of the batch's tasks. Runs on a worker thread, if the batch has threads.
+ */
+static void PDPipeBatchExecuteDocument(void *info)
+{
+    struct PDPipeBatchDocument *doc = info;
+    PDPipeBatchRef batch = doc->batch;
+    PDTaskRef task;
+    PDInteger i;
+    
+    PDPipeRef pipe = PDPipeCreateWithFilePaths(doc->pi, doc->po);
+    if (NULL == pipe) {
+        PDWarn("unable to set up pipe from %s to %s", doc->pi, doc->po);
+        doc->status = PDPipeBatchStatusOpenFailed;
+        return;
+    }
+    
+    if (batch->setup) 
+        (*batch->setup)(batch, pipe, doc->index, batch->setupInfo);
+    
+    if (! PDPipePrepare(pipe)) {
+        PDWarn("unable to prepare pipe from %s to %s", doc->pi, doc->po);
+        doc->status = PDPipeBatchStatusOpenFailed;
+    } else {
+        for (i = 0; i < batch->taskCount; i++) {
+            task = PDTaskCreateCopy(batch->tasks[i]);
+            PDPipeAddTask(pipe, task);
+            PDRelease(task);
+        }
+        
+        doc->objects = PDPipeExecute(pipe);
+        doc->status = doc->objects == -1 ? PDPipeBatchStatusFailed : PDPipeBatchStatusDone;
+    }
+    
+    PDRelease(pipe);
+    
+    // autorelease pools are per thread, so this only drains the document's own objects
+    PDFlush();
+}
+
+PDInteger PDPipeBatchExecute(PDPipeBatchRef batch)
+{
+    PDInteger i, succeeded = 0;
+    PDWorkQueueRef queue = PDWorkQueueCreate(batch->threads);
+    PDWorkItemRef *items = calloc(batch->count, sizeof(PDWorkItemRef));
+    
+    for (i = 0; i < batch->count; i++) 
+        if (batch->docs[i].status == PDPipeBatchStatusPending) 
+            items[i] = PDWorkQueueEnqueue(queue, PDPipeBatchExecuteDocument, &batch->docs[i]);
+    
+    for (i = 0; i < batch->count; i++) {
+        if (items[i]) {
+            PDWorkItemWait(items[i]);
+            PDRelease(items[i]);
+            if (batch->docs[i].status == PDPipeBatchStatusDone) succeeded++;
+        }
+    }
+    
+    free(items);
+    PDRelease(queue);
+    
+    return succeeded;
+}
+
+PDInteger PDPipeBatchGetDocumentCount(PDPipeBatchRef batch)
+{
+    return batch->count;
+}
+
+PDPipeBatchStatus PDPipeBatchGetStatus(PDPipeBatchRef batch, PDInteger index)
+{
+    PDAssert(index >= 0 && index < batch->count); // crash = index out of range
+    return batch->docs[index].status;
+}
+
+PDInteger PDPipeBatchGetObjectCount(PDPipeBatchRef batch, PDInteger index)
+{
+    PDAssert(index >= 0 && index < batch->count); // crash = index out of range
+    return batch->docs[index].objects;
+}
@@ -0,0 +1,123 @@
+//
+// PDPipeBatch.h
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+/**
+ @file PDPipeBatch.h Pipe batch header file.
+ 
+ @ingroup PDPIPEBATCH
+ 
+ @defgroup PDPIPEBATCH PDPipeBatch
+ 
+ @brief A batch of pipes, applying the same tasks to many documents.
+ 
+ @ingroup PDPIPE_CONCEPT
+ 
+ A pipe batch takes a list of input/output file pairs and a set of tasks, and pipes every input through to its output with (a copy of) the tasks, in the same way as a PDPipe would. 
+ 
+ The PDF grammar, filter registry, and filter buffer pools are kept around for as long as the batch exists, rather than being set up and torn down for every document, and documents can be executed at the same time on several threads. The outcome of every document is recorded separately, so a broken document does not affect the others.
+ 
+ @warning When documents are executed on several threads, tasks (and setup functions) run on several threads at the same time. They must only touch objects belonging to their own pipe, and any info objects they share must be thread safe.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PDPipeBatch_h
+#define INCLUDED_PDPipeBatch_h
+
+#include "PDDefines.h"
+
+/**
+ Create a pipe batch.
+ 
+ @param threads The number of documents to execute at the same time, each on a separate thread. If 0, documents are executed one at a time, on the thread calling PDPipeBatchExecute().
+ @return The batch.
+ */
+extern PDPipeBatchRef PDPipeBatchCreate(PDInteger threads);
+
+/**
+ Add a document to the batch.
+ 
+ @param batch The batch.
+ @param inputFilePath Path to the input PDF.
+ @param outputFilePath Path to the output PDF, which must not be the same as the input path.
+ @return The index of the document, used to look up its outcome.
+ */
+extern PDInteger PDPipeBatchAddDocument(PDPipeBatchRef batch, const char *inputFilePath, const char *outputFilePath);
+
+/**
+ Add a task to the batch.
+ 
+ The task acts as a template, and is not itself added to any pipe. Instead, every document's pipe is given a copy of it (see PDTaskCreateCopy()), which shares the task's functions and info objects.
+ 
+ @param batch The batch.
+ @param task The task. It is retained by the batch.
+ */
+extern void PDPipeBatchAddTask(PDPipeBatchRef batch, PDTaskRef task);
+
+/**
+ Set a function to configure every document's pipe, e.g. with PDPipeSetCompressionLevel() or additional tasks, before the batch's tasks are added to it.
+ 
+ @param batch The batch.
+ @param setup The setup function, or NULL.
+ @param info Info passed to the setup function.
+ */
+extern void PDPipeBatchSetSetupFunc(PDPipeBatchRef batch, PDPipeBatchSetupFunc setup, void *info);
+
+/**
+ Execute the batch, piping every document which has not yet been executed through to its output.
+ 
+ Documents may be added, and the batch executed again, afterwards.
+ 
+ @param batch The batch.
+ @return The number of documents which were piped through successfully in this call.
+ */
+extern PDInteger PDPipeBatchExecute(PDPipeBatchRef batch);
+
+/**
+ Get the number of documents in the batch.
+ 
+ @param batch The batch.
+ */
+extern PDInteger PDPipeBatchGetDocumentCount(PDPipeBatchRef batch);
+
+/**
+ Get the outcome of a document in the batch.
+ 
+ @param batch The batch.
+ @param index The index of the document, as returned by PDPipeBatchAddDocument().
+ @return The status of the document.
+ */
+extern PDPipeBatchStatus PDPipeBatchGetStatus(PDPipeBatchRef batch, PDInteger index);
+
+/**
+ Get the number of objects seen in a document in the batch.
+ 
+ @param batch The batch.
+ @param index The index of the document, as returned by PDPipeBatchAddDocument().
+ @return The number of objects, as returned by PDPipeExecute(), or -1 if the document has not been piped through successfully.
+ */
+extern PDInteger PDPipeBatchGetObjectCount(PDPipeBatchRef batch, PDInteger index);
+
+#endif
+
+/** @} */
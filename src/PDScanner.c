@@ -33,7 +33,7 @@
 #include "pd_crypto.h"
 #include "pd_pdf_implementation.h" // <-- not ideal
 
-static PDInteger PDScannerScanAttemptCap = -1;
+static PD_THREAD_LOCAL PDInteger PDScannerScanAttemptCap = -1;
 
 void PDScannerOperate(PDScannerRef scanner, PDOperatorRef op);
 void PDScannerScan(PDScannerRef scanner);
@@ -241,7 +241,7 @@ extern void PDScannerPopContext(PDScannerRef scanner);
  
  This is used when reading a PDF for the first time to not scan through the entire thing backwards looking for the startxref entry.
  
- The loop cap is reset after every successful pop.
+ The loop cap is reset after every successful pop, and only applies to pops on the calling thread.
  
  @param cap The cap.
  */
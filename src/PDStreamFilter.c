@@ -26,9 +26,122 @@
 #include "PDStreamFilter.h"
 #include "pd_stack.h"
 #include "pd_pdf_implementation.h"
+#include "PDArray.h"
+#include "PDString.h"
+
+#ifdef PD_SUPPORT_ZLIB
+#include "PDStreamFilterFlateDecode.h"
+#endif
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
+/**
+ The maximum capacity of the intermediate buffers between chained filters. Chained filters pass data along in chunks of at most this size, so that no intermediate stage ever holds the entire stream.
+ */
+#define PDStreamFilterChainBufferCap    (64 * 1024)
+
+/**
+ The largest expected length honored by PDStreamFilterApplyWithHint(). Hints come from the PDF, and anything larger than this is ignored rather than allocated up front.
+ */
+#define PDStreamFilterExpectedLenLimit  (256 * 1024 * 1024)
+
+/**
+ The maximum number of intermediate buffers kept around for reuse by later filter chains.
+ */
+#define PDStreamFilterBufferPoolCap     16
 
 static pd_stack filterRegistry = NULL;
 
+/**
+ Pooled intermediate buffers. Buffers keep the capacity they had when their last chain was done with them.
+ 
+ The pool is kept per thread, so that filters on separate worker threads never wait for one another; see PDStreamFilterPoolsInUse().
+ */
+static PD_THREAD_LOCAL struct {
+    unsigned char *bufs[PDStreamFilterBufferPoolCap];
+    PDInteger caps[PDStreamFilterBufferPoolCap];
+    PDInteger count;
+} bufferPool;
+
+#ifdef PD_SUPPORT_THREADS
+static pthread_key_t poolKey;
+static pthread_once_t poolKeyOnce = PTHREAD_ONCE_INIT;
+static PD_THREAD_LOCAL PDBool poolKeySet = false;
+
+static void PDStreamFilterPoolsThreadExit(void *value)
+{
+    PDStreamFilterDrainPools();
+}
+
+static void PDStreamFilterPoolKeyCreate(void)
+{
+    pthread_key_create(&poolKey, PDStreamFilterPoolsThreadExit);
+}
+#endif
+
+void PDStreamFilterPoolsInUse(void)
+{
+#ifdef PD_SUPPORT_THREADS
+    // the key's value only serves to have its destructor called, which drains the exiting thread's pools
+    if (! poolKeySet) {
+        pthread_once(&poolKeyOnce, PDStreamFilterPoolKeyCreate);
+        pthread_setspecific(poolKey, &poolKeySet);
+        poolKeySet = true;
+    }
+#endif
+}
+
+static unsigned char *PDStreamFilterBufferObtain(PDInteger *cap)
+{
+    unsigned char *buf = NULL;
+    PDInteger i, best = -1, have = 0;
+    
+    // take the largest buffer, as the previous chain needed it
+    for (i = 0; i < bufferPool.count; i++) 
+        if (best == -1 || bufferPool.caps[i] > bufferPool.caps[best]) best = i;
+    if (best != -1) {
+        buf = bufferPool.bufs[best];
+        have = bufferPool.caps[best];
+        bufferPool.count--;
+        bufferPool.bufs[best] = bufferPool.bufs[bufferPool.count];
+        bufferPool.caps[best] = bufferPool.caps[bufferPool.count];
+    }
+    
+    if (buf == NULL) 
+        return malloc(*cap);
+    
+    if (*cap > have) 
+        return realloc(buf, *cap);
+    
+    *cap = have;
+    return buf;
+}
+
+static void PDStreamFilterBufferRecycle(unsigned char *buf, PDInteger cap)
+{
+    if (bufferPool.count < PDStreamFilterBufferPoolCap) {
+        PDStreamFilterPoolsInUse();
+        bufferPool.bufs[bufferPool.count] = buf;
+        bufferPool.caps[bufferPool.count] = cap;
+        bufferPool.count++;
+        buf = NULL;
+    }
+    
+    free(buf);
+}
+
+void PDStreamFilterDrainPools(void)
+{
+    while (bufferPool.count > 0) 
+        free(bufferPool.bufs[--bufferPool.count]);
+    
+#ifdef PD_SUPPORT_ZLIB
+    PDStreamFilterFlateDecodeDrainPool();
+#endif
+}
+
 void PDStreamFilterRegisterDualFilter(const char *name, PDStreamDualFilterConstr constr)
 {
     pd_stack_push_identifier(&filterRegistry, (PDID)constr);
@@ -47,6 +160,65 @@ PDStreamFilterRef PDStreamFilterObtain(const char *name, PDBool inputEnd, PDDict
     return NULL;
 }
 
+PDStreamFilterRef PDStreamFilterObtainChain(void *filters, void *decodeParms, PDBool inputEnd)
+{
+    PDArrayRef filterArray = NULL;
+    PDArrayRef parmsArray = NULL;
+    PDInteger count = 1;
+    
+    if (filters == NULL) return NULL;
+    
+    switch (PDResolve(filters)) {
+        case PDInstanceTypeArray:
+            filterArray = filters;
+            count = PDArrayGetCount(filterArray);
+            break;
+        case PDInstanceTypeString:
+            break;
+        default:
+            PDWarn("Unsupported filter type %d", PDResolve(filters));
+            return NULL;
+    }
+    
+    if (decodeParms && PDResolve(decodeParms) == PDInstanceTypeArray) {
+        parmsArray = decodeParms;
+        decodeParms = NULL;
+    }
+    
+    PDStreamFilterRef chain = NULL;
+    for (PDInteger i = 0; i < count; i++) {
+        // decoders run in the listed order, whereas encoders run in the reverse order
+        PDInteger index = inputEnd ? i : count - i - 1;
+        PDStringRef name = filterArray ? PDArrayGetElement(filterArray, index) : filters;
+        
+        // the decode parms entry is either an array matching the filters array, or a single dictionary which we apply to all filters
+        void *options = decodeParms;
+        if (parmsArray) {
+            options = index < PDArrayGetCount(parmsArray) ? PDArrayGetElement(parmsArray, index) : NULL;
+        }
+        if (options && PDResolve(options) != PDInstanceTypeDict) options = NULL;
+        
+        PDStreamFilterRef filter = NULL;
+        if (name && PDResolve(name) == PDInstanceTypeString) {
+            filter = PDStreamFilterObtain(PDStringEscapedValue(name, false, NULL), inputEnd, options);
+        }
+        if (filter == NULL) {
+            PDNotice("Unsupported filter \"%s\" in filter chain", name && PDResolve(name) == PDInstanceTypeString ? PDStringEscapedValue(name, false, NULL) : "?");
+            PDRelease(chain);
+            return NULL;
+        }
+        
+        if (chain) {
+            PDStreamFilterAppendFilter(chain, filter);
+            PDRelease(filter);
+        } else {
+            chain = filter;
+        }
+    }
+    
+    return chain;
+}
+
 void PDStreamFilterDestroy(PDStreamFilterRef filter)
 {
     if (filter->initialized) 
@@ -56,7 +228,7 @@ void PDStreamFilterDestroy(PDStreamFilterRef filter)
 //    pd_stack_destroy(&filter->options);
     
     if (filter->bufOutOwned)
-        free(filter->bufOutOwned);
+        PDStreamFilterBufferRecycle(filter->bufOutOwned, filter->bufOutOwnedCapacity);
     
     PDRelease(filter->nextFilter);
 }
@@ -86,44 +258,100 @@ void PDStreamFilterAppendFilter(PDStreamFilterRef filter, PDStreamFilterRef next
     filter->nextFilter = PDRetain(next);
 }
 
+void PDStreamFilterSetCompressionLevel(PDStreamFilterRef filter, PDInteger level)
+{
+    for (; filter; filter = filter->nextFilter)
+        filter->compressionLevel = level;
+}
+
 PDBool PDStreamFilterApply(PDStreamFilterRef filter, unsigned char *src, unsigned char **dstPtr, PDInteger len, PDInteger *newlenPtr, PDInteger *allocatedlenPtr)
 {
+    *dstPtr = NULL;
+    return PDStreamFilterApplyWithHint(filter, src, dstPtr, len, newlenPtr, allocatedlenPtr, 0);
+}
+
+PDBool PDStreamFilterApplyWithHint(PDStreamFilterRef filter, unsigned char *src, unsigned char **dstPtr, PDInteger len, PDInteger *newlenPtr, PDInteger *allocatedlenPtr, PDInteger expectedLen)
+{
+    unsigned char *resbuf = *dstPtr;
+    PDInteger dstCap = resbuf ? *allocatedlenPtr : 0;
+    
     if (filter == NULL) {
         PDWarn("NULL filter in call to PDStreamFilterApply(). Performing copy.");
-        memcpy(*dstPtr, src, len);
+        if (dstCap < len) {
+            resbuf = realloc(resbuf, len);
+            dstCap = len;
+        }
+        memcpy(resbuf, src, len);
+        *dstPtr = resbuf;
         *newlenPtr = len;
-        if (allocatedlenPtr) *allocatedlenPtr = len;
+        if (allocatedlenPtr) *allocatedlenPtr = dstCap;
         return true;
     }
     
     if (! filter->initialized) {
-        if (! PDStreamFilterInit(filter))
+        if (! PDStreamFilterInit(filter)) {
             return false;
+        }
     }
     
-    unsigned char *resbuf;
-    PDInteger dstCap = len * filter->growthHint;
-    if (dstCap < 64) dstCap = 64;
-    if (dstCap > 64 * 1024) dstCap = 64 * 1024;
+    if (expectedLen > PDStreamFilterExpectedLenLimit) 
+        // we don't trust huge hints to be anything but garbage
+        expectedLen = 0;
+    
+    if (resbuf == NULL || dstCap < expectedLen) {
+        if (expectedLen > 0) {
+            dstCap = expectedLen;
+        } else if (resbuf == NULL) {
+            dstCap = len * filter->growthHint;
+            if (dstCap < 64) dstCap = 64;
+            if (dstCap > 64 * 1024) dstCap = 64 * 1024;
+        }
+        resbuf = realloc(resbuf, dstCap);
+    }
     
     filter->bufIn = src;
     filter->bufInAvailable = len;
-    resbuf = filter->bufOut = malloc(dstCap);
+    filter->bufOut = resbuf;
     filter->bufOutCapacity = dstCap;
     
+    PDStreamFilterRef last = filter;
+    while (last->nextFilter) last = last->nextFilter;
+    
     PDInteger bytes = PDStreamFilterBegin(filter);
     PDInteger got = 0;
-    while (bytes > 0) {
-        got += bytes;
-        if (! filter->finished) {
+    PDBool grown = false;
+    for (;;) {
+        if (bytes > 0) {
+            got += bytes;
+            grown = false;
+            if (! filter->finished && dstCap - got < bytes) {
+                // running out of room
+                dstCap *= 3;
+                resbuf = realloc(resbuf, dstCap);
+            }
+        } else if (filter->finished || filter->failing) {
+            break;
+        } else if (filter->nextFilter && filter->progressed) {
+            // chained filters may spend rounds moving data between intermediate buffers without producing any output; that is fine for as long as some filter in the chain gets anywhere
+        } else if (! grown && ! last->needsInput) {
+            // the last filter has input but produced nothing, which means its output (e.g. a predictor row) did not fit in the remaining room
             dstCap *= 3;
             resbuf = realloc(resbuf, dstCap);
+            grown = true;
+        } else {
+            break;
         }
         filter->bufOut = &resbuf[got];
         filter->bufOutCapacity = dstCap - got;
         bytes = PDStreamFilterProceed(filter);
     }
     
+    if (filter->nextFilter && ! filter->finished && ! filter->failing) {
+        // all of the input was given up front, so a chain that stops getting anywhere before it finishes has truncated its output
+        PDWarn("filter chain stalled after %ld bytes of output", got);
+        filter->failing = true;
+    }
+    
     // if we ended up with a huge alloc for resbuf, we want to attempt to trim it down
     if (dstCap - 5000 > got) {
         resbuf = realloc(resbuf, got + 2);
@@ -152,12 +380,18 @@ PDBool PDStreamFilterInit(PDStreamFilterRef filter)
 
 PDBool PDStreamFilterDone(PDStreamFilterRef filter)
 {
+    PDBool success = true;
     while (filter) {
-        if (! (*filter->done)(filter)) 
-            return false;
+        if (filter->initialized) 
+            success &= (*filter->done)(filter);
+        if (filter->bufOutOwned) {
+            PDStreamFilterBufferRecycle(filter->bufOutOwned, filter->bufOutOwnedCapacity);
+            filter->bufOutOwned = NULL;
+            filter->bufOutOwnedCapacity = 0;
+        }
         filter = filter->nextFilter;
     }
-    return true;
+    return success;
 }
 
 PDInteger PDStreamFilterBegin(PDStreamFilterRef filter)
@@ -181,16 +415,19 @@ PDInteger PDStreamFilterBegin(PDStreamFilterRef filter)
         cap = curr->bufInAvailable * curr->growthHint;
         if (cap < bufOutCapacity) cap = bufOutCapacity;
         if (cap > bufOutCapacity * 10) cap = bufOutCapacity * 10;
+        if (cap > PDStreamFilterChainBufferCap) cap = PDStreamFilterChainBufferCap;
+        if (curr->bufOutOwned) 
+            PDStreamFilterBufferRecycle(curr->bufOutOwned, curr->bufOutOwnedCapacity);
+        next->bufIn = curr->bufOutOwned = curr->bufOut = PDStreamFilterBufferObtain(&cap);
         curr->bufOutCapacity = curr->bufOutOwnedCapacity = cap;
-        next->bufIn = curr->bufOutOwned = curr->bufOut = malloc(curr->bufOutCapacity);
         next->bufInAvailable = 0; //(*curr->begin)(curr);
         next->needsInput = true;
         next->hasInput = true;
     }
     
+    // the head's hasInput is left as is; it is only set by callers feeding input in several rounds
     filter->finished = false;
     filter->needsInput = true;
-    filter->hasInput = false;
     filter->bufOut = bufOut;
     filter->bufOutCapacity = bufOutCapacity;
     
@@ -198,15 +435,33 @@ PDInteger PDStreamFilterBegin(PDStreamFilterRef filter)
     return PDStreamFilterProceed(filter);
 }
 
+static inline PDInteger PDStreamFilterStep(PDStreamFilterRef filter, PDStreamFilterRef curr)
+{
+    // a chained filter waiting on input from its predecessor has nothing to do yet
+    if (curr != filter && curr->needsInput && curr->bufInAvailable == 0 && curr->hasInput) 
+        return 0;
+    
+    return curr->needsInput ? (*curr->begin)(curr) : (*curr->proceed)(curr);
+}
+
 PDInteger PDStreamFilterProceed(PDStreamFilterRef filter)
 {
     PDStreamFilterRef curr, prev, next;
     
     // don't waste time
-    if (filter->finished) return 0;
+    if (filter->finished) {
+        filter->progressed = false;
+        return 0;
+    }
     
     // or energy
-    if (filter->nextFilter == NULL) return (*filter->proceed)(filter);
+    PDInteger available;
+    if (filter->nextFilter == NULL) {
+        available = filter->bufInAvailable;
+        PDInteger result = (*filter->proceed)(filter);
+        filter->progressed = result > 0 || filter->bufInAvailable < available || filter->finished;
+        return result;
+    }
     
     // we pull out filter's output values
     PDInteger result = 0;
@@ -214,15 +469,21 @@ PDInteger PDStreamFilterProceed(PDStreamFilterRef filter)
     PDInteger bufOutCapacity = filter->bufOutCapacity;
     
     // iterate over each filter
+    PDBool progressed = false;
+    PDBool wasFinished;
+    PDInteger produced;
     prev = NULL;
     for (curr = filter; curr; curr = next) {
         next = curr->nextFilter;
         
-        if (curr->bufOutOwned && /*curr->bufOut - curr->bufOutOwned + 5 > bufOutCapacity &&*/ curr->bufOutOwnedCapacity < bufOutCapacity) {
-            // we're exhausting our buffer; grow to match main buffer (temporarily making this the case even when not exhausting)
-            curr->bufOutOwned = realloc(curr->bufOutOwned, bufOutCapacity);
+        if (curr->bufOutOwned && /*curr->bufOut - curr->bufOutOwned + 5 > bufOutCapacity &&*/ curr->bufOutOwnedCapacity < bufOutCapacity && curr->bufOutOwnedCapacity < PDStreamFilterChainBufferCap) {
+            // we're exhausting our buffer; grow to match main buffer (temporarily making this the case even when not exhausting), up to the chain buffer cap
+            PDInteger cap = bufOutCapacity < PDStreamFilterChainBufferCap ? bufOutCapacity : PDStreamFilterChainBufferCap;
+            PDInteger offs = next ? next->bufIn - curr->bufOutOwned : 0;
+            curr->bufOutOwned = realloc(curr->bufOutOwned, cap);
+            if (next) next->bufIn = curr->bufOutOwned + offs;
             curr->bufOut = NULL;
-            curr->bufOutOwnedCapacity = bufOutCapacity;
+            curr->bufOutOwnedCapacity = cap;
         }
         
         if (next) {
@@ -247,15 +508,23 @@ PDInteger PDStreamFilterProceed(PDStreamFilterRef filter)
                 curr->bufOutCapacity = curr->bufOutOwnedCapacity;
             }
             
-            next->bufInAvailable += (curr->needsInput ? (*curr->begin)(curr) : (*curr->proceed)(curr));
-            next->hasInput = curr->bufInAvailable > 0;
+            available = curr->bufInAvailable;
+            wasFinished = curr->finished;
+            produced = PDStreamFilterStep(filter, curr);
+            progressed |= produced > 0 || curr->bufInAvailable < available || (curr->finished && ! wasFinished);
+            next->bufInAvailable += produced;
+            next->hasInput = curr->bufInAvailable > 0 || ! curr->finished;
             
         } else {
             
             // last filter, which means we plug it into the "real" output buffer
             curr->bufOut = bufOut;
             curr->bufOutCapacity = bufOutCapacity;
-            result += curr->needsInput ? (*curr->begin)(curr) : (*curr->proceed)(curr);
+            available = curr->bufInAvailable;
+            wasFinished = curr->finished;
+            produced = PDStreamFilterStep(filter, curr);
+            progressed |= produced > 0 || curr->bufInAvailable < available || (curr->finished && ! wasFinished);
+            result += produced;
             bufOut = curr->bufOut;
             bufOutCapacity = curr->bufOutCapacity;
         
@@ -267,14 +536,15 @@ PDInteger PDStreamFilterProceed(PDStreamFilterRef filter)
         }
         
         // we may be in a situation where we consumed a lot of content and produced little; to prevent bottlenecks we will return to previous filters and reapply in these cases
-        if (prev && prev->bufInAvailable > 0 && curr->bufInAvailable < 64 && curr->bufOutCapacity > 64) {
-            // we have a prev, its input buffer has stuff, our input buffer has very little or no stuff, and our output buffer is capable of taking more stuff
+        if (prev && prev->bufInAvailable > 0 && ! prev->needsInput && curr->bufInAvailable < 64 && curr->bufOutCapacity > 64) {
+            // we have a prev, its input buffer has stuff it can process (as opposed to e.g. a partial predictor row), our input buffer has very little or no stuff, and our output buffer is capable of taking more stuff
             // this is a good sign that we may need to grow an inbetween buffer to not bounce around too much
-            if (prev->bufOutOwnedCapacity < result + bufOutCapacity) {
+            PDInteger cap = result + bufOutCapacity < PDStreamFilterChainBufferCap ? result + bufOutCapacity : PDStreamFilterChainBufferCap;
+            if (prev->bufOutOwnedCapacity < cap) {
                 PDInteger offs = curr->bufIn - prev->bufOutOwned;
-                prev->bufOutOwned = realloc(prev->bufOutOwned, result + bufOutCapacity);
+                prev->bufOutOwned = realloc(prev->bufOutOwned, cap);
                 curr->bufIn = prev->bufOutOwned + offs;
-                prev->bufOutOwnedCapacity = result + bufOutCapacity;
+                prev->bufOutOwnedCapacity = cap;
             }
             next = prev;
             curr = NULL;
@@ -293,6 +563,7 @@ PDInteger PDStreamFilterProceed(PDStreamFilterRef filter)
         finished &= curr->finished;
     
     filter->finished = finished;
+    filter->progressed = progressed;
 
     return result;
 }
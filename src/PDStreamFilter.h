@@ -58,6 +58,8 @@
  
  Chained filters are transparent to the caller, in the sense that the first filter in the chain holds the output buffer and capacity for the whole filter chain. 
  
+ Streams with multiple filters (i.e. a /Filter array, optionally with a matching /DecodeParms array) are set up as chains via PDStreamFilterObtainChain().
+ 
  @note Chained filters are an extension mechanism enabled via PDStreamFilterBegin() and PDStreamFilterProceed(). Calling a filter's begin or proceed function pointers directly will only execute that filter.
  
  @section filter_dual Dual filters and inversion
@@ -125,6 +127,7 @@ struct PDStreamFilter {
     PDBool hasInput;                    ///< Whether the filter has pending input that, for capacity reasons, has not been added to the buffer yet.
     PDBool finished;                    ///< Whether the filter is finished.
     PDBool failing;                     ///< Whether the filter is failing to handle its input.
+    PDBool progressed;                  ///< Whether the last PDStreamFilterProceed() call had any filter in the chain consume input, produce output, or finish.
     PDDictionaryRef options;            ///< Filter options
     void *data;                         ///< User info object.
     unsigned char *bufIn;               ///< Input buffer.
@@ -140,6 +143,7 @@ struct PDStreamFilter {
     float growthHint;                   ///< The growth hint is an indicator for how the filter expects the size of its resulting data to be relative to the unfiltered data. 
     unsigned char *bufOutOwned;         ///< Internal output buffer, that will be freed on destruction. This is used internally for chained filters.
     PDInteger bufOutOwnedCapacity;      ///< Capacity of internal output buffer.
+    PDInteger compressionLevel;         ///< Compression level for compressing filters, from 1 (fastest) to 9 (smallest), or 0 for the filter's default.
 };
 
 /**
@@ -177,6 +181,21 @@ extern void PDStreamFilterRegisterDualFilter(const char *name, PDStreamDualFilte
  */
 extern PDStreamFilterRef PDStreamFilterObtain(const char *name, PDBool inputEnd, PDDictionaryRef options);
 
+/**
+ Obtain a filter chain for the given /Filter and /DecodeParms values of a stream object. 
+ 
+ The filters value may be a single filter name or an array of names, and the decode parms value may be a single dictionary, an array of dictionaries (or nulls) matching the filters array, or NULL. Reader (decoder) chains run in the listed order, whereas writer (encoder) chains run in the reverse order, so that the writer chain for a given set of values produces data which the reader chain for the same values decodes.
+ 
+ Chained filters pass data to each other in bounded chunks, so intermediate stages never hold the entire stream.
+ 
+ @param filters     The /Filter value (a PDStringRef or a PDArrayRef), or NULL.
+ @param decodeParms The /DecodeParms value (a PDDictionaryRef or a PDArrayRef), or NULL.
+ @param inputEnd    Whether the input end (decoders) or output end (encoders) should be returned.
+ 
+ @return A created PDStreamFilterRef chain, or NULL if filters is NULL or empty, or if any of the filters is unsupported.
+ */
+extern PDStreamFilterRef PDStreamFilterObtainChain(void *filters, void *decodeParms, PDBool inputEnd);
+
 /**
  Append a filter to the filter, causing a chain.
  
@@ -187,6 +206,32 @@ extern PDStreamFilterRef PDStreamFilterObtain(const char *name, PDBool inputEnd,
  */
 extern void PDStreamFilterAppendFilter(PDStreamFilterRef filter, PDStreamFilterRef next);
 
+/**
+ Set the compression level for the filter and any filters chained to it.
+ 
+ The level is a hint for compressing filters, which trade output size for speed; it is ignored by other filters. It must be set before the filter is initialized.
+ 
+ @param filter The filter.
+ @param level The compression level, from 1 (fastest) to 9 (smallest), or 0 for the filter's default.
+ */
+extern void PDStreamFilterSetCompressionLevel(PDStreamFilterRef filter, PDInteger level);
+
+/**
+ Release resources kept around for reuse by filters on the calling thread.
+ 
+ Intermediate buffers of filter chains, as well as the zlib states of FlateDecode filters, are pooled when their filters are done with them, and handed to new filters on the same thread. The pools are kept per thread, so that worker threads filtering streams at the same time do not contend for them.
+ 
+ This is called when the PDF implementation is discarded, and for every other thread which pooled anything when it exits.
+ */
+extern void PDStreamFilterDrainPools(void);
+
+/**
+ Note that the calling thread is putting something in a filter pool, so that the thread's pools are drained when it exits.
+ 
+ This is called by the pools themselves, before they take anything in.
+ */
+extern void PDStreamFilterPoolsInUse(void);
+
 /**
  Initialize a filter.
  
@@ -195,9 +240,12 @@ extern void PDStreamFilterAppendFilter(PDStreamFilterRef filter, PDStreamFilterR
 extern PDBool PDStreamFilterInit(PDStreamFilterRef filter);
 
 /**
- Deinitialize a filter.
+ Deinitialize a filter, along with any filters chained to it.
+ 
+ The filters' pooled resources (zlib states and intermediate buffers) are handed to the calling thread's pools. Filters are deinitialized when they are destroyed as well, but filters used on a worker thread and released elsewhere should be deinitialized on the worker thread, so that the resources stay with the thread that uses them.
  
  @param filter The filter.
+ @return false if a filter failed to deinitialize.
  */
 extern PDBool PDStreamFilterDone(PDStreamFilterRef filter);
 
@@ -235,6 +283,25 @@ extern PDInteger PDStreamFilterProceed(PDStreamFilterRef filter);
  */
 extern PDBool PDStreamFilterApply(PDStreamFilterRef filter, unsigned char *src, unsigned char **dstPtr, PDInteger len, PDInteger *newlenPtr, PDInteger *allocatedlenPtr);
 
+/**
+ Apply a filter to the given buffer, sizing the destination buffer based on the expected size of the result.
+ 
+ If the expected length is right, the result is produced in a single allocation which is neither grown nor trimmed. If it is wrong, the buffer is grown as in PDStreamFilterApply().
+ 
+ The caller may provide the destination buffer: if *dstPtr is non-NULL, it must be a malloc()ed buffer whose capacity is given in *allocatedlenPtr, and it is used instead of a new buffer. It may be reallocated, so *dstPtr must be read back after the call. If *dstPtr is NULL, a new buffer is allocated.
+ 
+ @param filter          The filter to apply
+ @param src             The source buffer
+ @param dstPtr          The destination buffer pointer; points to the caller's buffer, or to NULL
+ @param len             The length of the source buffer content
+ @param newlenPtr       The filtered content length pointer
+ @param allocatedlenPtr The capacity of the caller's buffer, if any, and the resulting allocation size of the destination buffer (optional if *dstPtr is NULL)
+ @param expectedLen     The expected length of the filtered content (e.g. from a /DL entry), or 0 if unknown
+ 
+ @return true on success, false on failure.
+ */
+extern PDBool PDStreamFilterApplyWithHint(PDStreamFilterRef filter, unsigned char *src, unsigned char **dstPtr, PDInteger len, PDInteger *newlenPtr, PDInteger *allocatedlenPtr, PDInteger expectedLen);
+
 /**
  Create the inversion of the given filter, so that invert(filter(data)) == data
  
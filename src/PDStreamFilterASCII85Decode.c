@@ -0,0 +1,491 @@
+//
+// PDStreamFilterASCII85Decode.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "pd_internal.h"
+#include "PDStreamFilterASCII85Decode.h"
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_A85_SSE2
+#   include <cpuid.h>
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_A85_NEON
+#   include <arm_neon.h>
+#endif
+
+#define a85_line_length 75  ///< Number of characters per line when encoding
+
+#define A85_SPACE  -1
+#define A85_Z      -2
+#define A85_EOD    -3
+#define A85_BAD    -4
+
+typedef struct PDASCII85 *PDASCII85Ref;
+/**
+ ASCII base-85 state data for an ongoing encode/decode operation.
+ */
+struct PDASCII85 {
+    unsigned char spill[16];    ///< Output which did not fit into the output buffer last time around
+    PDInteger spillLen;         ///< Number of bytes in spill
+    PDInteger spillPos;         ///< Number of bytes in spill which have been written
+    unsigned long long tuple;   ///< The group currently being built
+    int count;                  ///< Number of bytes (encoding) or characters (decoding) in tuple
+    PDInteger column;           ///< Current line length while encoding
+    PDBool eod;                 ///< Whether the end of data marker was read or written
+    PDBool vector;              ///< Whether the vector decoder is used
+};
+
+static signed char a85_table[256];
+static PDBool a85_table_ready = false;
+#ifdef PD_SUPPORT_THREADS
+static pthread_once_t a85_table_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void a85_setup_table()
+{
+    int i;
+    for (i = 0; i < 256; i++) a85_table[i] = A85_BAD;
+    for (i = 0; i < 85; i++) a85_table['!' + i] = i;
+    a85_table[0] = a85_table['\t'] = a85_table['\n'] = a85_table['\f'] = a85_table['\r'] = a85_table[' '] = A85_SPACE;
+    a85_table['z'] = A85_Z;
+    a85_table['~'] = A85_EOD;
+    a85_table_ready = true;
+}
+
+static PDBool a85_vector_enabled = true;
+
+PDBool PDStreamFilterASCII85DecodeVectorAvailable(void)
+{
+#if defined(PD_A85_SSE2)
+    static int available = -1;
+    if (available == -1) {
+        unsigned int a, b, c, d;
+        available = __get_cpuid(1, &a, &b, &c, &d) && (d & bit_SSE2) != 0;
+    }
+    return available;
+#elif defined(PD_A85_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PDStreamFilterASCII85DecodeSetVectorEnabled(PDBool enabled)
+{
+    a85_vector_enabled = enabled;
+}
+
+#if defined(PD_A85_SSE2)
+
+// decode 4 groups (20 characters) into 16 bytes at dst; false, with nothing written, if a group has anything but digits in it or is out of range
+__attribute__((target("sse2")))
+static inline PDBool a85_decode_groups(const unsigned char *src, unsigned char *dst)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_set1_epi8('!' - 1);
+    __m128i hi = _mm_set1_epi8('u' + 1);
+    __m128i c01, c23, digit, p0, p1, p2, p3, r01, r23, q, e, max, over, v;
+    
+    // two groups per register, in bytes 0-4 and 8-12; characters from 0x80 up are negative, and so not digits
+    c01 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)src), _mm_loadl_epi64((const __m128i *)(src + 5)));
+    c23 = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(src + 10)), _mm_loadl_epi64((const __m128i *)(src + 15)));
+    digit = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi8(c01, lo), _mm_cmplt_epi8(c01, hi)), 
+                          _mm_and_si128(_mm_cmpgt_epi8(c23, lo), _mm_cmplt_epi8(c23, hi)));
+    if ((_mm_movemask_epi8(digit) & 0x1f1f) != 0x1f1f) return false;
+    c01 = _mm_sub_epi8(c01, _mm_set1_epi8('!'));
+    c23 = _mm_sub_epi8(c23, _mm_set1_epi8('!'));
+    
+    // d0 * 85 + d1, d2 * 85 + d3 and d4 of each group
+    p0 = _mm_madd_epi16(_mm_unpacklo_epi8(c01, zero), _mm_setr_epi16(85, 1, 85, 1, 1, 0, 0, 0));
+    p1 = _mm_madd_epi16(_mm_unpackhi_epi8(c01, zero), _mm_setr_epi16(85, 1, 85, 1, 1, 0, 0, 0));
+    p2 = _mm_madd_epi16(_mm_unpacklo_epi8(c23, zero), _mm_setr_epi16(85, 1, 85, 1, 1, 0, 0, 0));
+    p3 = _mm_madd_epi16(_mm_unpackhi_epi8(c23, zero), _mm_setr_epi16(85, 1, 85, 1, 1, 0, 0, 0));
+    
+    // q = (d0 * 85 + d1) * 85^2 + d2 * 85 + d3 and e = d4, transposed into one register each
+    r01 = _mm_madd_epi16(_mm_packs_epi32(p0, p1), _mm_setr_epi16(7225, 1, 1, 0, 7225, 1, 1, 0));
+    r23 = _mm_madd_epi16(_mm_packs_epi32(p2, p3), _mm_setr_epi16(7225, 1, 1, 0, 7225, 1, 1, 0));
+    r01 = _mm_shuffle_epi32(r01, _MM_SHUFFLE(3, 1, 2, 0));
+    r23 = _mm_shuffle_epi32(r23, _MM_SHUFFLE(3, 1, 2, 0));
+    q = _mm_unpacklo_epi64(r01, r23);
+    e = _mm_unpackhi_epi64(r01, r23);
+    
+    // 0xffffffff is 85 * 50529027, so q * 85 + e is in range if q is below that, or equal to it with e 0
+    max = _mm_set1_epi32(50529027);
+    over = _mm_or_si128(_mm_cmpgt_epi32(q, max), _mm_andnot_si128(_mm_cmpeq_epi32(e, zero), _mm_cmpeq_epi32(q, max)));
+    if (_mm_movemask_epi8(over)) return false;
+    
+    // q * 85 + e, with 85 = 64 + 16 + 4 + 1, stored big endian
+    v = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(q, 6), _mm_slli_epi32(q, 4)), _mm_add_epi32(_mm_slli_epi32(q, 2), _mm_add_epi32(q, e)));
+    v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+    _mm_storeu_si128((__m128i *)dst, v);
+    return true;
+}
+
+#elif defined(PD_A85_NEON)
+
+// decode 4 groups (20 characters) into 16 bytes at dst; false, with nothing written, if a group has anything but digits in it or is out of range
+static inline PDBool a85_decode_groups(const unsigned char *src, unsigned char *dst)
+{
+    static const uint16_t weights[8] = { 85, 1, 85, 1, 1, 0, 0, 0 };
+    uint16x8_t w = vld1q_u16(weights);
+    uint8x16_t c01, c23;
+    uint64x2_t digit, over;
+    uint32x4_t p0, p1, p2, p3, a, b, e, q, max;
+    uint32x4x2_t t01, t23;
+    
+    // two groups per register, in bytes 0-4 and 8-12; the subtraction wraps around, so a single unsigned comparison checks the range
+    c01 = vsubq_u8(vcombine_u8(vld1_u8(src), vld1_u8(src + 5)), vdupq_n_u8('!'));
+    c23 = vsubq_u8(vcombine_u8(vld1_u8(src + 10), vld1_u8(src + 15)), vdupq_n_u8('!'));
+    digit = vreinterpretq_u64_u8(vandq_u8(vcleq_u8(c01, vdupq_n_u8(84)), vcleq_u8(c23, vdupq_n_u8(84))));
+    if ((vgetq_lane_u64(digit, 0) & vgetq_lane_u64(digit, 1) & 0xffffffffffULL) != 0xffffffffffULL) return false;
+    
+    // d0 * 85 + d1, d2 * 85 + d3 and d4 of each group
+    p0 = vpaddlq_u16(vmulq_u16(vmovl_u8(vget_low_u8(c01)), w));
+    p1 = vpaddlq_u16(vmulq_u16(vmovl_u8(vget_high_u8(c01)), w));
+    p2 = vpaddlq_u16(vmulq_u16(vmovl_u8(vget_low_u8(c23)), w));
+    p3 = vpaddlq_u16(vmulq_u16(vmovl_u8(vget_high_u8(c23)), w));
+    
+    // transposed into one register each
+    t01 = vtrnq_u32(p0, p1);
+    t23 = vtrnq_u32(p2, p3);
+    a = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+    b = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+    e = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+    
+    // q = (d0 * 85 + d1) * 85^2 + d2 * 85 + d3; 0xffffffff is 85 * 50529027, so q * 85 + e is in range if q is below that, or equal to it with e 0
+    q = vmlaq_n_u32(b, a, 7225);
+    max = vdupq_n_u32(50529027);
+    over = vreinterpretq_u64_u32(vorrq_u32(vcgtq_u32(q, max), vandq_u32(vceqq_u32(q, max), vtstq_u32(e, e))));
+    if (vgetq_lane_u64(over, 0) | vgetq_lane_u64(over, 1)) return false;
+    
+    // q * 85 + e, stored big endian
+    vst1q_u8(dst, vrev32q_u8(vreinterpretq_u8_u32(vmlaq_n_u32(e, q, 85))));
+    return true;
+}
+
+#endif
+
+#if defined(PD_A85_SSE2) || defined(PD_A85_NEON)
+
+#if defined(PD_A85_SSE2)
+__attribute__((target("sse2")))
+#endif
+static void a85_decode_vec(unsigned char **src, unsigned char **dst, PDInteger *avail, PDInteger *cap)
+{
+    unsigned char *s = *src;
+    unsigned char *d = *dst;
+    PDInteger a = *avail;
+    PDInteger n = *cap;
+    
+    // the last group is read 8 bytes at a time, i.e. 3 bytes past its end
+    while (a >= 23 && n >= 16 && a85_decode_groups(s, d)) {
+        s += 20;
+        a -= 20;
+        d += 16;
+        n -= 16;
+    }
+    
+    *src = s;
+    *dst = d;
+    *avail = a;
+    *cap = n;
+}
+
+#endif
+
+static inline void a85_drain(PDASCII85Ref a85, unsigned char **dst, PDInteger *cap)
+{
+    while (a85->spillPos < a85->spillLen && *cap > 0) {
+        *(*dst)++ = a85->spill[a85->spillPos++];
+        (*cap)--;
+    }
+    if (a85->spillPos == a85->spillLen) 
+        a85->spillPos = a85->spillLen = 0;
+}
+
+static inline void a85_put(PDASCII85Ref a85, unsigned char **dst, PDInteger *cap, unsigned char c)
+{
+    if (*cap > 0) {
+        *(*dst)++ = c;
+        (*cap)--;
+    } else {
+        a85->spill[a85->spillLen++] = c;
+    }
+}
+
+static inline void a85_encode_group(PDASCII85Ref a85, unsigned char **dst, PDInteger *cap, unsigned int tuple, int bytes)
+{
+    char enc[5];
+    int i;
+    
+    if (bytes == 4 && tuple == 0) {
+        a85_put(a85, dst, cap, 'z');
+        a85->column++;
+    } else {
+        for (i = 4; i >= 0; i--) {
+            enc[i] = '!' + tuple % 85;
+            tuple /= 85;
+        }
+        // a partial group of n bytes is written as n + 1 characters
+        for (i = 0; i <= bytes; i++) 
+            a85_put(a85, dst, cap, enc[i]);
+        a85->column += bytes + 1;
+    }
+    
+    if (a85->column >= a85_line_length) {
+        a85_put(a85, dst, cap, '\n');
+        a85->column = 0;
+    }
+}
+
+static inline void a85_decode_group(PDASCII85Ref a85, unsigned char **dst, PDInteger *cap, unsigned long long tuple, int bytes)
+{
+    int i;
+    for (i = 0; i < bytes; i++) 
+        a85_put(a85, dst, cap, (tuple >> (24 - 8 * i)) & 0xff);
+}
+
+PDInteger a85_init(PDStreamFilterRef filter)
+{
+    if (filter->initialized)
+        return true;
+    
+#ifdef PD_SUPPORT_THREADS
+    // filters are set up on worker threads as well
+    pthread_once(&a85_table_once, a85_setup_table);
+#else
+    if (! a85_table_ready) a85_setup_table();
+#endif
+    
+    PDASCII85Ref a85 = calloc(1, sizeof(struct PDASCII85));
+    a85->vector = a85_vector_enabled && PDStreamFilterASCII85DecodeVectorAvailable();
+    filter->data = a85;
+    
+    filter->initialized = true;
+    
+    return true;
+}
+
+PDInteger a85_done(PDStreamFilterRef filter)
+{
+    PDAssert(filter->initialized);
+    
+    free(filter->data);
+    filter->data = NULL;
+    
+    filter->initialized = false;
+    
+    return true;
+}
+
+PDInteger a85_encode_proceed(PDStreamFilterRef filter)
+{
+    PDASCII85Ref a85 = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    
+    a85_drain(a85, &dst, &cap);
+    
+    while (avail > 0 && a85->spillLen == 0) {
+        if (a85->count == 0) {
+            // fast path: whole groups which fit in the output buffer along with a line break
+            while (avail >= 4 && cap >= 6) {
+                a85_encode_group(a85, &dst, &cap, (unsigned int)src[0] << 24 | src[1] << 16 | src[2] << 8 | src[3], 4);
+                src += 4;
+                avail -= 4;
+            }
+            if (avail == 0) break;
+        }
+        
+        a85->tuple |= (unsigned long long)*src << (24 - 8 * a85->count);
+        src++;
+        avail--;
+        if (++a85->count == 4) {
+            a85_encode_group(a85, &dst, &cap, (unsigned int)a85->tuple, 4);
+            a85->tuple = 0;
+            a85->count = 0;
+        }
+    }
+    
+    if (avail == 0 && ! filter->hasInput && ! a85->eod) {
+        if (a85->count > 0) {
+            a85_encode_group(a85, &dst, &cap, (unsigned int)a85->tuple, a85->count);
+            a85->tuple = 0;
+            a85->count = 0;
+        }
+        a85_put(a85, &dst, &cap, '~');
+        a85_put(a85, &dst, &cap, '>');
+        a85->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = a85->eod && a85->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger a85_decode_proceed(PDStreamFilterRef filter)
+{
+    PDASCII85Ref a85 = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    unsigned long long tuple;
+    signed char v;
+    
+    a85_drain(a85, &dst, &cap);
+    
+    while (avail > 0 && a85->spillLen == 0 && ! a85->eod && ! filter->failing) {
+        if (a85->count == 0) {
+#if defined(PD_A85_SSE2) || defined(PD_A85_NEON)
+            // vector fast path: 4 groups at a time, up to the first group with a 'z', whitespace or a value out of range in it
+            if (a85->vector) 
+                a85_decode_vec(&src, &dst, &avail, &cap);
+#endif
+            // fast path: groups of 5 digits with no interspersed whitespace; negative table values (anything but a digit) make the OR negative
+            while (avail >= 5 && cap >= 4 && (a85_table[src[0]] | a85_table[src[1]] | a85_table[src[2]] | a85_table[src[3]] | a85_table[src[4]]) >= 0) {
+                tuple = (((((unsigned long long)a85_table[src[0]] * 85 + a85_table[src[1]]) * 85 + a85_table[src[2]]) * 85 + a85_table[src[3]]) * 85 + a85_table[src[4]]);
+                if (tuple > 0xffffffffULL) break;
+                dst[0] = tuple >> 24;
+                dst[1] = tuple >> 16;
+                dst[2] = tuple >> 8;
+                dst[3] = tuple;
+                dst += 4;
+                cap -= 4;
+                src += 5;
+                avail -= 5;
+            }
+            if (avail == 0) break;
+        }
+        
+        v = a85_table[*src];
+        if (v >= 0) {
+            a85->tuple = a85->tuple * 85 + v;
+            if (++a85->count == 5) {
+                if (a85->tuple > 0xffffffffULL) {
+                    PDWarn("ASCII85Decode group out of range\n");
+                    filter->failing = true;
+                    break;
+                }
+                a85_decode_group(a85, &dst, &cap, a85->tuple, 4);
+                a85->tuple = 0;
+                a85->count = 0;
+            }
+        } else if (v == A85_Z && a85->count == 0) {
+            a85_decode_group(a85, &dst, &cap, 0, 4);
+        } else if (v == A85_EOD) {
+            // the '>' following '~' is skipped along with anything else after the EOD marker
+            a85->eod = true;
+        } else if (v != A85_SPACE) {
+            PDWarn("invalid character in ASCII85Decode stream: 0x%02x\n", *src);
+            filter->failing = true;
+            break;
+        }
+        src++;
+        avail--;
+    }
+    
+    PDBool ended = a85->eod || (avail == 0 && ! filter->hasInput);
+    if (ended) {
+        if (a85->count == 1) {
+            PDWarn("ASCII85Decode stream ends with a single character group; ignoring\n");
+        } else if (a85->count > 1) {
+            // a partial group of n characters is padded with 'u' and yields n - 1 bytes
+            tuple = a85->tuple;
+            for (v = a85->count; v < 5; v++) tuple = tuple * 85 + 84;
+            a85_decode_group(a85, &dst, &cap, tuple, a85->count - 1);
+        }
+        a85->tuple = 0;
+        a85->count = 0;
+        src += avail;
+        avail = 0;
+        a85->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = ended && a85->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger a85_encode_begin(PDStreamFilterRef filter)
+{
+    return a85_encode_proceed(filter);
+}
+
+PDInteger a85_decode_begin(PDStreamFilterRef filter)
+{
+    return a85_decode_proceed(filter);
+}
+
+PDStreamFilterRef a85_encode_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterASCII85DecodeDecodeCreate(NULL);
+}
+
+PDStreamFilterRef a85_decode_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterASCII85DecodeEncodeCreate(NULL);
+}
+
+PDStreamFilterRef PDStreamFilterASCII85DecodeEncodeCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(a85_init, a85_done, a85_encode_begin, a85_encode_proceed, a85_encode_invert, options);
+    filter->growthHint = 1.3f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterASCII85DecodeDecodeCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(a85_init, a85_done, a85_decode_begin, a85_decode_proceed, a85_decode_invert, options);
+    filter->growthHint = 0.8f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterASCII85DecodeConstructor(PDBool inputEnd, PDDictionaryRef options)
+{
+    return (inputEnd
+            ? PDStreamFilterASCII85DecodeDecodeCreate(options)
+            : PDStreamFilterASCII85DecodeEncodeCreate(options));
+}
@@ -0,0 +1,82 @@
+//
+// PDStreamFilterASCII85Decode.h
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/**
+ @file PDStreamFilterASCII85Decode.h
+ 
+ @ingroup PDSTREAMFILTERASCII85DECODE
+ 
+ @defgroup PDSTREAMFILTERASCII85DECODE PDStreamFilterASCII85Decode
+ 
+ @brief ASCII base-85 (encoding/decoding) stream filter
+ 
+ @ingroup PDINTERNAL
+ 
+ @implements PDSTREAMFILTER
+ 
+ Every 4 bytes of binary data are represented by 5 characters in the range '!' to 'u', with 'z' as shorthand for 4 zero bytes. The data is terminated by '~>'.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PDStreamFilterASCII85Decode_h
+#define INCLUDED_PDStreamFilterASCII85Decode_h
+
+#include "PDStreamFilter.h"
+
+/**
+ Set up a stream filter for ASCII85Decode encoding.
+ */
+extern PDStreamFilterRef PDStreamFilterASCII85DecodeEncodeCreate(PDDictionaryRef options);
+
+/**
+ Set up stream filter for ASCII85Decode decoding.
+ */
+extern PDStreamFilterRef PDStreamFilterASCII85DecodeDecodeCreate(PDDictionaryRef options);
+
+/**
+ Set up a stream filter for ASCII85Decode based on inputEnd boolean. 
+ */
+extern PDStreamFilterRef PDStreamFilterASCII85DecodeConstructor(PDBool inputEnd, PDDictionaryRef options);
+
+/**
+ Determine whether the vector (SSE2 or NEON) decoder is available, which decodes 4 groups of digits at a time.
+ 
+ @return true if the vector decoder is available.
+ */
+extern PDBool PDStreamFilterASCII85DecodeVectorAvailable(void);
+
+/**
+ Enable or disable the vector decoder (it is enabled by default, where available), e.g. to compare it against the portable one.
+ 
+ The setting applies to filters initialized after the call, and is not meant to be changed while filters are being set up on other threads.
+ 
+ @param enabled Whether the vector decoder is used.
+ */
+extern void PDStreamFilterASCII85DecodeSetVectorEnabled(PDBool enabled);
+
+#endif
+
+/** @} */
@@ -0,0 +1,418 @@
+//
+// PDStreamFilterASCIIHexDecode.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "pd_internal.h"
+#include "PDStreamFilterASCIIHexDecode.h"
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_AHX_SSE2
+#   include <cpuid.h>
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_AHX_NEON
+#   include <arm_neon.h>
+#endif
+
+#define ahx_line_length 64  ///< Number of hex digits per line when encoding
+
+#define AHX_SPACE  -1
+#define AHX_EOD    -2
+#define AHX_BAD    -3
+
+typedef struct PDASCIIHex *PDASCIIHexRef;
+/**
+ ASCII hex state data for an ongoing encode/decode operation.
+ */
+struct PDASCIIHex {
+    unsigned char spill[4];     ///< Output which did not fit into the output buffer last time around
+    PDInteger spillLen;         ///< Number of bytes in spill
+    PDInteger spillPos;         ///< Number of bytes in spill which have been written
+    int nibble;                 ///< Pending high nibble while decoding, or -1 if none
+    PDInteger column;           ///< Current line length while encoding
+    PDBool eod;                 ///< Whether the end of data marker was read or written
+    PDBool vector;              ///< Whether the vector decoder is used
+};
+
+static const char ahx_digits[] = "0123456789ABCDEF";
+static signed char ahx_table[256];
+static PDBool ahx_table_ready = false;
+#ifdef PD_SUPPORT_THREADS
+static pthread_once_t ahx_table_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void ahx_setup_table()
+{
+    int i;
+    for (i = 0; i < 256; i++) ahx_table[i] = AHX_BAD;
+    for (i = 0; i < 10; i++) ahx_table['0' + i] = i;
+    for (i = 0; i < 6; i++) ahx_table['a' + i] = ahx_table['A' + i] = 10 + i;
+    ahx_table[0] = ahx_table['\t'] = ahx_table['\n'] = ahx_table['\f'] = ahx_table['\r'] = ahx_table[' '] = AHX_SPACE;
+    ahx_table['>'] = AHX_EOD;
+    ahx_table_ready = true;
+}
+
+static PDBool ahx_vector_enabled = true;
+
+PDBool PDStreamFilterASCIIHexDecodeVectorAvailable(void)
+{
+#if defined(PD_AHX_SSE2)
+    static int available = -1;
+    if (available == -1) {
+        unsigned int a, b, c, d;
+        available = __get_cpuid(1, &a, &b, &c, &d) && (d & bit_SSE2) != 0;
+    }
+    return available;
+#elif defined(PD_AHX_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PDStreamFilterASCIIHexDecodeSetVectorEnabled(PDBool enabled)
+{
+    ahx_vector_enabled = enabled;
+}
+
+#if defined(PD_AHX_SSE2)
+
+// the values of 16 characters which are hex digits; valid is set to 0xff for those, and 0 for the others
+__attribute__((target("sse2")))
+static inline __m128i ahx_sse2_values(__m128i c, __m128i *valid)
+{
+    // characters from 0x80 up are negative, and so neither digits nor letters
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    *valid = _mm_or_si128(digit, alpha);
+    return _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))), 
+                        _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+// the 8 bytes given by 16 digit values, one in the low byte of each 16 bit lane
+__attribute__((target("sse2")))
+static inline __m128i ahx_sse2_pack(__m128i v)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(v, 4), _mm_set1_epi16(0xf0)), _mm_srli_epi16(v, 8));
+}
+
+__attribute__((target("sse2")))
+static void ahx_decode_vec(unsigned char **src, unsigned char **dst, PDInteger *avail, PDInteger *cap)
+{
+    unsigned char *s = *src;
+    unsigned char *d = *dst;
+    PDInteger a = *avail;
+    PDInteger n = *cap;
+    __m128i v0, v1, valid0, valid1;
+    
+    while (a >= 32 && n >= 16) {
+        v0 = ahx_sse2_values(_mm_loadu_si128((const __m128i *)s), &valid0);
+        v1 = ahx_sse2_values(_mm_loadu_si128((const __m128i *)(s + 16)), &valid1);
+        if (_mm_movemask_epi8(_mm_and_si128(valid0, valid1)) != 0xffff) break;
+        _mm_storeu_si128((__m128i *)d, _mm_packus_epi16(ahx_sse2_pack(v0), ahx_sse2_pack(v1)));
+        s += 32;
+        a -= 32;
+        d += 16;
+        n -= 16;
+    }
+    
+    *src = s;
+    *dst = d;
+    *avail = a;
+    *cap = n;
+}
+
+#elif defined(PD_AHX_NEON)
+
+// the values of 16 characters which are hex digits; valid is set to 0xff for those, and 0 for the others
+static inline uint8x16_t ahx_neon_values(uint8x16_t c, uint8x16_t *valid)
+{
+    // the subtractions wrap around, so a single unsigned comparison checks each range
+    uint8x16_t lower = vorrq_u8(c, vdupq_n_u8(0x20));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(9));
+    uint8x16_t alpha = vcleq_u8(vsubq_u8(lower, vdupq_n_u8('a')), vdupq_n_u8(5));
+    *valid = vorrq_u8(digit, alpha);
+    return vorrq_u8(vandq_u8(digit, vsubq_u8(c, vdupq_n_u8('0'))), 
+                    vandq_u8(alpha, vsubq_u8(lower, vdupq_n_u8('a' - 10))));
+}
+
+static void ahx_decode_vec(unsigned char **src, unsigned char **dst, PDInteger *avail, PDInteger *cap)
+{
+    unsigned char *s = *src;
+    unsigned char *d = *dst;
+    PDInteger a = *avail;
+    PDInteger n = *cap;
+    uint8x16x2_t c;
+    uint8x16_t hi, lo, valid0, valid1;
+    uint64x2_t valid;
+    
+    while (a >= 32 && n >= 16) {
+        // the high and low digits of 16 bytes, deinterleaved
+        c = vld2q_u8(s);
+        hi = ahx_neon_values(c.val[0], &valid0);
+        lo = ahx_neon_values(c.val[1], &valid1);
+        valid = vreinterpretq_u64_u8(vandq_u8(valid0, valid1));
+        if ((vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1)) != ~0ULL) break;
+        vst1q_u8(d, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+        s += 32;
+        a -= 32;
+        d += 16;
+        n -= 16;
+    }
+    
+    *src = s;
+    *dst = d;
+    *avail = a;
+    *cap = n;
+}
+
+#endif
+
+static inline void ahx_drain(PDASCIIHexRef ahx, unsigned char **dst, PDInteger *cap)
+{
+    while (ahx->spillPos < ahx->spillLen && *cap > 0) {
+        *(*dst)++ = ahx->spill[ahx->spillPos++];
+        (*cap)--;
+    }
+    if (ahx->spillPos == ahx->spillLen) 
+        ahx->spillPos = ahx->spillLen = 0;
+}
+
+static inline void ahx_put(PDASCIIHexRef ahx, unsigned char **dst, PDInteger *cap, unsigned char c)
+{
+    if (*cap > 0) {
+        *(*dst)++ = c;
+        (*cap)--;
+    } else {
+        ahx->spill[ahx->spillLen++] = c;
+    }
+}
+
+PDInteger ahx_init(PDStreamFilterRef filter)
+{
+    if (filter->initialized)
+        return true;
+    
+#ifdef PD_SUPPORT_THREADS
+    // filters are set up on worker threads as well
+    pthread_once(&ahx_table_once, ahx_setup_table);
+#else
+    if (! ahx_table_ready) ahx_setup_table();
+#endif
+    
+    PDASCIIHexRef ahx = calloc(1, sizeof(struct PDASCIIHex));
+    ahx->nibble = -1;
+    ahx->vector = ahx_vector_enabled && PDStreamFilterASCIIHexDecodeVectorAvailable();
+    filter->data = ahx;
+    
+    filter->initialized = true;
+    
+    return true;
+}
+
+PDInteger ahx_done(PDStreamFilterRef filter)
+{
+    PDAssert(filter->initialized);
+    
+    free(filter->data);
+    filter->data = NULL;
+    
+    filter->initialized = false;
+    
+    return true;
+}
+
+PDInteger ahx_encode_proceed(PDStreamFilterRef filter)
+{
+    PDASCIIHexRef ahx = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    PDInteger i, n;
+    
+    ahx_drain(ahx, &dst, &cap);
+    
+    while (avail > 0 && ahx->spillLen == 0) {
+        // fast path: as much of the current line as fits in the output buffer
+        n = (ahx_line_length - ahx->column) / 2;
+        if (n > avail) n = avail;
+        if (n > cap / 2) n = cap / 2;
+        for (i = 0; i < n; i++) {
+            dst[0] = ahx_digits[src[i] >> 4];
+            dst[1] = ahx_digits[src[i] & 0xf];
+            dst += 2;
+        }
+        src += n;
+        avail -= n;
+        cap -= n << 1;
+        ahx->column += n << 1;
+        
+        if (ahx->column >= ahx_line_length) {
+            ahx_put(ahx, &dst, &cap, '\n');
+            ahx->column = 0;
+        } else if (avail > 0 && cap < 2) {
+            // straddling the end of the output buffer
+            ahx_put(ahx, &dst, &cap, ahx_digits[*src >> 4]);
+            ahx_put(ahx, &dst, &cap, ahx_digits[*src & 0xf]);
+            src++;
+            avail--;
+            ahx->column += 2;
+        }
+    }
+    
+    if (avail == 0 && ! filter->hasInput && ! ahx->eod) {
+        ahx_put(ahx, &dst, &cap, '>');
+        ahx->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = ahx->eod && ahx->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger ahx_decode_proceed(PDStreamFilterRef filter)
+{
+    PDASCIIHexRef ahx = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    signed char hi, lo;
+    
+    ahx_drain(ahx, &dst, &cap);
+    
+    while (avail > 0 && cap > 0 && ! ahx->eod && ! filter->failing) {
+        if (ahx->nibble < 0) {
+#if defined(PD_AHX_SSE2) || defined(PD_AHX_NEON)
+            // vector fast path: 32 digits at a time, up to the first block with anything but digits in it
+            if (ahx->vector) 
+                ahx_decode_vec(&src, &dst, &avail, &cap);
+#endif
+            // fast path: runs of digit pairs, which is what most encoders produce between line breaks
+            while (avail >= 2 && cap > 0 && (hi = ahx_table[src[0]]) >= 0 && (lo = ahx_table[src[1]]) >= 0) {
+                *dst++ = (hi << 4) | lo;
+                src += 2;
+                avail -= 2;
+                cap--;
+            }
+            if (avail == 0 || cap == 0) break;
+        }
+        
+        hi = ahx_table[*src];
+        if (hi >= 0) {
+            if (ahx->nibble < 0) {
+                ahx->nibble = hi;
+            } else {
+                *dst++ = (ahx->nibble << 4) | hi;
+                cap--;
+                ahx->nibble = -1;
+            }
+        } else if (hi == AHX_EOD) {
+            ahx->eod = true;
+        } else if (hi == AHX_BAD) {
+            PDWarn("invalid character in ASCIIHexDecode stream: 0x%02x\n", *src);
+            filter->failing = true;
+            break;
+        }
+        src++;
+        avail--;
+    }
+    
+    PDBool ended = ahx->eod || (avail == 0 && ! filter->hasInput);
+    if (ended) {
+        // an odd trailing digit is followed by an implicit 0
+        if (ahx->nibble >= 0) {
+            ahx_put(ahx, &dst, &cap, ahx->nibble << 4);
+            ahx->nibble = -1;
+        }
+        // anything after the EOD marker is ignored
+        src += avail;
+        avail = 0;
+        ahx->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = ended && ahx->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger ahx_encode_begin(PDStreamFilterRef filter)
+{
+    return ahx_encode_proceed(filter);
+}
+
+PDInteger ahx_decode_begin(PDStreamFilterRef filter)
+{
+    return ahx_decode_proceed(filter);
+}
+
+PDStreamFilterRef ahx_encode_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterASCIIHexDecodeDecodeCreate(NULL);
+}
+
+PDStreamFilterRef ahx_decode_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterASCIIHexDecodeEncodeCreate(NULL);
+}
+
+PDStreamFilterRef PDStreamFilterASCIIHexDecodeEncodeCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(ahx_init, ahx_done, ahx_encode_begin, ahx_encode_proceed, ahx_encode_invert, options);
+    filter->growthHint = 2.1f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterASCIIHexDecodeDecodeCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(ahx_init, ahx_done, ahx_decode_begin, ahx_decode_proceed, ahx_decode_invert, options);
+    filter->growthHint = 0.5f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterASCIIHexDecodeConstructor(PDBool inputEnd, PDDictionaryRef options)
+{
+    return (inputEnd
+            ? PDStreamFilterASCIIHexDecodeDecodeCreate(options)
+            : PDStreamFilterASCIIHexDecodeEncodeCreate(options));
+}
@@ -31,6 +31,219 @@
 #include "zlib.h"
 #include "PDDictionary.h"
 
+#ifdef PD_SUPPORT_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
+#define fd_default_level 5  ///< Compression level used when the filter has none set
+#define fd_pool_cap     16  ///< Maximum number of idle states kept around for reuse
+
+typedef struct PDFlate *PDFlateRef;
+/**
+ FlateDecode state data for an ongoing compress/decompress operation.
+ 
+ States are pooled when their filter is done, and reset rather than re-initialized for the next filter of the same kind.
+ */
+struct PDFlate {
+    z_stream stream;            ///< The zlib stream, used for streamed filtering
+    int level;                  ///< The compression level, or -1 for decompression
+    PDBool broken;              ///< If set, the zlib stream has been torn down and the state cannot be reused
+    PDBool outputFull;          ///< If set, the last inflate filled the output buffer, and zlib may be holding on to more output
+    PDFlateRef next;            ///< Next idle state in the pool
+#ifdef PD_SUPPORT_LIBDEFLATE
+    struct libdeflate_compressor *compressor;       ///< libdeflate compressor, if used
+    struct libdeflate_decompressor *decompressor;   ///< libdeflate decompressor, if used
+    PDBool wholeMode;           ///< Whether whole-buffer filtering via libdeflate is in progress
+    unsigned char *whole;       ///< Output buffer for whole-buffer filtering; this is kept when the state is pooled
+    PDInteger wholeCap;         ///< Capacity of whole
+    PDInteger wholeLen;         ///< Length of output in whole
+    PDInteger wholePos;         ///< Number of bytes of whole which have been written
+    PDInteger wholeIn;          ///< Number of input bytes consumed by whole-buffer filtering
+#endif
+};
+
+#ifdef PD_SUPPORT_LIBDEFLATE
+#define fd_whole_pool_limit (1 << 20)   ///< Largest whole-buffer output buffer kept when a state is pooled
+#endif
+
+/**
+ The pool of idle states, along with the output-to-input ratio seen by recent decompressions, which is used as the growth hint for new decompression filters.
+ 
+ Like the chain buffer pool in PDStreamFilter.c, this is kept per thread, and drained when the thread exits.
+ */
+static PD_THREAD_LOCAL struct {
+    PDFlateRef idle;
+    PDInteger count;
+    float inflateRatio;
+} fd_pool;
+
+static void fd_destroy(PDFlateRef fl)
+{
+    if (! fl->broken) {
+        if (fl->level < 0) inflateEnd(&fl->stream); else deflateEnd(&fl->stream);
+    }
+#ifdef PD_SUPPORT_LIBDEFLATE
+    if (fl->compressor) libdeflate_free_compressor(fl->compressor);
+    if (fl->decompressor) libdeflate_free_decompressor(fl->decompressor);
+    free(fl->whole);
+#endif
+    free(fl);
+}
+
+static PDFlateRef fd_obtain(int level)
+{
+    PDFlateRef fl, *prev;
+    
+    for (prev = &fd_pool.idle; *prev && (*prev)->level != level; prev = &(*prev)->next) ;
+    fl = *prev;
+    if (fl) {
+        *prev = fl->next;
+        fd_pool.count--;
+    }
+    
+    if (fl) {
+        fl->next = NULL;
+        return fl;
+    }
+    
+    fl = calloc(1, sizeof(struct PDFlate));
+    fl->level = level;
+    
+    // zalloc, zfree, opaque, next_in are all Z_NULL from calloc
+    if (Z_OK != (level < 0 ? inflateInit(&fl->stream) : deflateInit(&fl->stream, level))) {
+        free(fl);
+        return NULL;
+    }
+    
+    return fl;
+}
+
+static void fd_recycle(PDFlateRef fl)
+{
+    if (fl->broken || Z_OK != (fl->level < 0 ? inflateReset(&fl->stream) : deflateReset(&fl->stream))) {
+        fd_destroy(fl);
+        return;
+    }
+    
+    fl->outputFull = false;
+    
+#ifdef PD_SUPPORT_LIBDEFLATE
+    fl->wholeMode = false;
+    if (fl->wholeCap > fd_whole_pool_limit) {
+        free(fl->whole);
+        fl->whole = NULL;
+        fl->wholeCap = 0;
+    }
+#endif
+    
+    if (fd_pool.count < fd_pool_cap) {
+        PDStreamFilterPoolsInUse();
+        fl->next = fd_pool.idle;
+        fd_pool.idle = fl;
+        fd_pool.count++;
+        fl = NULL;
+    }
+    
+    if (fl) fd_destroy(fl);
+}
+
+void PDStreamFilterFlateDecodeDrainPool(void)
+{
+    PDFlateRef fl;
+    
+    fl = fd_pool.idle;
+    fd_pool.idle = NULL;
+    fd_pool.count = 0;
+    
+    while (fl) {
+        PDFlateRef next = fl->next;
+        fd_destroy(fl);
+        fl = next;
+    }
+}
+
+#ifdef PD_SUPPORT_LIBDEFLATE
+
+#define fd_whole_limit  (1 << 30)   ///< Largest output buffer attempted for whole-buffer decompression
+
+static void fd_whole_reserve(PDFlateRef fl, PDInteger cap)
+{
+    if (fl->wholeCap < cap) {
+        free(fl->whole);
+        fl->whole = malloc(cap);
+        fl->wholeCap = cap;
+    }
+}
+
+static PDBool fd_whole_compress(PDStreamFilterRef filter, PDFlateRef fl)
+{
+    if (fl->compressor == NULL) fl->compressor = libdeflate_alloc_compressor(fl->level);
+    if (fl->compressor == NULL) return false;
+    
+    size_t bound = libdeflate_zlib_compress_bound(fl->compressor, filter->bufInAvailable);
+    fd_whole_reserve(fl, bound);
+    size_t len = libdeflate_zlib_compress(fl->compressor, filter->bufIn, filter->bufInAvailable, fl->whole, fl->wholeCap);
+    
+    if (len == 0) 
+        return false;
+    
+    fl->wholeMode = true;
+    fl->wholeLen = len;
+    fl->wholePos = 0;
+    fl->wholeIn = filter->bufInAvailable;
+    filter->bufIn += filter->bufInAvailable;
+    filter->bufInAvailable = 0;
+    return true;
+}
+
+static PDBool fd_whole_decompress(PDStreamFilterRef filter, PDFlateRef fl)
+{
+    if (fl->decompressor == NULL) fl->decompressor = libdeflate_alloc_decompressor();
+    if (fl->decompressor == NULL) return false;
+    
+    enum libdeflate_result result;
+    size_t inLen, outLen;
+    size_t cap = filter->bufInAvailable * filter->growthHint;
+    if (cap < filter->bufOutCapacity) cap = filter->bufOutCapacity;
+    if (cap < fl->wholeCap) cap = fl->wholeCap;
+    
+    // the decompressed size is unknown, so we grow the buffer until it fits
+    fd_whole_reserve(fl, cap);
+    while (LIBDEFLATE_INSUFFICIENT_SPACE == (result = libdeflate_zlib_decompress_ex(fl->decompressor, filter->bufIn, filter->bufInAvailable, fl->whole, fl->wholeCap, &inLen, &outLen))
+           && fl->wholeCap * 2 <= fd_whole_limit) {
+        fd_whole_reserve(fl, fl->wholeCap * 2);
+    }
+    
+    if (result != LIBDEFLATE_SUCCESS) 
+        // zlib is more forgiving about broken streams (e.g. missing checksums), so we let it have a go
+        return false;
+    
+    fl->wholeMode = true;
+    fl->wholeLen = outLen;
+    fl->wholePos = 0;
+    fl->wholeIn = filter->bufInAvailable;
+    filter->bufIn += filter->bufInAvailable;
+    filter->bufInAvailable = 0;
+    return true;
+}
+
+static PDInteger fd_whole_proceed(PDStreamFilterRef filter, PDFlateRef fl)
+{
+    PDInteger amount = fl->wholeLen - fl->wholePos;
+    if (amount > filter->bufOutCapacity) amount = filter->bufOutCapacity;
+    
+    memcpy(filter->bufOut, &fl->whole[fl->wholePos], amount);
+    fl->wholePos += amount;
+    filter->bufOut += amount;
+    filter->bufOutCapacity -= amount;
+    filter->needsInput = true;
+    filter->finished = fl->wholePos == fl->wholeLen;
+    
+    return amount;
+}
+
+#endif
+
 PDInteger fd_compress_init(PDStreamFilterRef filter)
 {
     if (filter->initialized)
@@ -58,16 +271,12 @@ PDInteger fd_compress_init(PDStreamFilterRef filter)
         }
     }
     
-    z_stream *stream = filter->data = calloc(1, sizeof(z_stream));
+    int level = filter->compressionLevel > 0 ? (int)filter->compressionLevel : fd_default_level;
+    if (level > 9) level = 9;
     
-    stream->zalloc = Z_NULL;
-    stream->zfree = Z_NULL;
-    stream->opaque = Z_NULL;
-    
-    if (Z_OK != deflateInit(stream, 5)) {
-        free(stream);
+    filter->data = fd_obtain(level);
+    if (filter->data == NULL) 
         return false;
-    }
     
     filter->initialized = true;
     
@@ -83,23 +292,22 @@ PDInteger fd_decompress_init(PDStreamFilterRef filter)
         PDDictionaryRef options = filter->options;
         void *value = PDDictionaryGet(options, "Predictor");
         if (value) {
-            // we need a predictor as well
-            filter->nextFilter = PDStreamFilterObtain("Predictor", true, filter->options);
+            // we need a predictor as well, which goes between us and whatever filter we were chained to
+            PDStreamFilterRef predictor = PDStreamFilterObtain("Predictor", true, filter->options);
+            if (predictor) {
+                predictor->nextFilter = filter->nextFilter;
+                filter->nextFilter = predictor;
+            }
         }
     }
     
-    z_stream *stream = filter->data = calloc(1, sizeof(z_stream));
-    
-    stream->zalloc = Z_NULL;
-    stream->zfree = Z_NULL;
-    stream->opaque = Z_NULL;
-    stream->avail_in = 0;
-    stream->next_in = Z_NULL;
-    
-    if (Z_OK != inflateInit(stream)) {
-        free(stream);
+    filter->data = fd_obtain(-1);
+    if (filter->data == NULL) 
         return false;
-    }
+    
+    // size output buffers based on what recent streams decompressed to
+    if (filter->growthHint < fd_pool.inflateRatio) 
+        filter->growthHint = fd_pool.inflateRatio;
     
     filter->initialized = true;
     
@@ -110,10 +318,8 @@ PDInteger fd_compress_done(PDStreamFilterRef filter)
 {
     PDAssert(filter->initialized);
     
-    z_stream *stream = filter->data;
-    
-    deflateEnd(stream);
-    free(stream);
+    fd_recycle(filter->data);
+    filter->data = NULL;
     
     filter->initialized = false;
     
@@ -124,10 +330,28 @@ PDInteger fd_decompress_done(PDStreamFilterRef filter)
 {
     PDAssert(filter->initialized);
     
-    z_stream *stream = filter->data;
+    PDFlateRef fl = filter->data;
+    PDInteger in = fl->stream.total_in;
+    PDInteger out = fl->stream.total_out;
+#ifdef PD_SUPPORT_LIBDEFLATE
+    if (fl->wholeMode) {
+        in = fl->wholeIn;
+        out = fl->wholeLen;
+    }
+#endif
+    
+    if (in > 0 && ! fl->broken) {
+        // keep a running estimate, within reason
+        float ratio = (float)out / in;
+        if (ratio < 1.f) ratio = 1.f;
+        if (ratio > 16.f) ratio = 16.f;
+        // a thread's estimate starts out at 1 (it is 0 until then)
+        if (fd_pool.inflateRatio < 1.f) fd_pool.inflateRatio = 1.f;
+        fd_pool.inflateRatio = (3.f * fd_pool.inflateRatio + ratio) / 4.f;
+    }
     
-    inflateEnd(stream);
-    free(stream);
+    fd_recycle(fl);
+    filter->data = NULL;
     
     filter->initialized = false;
     
@@ -139,7 +363,12 @@ PDInteger fd_compress_proceed(PDStreamFilterRef filter)
     PDInteger outputLength;
     int ret;
 
-    z_stream *stream = filter->data;
+    PDFlateRef fl = filter->data;
+    z_stream *stream = &fl->stream;
+    
+#ifdef PD_SUPPORT_LIBDEFLATE
+    if (fl->wholeMode) return fd_whole_proceed(filter, fl);
+#endif
 
     stream->avail_out = (uInt)filter->bufOutCapacity;
     stream->next_out = filter->bufOut;
@@ -168,9 +397,14 @@ PDInteger fd_decompress_proceed(PDStreamFilterRef filter)
     PDInteger outputLength;
     int ret;
     
-    z_stream *stream = filter->data;
+    PDFlateRef fl = filter->data;
+    z_stream *stream = &fl->stream;
+    
+#ifdef PD_SUPPORT_LIBDEFLATE
+    if (fl->wholeMode) return fd_whole_proceed(filter, fl);
+#endif
     
-    if (filter->bufInAvailable == 0) {
+    if (filter->bufInAvailable == 0 && ! fl->outputFull) {
         // we are being asked to decompress but we haven't gotten any data; this indicates the input source is broken so we're going to just fail silently here
         // this is opposed to crashing hard at the Z_BUF_ERROR that occurs otherwise, below
         filter->finished = true;
@@ -181,6 +415,13 @@ PDInteger fd_decompress_proceed(PDStreamFilterRef filter)
     stream->next_out = filter->bufOut;
     
     ret = inflate(stream, Z_NO_FLUSH);
+    if (ret == Z_BUF_ERROR && stream->avail_in == 0) {
+        // the output buffer was filled exactly by the last call, and there was nothing more to flush
+        fl->outputFull = false;
+        filter->needsInput = true;
+        filter->finished = ! filter->hasInput;
+        return 0;
+    }
     if (ret < 0) { 
         PDError("inflate error: %s\n", stream->msg); 
     }
@@ -192,6 +433,7 @@ PDInteger fd_decompress_proceed(PDStreamFilterRef filter)
         case Z_DATA_ERROR:
         case Z_MEM_ERROR:
             inflateEnd(stream);
+            fl->broken = true;
             filter->failing = true;
             return 0;
     }
@@ -200,6 +442,7 @@ PDInteger fd_decompress_proceed(PDStreamFilterRef filter)
     outputLength = filter->bufOutCapacity - stream->avail_out;
     filter->bufOut += outputLength;
     
+    fl->outputFull = 0 == stream->avail_out;
     filter->needsInput = 0 == stream->avail_in;
     filter->bufOutCapacity = stream->avail_out;
 
@@ -208,7 +451,14 @@ PDInteger fd_decompress_proceed(PDStreamFilterRef filter)
 
 PDInteger fd_compress_begin(PDStreamFilterRef filter)
 {
-    z_stream *stream = filter->data;
+    PDFlateRef fl = filter->data;
+    z_stream *stream = &fl->stream;
+    
+#ifdef PD_SUPPORT_LIBDEFLATE
+    // if we have been handed all of the input at once, we can compress it in one go
+    if (! filter->hasInput && fl->stream.total_in == 0 && fd_whole_compress(filter, fl))
+        return fd_whole_proceed(filter, fl);
+#endif
     
     stream->avail_in = (uInt)filter->bufInAvailable;
     stream->next_in = filter->bufIn;
@@ -218,7 +468,14 @@ PDInteger fd_compress_begin(PDStreamFilterRef filter)
 
 PDInteger fd_decompress_begin(PDStreamFilterRef filter)
 {
-    z_stream *stream = filter->data;
+    PDFlateRef fl = filter->data;
+    z_stream *stream = &fl->stream;
+    
+#ifdef PD_SUPPORT_LIBDEFLATE
+    // if we have been handed all of the input at once, we can decompress it in one go
+    if (! filter->hasInput && filter->bufInAvailable > 0 && fl->stream.total_in == 0 && fd_whole_decompress(filter, fl))
+        return fd_whole_proceed(filter, fl);
+#endif
     
     stream->avail_in = (uInt)filter->bufInAvailable;
     stream->next_in = filter->bufIn;
@@ -64,6 +64,13 @@ extern PDStreamFilterRef PDStreamFilterFlateDecodeDecompressCreate(PDDictionaryR
  */
 extern PDStreamFilterRef PDStreamFilterFlateDecodeConstructor(PDBool inputEnd, PDDictionaryRef options);
 
+/**
+ Release the zlib states kept around for reuse.
+ 
+ FlateDecode filters hand their zlib state to a pool when they are done, and new filters are set up from the pool using inflateReset()/deflateReset() rather than a full initialization. This releases the pooled states.
+ */
+extern void PDStreamFilterFlateDecodeDrainPool(void);
+
 #endif
 
 #endif
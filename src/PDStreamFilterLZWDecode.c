@@ -0,0 +1,428 @@
+//
+// PDStreamFilterLZWDecode.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "pd_internal.h"
+#include "PDStreamFilterLZWDecode.h"
+#include "PDDictionary.h"
+#include "PDNumber.h"
+
+#define LZW_CLEAR       256
+#define LZW_EOD         257
+#define LZW_FIRST       258
+#define LZW_MAX_CODES   4096
+#define LZW_HASH_SIZE   5021    ///< Prime, roughly 1.25 times the number of codes
+#define LZW_RESET_AT    4094    ///< Code count at which the compressor emits a clear-table code
+
+typedef struct PDLZW *PDLZWRef;
+/**
+ LZW state data for an ongoing compress/decompress operation.
+ 
+ The decompressor keeps its dictionary as a table of (prefix code, suffix byte) pairs along with the first byte and length of each string, which lets it write a string backwards into the output in a single pass. The compressor looks up (prefix code, byte) pairs in an open addressing hash table.
+ */
+struct PDLZW {
+    unsigned char spill[LZW_MAX_CODES]; ///< Output which did not fit into the output buffer last time around
+    PDInteger spillLen;                 ///< Number of bytes in spill
+    PDInteger spillPos;                 ///< Number of bytes in spill which have been written
+    unsigned short prefix[LZW_MAX_CODES]; ///< Prefix code for each code (decompression)
+    unsigned char suffix[LZW_MAX_CODES];  ///< Final byte for each code (decompression)
+    unsigned char first[LZW_MAX_CODES];   ///< First byte for each code (decompression)
+    unsigned short length[LZW_MAX_CODES]; ///< String length for each code (decompression)
+    int hashKey[LZW_HASH_SIZE];         ///< (prefix << 8 | byte) keys, or -1 for empty slots (compression)
+    unsigned short hashCode[LZW_HASH_SIZE]; ///< Codes for the keys in hashKey (compression)
+    int next;                           ///< Next code to be assigned
+    int width;                          ///< Current code width in bits (decompression)
+    int prev;                           ///< Previous code (decompression) or code for the current string (compression), or -1
+    int early;                          ///< The EarlyChange option
+    unsigned int bitBuf;                ///< Pending bits
+    int bitCount;                       ///< Number of pending bits
+    PDBool started;                     ///< Whether the initial clear-table code has been written (compression)
+    PDBool eod;                         ///< Whether the end of data code was read or written
+};
+
+static inline int lzw_width(int next, int early)
+{
+    next += early;
+    return (next >= 2048 ? 12 : 
+            next >= 1024 ? 11 : 
+            next >= 512  ? 10 : 9);
+}
+
+static inline void lzw_drain(PDLZWRef lzw, unsigned char **dst, PDInteger *cap)
+{
+    PDInteger n = lzw->spillLen - lzw->spillPos;
+    if (n > *cap) n = *cap;
+    memcpy(*dst, &lzw->spill[lzw->spillPos], n);
+    *dst += n;
+    *cap -= n;
+    lzw->spillPos += n;
+    if (lzw->spillPos == lzw->spillLen) 
+        lzw->spillPos = lzw->spillLen = 0;
+}
+
+static inline void lzw_put(PDLZWRef lzw, unsigned char **dst, PDInteger *cap, unsigned char c)
+{
+    if (*cap > 0) {
+        *(*dst)++ = c;
+        (*cap)--;
+    } else {
+        lzw->spill[lzw->spillLen++] = c;
+    }
+}
+
+static inline void lzw_write_code(PDLZWRef lzw, unsigned char **dst, PDInteger *cap, int code, int width)
+{
+    lzw->bitBuf = (lzw->bitBuf << width) | code;
+    lzw->bitCount += width;
+    while (lzw->bitCount >= 8) {
+        lzw->bitCount -= 8;
+        lzw_put(lzw, dst, cap, lzw->bitBuf >> lzw->bitCount);
+    }
+    lzw->bitBuf &= (1 << lzw->bitCount) - 1;
+}
+
+static inline void lzw_write_string(PDLZWRef lzw, unsigned char **dst, PDInteger *cap, int code)
+{
+    PDInteger len = lzw->length[code];
+    unsigned char *p;
+    
+    // strings are stored back to front, so we fill in from the end; if the output buffer is too small, the string goes into spill instead
+    if (len <= *cap) {
+        p = *dst + len;
+        *dst += len;
+        *cap -= len;
+    } else {
+        p = lzw->spill + len;
+        lzw->spillLen = len;
+    }
+    
+    for (; code >= LZW_FIRST; code = lzw->prefix[code])
+        *--p = lzw->suffix[code];
+    *--p = code;
+    
+    if (lzw->spillLen) lzw_drain(lzw, dst, cap);
+}
+
+static void lzw_reset_hash(PDLZWRef lzw)
+{
+    memset(lzw->hashKey, 0xff, sizeof(lzw->hashKey));
+    lzw->next = LZW_FIRST;
+}
+
+static void lzw_reset_table(PDLZWRef lzw)
+{
+    lzw->next = LZW_FIRST;
+    lzw->width = 9;
+    lzw->prev = -1;
+}
+
+static void lzw_setup(PDStreamFilterRef filter, PDDictionaryRef options)
+{
+    PDLZWRef lzw = filter->data = calloc(1, sizeof(struct PDLZW));
+    int i;
+    
+    lzw->early = 1;
+    if (options) {
+        PDNumberRef n = PDDictionaryGet(options, "EarlyChange");
+        if (n) lzw->early = PDNumberGetInteger(n) ? 1 : 0;
+    }
+    
+    for (i = 0; i < 256; i++) {
+        lzw->suffix[i] = lzw->first[i] = i;
+        lzw->length[i] = 1;
+    }
+    lzw_reset_table(lzw);
+    lzw_reset_hash(lzw);
+}
+
+PDInteger lzw_compress_init(PDStreamFilterRef filter)
+{
+    if (filter->initialized)
+        return true;
+    
+    if (filter->options) {
+        PDDictionaryRef options = filter->options;
+        void *value = PDDictionaryGet(options, "Predictor");
+        if (value) {
+            // prediction has to come before compression, so we swap places with a predictor the same way FlateDecode does
+            PDStreamFilterRef predictor = PDStreamFilterObtain("Predictor", false, filter->options);
+            if (predictor) {
+                PDStreamFilterRef newSelf = PDStreamFilterAlloc();
+                memcpy(newSelf, filter, sizeof(struct PDStreamFilter));
+                memcpy(filter, predictor, sizeof(struct PDStreamFilter));
+                filter->nextFilter = newSelf;
+                // options are only retained once, so our new self lets go of them; it is set up right away to hang on to EarlyChange
+                newSelf->options = NULL;
+                lzw_setup(newSelf, options);
+                newSelf->initialized = true;
+                PDRelease(predictor);
+                return (*filter->init)(filter);
+            }
+        }
+    }
+    
+    lzw_setup(filter, filter->options);
+    
+    filter->initialized = true;
+    
+    return true;
+}
+
+PDInteger lzw_decompress_init(PDStreamFilterRef filter)
+{
+    if (filter->initialized)
+        return true;
+    
+    if (filter->options) {
+        PDDictionaryRef options = filter->options;
+        void *value = PDDictionaryGet(options, "Predictor");
+        if (value) {
+            // we need a predictor as well, which goes between us and whatever filter we were chained to
+            PDStreamFilterRef predictor = PDStreamFilterObtain("Predictor", true, filter->options);
+            if (predictor) {
+                predictor->nextFilter = filter->nextFilter;
+                filter->nextFilter = predictor;
+            }
+        }
+    }
+    
+    lzw_setup(filter, filter->options);
+    
+    filter->initialized = true;
+    
+    return true;
+}
+
+PDInteger lzw_done(PDStreamFilterRef filter)
+{
+    PDAssert(filter->initialized);
+    
+    free(filter->data);
+    filter->data = NULL;
+    
+    filter->initialized = false;
+    
+    return true;
+}
+
+PDInteger lzw_compress_proceed(PDStreamFilterRef filter)
+{
+    PDLZWRef lzw = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    int key, h;
+    unsigned char c;
+    
+    lzw_drain(lzw, &dst, &cap);
+    
+    if (! lzw->started) {
+        lzw_write_code(lzw, &dst, &cap, LZW_CLEAR, 9);
+        lzw->started = true;
+    }
+    
+    while (avail > 0 && lzw->spillLen == 0) {
+        c = *src++;
+        avail--;
+        
+        if (lzw->prev < 0) {
+            lzw->prev = c;
+            continue;
+        }
+        
+        key = lzw->prev << 8 | c;
+        for (h = key % LZW_HASH_SIZE; lzw->hashKey[h] != -1 && lzw->hashKey[h] != key; h = h + 1 == LZW_HASH_SIZE ? 0 : h + 1) ;
+        if (lzw->hashKey[h] == key) {
+            lzw->prev = lzw->hashCode[h];
+            continue;
+        }
+        
+        // the decompressor lags one code behind in building its table, hence next - 1
+        lzw_write_code(lzw, &dst, &cap, lzw->prev, lzw_width(lzw->next - 1, lzw->early));
+        lzw->hashKey[h] = key;
+        lzw->hashCode[h] = lzw->next++;
+        if (lzw->next >= LZW_RESET_AT) {
+            lzw_write_code(lzw, &dst, &cap, LZW_CLEAR, lzw_width(lzw->next - 1, lzw->early));
+            lzw_reset_hash(lzw);
+        }
+        lzw->prev = c;
+    }
+    
+    if (avail == 0 && ! filter->hasInput && ! lzw->eod) {
+        if (lzw->prev >= 0) 
+            lzw_write_code(lzw, &dst, &cap, lzw->prev, lzw_width(lzw->next - 1, lzw->early));
+        lzw_write_code(lzw, &dst, &cap, LZW_EOD, lzw_width(lzw->next, lzw->early));
+        if (lzw->bitCount > 0) 
+            lzw_put(lzw, &dst, &cap, lzw->bitBuf << (8 - lzw->bitCount));
+        lzw->bitCount = 0;
+        lzw->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = lzw->eod && lzw->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger lzw_decompress_proceed(PDStreamFilterRef filter)
+{
+    PDLZWRef lzw = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    int code;
+    
+    lzw_drain(lzw, &dst, &cap);
+    
+    while (lzw->spillLen == 0 && ! lzw->eod && ! filter->failing) {
+        while (lzw->bitCount < lzw->width && avail > 0) {
+            lzw->bitBuf = (lzw->bitBuf << 8) | *src++;
+            lzw->bitCount += 8;
+            avail--;
+        }
+        if (lzw->bitCount < lzw->width) break;
+        
+        lzw->bitCount -= lzw->width;
+        code = (lzw->bitBuf >> lzw->bitCount) & ((1 << lzw->width) - 1);
+        lzw->bitBuf &= (1 << lzw->bitCount) - 1;
+        
+        if (code == LZW_CLEAR) {
+            lzw_reset_table(lzw);
+            continue;
+        }
+        
+        if (code == LZW_EOD) {
+            lzw->eod = true;
+            break;
+        }
+        
+        if (lzw->prev < 0) {
+            if (code > 255) {
+                PDWarn("invalid LZW code %d following clear-table\n", code);
+                filter->failing = true;
+                break;
+            }
+            lzw_put(lzw, &dst, &cap, code);
+            lzw->prev = code;
+            continue;
+        }
+        
+        if (code > lzw->next || (code == lzw->next && lzw->next == LZW_MAX_CODES)) {
+            PDWarn("invalid LZW code %d (next = %d)\n", code, lzw->next);
+            filter->failing = true;
+            break;
+        }
+        
+        if (lzw->next < LZW_MAX_CODES) {
+            // code == next is the special case where the new string is the previous string plus its own first byte
+            int n = lzw->next++;
+            lzw->prefix[n] = lzw->prev;
+            lzw->suffix[n] = lzw->first[code == n ? lzw->prev : code];
+            lzw->first[n] = lzw->first[lzw->prev];
+            lzw->length[n] = lzw->length[lzw->prev] + 1;
+            lzw->width = lzw_width(lzw->next, lzw->early);
+        }
+        
+        lzw_write_string(lzw, &dst, &cap, code);
+        lzw->prev = code;
+    }
+    
+    PDBool ended = lzw->eod || (avail == 0 && ! filter->hasInput && lzw->bitCount < lzw->width);
+    if (ended) {
+        src += avail;
+        avail = 0;
+        lzw->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = ended && lzw->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger lzw_compress_begin(PDStreamFilterRef filter)
+{
+    return lzw_compress_proceed(filter);
+}
+
+PDInteger lzw_decompress_begin(PDStreamFilterRef filter)
+{
+    return lzw_decompress_proceed(filter);
+}
+
+static PDStreamFilterRef lzw_invert_with_options(PDStreamFilterRef filter, PDBool inputEnd)
+{
+    PDLZWRef lzw = filter->data;
+    
+    if (lzw->early == 1) 
+        return PDStreamFilterLZWDecodeConstructor(inputEnd, NULL);
+    
+    PDDictionaryRef opts = PDDictionaryCreate();
+    PDDictionarySet(opts, "EarlyChange", PDNumberWithInteger(lzw->early));
+    PDStreamFilterRef inversion = PDStreamFilterLZWDecodeConstructor(inputEnd, opts);
+    PDRelease(opts);
+    return inversion;
+}
+
+PDStreamFilterRef lzw_compress_invert(PDStreamFilterRef filter)
+{
+    return lzw_invert_with_options(filter, true);
+}
+
+PDStreamFilterRef lzw_decompress_invert(PDStreamFilterRef filter)
+{
+    return lzw_invert_with_options(filter, false);
+}
+
+PDStreamFilterRef PDStreamFilterLZWDecodeCompressCreate(PDDictionaryRef options)
+{
+    return PDStreamFilterCreate(lzw_compress_init, lzw_done, lzw_compress_begin, lzw_compress_proceed, lzw_compress_invert, options);
+}
+
+PDStreamFilterRef PDStreamFilterLZWDecodeDecompressCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(lzw_decompress_init, lzw_done, lzw_decompress_begin, lzw_decompress_proceed, lzw_decompress_invert, options);
+    filter->growthHint = 2.f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterLZWDecodeConstructor(PDBool inputEnd, PDDictionaryRef options)
+{
+    return (inputEnd
+            ? PDStreamFilterLZWDecodeDecompressCreate(options)
+            : PDStreamFilterLZWDecodeCompressCreate(options));
+}
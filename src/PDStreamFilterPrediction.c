@@ -29,16 +29,34 @@
 
 #include "PDStreamFilterPrediction.h"
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_PRED_SSE2
+#   include <cpuid.h>
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && (defined(__GNUC__) || defined(__clang__))
+#   define PD_PRED_NEON
+#   include <arm_neon.h>
+#endif
+
+typedef void (*PDPredictorRowFunc)(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp);
+
 typedef struct PDPredictor *PDPredictorRef;
 /**
  Predictor settings, including options and state data for an ongoing predictor/unpredictor operation.
  */
 struct PDPredictor {
-    unsigned char *prevRow;     ///< Previous row cache.
-    PDInteger columns;          ///< Columns per row.
+    unsigned char *prevRow;     ///< Previous row cache (unfiltered).
+    PDInteger columns;          ///< Columns (samples) per row.
+    PDInteger colors;           ///< Color components per sample.
+    PDInteger bpc;              ///< Bits per color component.
+    PDInteger bpp;              ///< Bytes per pixel, rounded up to 1; this is the distance to the "left" byte in PNG filters.
+    PDInteger rowBytes;         ///< Bytes per (unfiltered) row.
     PDPredictorType predictor;  ///< Predictor type (strategy)
+    const PDPredictorRowFunc *unrows; ///< Unpredictor row functions, indexed by PNG filter type
 };
 
+static const PDPredictorRowFunc *unpred_rows_for_bpp(PDInteger bpp);
+
 PDInteger pred_init(PDStreamFilterRef filter)
 {
     if (filter->initialized)
@@ -47,6 +65,8 @@ PDInteger pred_init(PDStreamFilterRef filter)
     PDPredictorRef pred = malloc(sizeof(struct PDPredictor));
     pred->predictor = PDPredictorNone;
     pred->columns = 1;
+    pred->colors = 1;
+    pred->bpc = 8;
     
     filter->data = pred;
     
@@ -55,26 +75,45 @@ PDInteger pred_init(PDStreamFilterRef filter)
     PDNumberRef n;
     n = PDDictionaryGet(dict, "Columns");
     if (n) pred->columns = PDNumberGetInteger(n);
+    n = PDDictionaryGet(dict, "Colors");
+    if (n) pred->colors = PDNumberGetInteger(n);
+    n = PDDictionaryGet(dict, "BitsPerComponent");
+    if (n) pred->bpc = PDNumberGetInteger(n);
     n = PDDictionaryGet(dict, "Predictor");
     if (n) pred->predictor = (PDPredictorType)PDNumberGetInteger(n);
     
+    if (pred->columns < 1 || pred->colors < 1 || pred->bpc < 1 || pred->bpc > 16) {
+        PDWarn("Invalid predictor parameters: Columns %ld, Colors %ld, BitsPerComponent %ld\n", pred->columns, pred->colors, pred->bpc);
+        free(pred);
+        return false;
+    }
+    
+    pred->rowBytes = (pred->columns * pred->colors * pred->bpc + 7) / 8;
+    pred->bpp = (pred->colors * pred->bpc + 7) / 8;
+    
     // we only support given predictors; as more are encountered, support will be added
     switch (pred->predictor) {
         case PDPredictorNone:
+        case PDPredictorPNG_NONE:
         case PDPredictorPNG_UP:
         case PDPredictorPNG_OPT:
-            break;
         case PDPredictorPNG_SUB:
         case PDPredictorPNG_AVG:
         case PDPredictorPNG_PAE:
             break;
+        case PDPredictorTIFF2:
+            if (pred->bpc == 8 || pred->bpc == 16) 
+                break;
+            // fall through; sub-byte components are not supported
             
         default:
             PDWarn("Unsupported predictor: %d\n", pred->predictor);
+            free(pred);
             return false;
     }
     
-    pred->prevRow = calloc(1, pred->columns);
+    pred->prevRow = calloc(1, pred->rowBytes);
+    pred->unrows = unpred_rows_for_bpp(pred->bpp);
 
     filter->initialized = true;
     
@@ -106,18 +145,487 @@ PDInteger pred_done(PDStreamFilterRef filter)
     return pred_done(filter);
 }*/
 
-int paeth_predictor(int a, int b, int c)
+//
+// row filters
+//
+// each filter processes an entire row, with no branching inside of the loops beyond the first pixel; the filters whose 
+// output bytes are independent of each other (all of the filtering ones, and Up for unfiltering) are written so that 
+// the compiler can vectorize them
+//
+
+static inline unsigned char paeth_predictor(unsigned char a, unsigned char b, unsigned char c)
 {
     // a = left, b = above, c = upper left
-    int p = a + b - c;
-    int pa = abs(p - a); // distances to a, b, c
-    int pb = abs(p - b);
-    int pc = abs(p - c);
+    // distances to a, b, c from p = a + b - c
+    int pa = abs((int)b - c);
+    int pb = abs((int)a - c);
+    int pc = abs((int)a + b - 2 * c);
     // return nearest of a,b,c,
     // breaking ties in order a,b,c.
-    if (pa <= pb && pa <= pc) return a;
-    if (pb <= pc) return b;
-    return c;
+    return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+static void pred_row_none(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    memcpy(out, in, bw);
+}
+
+static void pred_row_sub(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i];
+    for (; i < bw; i++) out[i] = in[i] - in[i - bpp];
+}
+
+static void pred_row_up(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bw; i++) out[i] = in[i] - prev[i];
+}
+
+static void pred_row_avg(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i] - (prev[i] >> 1);
+    for (; i < bw; i++) out[i] = in[i] - (unsigned char)(((unsigned)in[i - bpp] + prev[i]) >> 1);
+}
+
+static void pred_row_paeth(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i] - prev[i];
+    for (; i < bw; i++) out[i] = in[i] - paeth_predictor(in[i - bpp], prev[i], prev[i - bpp]);
+}
+
+static void unpred_row_sub(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i];
+    for (; i < bw; i++) out[i] = in[i] + out[i - bpp];
+}
+
+static void unpred_row_up(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bw; i++) out[i] = in[i] + prev[i];
+}
+
+static void unpred_row_avg(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i] + (prev[i] >> 1);
+    for (; i < bw; i++) out[i] = in[i] + (unsigned char)(((unsigned)out[i - bpp] + prev[i]) >> 1);
+}
+
+static void unpred_row_paeth(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    PDInteger i;
+    for (i = 0; i < bpp && i < bw; i++) out[i] = in[i] + prev[i];
+    for (; i < bw; i++) out[i] = in[i] + paeth_predictor(out[i - bpp], prev[i], prev[i - bpp]);
+}
+
+// indexed by PNG filter type (the row's tag byte)
+static const PDPredictorRowFunc pred_rows[] = { pred_row_none, pred_row_sub, pred_row_up, pred_row_avg, pred_row_paeth };
+static const PDPredictorRowFunc unpred_rows[] = { pred_row_none, unpred_row_sub, unpred_row_up, unpred_row_avg, unpred_row_paeth };
+
+//
+// vector row unfilters
+//
+// unfiltering Sub, Average and Paeth is serial, as each pixel depends on the (unfiltered) pixel to its left, but the 
+// bytes of a pixel are independent of each other; for 3 and 4 byte pixels (8 bit RGB and RGBA/CMYK, the common cases 
+// for images), the pixel is handled in one go in a vector register; pixels are loaded 4 bytes at a time, so the last 
+// 3 byte pixel of a row is loaded on its own, and whatever is left of the row after the last whole pixel (only 
+// possible for unusual bits per component) is done by the scalar code
+//
+
+static PDBool pred_vector_enabled = true;
+
+PDBool PDStreamFilterPredictionVectorAvailable(void)
+{
+#if defined(PD_PRED_SSE2)
+    static int available = -1;
+    if (available == -1) {
+        unsigned int a, b, c, d;
+        available = __get_cpuid(1, &a, &b, &c, &d) && (d & bit_SSE2) != 0;
+    }
+    return available;
+#elif defined(PD_PRED_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PDStreamFilterPredictionSetVectorEnabled(PDBool enabled)
+{
+    pred_vector_enabled = enabled;
+}
+
+static inline void unpred_tail_sub(unsigned char * restrict out, const unsigned char * restrict in, PDInteger i, PDInteger bw, PDInteger bpp)
+{
+    for (; i < bw; i++) out[i] = in[i] + out[i - bpp];
+}
+
+static inline void unpred_tail_avg(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger i, PDInteger bw, PDInteger bpp)
+{
+    for (; i < bw; i++) out[i] = in[i] + (unsigned char)(((unsigned)out[i - bpp] + prev[i]) >> 1);
+}
+
+static inline void unpred_tail_paeth(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger i, PDInteger bw, PDInteger bpp)
+{
+    for (; i < bw; i++) out[i] = in[i] + paeth_predictor(out[i - bpp], prev[i], prev[i - bpp]);
+}
+
+#if defined(PD_PRED_SSE2)
+
+__attribute__((target("sse2")))
+static inline __m128i pred_sse2_load(const unsigned char *p, PDInteger n)
+{
+    int v = 0;
+    memcpy(&v, p, n);
+    return _mm_cvtsi32_si128(v);
+}
+
+__attribute__((target("sse2")))
+static inline void pred_sse2_store(unsigned char *p, __m128i x, PDInteger n)
+{
+    int v = _mm_cvtsi128_si32(x);
+    memcpy(p, &v, n);
+}
+
+__attribute__((target("sse2")))
+static inline void unpred_sub_sse2(unsigned char * restrict out, const unsigned char * restrict in, PDInteger bw, PDInteger bpp)
+{
+    __m128i a = _mm_setzero_si128();
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        a = _mm_add_epi8(a, pred_sse2_load(&in[i], 4));
+        pred_sse2_store(&out[i], a, bpp);
+    }
+    if (i + bpp <= bw) {
+        a = _mm_add_epi8(a, pred_sse2_load(&in[i], bpp));
+        pred_sse2_store(&out[i], a, bpp);
+        i += bpp;
+    }
+    unpred_tail_sub(out, in, i, bw, bpp);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i unpred_avg_sse2_pixel(__m128i a, __m128i b, __m128i x)
+{
+    // the average rounds up, where PNG truncates, which is undone by subtracting the low bit of a ^ b
+    __m128i avg = _mm_avg_epu8(a, b);
+    avg = _mm_sub_epi8(avg, _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+    return _mm_add_epi8(avg, x);
+}
+
+__attribute__((target("sse2")))
+static inline void unpred_avg_sse2(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    __m128i a = _mm_setzero_si128();
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        a = unpred_avg_sse2_pixel(a, pred_sse2_load(&prev[i], 4), pred_sse2_load(&in[i], 4));
+        pred_sse2_store(&out[i], a, bpp);
+    }
+    if (i + bpp <= bw) {
+        a = unpred_avg_sse2_pixel(a, pred_sse2_load(&prev[i], bpp), pred_sse2_load(&in[i], bpp));
+        pred_sse2_store(&out[i], a, bpp);
+        i += bpp;
+    }
+    unpred_tail_avg(out, in, prev, i, bw, bpp);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pred_sse2_abs16(__m128i x)
+{
+    __m128i neg = _mm_cmplt_epi16(x, _mm_setzero_si128());
+    return _mm_sub_epi16(_mm_xor_si128(x, neg), neg);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pred_sse2_select(__m128i mask, __m128i t, __m128i f)
+{
+    return _mm_or_si128(_mm_and_si128(mask, t), _mm_andnot_si128(mask, f));
+}
+
+// a, b, c and x hold one byte per 16 bit lane
+__attribute__((target("sse2")))
+static inline __m128i unpred_paeth_sse2_pixel(__m128i a, __m128i b, __m128i c, __m128i x)
+{
+    __m128i pa, pb, pc, smallest, nearest;
+    
+    pa = _mm_sub_epi16(b, c);
+    pb = _mm_sub_epi16(a, c);
+    pc = _mm_add_epi16(pa, pb);
+    pa = pred_sse2_abs16(pa);
+    pb = pred_sse2_abs16(pb);
+    pc = pred_sse2_abs16(pc);
+    smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    nearest = pred_sse2_select(_mm_cmpeq_epi16(smallest, pa), a, 
+                               pred_sse2_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+    // the high bytes of the lanes are zero, so adding bytes wraps each lane the way the scalar code does
+    return _mm_add_epi8(nearest, x);
+}
+
+__attribute__((target("sse2")))
+static inline void unpred_paeth_sse2(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i c = zero;
+    __m128i b;
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        b = _mm_unpacklo_epi8(pred_sse2_load(&prev[i], 4), zero);
+        a = unpred_paeth_sse2_pixel(a, b, c, _mm_unpacklo_epi8(pred_sse2_load(&in[i], 4), zero));
+        pred_sse2_store(&out[i], _mm_packus_epi16(a, a), bpp);
+        c = b;
+    }
+    if (i + bpp <= bw) {
+        b = _mm_unpacklo_epi8(pred_sse2_load(&prev[i], bpp), zero);
+        a = unpred_paeth_sse2_pixel(a, b, c, _mm_unpacklo_epi8(pred_sse2_load(&in[i], bpp), zero));
+        pred_sse2_store(&out[i], _mm_packus_epi16(a, a), bpp);
+        i += bpp;
+    }
+    unpred_tail_paeth(out, in, prev, i, bw, bpp);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_sub3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_sub_sse2(out, in, bw, 3);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_sub4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_sub_sse2(out, in, bw, 4);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_avg3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_avg_sse2(out, in, prev, bw, 3);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_avg4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_avg_sse2(out, in, prev, bw, 4);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_paeth3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_paeth_sse2(out, in, prev, bw, 3);
+}
+
+__attribute__((target("sse2")))
+static void unpred_row_paeth4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_paeth_sse2(out, in, prev, bw, 4);
+}
+
+#elif defined(PD_PRED_NEON)
+
+static inline uint8x8_t pred_neon_load(const unsigned char *p, PDInteger n)
+{
+    uint32_t v = 0;
+    memcpy(&v, p, n);
+    return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static inline void pred_neon_store(unsigned char *p, uint8x8_t x, PDInteger n)
+{
+    uint32_t v = vget_lane_u32(vreinterpret_u32_u8(x), 0);
+    memcpy(p, &v, n);
+}
+
+static inline void unpred_sub_neon(unsigned char * restrict out, const unsigned char * restrict in, PDInteger bw, PDInteger bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        a = vadd_u8(a, pred_neon_load(&in[i], 4));
+        pred_neon_store(&out[i], a, bpp);
+    }
+    if (i + bpp <= bw) {
+        a = vadd_u8(a, pred_neon_load(&in[i], bpp));
+        pred_neon_store(&out[i], a, bpp);
+        i += bpp;
+    }
+    unpred_tail_sub(out, in, i, bw, bpp);
+}
+
+static inline uint8x8_t unpred_avg_neon_pixel(uint8x8_t a, uint8x8_t b, uint8x8_t x)
+{
+    // the halving add truncates, as PNG does
+    return vadd_u8(vhadd_u8(a, b), x);
+}
+
+static inline void unpred_avg_neon(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        a = unpred_avg_neon_pixel(a, pred_neon_load(&prev[i], 4), pred_neon_load(&in[i], 4));
+        pred_neon_store(&out[i], a, bpp);
+    }
+    if (i + bpp <= bw) {
+        a = unpred_avg_neon_pixel(a, pred_neon_load(&prev[i], bpp), pred_neon_load(&in[i], bpp));
+        pred_neon_store(&out[i], a, bpp);
+        i += bpp;
+    }
+    unpred_tail_avg(out, in, prev, i, bw, bpp);
+}
+
+static inline uint8x8_t unpred_paeth_neon_pixel(uint8x8_t a, uint8x8_t b, uint8x8_t c, uint8x8_t x)
+{
+    uint16x8_t pa, pb, pc;
+    uint8x8_t useA, useB;
+    
+    pa = vabdl_u8(b, c);
+    pb = vabdl_u8(a, c);
+    pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));
+    useA = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+    useB = vmovn_u16(vcleq_u16(pb, pc));
+    return vadd_u8(vbsl_u8(useA, a, vbsl_u8(useB, b, c)), x);
+}
+
+static inline void unpred_paeth_neon(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    uint8x8_t c = vdup_n_u8(0);
+    uint8x8_t b;
+    PDInteger i;
+    
+    for (i = 0; i + 4 <= bw; i += bpp) {
+        b = pred_neon_load(&prev[i], 4);
+        a = unpred_paeth_neon_pixel(a, b, c, pred_neon_load(&in[i], 4));
+        pred_neon_store(&out[i], a, bpp);
+        c = b;
+    }
+    if (i + bpp <= bw) {
+        b = pred_neon_load(&prev[i], bpp);
+        a = unpred_paeth_neon_pixel(a, b, c, pred_neon_load(&in[i], bpp));
+        pred_neon_store(&out[i], a, bpp);
+        i += bpp;
+    }
+    unpred_tail_paeth(out, in, prev, i, bw, bpp);
+}
+
+static void unpred_row_sub3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_sub_neon(out, in, bw, 3);
+}
+
+static void unpred_row_sub4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_sub_neon(out, in, bw, 4);
+}
+
+static void unpred_row_avg3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_avg_neon(out, in, prev, bw, 3);
+}
+
+static void unpred_row_avg4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_avg_neon(out, in, prev, bw, 4);
+}
+
+static void unpred_row_paeth3_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_paeth_neon(out, in, prev, bw, 3);
+}
+
+static void unpred_row_paeth4_vec(unsigned char * restrict out, const unsigned char * restrict in, const unsigned char * restrict prev, PDInteger bw, PDInteger bpp)
+{
+    unpred_paeth_neon(out, in, prev, bw, 4);
+}
+
+#endif
+
+#if defined(PD_PRED_SSE2) || defined(PD_PRED_NEON)
+static const PDPredictorRowFunc unpred_rows_vec3[] = { pred_row_none, unpred_row_sub3_vec, unpred_row_up, unpred_row_avg3_vec, unpred_row_paeth3_vec };
+static const PDPredictorRowFunc unpred_rows_vec4[] = { pred_row_none, unpred_row_sub4_vec, unpred_row_up, unpred_row_avg4_vec, unpred_row_paeth4_vec };
+#endif
+
+static const PDPredictorRowFunc *unpred_rows_for_bpp(PDInteger bpp)
+{
+#if defined(PD_PRED_SSE2) || defined(PD_PRED_NEON)
+    if (pred_vector_enabled && PDStreamFilterPredictionVectorAvailable()) {
+        if (bpp == 3) return unpred_rows_vec3;
+        if (bpp == 4) return unpred_rows_vec4;
+    }
+#endif
+    return unpred_rows;
+}
+
+static void pred_row_tiff(unsigned char * restrict out, const unsigned char * restrict in, PDInteger bw, PDPredictorRef pred)
+{
+    PDInteger i;
+    PDInteger c = pred->colors;
+    
+    if (pred->bpc == 8) {
+        for (i = 0; i < c && i < bw; i++) out[i] = in[i];
+        for (; i < bw; i++) out[i] = in[i] - in[i - c];
+        return;
+    }
+    
+    // 16 bit components, big endian
+    unsigned cur, left;
+    c *= 2;
+    for (i = 0; i < c && i < bw; i++) out[i] = in[i];
+    for (; i + 1 < bw; i += 2) {
+        cur = (in[i] << 8) | in[i + 1];
+        left = (in[i - c] << 8) | in[i - c + 1];
+        cur -= left;
+        out[i] = (cur >> 8) & 0xff;
+        out[i + 1] = cur & 0xff;
+    }
+}
+
+static void unpred_row_tiff(unsigned char * restrict out, const unsigned char * restrict in, PDInteger bw, PDPredictorRef pred)
+{
+    PDInteger i;
+    PDInteger c = pred->colors;
+    
+    if (pred->bpc == 8) {
+        for (i = 0; i < c && i < bw; i++) out[i] = in[i];
+        for (; i < bw; i++) out[i] = in[i] + out[i - c];
+        return;
+    }
+    
+    unsigned cur, left;
+    c *= 2;
+    for (i = 0; i < c && i < bw; i++) out[i] = in[i];
+    for (; i + 1 < bw; i += 2) {
+        cur = (in[i] << 8) | in[i + 1];
+        left = (out[i - c] << 8) | out[i - c + 1];
+        cur += left;
+        out[i] = (cur >> 8) & 0xff;
+        out[i + 1] = cur & 0xff;
+    }
+}
+
+static PDInteger pred_passthrough(PDStreamFilterRef filter)
+{
+    PDInteger amount = filter->bufOutCapacity > filter->bufInAvailable ? filter->bufInAvailable : filter->bufOutCapacity;
+    memcpy(filter->bufOut, filter->bufIn, amount);
+    filter->bufOut += amount;
+    filter->bufOutCapacity -= amount;
+    filter->bufIn += amount;
+    filter->bufInAvailable -= amount;
+    filter->needsInput = filter->bufInAvailable == 0;
+    filter->finished = filter->bufInAvailable == 0 && ! filter->hasInput;
+    return amount;
 }
 
 PDInteger pred_proceed(PDStreamFilterRef filter)
@@ -131,69 +639,46 @@ PDInteger pred_proceed(PDStreamFilterRef filter)
         return 0;
     }
     
-    if (pred->predictor == PDPredictorNone) {
-        PDInteger amount = filter->bufOutCapacity > filter->bufInAvailable ? filter->bufInAvailable : filter->bufOutCapacity;
-        memcpy(filter->bufOut, filter->bufIn, amount);
-        filter->bufOutCapacity -= amount;
-        filter->bufIn += amount;
-        filter->bufInAvailable -= amount;
-        return amount;
-    }
+    if (pred->predictor == PDPredictorNone) 
+        return pred_passthrough(filter);
     
     unsigned char *src = filter->bufIn;
     unsigned char *dst = filter->bufOut;
     PDInteger avail = filter->bufInAvailable;
     PDInteger cap = filter->bufOutCapacity;
-    PDInteger bw = pred->columns;
-    PDInteger rw = bw + 1;
-    PDInteger i;
+    PDInteger bw = pred->rowBytes;
+    PDInteger bpp = pred->bpp;
+    unsigned char *prevRow = pred->prevRow;
     
     //PDAssert(avail % bw == 0); // crash = this filter is bugged, or the input is corrupt
 
-    unsigned char  prevRowMinus1 = 0;
-    unsigned char *prevRow = pred->prevRow;
-    unsigned char *row = calloc(1, bw);
-    
-    // if the predictor is OPT, we fall back to UP, which we fill into every row, otherwise we keep it
-    PDPredictorType predictor = pred->predictor == PDPredictorPNG_OPT ? PDPredictorPNG_UP : pred->predictor;
-    
-    PDAssert(predictor >= 10);
-    
-#define pred_loop_begin() \
-    while (avail >= bw && cap >= rw) {\
-        memcpy(row, src, bw);\
-        src += bw;\
-        avail -= bw;\
-\
-        *dst = predictor - 10;\
-        dst++;\
-\
-        for (i = 0; i < bw; i++) {
-#define pred_loop_end() \
-            prevRow[i] = row[i];\
-            dst++;\
-        }\
-        cap -= rw;\
-    }
-#define pred_apply(formula, suffix) pred_loop_begin() *dst = (formula) & 0xff; suffix; pred_loop_end()
-#define pred_case(pred, formula, suffix) \
-        case pred: \
-            pred_apply(formula, suffix); \
-            break
-    
-    switch (predictor) {
-            pred_case(PDPredictorPNG_UP,    row[i] - prevRow[i],);
-            pred_case(PDPredictorPNG_SUB,   row[i] - (i ? row[i-1] : 0),);
-            pred_case(PDPredictorPNG_AVG,   row[i] - ((i ? row[i-1] : 0) + prevRow[i]) / 2,);
-            pred_case(PDPredictorPNG_PAE,   paeth_predictor(i ? row[i-1] : 0, prevRow[i], i ? prevRowMinus1 : 0), prevRowMinus1 = prevRow[i]);
-        default:
-            // unsupported; falling back to PNG_NONE
-            pred_apply(row[i],);
-            break;
+    if (pred->predictor == PDPredictorTIFF2) {
+        while (avail >= bw && cap >= bw) {
+            pred_row_tiff(dst, src, bw, pred);
+            src += bw;
+            avail -= bw;
+            dst += bw;
+            cap -= bw;
+        }
+    } else {
+        // if the predictor is OPT, we fall back to UP, which we fill into every row, otherwise we keep it
+        PDInteger type = (pred->predictor == PDPredictorPNG_OPT ? PDPredictorPNG_UP : pred->predictor) - 10;
+        PDPredictorRowFunc func = pred_rows[type];
+        PDInteger rw = bw + 1;
+        
+        PDAssert(type >= 0 && type <= 4);
+        
+        while (avail >= bw && cap >= rw) {
+            *dst = type;
+            (*func)(dst + 1, src, prevRow, bw, bpp);
+            memcpy(prevRow, src, bw);
+            src += bw;
+            avail -= bw;
+            dst += rw;
+            cap -= rw;
+        }
     }
     
-    free(row);
-    
     outputLength = filter->bufOutCapacity - cap;
 
     filter->bufIn = src;
@@ -217,92 +702,47 @@ PDInteger unpred_proceed(PDStreamFilterRef filter)
         return 0;
     }
     
-    if (pred->predictor == PDPredictorNone) {
-        PDInteger amount = filter->bufOutCapacity > filter->bufInAvailable ? filter->bufInAvailable : filter->bufOutCapacity;
-        memcpy(filter->bufOut, filter->bufIn, amount);
-        filter->bufOutCapacity -= amount;
-        filter->bufIn += amount;
-        filter->bufInAvailable -= amount;
-        return amount;
-    }
+    if (pred->predictor == PDPredictorNone) 
+        return pred_passthrough(filter);
     
     unsigned char *src = filter->bufIn;
     unsigned char *dst = filter->bufOut;
     PDInteger avail = filter->bufInAvailable;
     PDInteger cap = filter->bufOutCapacity;
-    PDInteger bw = pred->columns;
+    PDInteger bw = pred->rowBytes;
+    PDInteger bpp = pred->bpp;
     PDInteger rw = bw + 1;
-    PDInteger i;
+    unsigned char *prevRow = pred->prevRow;
     
     // this throws incorrectly if input is incomplete
     //PDAssert(avail % rw == 0); // crash = this filter is bugged, or the input is corrupt
     
-    unsigned char  prevRowMinus1 = 0;
-    unsigned char *prevRow = pred->prevRow;
-    unsigned char *row = calloc(1, bw);
-
-    PDPredictorType predictor = pred->predictor;
-    
-#define unpred_loop_begin() \
-    while (avail >= rw && cap >= bw) {\
-        predictor = src[0] + 10;\
-        memcpy(row, &src[1], bw);\
-        src += rw;\
-        avail -= rw;\
-        \
-        for (i = 0; i < bw; i++) {
-#define unpred_loop_end() \
-            dst++;\
-        }\
-        cap -= bw;\
-    }
-#define unpred_apply(formula, suffix) unpred_loop_begin() *dst = (formula) & 0xff; suffix; prevRow[i] = *dst; unpred_loop_end()
-#define unpred_case(pred, formula, suffix) \
-        case pred: \
-            unpred_apply(formula, suffix); \
-            break
-    
-    if (predictor == PDPredictorPNG_OPT) {
+    if (pred->predictor == PDPredictorTIFF2) {
+        rw = bw;
+        while (avail >= bw && cap >= bw) {
+            unpred_row_tiff(dst, src, bw, pred);
+            src += bw;
+            avail -= bw;
+            dst += bw;
+            cap -= bw;
+        }
+    } else {
+        // PNG predictors all tag each row with its filter type, regardless of the predictor given in the options
         while (avail >= rw && cap >= bw) {
-            predictor = src[0] + 10;
-            memcpy(row, &src[1], bw);
+            unsigned char type = src[0];
+            if (type > 4) {
+                PDWarn("Invalid PNG filter type %d; treating as None\n", type);
+                type = 0;
+            }
+            (*pred->unrows[type])(dst, src + 1, prevRow, bw, bpp);
+            memcpy(prevRow, dst, bw);
             src += rw;
             avail -= rw;
-            
-#define unpred_opt_case(pred, formula, suffix) \
-                case pred:\
-                    for (i = 0; i < bw; i++) {\
-                        *dst = (formula) & 0xff; suffix; prevRow[i] = *dst;\
-                        dst++;\
-                    }\
-                    break
-            switch (predictor) {
-                    unpred_opt_case(PDPredictorPNG_UP,  row[i] + prevRow[i],);
-                    unpred_opt_case(PDPredictorPNG_SUB, row[i] + (i ? row[i-1] : 0),);
-                    unpred_opt_case(PDPredictorPNG_AVG, row[i] + ((i ? row[i-1] : 0) + prevRow[i]),);
-                    unpred_opt_case(PDPredictorPNG_PAE, row[i] + paeth_predictor(i ? row[i-1] : 0, prevRow[i], prevRowMinus1), prevRowMinus1 = prevRow[i]);
-                default:
-                    for (i = 0; i < bw; i++) {
-                        unpred_apply(row[i],);
-                        dst++;
-                    }
-            }
+            dst += bw;
             cap -= bw;
         }
-    } else {
-        switch (predictor) {
-                unpred_case(PDPredictorPNG_UP,  row[i] + prevRow[i],);
-                unpred_case(PDPredictorPNG_SUB, row[i] + (i ? row[i-1] : 0),);
-                unpred_case(PDPredictorPNG_AVG, row[i] + ((i ? row[i-1] : 0) + prevRow[i]),);
-                unpred_case(PDPredictorPNG_PAE, row[i] + paeth_predictor(i ? row[i-1] : 0, prevRow[i], prevRowMinus1), prevRowMinus1 = prevRow[i]);
-            default:
-                unpred_apply(row[i],);
-                break;
-        }
     }
     
-    free(row);
-    
     outputLength = filter->bufOutCapacity - cap;
     
     filter->bufIn = src;
@@ -334,6 +774,8 @@ PDStreamFilterRef pred_invert_with_options(PDStreamFilterRef filter, PDBool inpu
     PDDictionaryRef opts = PDDictionaryCreate();
     PDDictionarySet(opts, "Predictor", PDNumberWithInteger(pred->predictor));
     PDDictionarySet(opts, "Columns", PDNumberWithInteger(pred->columns));
+    PDDictionarySet(opts, "Colors", PDNumberWithInteger(pred->colors));
+    PDDictionarySet(opts, "BitsPerComponent", PDNumberWithInteger(pred->bpc));
     
     return PDStreamFilterPredictionConstructor(inputEnd, opts);
 }
@@ -57,6 +57,24 @@ extern PDStreamFilterRef PDStreamFilterUnpredictionCreate(PDDictionaryRef option
  */
 extern PDStreamFilterRef PDStreamFilterPredictionConstructor(PDBool inputEnd, PDDictionaryRef options);
 
+/**
+ Determine whether vector (SSE2 or NEON) kernels are available for unpredicting PNG Sub, Average and Paeth rows of 3 and 4 byte pixels.
+ 
+ On x86 processors with SSE2, and on ARM processors with NEON, the vector kernels are used; elsewhere, and for other pixel sizes, the portable row functions are used. Both give identical results.
+ 
+ @return true if the vector kernels are available.
+ */
+extern PDBool PDStreamFilterPredictionVectorAvailable(void);
+
+/**
+ Enable or disable the vector kernels (they are enabled by default, where available), e.g. to compare them against the portable row functions.
+ 
+ The setting applies to filters initialized after the call, and is not meant to be changed while filters are being set up on other threads.
+ 
+ @param enabled Whether the vector kernels are used.
+ */
+extern void PDStreamFilterPredictionSetVectorEnabled(PDBool enabled);
+
 #endif
 
 /** @} */
@@ -0,0 +1,281 @@
+//
+// PDStreamFilterRunLengthDecode.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "pd_internal.h"
+#include "PDStreamFilterRunLengthDecode.h"
+
+#define RL_EOD 128
+
+typedef struct PDRunLength *PDRunLengthRef;
+/**
+ Run length state data for an ongoing compress/decompress operation.
+ */
+struct PDRunLength {
+    unsigned char spill[132];   ///< Output which did not fit into the output buffer last time around (compression)
+    PDInteger spillLen;         ///< Number of bytes in spill
+    PDInteger spillPos;         ///< Number of bytes in spill which have been written
+    unsigned char lit[128];     ///< Pending literal bytes (compression)
+    PDInteger litLen;           ///< Number of pending literal bytes (compression), or remaining literal bytes to copy (decompression)
+    unsigned char runByte;      ///< The byte being repeated
+    PDInteger runLen;           ///< Length of the current run (compression), or remaining repetitions (decompression)
+    PDInteger pendingRun;       ///< Repetitions for a run whose byte has not been read yet (decompression)
+    PDBool eod;                 ///< Whether the end of data marker was read or written
+};
+
+static inline void rl_drain(PDRunLengthRef rl, unsigned char **dst, PDInteger *cap)
+{
+    PDInteger n = rl->spillLen - rl->spillPos;
+    if (n > *cap) n = *cap;
+    memcpy(*dst, &rl->spill[rl->spillPos], n);
+    *dst += n;
+    *cap -= n;
+    rl->spillPos += n;
+    if (rl->spillPos == rl->spillLen) 
+        rl->spillPos = rl->spillLen = 0;
+}
+
+static inline void rl_write(PDRunLengthRef rl, unsigned char **dst, PDInteger *cap, const unsigned char *buf, PDInteger len)
+{
+    PDInteger n = len > *cap ? *cap : len;
+    memcpy(*dst, buf, n);
+    *dst += n;
+    *cap -= n;
+    if (n < len) {
+        memcpy(&rl->spill[rl->spillLen], &buf[n], len - n);
+        rl->spillLen += len - n;
+    }
+}
+
+static inline void rl_flush_literal(PDRunLengthRef rl, unsigned char **dst, PDInteger *cap, PDInteger len)
+{
+    unsigned char op = len - 1;
+    rl_write(rl, dst, cap, &op, 1);
+    rl_write(rl, dst, cap, rl->lit, len);
+    rl->litLen -= len;
+    if (rl->litLen > 0) memmove(rl->lit, &rl->lit[len], rl->litLen);
+}
+
+static inline void rl_flush_run(PDRunLengthRef rl, unsigned char **dst, PDInteger *cap)
+{
+    unsigned char op[2] = { 257 - rl->runLen, rl->runByte };
+    rl_write(rl, dst, cap, op, 2);
+    rl->runLen = 0;
+}
+
+PDInteger rl_init(PDStreamFilterRef filter)
+{
+    if (filter->initialized)
+        return true;
+    
+    filter->data = calloc(1, sizeof(struct PDRunLength));
+    
+    filter->initialized = true;
+    
+    return true;
+}
+
+PDInteger rl_done(PDStreamFilterRef filter)
+{
+    PDAssert(filter->initialized);
+    
+    free(filter->data);
+    filter->data = NULL;
+    
+    filter->initialized = false;
+    
+    return true;
+}
+
+PDInteger rl_compress_proceed(PDStreamFilterRef filter)
+{
+    PDRunLengthRef rl = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    unsigned char c;
+    
+    rl_drain(rl, &dst, &cap);
+    
+    // every flush fits in the spill buffer, so we keep going until something actually spills
+    while (avail > 0 && rl->spillLen == 0) {
+        c = *src++;
+        avail--;
+        
+        if (rl->runLen > 0) {
+            if (c == rl->runByte && rl->runLen < 128) {
+                rl->runLen++;
+                continue;
+            }
+            rl_flush_run(rl, &dst, &cap);
+            rl->lit[0] = c;
+            rl->litLen = 1;
+            continue;
+        }
+        
+        rl->lit[rl->litLen++] = c;
+        if (rl->litLen >= 3 && rl->lit[rl->litLen-2] == c && rl->lit[rl->litLen-3] == c) {
+            // three equal bytes start a run; whatever came before them goes out as a literal
+            if (rl->litLen > 3) rl_flush_literal(rl, &dst, &cap, rl->litLen - 3);
+            rl->runByte = c;
+            rl->runLen = 3;
+            rl->litLen = 0;
+        } else if (rl->litLen == 128) {
+            rl_flush_literal(rl, &dst, &cap, 128);
+        }
+    }
+    
+    if (avail == 0 && ! filter->hasInput && ! rl->eod && rl->spillLen == 0) {
+        unsigned char eod = RL_EOD;
+        if (rl->runLen > 0) rl_flush_run(rl, &dst, &cap);
+        if (rl->litLen > 0) rl_flush_literal(rl, &dst, &cap, rl->litLen);
+        rl_write(rl, &dst, &cap, &eod, 1);
+        rl->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = rl->eod && rl->spillLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger rl_decompress_proceed(PDStreamFilterRef filter)
+{
+    PDRunLengthRef rl = filter->data;
+    unsigned char *src = filter->bufIn;
+    unsigned char *dst = filter->bufOut;
+    PDInteger avail = filter->bufInAvailable;
+    PDInteger cap = filter->bufOutCapacity;
+    PDInteger n;
+    unsigned char op;
+    
+    while (cap > 0 && ! rl->eod) {
+        if (rl->litLen > 0) {
+            if (avail == 0) break;
+            n = rl->litLen;
+            if (n > avail) n = avail;
+            if (n > cap) n = cap;
+            memcpy(dst, src, n);
+            dst += n;
+            src += n;
+            cap -= n;
+            avail -= n;
+            rl->litLen -= n;
+            continue;
+        }
+        
+        if (rl->runLen > 0) {
+            n = rl->runLen > cap ? cap : rl->runLen;
+            memset(dst, rl->runByte, n);
+            dst += n;
+            cap -= n;
+            rl->runLen -= n;
+            continue;
+        }
+        
+        if (avail == 0) break;
+        
+        if (rl->pendingRun > 0) {
+            rl->runByte = *src++;
+            avail--;
+            rl->runLen = rl->pendingRun;
+            rl->pendingRun = 0;
+            continue;
+        }
+        
+        op = *src++;
+        avail--;
+        if (op < RL_EOD) 
+            rl->litLen = op + 1;
+        else if (op > RL_EOD)
+            rl->pendingRun = 257 - op;
+        else 
+            rl->eod = true;
+    }
+    
+    PDBool ended = rl->eod || (avail == 0 && ! filter->hasInput && rl->runLen == 0);
+    if (ended) {
+        if (! rl->eod && (rl->litLen > 0 || rl->pendingRun > 0)) 
+            PDWarn("RunLengthDecode stream is truncated\n");
+        src += avail;
+        avail = 0;
+        rl->eod = true;
+    }
+    
+    PDInteger outputLength = filter->bufOutCapacity - cap;
+    
+    filter->bufIn = src;
+    filter->bufOut = dst;
+    filter->bufInAvailable = avail;
+    filter->bufOutCapacity = cap;
+    filter->needsInput = avail == 0;
+    filter->finished = ended && rl->runLen == 0;
+    
+    return outputLength;
+}
+
+PDInteger rl_compress_begin(PDStreamFilterRef filter)
+{
+    return rl_compress_proceed(filter);
+}
+
+PDInteger rl_decompress_begin(PDStreamFilterRef filter)
+{
+    return rl_decompress_proceed(filter);
+}
+
+PDStreamFilterRef rl_compress_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterRunLengthDecodeDecompressCreate(NULL);
+}
+
+PDStreamFilterRef rl_decompress_invert(PDStreamFilterRef filter)
+{
+    return PDStreamFilterRunLengthDecodeCompressCreate(NULL);
+}
+
+PDStreamFilterRef PDStreamFilterRunLengthDecodeCompressCreate(PDDictionaryRef options)
+{
+    return PDStreamFilterCreate(rl_init, rl_done, rl_compress_begin, rl_compress_proceed, rl_compress_invert, options);
+}
+
+PDStreamFilterRef PDStreamFilterRunLengthDecodeDecompressCreate(PDDictionaryRef options)
+{
+    PDStreamFilterRef filter = PDStreamFilterCreate(rl_init, rl_done, rl_decompress_begin, rl_decompress_proceed, rl_decompress_invert, options);
+    filter->growthHint = 2.f;
+    return filter;
+}
+
+PDStreamFilterRef PDStreamFilterRunLengthDecodeConstructor(PDBool inputEnd, PDDictionaryRef options)
+{
+    return (inputEnd
+            ? PDStreamFilterRunLengthDecodeDecompressCreate(options)
+            : PDStreamFilterRunLengthDecodeCompressCreate(options));
+}
@@ -0,0 +1,66 @@
+//
+// PDStreamFilterRunLengthDecode.h
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/**
+ @file PDStreamFilterRunLengthDecode.h
+ 
+ @ingroup PDSTREAMFILTERRUNLENGTHDECODE
+ 
+ @defgroup PDSTREAMFILTERRUNLENGTHDECODE PDStreamFilterRunLengthDecode
+ 
+ @brief Run Length Decode (compression/decompression) stream filter
+ 
+ @ingroup PDINTERNAL
+ 
+ @implements PDSTREAMFILTER
+ 
+ Data is split into runs, each prefixed by a length byte: 0-127 means the following 1-128 bytes are copied literally, 129-255 means the following single byte is repeated 2-128 times, and 128 marks the end of the data.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PDStreamFilterRunLengthDecode_h
+#define INCLUDED_PDStreamFilterRunLengthDecode_h
+
+#include "PDStreamFilter.h"
+
+/**
+ Set up a stream filter for RunLengthDecode compression.
+ */
+extern PDStreamFilterRef PDStreamFilterRunLengthDecodeCompressCreate(PDDictionaryRef options);
+
+/**
+ Set up stream filter for RunLengthDecode decompression.
+ */
+extern PDStreamFilterRef PDStreamFilterRunLengthDecodeDecompressCreate(PDDictionaryRef options);
+
+/**
+ Set up a stream filter for RunLengthDecode based on inputEnd boolean. 
+ */
+extern PDStreamFilterRef PDStreamFilterRunLengthDecodeConstructor(PDBool inputEnd, PDDictionaryRef options);
+
+#endif
+
+/** @} */
@@ -830,18 +830,21 @@ PDStringRef PDStringCreateEncrypted(PDStringRef string)
     PDSize len;
     char *dst;
     const char *str_in = PDStringBinaryValue(string, &len);
-    char *str = malloc(len);
+    char *str = malloc(len + 1);
     memcpy(str, str_in, len);
     
-    len = pd_crypto_encrypt(string->ci->crypto, string->ci->obid, string->ci->genid, &dst, str, len);
-    PDStringRef encrypted = PDStringCreateBinary(dst, len);
+    // the encrypted data is escaped here, as converting it from binary when printing may mistake it for text in some encoding
+    len = pd_crypto_encrypt_data(string->ci->crypto, string->ci->obid, string->ci->genid, &str, len);
+    len = pd_crypto_escape(&dst, str, len);
+    free(str);
+    PDStringRef encrypted = PDStringCreate(dst, len);
     PDStringAttachCryptoInstance(encrypted, string->ci, true);
     return encrypted;
 }
 
 PDStringRef PDStringCreateDecrypted(PDStringRef string)
 {
-    if (NULL == string || NULL == string->ci || ! string->encrypted || string->length == 0) return PDRetain(string);
+    if (NULL == string || ! PDStringIsEncrypted(string) || string->length == 0) return PDRetain(string);
     
     PDSize len;
     const char *data_in = PDStringBinaryValue(string, &len);
@@ -849,8 +852,9 @@ PDStringRef PDStringCreateDecrypted(PDStringRef string)
     memcpy(data, data_in, len);
     data[len] = 0;
     
-    pd_crypto_convert(string->ci->crypto, string->ci->obid, string->ci->genid, data, len);
-    PDStringRef decrypted = PDStringCreate(data, strlen(data));
+    len = pd_crypto_decrypt_data(string->ci->crypto, string->ci->obid, string->ci->genid, data, len);
+    data[len] = 0;
+    PDStringRef decrypted = PDStringCreateBinary(data, len);
     PDStringAttachCryptoInstance(decrypted, string->ci, false);
     return decrypted;
 }
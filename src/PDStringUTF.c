@@ -31,8 +31,13 @@
 #include "PDNumber.h"
 #include "pd_internal.h"
 
-PDBool iconv_unicode_mb_to_uc_fb_called = false;
-PDBool iconv_unicode_uc_to_mb_fb_called = false;
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
+// the fallbacks are called from within iconv(), so the flags are per thread, like the conversions themselves
+PD_THREAD_LOCAL PDBool iconv_unicode_mb_to_uc_fb_called = false;
+PD_THREAD_LOCAL PDBool iconv_unicode_uc_to_mb_fb_called = false;
 
 void pdstring_iconv_unicode_mb_to_uc_fallback(const char* inbuf, size_t inbufsize,
                                               void (*write_replacement) (const unsigned int *buf, size_t buflen,
@@ -64,6 +69,17 @@ PDStringEncoding PDStringDetermineEncoding(PDStringRef string);
 
 static PDStringEncoding autoList[__PDSTRINGENC_END] = {0};
 
+// lookup tables are set up on first use, which may happen on several threads at once (e.g. in PDParserForEachPageParallel())
+#ifdef PD_SUPPORT_THREADS
+static pthread_once_t autolist_once = PTHREAD_ONCE_INIT;
+static pthread_once_t enc_names_once = PTHREAD_ONCE_INIT;
+static pthread_once_t latin_dict_once = PTHREAD_ONCE_INIT;
+static pthread_once_t latin_rarr_once = PTHREAD_ONCE_INIT;
+#   define PDStringUTFSetupOnce(once, ready, setup) pthread_once(&once, setup)
+#else
+#   define PDStringUTFSetupOnce(once, ready, setup) if (! (ready)) setup()
+#endif
+
 #define PDStringEncodingEnumerate(enc) \
             for (PDStringEncoding enc = autoList[0]; \
                  enc > 0 && enc < __PDSTRINGENC_END; \
@@ -103,7 +119,7 @@ static const char *enc_uhc = "UHC";
 static const char **enc_names = NULL;
 static PDDictionaryRef encMap = NULL;
 
-static inline void setup_autolist()
+static void setup_autolist()
 {
 #define map(a, b) autoList[a] = b
     map(PDStringEncodingDefault, PDStringEncodingUTF8);//16BE);
@@ -121,7 +137,7 @@ static inline void setup_autolist()
 #undef map
 }
 
-static inline void setup_enc_names() 
+static void setup_enc_names() 
 {
     PDAssert(__PDSTRINGENC_END == 28);
 
@@ -258,13 +274,13 @@ static inline void setup_enc_names()
 const char *PDStringEncodingToIconvName(PDStringEncoding enc)
 {
     if (enc < 1 || enc > __PDSTRINGENC_END) return NULL;
-    if (enc_names == NULL) setup_enc_names();
+    PDStringUTFSetupOnce(enc_names_once, enc_names, setup_enc_names);
     return enc_names[enc-1];
 }
 
 PDStringEncoding PDStringEncodingGetByName(const char *encodingName)
 {
-    if (enc_names == NULL) setup_enc_names();
+    PDStringUTFSetupOnce(enc_names_once, enc_names, setup_enc_names);
     PDNumberRef encNum = PDDictionaryGet(encMap, encodingName);
     if (NULL == encNum) {
         PDError("Unknown encoding string: %s", encodingName);
@@ -289,7 +305,7 @@ void PDStringSetFont(PDStringRef string, PDFontRef font)
 
 PDStringRef PDUTF8String(PDStringRef string)
 {
-    if (autoList[0] == 0) setup_autolist();
+    PDStringUTFSetupOnce(autolist_once, autoList[0], setup_autolist);
     
     PDStringRef source = string;
     
@@ -520,15 +536,19 @@ void PDStringLatinRCharsetIter(char *key, void *value, void *userInfo, PDBool *s
     rarr[iv] = key;
 }
 
-const char **PDStringLatinRCharsetArray(void)
+static char **latin_rarr = NULL;
+
+static void setup_latin_rarr()
 {
-    static char **rarr = NULL;
-    if (rarr) return (const char **)rarr;
-    
     PDDictionaryRef lat = PDStringLatinCharsetDict();
-    rarr = calloc(256, sizeof(char*));
-    PDDictionaryIterate(lat, PDStringLatinRCharsetIter, rarr);
-    return (const char **)rarr;
+    latin_rarr = calloc(256, sizeof(char*));
+    PDDictionaryIterate(lat, PDStringLatinRCharsetIter, latin_rarr);
+}
+
+const char **PDStringLatinRCharsetArray(void)
+{
+    PDStringUTFSetupOnce(latin_rarr_once, latin_rarr, setup_latin_rarr);
+    return (const char **)latin_rarr;
 }
 
 const unsigned char PDStringLatinPDFToWin[] = {
@@ -550,17 +570,16 @@ const unsigned char PDStringLatinPDFToWin[] = {
     0360, 0361, 0362, 0363, 0364, 0365, 0366, 0367, 0370, 0371, 0372, 0373, 0374, 0375, 0376, 0377, 
 };
 
-PDDictionaryRef PDStringLatinCharsetDict(void)
+static PDDictionaryRef latin_dict = NULL;
+
+static void setup_latin_dict()
 {
-    static PDDictionaryRef dict = NULL;
-    if (dict) return dict;
-    
     PDNumberRef dummyRef = PDNumberCreateWithBool(true);
     PDAutorelease(dummyRef);
     
 #define n(v) PDNumberWithInteger(v)
 #define pair(k,v) k, n(0##v)
-    dict = PDDictionaryCreateWithKeyValueDefinition
+    latin_dict = PDDictionaryCreateWithKeyValueDefinition
     (PDDef(
            ".notdef", n(0),
            pair("A", 101),
@@ -796,6 +815,11 @@ PDDictionaryRef PDStringLatinCharsetDict(void)
            ));
     
     PDFlushUntil(dummyRef);
-    return dict;
+}
+
+PDDictionaryRef PDStringLatinCharsetDict(void)
+{
+    PDStringUTFSetupOnce(latin_dict_once, latin_dict, setup_latin_dict);
+    return latin_dict;
 }
 
@@ -93,6 +93,7 @@ PDTaskRef PDTaskCreateFilterWithValue(PDPropertyType propertyType, PDInteger val
     task->propertyType = propertyType;
     task->value        = value;
     task->child        = NULL;
+    task->isIndependent = false;
     return task;
 }
 
@@ -110,6 +111,7 @@ PDTaskRef PDTaskCreateMutator(PDTaskFunc mutatorFunc)
     task->func         = mutatorFunc;
     task->child        = NULL;
     task->info         = NULL;
+    task->isIndependent = false;
     return task;
 }
 
@@ -121,6 +123,22 @@ void PDTaskAppendTask(PDTaskRef parentTask, PDTaskRef childTask)
     childParentTask->child = PDRetain(childTask);
 }
 
+PDTaskRef PDTaskCreateCopy(PDTaskRef task)
+{
+    PDTaskRef copy = (task->isFilter 
+                      ? PDAllocTyped(PDInstanceTypeTask, sizeof(struct PDTask), PDTaskDestroy, false) 
+                      : PDAlloc(sizeof(struct PDTask), PDTaskDestroy, false));
+    memcpy(copy, task, sizeof(struct PDTask));
+    copy->child = task->child ? PDTaskCreateCopy(task->child) : NULL;
+    return copy;
+}
+
+void PDTaskSetIndependent(PDTaskRef task, PDBool independent)
+{
+    for (; task; task = task->child) 
+        task->isIndependent = independent;
+}
+
 void PDTaskSetInfo(PDTaskRef task, void *info)
 {
     if (task->isFilter)
@@ -68,6 +68,16 @@ extern PDTaskRef PDTaskCreateMutator(PDTaskFunc mutatorFunc);
  */
 extern void PDTaskAppendTask(PDTaskRef parentTask, PDTaskRef childTask);
 
+/**
+ Create a copy of a task, along with copies of its child tasks.
+ 
+ Pipes modify the tasks added to them, e.g. by merging tasks for the same object, so the same task cannot be added to several pipes. A copy can, however, and shares the original's functions and info objects.
+ 
+ @param task The task.
+ @return The copy.
+ */
+extern PDTaskRef PDTaskCreateCopy(PDTaskRef task);
+
 /**
  Set the info object for a task. 
  
@@ -78,6 +88,18 @@ extern void PDTaskAppendTask(PDTaskRef parentTask, PDTaskRef childTask);
  */
 extern void PDTaskSetInfo(PDTaskRef task, void *info);
 
+/**
+ Declare whether a task, along with its child tasks, is independent.
+ 
+ An independent task only reads and modifies the object it is given, and its stream (via PDParserFetchCurrentObjectStream() or PDParserOpenCurrentObjectStreamReader()). It does not call other parser or pipe functions, create objects, set stream producers, or touch objects other than the one it is given, and its info object is safe to use from several threads at once. Pipes with sharding enabled (see PDPipeSetSharding()) run independent tasks on their worker threads. 
+ 
+ @note When run on worker threads, PDTaskUnload is treated as PDTaskDone, i.e. the task is still called for the following objects, as other threads are running it at the same time.
+ 
+ @param task The task.
+ @param independent Whether the task is independent; the default is false.
+ */
+extern void PDTaskSetIndependent(PDTaskRef task, PDBool independent);
+
 /**
  Execute a task, possibly resulting in a chain of tasks executing if the task has children.
  */
@@ -23,21 +23,70 @@
 //
 
 #include <assert.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include "Pajdeg.h"
 #include "PDTwinStream.h"
 #include "PDScanner.h"
+#include "PDWorkQueue.h"
 
 #include "pd_internal.h"
 
 #define PIO_CHUNK_SIZE  512
+#define PIO_CLONE_CHUNK_SIZE (1024 * 1024) ///< Amount copied per round by PDTwinStreamCloneInput(), when the file system cannot share the data
+
+// pending deferred segments are flushed (waiting on their work items) when they hold more than this many bytes of 
+// buffered output, or when there are more than this many of them
+#define PDTwinStreamReorderByteLimit    (32 * 1024 * 1024)
+#define PDTwinStreamReorderCountLimit   256
+
+typedef struct PDTwinStreamOffsetRecord {
+    PDInteger key;                  ///< the key handed to the offset resolver
+    PDOffset pos;                   ///< the offset relative to the start of the segment's literal content
+} PDTwinStreamOffsetRecord;
+
+struct PDTwinStreamSegment {
+    PDWorkItemRef item;             ///< the work item producing the deferred content
+    PDTwinStreamDeferredFunc func;  ///< the function writing the deferred content
+    void *info;                     ///< info passed to func
+    char *buf;                      ///< literal content following the deferred content
+    PDSize len;                     ///< length of literal content
+    PDSize cap;                     ///< capacity of buf
+    PDOffset start;                 ///< output offset (as tracked by offso) at which the literal content begins
+    PDTwinStreamOffsetRecord *offsets; ///< offsets inside the literal content, pending resolution
+    PDInteger offsetCount;          ///< number of offsets
+    PDInteger offsetCap;            ///< capacity of offsets
+    struct PDTwinStreamSegment *next; ///< the next segment
+};
 
 void PDTwinStreamRealign(PDTwinStreamRef ts);
 
+static void PDTwinStreamSegmentDestroy(struct PDTwinStreamSegment *seg)
+{
+    PDRelease(seg->item);
+    free(seg->buf);
+    free(seg->offsets);
+    free(seg);
+}
+
 void PDTwinStreamDestroy(PDTwinStreamRef ts)
 {
 //    PDScannerContextPop();
     
+    // pending segments are discarded; the output file may be gone at this point
+    struct PDTwinStreamSegment *seg;
+    while (ts->reorderHead) {
+        seg = ts->reorderHead;
+        ts->reorderHead = seg->next;
+        PDWorkItemWait(seg->item);
+        (*seg->func)(ts, seg->info, false);
+        PDTwinStreamSegmentDestroy(seg);
+    }
+    
     PDRelease(ts->scanner);
     if (ts->sidebuf) free(ts->sidebuf);
     free(ts->heap);
@@ -52,6 +101,14 @@ PDTwinStreamRef PDTwinStreamCreate(FILE *fi, FILE *fo)
     return ts;
 }
 
+void PDTwinStreamSetOutput(PDTwinStreamRef ts, FILE *fo)
+{
+    PDAssert(ts->reorderHead == NULL); // crash = output is being held back; it must be flushed before the output is changed
+    
+    ts->fo = fo;
+    ts->offso = 0;
+}
+
 //
 // configuring / querying
 //
@@ -355,13 +412,8 @@ PDSize PDTwinStreamFetchBranch(PDTwinStreamRef ts, PDSize position, PDInteger by
     }
     
     // we set up a dedicated buffer for this request
-    PDOffset cpos;
-    fgetpos(ts->fi, &cpos);
-    fseek(ts->fi, position, SEEK_SET);
     *buf = ts->sidebuf = malloc(bytes);
-    PDSize read = fread(ts->sidebuf, 1, bytes, ts->fi);
-    fseek(ts->fi, (long)cpos, SEEK_SET);
-    return read;
+    return PDTwinStreamReadInput(ts, position, bytes, ts->sidebuf);
 }
 
 #ifdef PD_DEBUG_TWINSTREAM_ASSERT_OBJECTS
@@ -397,6 +449,39 @@ void PDTwinStreamCutBranch(PDTwinStreamRef ts, char *buf)
     ts->sidebuf = NULL;
 }
 
+PDSize PDTwinStreamReadInput(PDTwinStreamRef ts, PDSize position, PDInteger bytes, char *dest)
+{
+    PDSize read = 0;
+    
+    // copy whatever part of the range is already on the heap
+    PDInteger alignment = (PDInteger)(position - ts->offsi);
+    PDInteger covered = (PDInteger)(ts->holds - alignment);
+    if (alignment >= 0 && covered > 0) {
+        read = covered < bytes ? covered : bytes;
+        memcpy(dest, ts->heap + alignment, read);
+        if (read == bytes) return read;
+    }
+    
+    // and read the rest from the input file
+    int fd = fileno(ts->fi);
+    if (fd >= 0) {
+        // pread() leaves the shared file position alone, so there is nothing to seek back to
+        while (read < (PDSize)bytes) {
+            ssize_t got = pread(fd, &dest[read], bytes - read, (off_t)(position + read));
+            if (got <= 0) break;
+            read += got;
+        }
+        return read;
+    }
+    
+    PDOffset cpos;
+    fgetpos(ts->fi, &cpos);
+    fseek(ts->fi, (long)(position + read), SEEK_SET);
+    read += fread(&dest[read], 1, bytes - read, ts->fi);
+    fseek(ts->fi, (long)cpos, SEEK_SET);
+    return read;
+}
+
 //
 // committing
 //
@@ -412,8 +497,10 @@ void PDTwinStreamAsserts(PDTwinStreamRef ts)
     PDOffset fp;
     fgetpos(ts->fi, &fp);
     PDAssert(fp == ts->offsi + ts->holds);
-    fgetpos(ts->fo, &fp);
-    PDAssert(fp == ts->offso);
+    if (ts->fo) {
+        fgetpos(ts->fo, &fp);
+        PDAssert(fp == ts->offso - ts->reorderBytes); // held back output is included in offso
+    }
 
     /*
     if (ts->scanner && ts->scanner->buf) {
@@ -509,26 +596,57 @@ void PDTwinStreamOperateOnContent(PDTwinStreamRef ts, PDOffset bytes, void(*op)(
     }
 }
 
-void PDTwinStreamOperatorPassthrough(PDTwinStreamRef ts, char *buf, PDSize bytes)
+static PDSize PDTwinStreamWrite(PDTwinStreamRef ts, const char *buf, PDSize bytes)
 {
-    fwrite(buf, 1, bytes, ts->fo);
+    struct PDTwinStreamSegment *seg = ts->reorderTail;
+    
+    if (seg && ! ts->emitting) {
+        // output is held back until the pending segments have been emitted
+        if (seg->len + bytes > seg->cap) {
+            seg->cap = seg->cap * 2 > seg->len + bytes ? seg->cap * 2 : seg->len + bytes + PIO_CHUNK_SIZE;
+            seg->buf = realloc(seg->buf, seg->cap);
+        }
+        memcpy(&seg->buf[seg->len], buf, bytes);
+        seg->len += bytes;
+        ts->reorderBytes += bytes;
+    } else if (ts->fo) {
+        bytes = fwrite(buf, 1, bytes, ts->fo);
+    }
+    
     ts->offso += bytes;
+    return bytes;
+}
+
+void PDTwinStreamOperatorPassthrough(PDTwinStreamRef ts, char *buf, PDSize bytes)
+{
+    PDTwinStreamWrite(ts, buf, bytes);
 }
 
 void PDTwinStreamOperatorDiscard(PDTwinStreamRef ts, char *buf, PDSize bytes)
 {}
 
+/**
+ The number of bytes between the cursor and the master scanner's position.
+ 
+ The master scanner is reset when content beyond the heap has been operated on, at which point it is at the cursor, even if it was skipped ahead afterwards.
+ */
+static inline PDOffset PDTwinStreamScannerBytes(PDTwinStreamRef ts)
+{
+    if (ts->scanner->buf == NULL) return ts->scanner->boffset;
+    return ts->scanner->buf - ts->heap + ts->scanner->boffset - ts->cursor;
+}
+
 void PDTWinStreamPassthroughContent(PDTwinStreamRef ts)//, PDSize bytes)
 {
     PDSOp("pass");
-    PDOffset bytes = ts->scanner->buf - ts->heap + ts->scanner->boffset - ts->cursor;
+    PDOffset bytes = PDTwinStreamScannerBytes(ts);
     PDTwinStreamOperateOnContent(ts, bytes, &PDTwinStreamOperatorPassthrough);
 }
 
 void PDTwinStreamDiscardContent(PDTwinStreamRef ts)//, PDSize bytes)
 {
     PDSOp("discard");
-    PDOffset bytes = ts->scanner->buf - ts->heap + ts->scanner->boffset - ts->cursor;
+    PDOffset bytes = PDTwinStreamScannerBytes(ts);
     PDTwinStreamOperateOnContent(ts, bytes, &PDTwinStreamOperatorDiscard);
 }
 
@@ -542,5 +660,142 @@ void PDTwinStreamPrune(PDTwinStreamRef ts, PDOffset mark)
 
 void PDTwinStreamInsertContent(PDTwinStreamRef ts, PDSize bytes, const char *content)
 {
-    ts->offso += fwrite(content, 1, bytes, ts->fo);
+    PDTwinStreamWrite(ts, content, bytes);
+}
+
+PDBool PDTwinStreamCloneInput(PDTwinStreamRef ts)
+{
+    PDAssert(ts->reorderHead == NULL); // crash = output is being held back; the input cannot be cloned until it has been flushed
+    
+    PDOffset cpos;
+    fgetpos(ts->fi, &cpos);
+    fseek(ts->fi, 0, SEEK_END);
+    PDSize size = (PDSize)ftell(ts->fi);
+    PDSize copied = 0;
+    
+    fflush(ts->fo);
+
+#ifdef FICLONE
+    // on file systems supporting it (e.g. btrfs, XFS), the output shares the input's data rather than copying it
+    if (0 == ioctl(fileno(ts->fo), FICLONE, fileno(ts->fi))) 
+        copied = size;
+#endif
+    
+    if (copied < size) {
+        char *buf = malloc(PIO_CLONE_CHUNK_SIZE);
+        fseek(ts->fi, 0, SEEK_SET);
+        fseek(ts->fo, 0, SEEK_SET);
+        while (copied < size) {
+            PDSize bytes = fread(buf, 1, PIO_CLONE_CHUNK_SIZE, ts->fi);
+            if (bytes == 0 || bytes != fwrite(buf, 1, bytes, ts->fo)) break;
+            copied += bytes;
+        }
+        free(buf);
+    }
+    
+    fseek(ts->fo, 0, SEEK_END);
+    fseek(ts->fi, (long)cpos, SEEK_SET);
+    ts->offso = copied;
+    
+    return copied == size;
+}
+
+//
+// deferred output
+//
+
+static void PDTwinStreamEmitSegment(PDTwinStreamRef ts)
+{
+    struct PDTwinStreamSegment *seg = ts->reorderHead;
+    struct PDTwinStreamSegment *s;
+    PDOffset grown, base;
+    PDInteger i;
+    
+    PDWorkItemWait(seg->item);
+    
+    // the deferred content goes straight to output, as it precedes everything that is still being held back
+    grown = ts->offso;
+    ts->emitting = true;
+    (*seg->func)(ts, seg->info, true);
+    ts->emitting = false;
+    grown = ts->offso - grown;
+    
+    // segments after this one were placed at offsets which did not include the deferred content
+    for (s = seg->next; s; s = s->next) 
+        s->start += grown;
+    
+    // the literal content begins at the actual position in the output file
+    base = ts->offso - ts->reorderBytes;
+    for (i = 0; i < seg->offsetCount; i++) 
+        (*ts->offsetResolver)(ts->offsetResolverInfo, seg->offsets[i].key, base + seg->offsets[i].pos);
+    
+    fwrite(seg->buf, 1, seg->len, ts->fo);
+    ts->reorderBytes -= seg->len;
+    
+    ts->reorderHead = seg->next;
+    if (ts->reorderHead == NULL) ts->reorderTail = NULL;
+    ts->reorderCount--;
+    
+    PDTwinStreamSegmentDestroy(seg);
+    PDTwinStreamAsserts(ts);
+}
+
+void PDTwinStreamFlushDeferred(PDTwinStreamRef ts, PDBool wait)
+{
+    while (ts->reorderHead && (wait || PDWorkItemIsDone(ts->reorderHead->item))) 
+        PDTwinStreamEmitSegment(ts);
+}
+
+void PDTwinStreamInsertDeferred(PDTwinStreamRef ts, PDWorkItemRef item, PDTwinStreamDeferredFunc func, void *info)
+{
+    struct PDTwinStreamSegment *seg = calloc(1, sizeof(struct PDTwinStreamSegment));
+    seg->item = PDRetain(item);
+    seg->func = func;
+    seg->info = info;
+    seg->start = ts->offso;
+    
+    if (ts->reorderTail) 
+        ts->reorderTail->next = seg;
+    else 
+        ts->reorderHead = seg;
+    ts->reorderTail = seg;
+    ts->reorderCount++;
+    
+    // emit whatever is done, and wait for the rest if we're holding on to too much
+    PDTwinStreamFlushDeferred(ts, false);
+    while (ts->reorderHead && (ts->reorderBytes > PDTwinStreamReorderByteLimit || ts->reorderCount > PDTwinStreamReorderCountLimit)) 
+        PDTwinStreamEmitSegment(ts);
+}
+
+PDBool PDTwinStreamIsDeferring(PDTwinStreamRef ts)
+{
+    return ts->reorderHead != NULL;
+}
+
+void PDTwinStreamSetOffsetResolver(PDTwinStreamRef ts, PDTwinStreamOffsetResolver resolver, void *info)
+{
+    ts->offsetResolver = resolver;
+    ts->offsetResolverInfo = info;
+}
+
+void PDTwinStreamDeferOffset(PDTwinStreamRef ts, PDInteger key, PDOffset offset)
+{
+    struct PDTwinStreamSegment *seg = ts->reorderTail;
+    
+    PDAssert(ts->offsetResolver); // crash = offsets were deferred without a resolver
+    
+    if (seg == NULL) {
+        (*ts->offsetResolver)(ts->offsetResolverInfo, key, offset);
+        return;
+    }
+    
+    PDAssert(offset >= seg->start); // crash = the offset was taken before the most recent deferred segment was inserted
+    
+    if (seg->offsetCount == seg->offsetCap) {
+        seg->offsetCap = seg->offsetCap ? seg->offsetCap * 2 : 8;
+        seg->offsets = realloc(seg->offsets, sizeof(PDTwinStreamOffsetRecord) * seg->offsetCap);
+    }
+    seg->offsets[seg->offsetCount].key = key;
+    seg->offsets[seg->offsetCount].pos = offset - seg->start;
+    seg->offsetCount++;
 }
@@ -57,10 +57,20 @@
  Create a new stream with the given file handlers.
  
  @param fi Input file handler.
- @param fo Output file handler.
+ @param fo Output file handler, or NULL if output is discarded until an output is set with PDTwinStreamSetOutput().
  */
 extern PDTwinStreamRef PDTwinStreamCreate(FILE *fi, FILE *fo);
 
+/**
+ Direct subsequent output of the stream to the given file handler, with the output offset starting over at 0.
+ 
+ @warning Behavior is undefined if output is being held back (see PDTwinStreamInsertDeferred()).
+ 
+ @param ts The stream.
+ @param fo Output file handler, or NULL to discard output.
+ */
+extern void PDTwinStreamSetOutput(PDTwinStreamRef ts, FILE *fo);
+
 /// @name Configuring / querying
 
 /**
@@ -106,6 +116,15 @@ extern PDScannerRef PDTwinStreamSetupScannerWithState(PDTwinStreamRef ts, PDStat
  */
 #define PDTwinStreamGetOutputOffset(str) (str->offso)
 
+/**
+ Get the absolute position in the output file at which content is written.
+
+ This differs from the output offset while output is being held back. In particular, content written by a deferred output function (see PDTwinStreamInsertDeferred()) is written at this position.
+
+ @param str Stream.
+ */
+#define PDTwinStreamGetFileOffset(str)   (str->offso - str->reorderBytes)
+
 /// @name Reading 
 
 /**
@@ -172,7 +191,7 @@ extern void PDTwinStreamAdvance(PDTwinStreamRef ts, PDSize bytes);
 /**
  Temporarily jump to and read given amount from given offset in input, then immediately jump back to original position.
  
- @note Uses existing heap if position + size is within bounds. Extends heap if appropriate, otherwise seeks to and reads the content into buf directly.
+ @note Uses existing heap if position + size is within bounds, otherwise reads the content into a dedicated buffer via PDTwinStreamReadInput(), so the input position is never moved.
  
  @note buf may become invalidated as soon as any of the other functions are used, but should be discarded using PDTwinStreamCutBranch() when no longer needed.
  
@@ -192,6 +211,19 @@ extern PDSize PDTwinStreamFetchBranch(PDTwinStreamRef ts, PDSize position, PDInt
  */
 extern void PDTwinStreamCutBranch(PDTwinStreamRef ts, char *buf);
 
+/**
+ Copy given amount from given offset in input into a caller-provided buffer, without moving the input position or touching the heap.
+ 
+ Unlike PDTwinStreamFetchBranch(), this does not allocate, so it is suited for reading large ranges in chunks. Content which is not on the heap is read with pread(), where the input has a file descriptor.
+ 
+ @param ts The stream.
+ @param position The absolute position to read from.
+ @param bytes Number of bytes to read.
+ @param dest The buffer to read into, which must hold at least bytes bytes.
+ @return The actual amount read (which may be lower, e.g. if EOF is hit).
+ */
+extern PDSize PDTwinStreamReadInput(PDTwinStreamRef ts, PDSize position, PDInteger bytes, char *dest);
+
 /// @name Committing
 
 // all commit operations are subject to heap realignment; any scanners except the master scanner (stream->scanner) must be discarded 
@@ -220,6 +252,70 @@ extern void PDTwinStreamDiscardContent(PDTwinStreamRef ts);
  */
 extern void PDTwinStreamInsertContent(PDTwinStreamRef ts, PDSize bytes, const char *content);
 
+/**
+ Replace the output with a verbatim copy of the entire input, positioning the output at the end of it.
+ 
+ Where the file system supports it, the copy shares its data with the input, rather than duplicating it. Content inserted afterwards is appended to the copy, and the output offset is the input size.
+ 
+ @warning Behavior is undefined if output is being held back (see PDTwinStreamInsertDeferred()).
+ 
+ @param ts The stream.
+ @return true if the input was copied in its entirety.
+ */
+extern PDBool PDTwinStreamCloneInput(PDTwinStreamRef ts);
+
+/// @name Deferred output
+
+/**
+ Insert content which is being produced by a work item.
+
+ Output following the deferred content is held back in memory until the work item completes, at which point func is called to write the deferred content, followed by the held back content. The output offset (PDTwinStreamGetOutputOffset()) does not include deferred content until it has been written, so offsets taken while content is being deferred must be resolved using PDTwinStreamDeferOffset().
+
+ If too much content is being held back, this waits for the oldest work items to complete.
+
+ @param ts The stream.
+ @param item The work item. It is retained by the stream.
+ @param func The function writing the deferred content.
+ @param info Info passed to func.
+ */
+extern void PDTwinStreamInsertDeferred(PDTwinStreamRef ts, PDWorkItemRef item, PDTwinStreamDeferredFunc func, void *info);
+
+/**
+ Write deferred content whose work items have completed, along with the content held back behind it.
+
+ @param ts The stream.
+ @param wait If true, wait for all pending work items, and write everything.
+ */
+extern void PDTwinStreamFlushDeferred(PDTwinStreamRef ts, PDBool wait);
+
+/**
+ Determine whether output is currently being held back pending deferred content.
+
+ @param ts The stream.
+ @return true if there is pending deferred content.
+ */
+extern PDBool PDTwinStreamIsDeferring(PDTwinStreamRef ts);
+
+/**
+ Set the function called with the actual offsets of offsets passed to PDTwinStreamDeferOffset().
+
+ @param ts The stream.
+ @param resolver The resolver function.
+ @param info Info passed to the resolver.
+ */
+extern void PDTwinStreamSetOffsetResolver(PDTwinStreamRef ts, PDTwinStreamOffsetResolver resolver, void *info);
+
+/**
+ Defer an output offset until the content preceding it has been written.
+
+ The offset must be at or beyond the output offset at the time the most recent deferred content was inserted. If nothing is being deferred, the resolver is called immediately.
+
+ @param ts The stream.
+ @param key The key passed to the resolver.
+ @param offset The output offset, as given by PDTwinStreamGetOutputOffset().
+ */
+extern void PDTwinStreamDeferOffset(PDTwinStreamRef ts, PDInteger key, PDOffset offset);
+
 /**
  Prune the stream.
  
@@ -31,7 +31,7 @@
 #include "PDSplayTree.h"
 #include "pd_pdf_implementation.h"
 
-static pd_stack arp = NULL;
+static PD_THREAD_LOCAL pd_stack arp = NULL;
 
 // if you are having issues with a non-PDTypeRef being mistaken for a PDTypeRef, you can enable DEBUG_PDTYPES_BREAK to stop the assertion from happening and instead returning a NULL value (for the value-returning functions)
 //#define DEBUG_PDTYPES_BREAK
@@ -317,6 +317,7 @@ void *PDAllocTyped(PDInstanceType it, PDSize size, void *dealloc, PDBool zeroed)
     chunk->pdc = PDC;
 #endif
     chunk->it = it;
+    chunk->immortal = false;
     chunk->retainCount = 1;
     chunk->dealloc = dealloc;
     _PDDebugAllocating(chunk + 1);
@@ -340,6 +341,7 @@ void PDRelease(void *pajdegObject)
     _PDDebugLogRetrelCall("release", file, lineNumber, pajdegObject, type->retainCount - 1);
     PDFocusCheck(pajdegObject);
     PDTypeCheck("released", /* void */);
+    if (type->immortal) return;
     type->retainCount--;
 #ifdef DEBUG_PD_RELEASES
     // over-autorelease check
@@ -370,6 +372,7 @@ void *PDRetain(void *pajdegObject)
     _PDDebugLogRetrelCall("retain", file, lineNumber, pajdegObject, type->retainCount + 1);
     PDFocusCheck(pajdegObject);
     PDTypeCheck("retained", NULL);
+    if (type->immortal) return pajdegObject;
     
     // if the most recent autoreleased object matches, we remove it from the autorelease pool rather than retain the object
     if (arp != NULL && pajdegObject == arp->info) {
@@ -400,6 +403,13 @@ void *PDAutorelease(void *pajdegObject)
     return pajdegObject;
 }
 
+void PDMakeImmortal(void *pajdegObject)
+{
+    PDTypeRef type = (PDTypeRef)pajdegObject - 1;
+    PDTypeCheck("made immortal", /* void */);
+    type->immortal = true;
+}
+
 PDInstanceType PDResolve(void *pajdegObject)
 {
     if (NULL == pajdegObject) return PDInstanceTypeNull;
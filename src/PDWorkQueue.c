@@ -0,0 +1,212 @@
+//
+// PDWorkQueue.c
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "pd_internal.h"
+#include "PDWorkQueue.h"
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
+
+struct PDWorkItem {
+    PDWorkFunc func;                ///< The work function
+    void *info;                     ///< The work function argument
+    PDBool done;                    ///< Whether the work function has returned
+    PDWorkItemRef next;             ///< The next item in the queue
+    PDWorkQueueRef queue;           ///< The queue (retained)
+};
+
+struct PDWorkQueue {
+    PDInteger threadCount;          ///< Number of worker threads
+    PDWorkItemRef head;             ///< First pending item
+    PDWorkItemRef tail;             ///< Last pending item
+    PDBool stopping;                ///< Set when the queue is being destroyed
+#ifdef PD_SUPPORT_THREADS
+    pthread_t *threads;             ///< The worker threads
+    pthread_mutex_t lock;           ///< Lock for everything above, and the items' done flags
+    pthread_cond_t wake;            ///< Signaled when items are enqueued, or when the queue is stopping
+    pthread_cond_t done;            ///< Signaled when an item completes
+#endif
+};
+
+void PDWorkItemDestroy(PDWorkItemRef item)
+{
+    // the worker thread references the item until it's done
+    PDWorkItemWait(item);
+    PDRelease(item->queue);
+}
+
+#ifdef PD_SUPPORT_THREADS
+
+static void *PDWorkQueueThread(void *arg)
+{
+    PDWorkQueueRef queue = arg;
+    PDWorkItemRef item;
+    
+    pthread_mutex_lock(&queue->lock);
+    while (true) {
+        while (queue->head == NULL && ! queue->stopping) 
+            pthread_cond_wait(&queue->wake, &queue->lock);
+        
+        // pending items are finished before the thread exits
+        item = queue->head;
+        if (item == NULL) break;
+        
+        queue->head = item->next;
+        if (queue->head == NULL) queue->tail = NULL;
+        pthread_mutex_unlock(&queue->lock);
+        
+        (*item->func)(item->info);
+        
+        pthread_mutex_lock(&queue->lock);
+        item->done = true;
+        pthread_cond_broadcast(&queue->done);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    
+    return NULL;
+}
+
+#endif
+
+void PDWorkQueueDestroy(PDWorkQueueRef queue)
+{
+#ifdef PD_SUPPORT_THREADS
+    if (queue->threadCount > 0) {
+        PDInteger i;
+        pthread_mutex_lock(&queue->lock);
+        queue->stopping = true;
+        pthread_cond_broadcast(&queue->wake);
+        pthread_mutex_unlock(&queue->lock);
+        
+        for (i = 0; i < queue->threadCount; i++) 
+            pthread_join(queue->threads[i], NULL);
+        
+        free(queue->threads);
+        pthread_cond_destroy(&queue->done);
+        pthread_cond_destroy(&queue->wake);
+        pthread_mutex_destroy(&queue->lock);
+    }
+#endif
+}
+
+PDWorkQueueRef PDWorkQueueCreate(PDInteger threads)
+{
+    PDWorkQueueRef queue = PDAlloc(sizeof(struct PDWorkQueue), PDWorkQueueDestroy, true);
+    
+#ifdef PD_SUPPORT_THREADS
+    PDInteger i;
+    
+    if (threads > 0) {
+        pthread_mutex_init(&queue->lock, NULL);
+        pthread_cond_init(&queue->wake, NULL);
+        pthread_cond_init(&queue->done, NULL);
+        
+        queue->threads = malloc(sizeof(pthread_t) * threads);
+        for (i = 0; i < threads; i++) {
+            if (0 != pthread_create(&queue->threads[i], NULL, PDWorkQueueThread, queue)) {
+                PDWarn("unable to create worker thread; continuing with %ld threads", i);
+                break;
+            }
+        }
+        queue->threadCount = i;
+        
+        if (i == 0) {
+            free(queue->threads);
+            pthread_cond_destroy(&queue->done);
+            pthread_cond_destroy(&queue->wake);
+            pthread_mutex_destroy(&queue->lock);
+        }
+    }
+#else
+    if (threads > 0) 
+        PDNotice("PD_SUPPORT_THREADS is not defined; work is performed synchronously");
+#endif
+    
+    return queue;
+}
+
+PDBool PDWorkQueueIsAsynchronous(PDWorkQueueRef queue)
+{
+    return queue->threadCount > 0;
+}
+
+PDWorkItemRef PDWorkQueueEnqueue(PDWorkQueueRef queue, PDWorkFunc func, void *info)
+{
+    PDWorkItemRef item = PDAlloc(sizeof(struct PDWorkItem), PDWorkItemDestroy, true);
+    item->func = func;
+    item->info = info;
+    item->queue = PDRetain(queue);
+    
+    if (queue->threadCount == 0) {
+        (*func)(info);
+        item->done = true;
+        return item;
+    }
+    
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail) 
+        queue->tail->next = item;
+    else 
+        queue->head = item;
+    queue->tail = item;
+    pthread_cond_signal(&queue->wake);
+    pthread_mutex_unlock(&queue->lock);
+#endif
+    
+    return item;
+}
+
+PDBool PDWorkItemIsDone(PDWorkItemRef item)
+{
+    PDBool done;
+    
+    if (item->queue->threadCount == 0) 
+        return item->done;
+    
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_lock(&item->queue->lock);
+#endif
+    done = item->done;
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_unlock(&item->queue->lock);
+#endif
+    
+    return done;
+}
+
+void PDWorkItemWait(PDWorkItemRef item)
+{
+    if (item->queue->threadCount == 0) 
+        return;
+    
+#ifdef PD_SUPPORT_THREADS
+    PDWorkQueueRef queue = item->queue;
+    pthread_mutex_lock(&queue->lock);
+    while (! item->done) 
+        pthread_cond_wait(&queue->done, &queue->lock);
+    pthread_mutex_unlock(&queue->lock);
+#endif
+}
@@ -0,0 +1,92 @@
+//
+// PDWorkQueue.h
+//
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/**
+ @file PDWorkQueue.h Work queue header file.
+ 
+ @ingroup PDWORKQUEUE
+ 
+ @defgroup PDWORKQUEUE PDWorkQueue
+ 
+ @brief A pool of worker threads processing work items in FIFO order.
+ 
+ @ingroup PDINTERNAL
+ 
+ Work items are enqueued from a single (owning) thread, which may wait for individual items to complete. The work functions run on the worker threads and must not touch shared Pajdeg objects, as retain counts are not thread safe. Autorelease pools are kept per thread.
+ 
+ If PD_SUPPORT_THREADS is not defined, or if the queue has no threads, work items are executed synchronously when enqueued.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PDWORKQUEUE_H
+#define INCLUDED_PDWORKQUEUE_H
+
+#include "PDDefines.h"
+
+/**
+ Create a work queue with the given number of worker threads.
+ 
+ @param threads The number of worker threads. If 0, work items are executed synchronously.
+ @return The work queue.
+ */
+extern PDWorkQueueRef PDWorkQueueCreate(PDInteger threads);
+
+/**
+ Enqueue a work item.
+ 
+ @param queue The work queue.
+ @param func The work function.
+ @param info The argument passed to the work function.
+ @return A retained work item, which must be released by the caller.
+ */
+extern PDWorkItemRef PDWorkQueueEnqueue(PDWorkQueueRef queue, PDWorkFunc func, void *info);
+
+/**
+ Determine if the work queue has worker threads.
+ 
+ @param queue The work queue.
+ @return true if work items are executed asynchronously.
+ */
+extern PDBool PDWorkQueueIsAsynchronous(PDWorkQueueRef queue);
+
+/**
+ Determine whether the work item has completed.
+ 
+ @param item The work item.
+ @return true if the work function has returned.
+ */
+extern PDBool PDWorkItemIsDone(PDWorkItemRef item);
+
+/**
+ Wait for the work item to complete. 
+ 
+ @param item The work item.
+ */
+extern void PDWorkItemWait(PDWorkItemRef item);
+
+#endif // INCLUDED_PDWORKQUEUE_H
+
+/** @} */
@@ -224,7 +224,7 @@ struct PDXI {
 
 void PDXTableDestroy(PDXTableRef xtable)
 {
-    if (xtable->nextOb) free(xtable->nextOb);
+    if (xtable->offsIndex) free(xtable->offsIndex);
     PDRelease(xtable->w);
     free(xtable->xrefs);
 }
@@ -235,6 +235,9 @@ PDXTableRef PDXTableCreate(PDXTableRef pdx)
     if (pdx) {
         PDXTableRef pdxc = PDAllocTyped(PDInstanceTypeXTable, sizeof(struct PDXTable), PDXTableDestroy, false);
         memcpy(pdxc, pdx, sizeof(struct PDXTable));
+        pdxc->offsIndex = NULL;
+        pdxc->offsIndexCount = 0;
+        pdxc->w = PDRetain(pdx->w);
         pdxc->xrefs = xrefalloc(pdx, pdx->cap, pdx->width); //malloc(pdx->cap * pdxc->width + 1);
         memcpy(pdxc->xrefs, pdx->xrefs, pdx->cap * pdxc->width);
         return pdxc;
@@ -342,6 +345,93 @@ PDBool PDXTableInsert(PDParserRef parser)
     }
 }
 
+PDBool PDXTableInsertUpdate(PDParserRef parser, PDInteger *obids, PDInteger count, PDSize prev)
+{
+    char *obuf = malloc(512);
+    PDInteger len;
+    PDInteger i, j;
+    PDTwinStreamRef stream = parser->stream;
+    PDXTableRef mxt = parser->mxt;
+    PDObjectRef trailer = parser->trailer;
+    PDDictionaryRef tobd = PDObjectGetDictionary(trailer);
+    
+    if (mxt->format == PDXTableFormatText) {
+        twinstream_printf("xref\n");
+        
+        // one subsection per run of consecutive object IDs
+        for (i = 0; i < count; i = j) {
+            for (j = i + 1; j < count && obids[j] == obids[j-1] + 1; j++) ;
+            twinstream_printf("%ld %ld\n", obids[i], j - i);
+            for (PDInteger k = i; k < j; k++) {
+                twinstream_printf("%010lld %05ld %c \n", PDXTableGetOffsetForID(mxt, obids[k]), PDXTableGetGenForID(mxt, obids[k]), PDXTableIsIDFree(mxt, obids[k]) ? 'f' : 'n');
+            }
+        }
+        
+        PDDictionarySet(tobd, "Size", PDNumberWithSize(mxt->count));
+        if (prev) PDDictionarySet(tobd, "Prev", PDNumberWithSize(prev));
+        else      PDDictionaryDelete(tobd, "Prev");
+        PDDictionaryDelete(tobd, "XRefStm");
+        
+        char *string = NULL;
+        len = PDObjectGenerateDefinition(trailer, &string, 0);
+        // overwrite "0 0 obj" 
+        //      with "trailer"
+        memcpy(string, "trailer", 7);
+        PDTwinStreamInsertContent(stream, len, string);
+        free(string);
+        
+        free(obuf);
+        return true;
+    }
+    
+    // the XREF stream is a new object, which lists itself along with the updated objects
+    PDInteger xobid = mxt->count;
+    if (mxt->count == mxt->cap) 
+        PDXTableGrow(mxt, mxt->cap + 1);
+    mxt->count++;
+    PDXTableSetOffsetForID(mxt, xobid, PDTwinStreamGetOutputOffset(stream));
+    PDXTableSetTypeForID(mxt, xobid, PDXTypeUsed);
+    PDXTableSetGenForID(mxt, xobid, 0);
+    
+    PDInteger *ids = malloc(sizeof(PDInteger) * (count + 1));
+    memcpy(ids, obids, sizeof(PDInteger) * count);
+    ids[count++] = xobid;
+    
+    // the widths are final once the stream's own offset has been set, as it is the highest one
+    PDInteger width = mxt->width;
+    char *rows = malloc(width * count);
+    PDArrayRef index = PDArrayCreateWithCapacity(4);
+    for (i = 0; i < count; i = j) {
+        for (j = i + 1; j < count && ids[j] == ids[j-1] + 1; j++) ;
+        PDArrayAppend(index, PDNumberWithInteger(ids[i]));
+        PDArrayAppend(index, PDNumberWithInteger(j - i));
+    }
+    for (i = 0; i < count; i++) {
+        memcpy(&rows[i * width], &mxt->xrefs[ids[i] * width], width);
+    }
+    free(ids);
+    
+    PDDictionarySet(tobd, "Size", PDNumberWithSize(mxt->count));
+    PDDictionarySet(tobd, "W", PDXTableWEntry(mxt));
+    PDDictionarySet(tobd, "Index", index);
+    if (prev) PDDictionarySet(tobd, "Prev", PDNumberWithSize(prev));
+    else      PDDictionaryDelete(tobd, "Prev");
+    PDDictionaryDelete(tobd, "XRefStm");
+    PDRelease(index);
+    
+    // override filters/decode params always, as with the full XREF stream
+    PDObjectSetFlateDecodedFlag(trailer, true);
+    PDObjectSetPredictionStrategy(trailer, PDPredictorPNG_UP, width);
+    PDObjectSetStreamFiltered(trailer, rows, width * count, true, true);
+    
+    trailer->obid = xobid;
+    trailer->genid = 0;
+    PDParserWriteObject(parser, trailer);
+    
+    free(obuf);
+    return true;
+}
+
 PDBool PDParserIterateXRefDomain(PDParserRef parser);
 
 PDBool PDXTablePassoverXRefEntry(PDParserRef parser, pd_stack stack, PDBool includeTrailer)
@@ -1209,67 +1299,145 @@ void PDXTableGrow(PDXTableRef table, PDSize cap)
     table->xrefs = xrefrealloc(table, table->xrefs, cap, table->width);
 }
 
-//#define DEBUG_PDX_GNAI
-
-struct gnai_s {
-    PDInteger *nextOb;
-    PDInteger  prevOb;
-#ifdef DEBUG_PDX_GNAI
-    PDInteger  prevOffset;
-    PDSize     cap;
-#endif
-};
-
-void PDXTableGNAIterator(PDInteger key, void *value, void *userInfo, PDBool *shouldStop)
+static int PDXTableOffsetCompare(const void *a, const void *b)
 {
-    struct gnai_s *gna = userInfo;
-    PDInteger obid = (PDInteger)value;
-#ifdef DEBUG_PDX_GNAI
-    PDInteger offs = key;
-    PDAssert(gna->cap > obid);
-    PDAssert(gna->prevOffset < offs);
-    gna->prevOffset = offs;
-#endif
-    if (gna->prevOb) gna->nextOb[gna->prevOb] = obid;
-    gna->prevOb = obid;
+    PDOffset oa = *(const PDOffset *)a;
+    PDOffset ob = *(const PDOffset *)b;
+    return oa < ob ? -1 : oa > ob;
 }
 
-void PDXTableGenerateNextArray(PDXTableRef table)
+void PDXTableGenerateOffsetIndex(PDXTableRef table)
 {
-    struct gnai_s userInfo;
     PDSize cap = table->count;
-    PDSplayTreeRef tree = PDSplayTreeCreate();
+    PDSize count = 0;
+    PDOffset *index = table->offsIndex = malloc((cap + 1) * sizeof(PDOffset));
+    PDOffset maxOffset = 0;
     for (PDSize i = 1; i < cap; i++) {
         if (PDXTableGetTypeForID(table, i) == PDXTypeUsed) {
             PDOffset offs = PDXTableGetOffsetForID(table, i);
-            PDSplayTreeInsert(tree, (PDInteger)offs, (void *)i);
+            if (offs > 0) {
+                index[count++] = offs;
+                if (offs > maxOffset) maxOffset = offs;
+            }
         }
     }
     
-    PDInteger *nextOb = table->nextOb = calloc(cap, sizeof(PDInteger));
-    userInfo.nextOb = nextOb;
-    userInfo.prevOb = 0;
-#ifdef DEBUG_PDX_GNAI
-    userInfo.prevOffset = -1;
-    userInfo.cap = cap;
-#endif
-    PDSplayTreeIterate(tree, PDXTableGNAIterator, &userInfo);
-    PDRelease(tree);
+    // the XRef (and trailer) terminates the last object preceding it
+    if (table->pos > 0 && (PDOffset)table->pos > maxOffset) {
+        index[count++] = (PDOffset)table->pos;
+    }
+    
+    qsort(index, count, sizeof(PDOffset), PDXTableOffsetCompare);
+    table->offsIndexCount = count;
 }
 
 PDSize PDXTableDetermineObjectSize(PDXTableRef table, PDInteger obid)
 {
-    if (table->nextOb == NULL) {
-        PDXTableGenerateNextArray(table);
+    if (table->offsIndex == NULL) {
+        PDXTableGenerateOffsetIndex(table);
     }
-    PDInteger nextOb = table->nextOb[obid];
-    if (! nextOb) {
-        // we give back a rather high value, but we don't want to risk not being able to read in an object; and chances are this is the very last object in the file so reading until the end of the buffer will not be super time consuming (we will get some overhead in terms of mem use for a sec though)
+    
+    if (obid > 0 && obid < table->count && PDXTableGetTypeForID(table, obid) == PDXTypeComp) {
+        // compressed objects are read as a part of their container, so that's what we measure
+        obid = (PDInteger) PDXTableGetOffsetForID(table, obid);
+    }
+    
+    if (obid <= 0 || obid >= table->count || PDXTableGetTypeForID(table, obid) != PDXTypeUsed) {
         return 2500000;
     }
     
     PDOffset startOffset = PDXTableGetOffsetForID(table, obid);
-    PDOffset endOffset = PDXTableGetOffsetForID(table, nextOb);
-    PDAssert(endOffset > startOffset); // crash = the XRef table is broken; the object (obid) is said to be at the same position or after the object that is supposedly after it (nextOb)
-    return (PDSize) (endOffset - startOffset);
+    
+    // binary search for the first offset beyond startOffset
+    PDOffset *index = table->offsIndex;
+    PDSize lo = 0;
+    PDSize hi = table->offsIndexCount;
+    while (lo < hi) {
+        PDSize mid = lo + ((hi - lo) >> 1);
+        if (index[mid] <= startOffset) lo = mid + 1; else hi = mid;
+    }
+    
+    if (lo == table->offsIndexCount) {
+        // we give back a rather high value, but we don't want to risk not being able to read in an object; and chances are this is the very last object in the file so reading until the end of the buffer will not be super time consuming (we will get some overhead in terms of mem use for a sec though)
+        return 2500000;
+    }
+    
+    // the scanner looks one byte beyond the final token of an object, so we include the first byte of whatever follows it
+    return (PDSize) (index[lo] - startOffset) + 1;
+}
+
+#define PDXTableFileWrite(f, v)  (1 == fwrite(&(v), sizeof(v), 1, f))
+#define PDXTableFileRead(f, v)   (1 == fread(&(v), sizeof(v), 1, f))
+
+PDBool PDXTableWriteToFile(PDXTableRef table, FILE *f)
+{
+    PDInteger format = table->format;
+    PDInteger linearized = table->linearized;
+    PDSize size = table->cap * table->width;
+    
+    return (PDXTableFileWrite(f, table->obid) &&
+            PDXTableFileWrite(f, format) &&
+            PDXTableFileWrite(f, linearized) &&
+            PDXTableFileWrite(f, table->cap) &&
+            PDXTableFileWrite(f, table->count) &&
+            PDXTableFileWrite(f, table->pos) &&
+            PDXTableFileWrite(f, table->typeSize) &&
+            PDXTableFileWrite(f, table->offsSize) &&
+            PDXTableFileWrite(f, table->genSize) &&
+            size == fwrite(table->xrefs, 1, size, f));
 }
+
+PDXTableRef PDXTableCreateFromFile(FILE *f, PDSize maxCount)
+{
+    PDInteger format, linearized;
+    unsigned char typeSize, offsSize, genSize;
+    
+    PDXTableRef pdx = PDXTableCreate(NULL);
+    if (! (PDXTableFileRead(f, pdx->obid) &&
+           PDXTableFileRead(f, format) &&
+           PDXTableFileRead(f, linearized) &&
+           PDXTableFileRead(f, pdx->cap) &&
+           PDXTableFileRead(f, pdx->count) &&
+           PDXTableFileRead(f, pdx->pos) &&
+           PDXTableFileRead(f, typeSize) &&
+           PDXTableFileRead(f, offsSize) &&
+           PDXTableFileRead(f, genSize))) {
+        PDRelease(pdx);
+        return NULL;
+    }
+    
+    if (maxCount > PDXTableMaxCount) maxCount = PDXTableMaxCount;
+    
+    // the sizes below go straight into allocations and reads, so they must be sane before anything else is done with them
+    if (typeSize != 1 || offsSize == 0 || offsSize > sizeof(PDOffset) || genSize > sizeof(PDInteger) ||
+        pdx->cap == 0 || pdx->cap > maxCount || pdx->count > pdx->cap) {
+        PDWarn("Invalid XRef table in index file.");
+        PDRelease(pdx);
+        return NULL;
+    }
+    
+    pdx->format = (PDXFormat)format;
+    pdx->linearized = (PDBool)linearized;
+    PDXTableSetSizes(pdx, typeSize, offsSize, genSize);
+    
+    // the entries must also actually be in the file
+    PDSize size = pdx->cap * pdx->width;
+    off_t start = ftello(f), end = -1;
+    if (start >= 0 && 0 == fseeko(f, 0, SEEK_END)) end = ftello(f);
+    if (end < start || (PDSize)(end - start) < size || 0 != fseeko(f, start, SEEK_SET)) {
+        PDWarn("Truncated XRef table in index file.");
+        PDRelease(pdx);
+        return NULL;
+    }
+    
+    pdx->xrefs = xrefalloc(pdx, pdx->cap, pdx->width);
+    if (size != fread(pdx->xrefs, 1, size, f)) {
+        PDRelease(pdx);
+        return NULL;
+    }
+    
+    return pdx;
+}
+
+#undef PDXTableFileWrite
+#undef PDXTableFileRead
@@ -41,8 +41,16 @@
 #define INCLUDED_PDXTable_h
 
 #include <sys/types.h>
+#include <stdio.h>
 #include "PDDefines.h"
 
+/**
+ The highest number of entries a table read from a file (see PDXTableCreateFromFile()) may have. 
+ 
+ This is the PDF implementation limit on the number of indirect objects in a file (8,388,607), plus one for object 0.
+ */
+#define PDXTableMaxCount    8388608
+
 /**
  The XREF format, which can be one of text or binary. 
  
@@ -107,7 +115,8 @@ struct PDXTable {
     PDOffset    offsCap;    ///< threshold for offsets using current offsSize
     
     PDArrayRef  w;          ///< The W entry, if set.
-    PDInteger  *nextOb;     ///< Array of object id's succeeding the object for the given array index. I.e. if the file has 4 0 obj ... endobj 10 0 obj ... endobj, then next[4] == 10 because object 10 is directly below object 4. This array is NULL until the first call to PDXTableDetermineObjectSize is made.
+    PDOffset   *offsIndex;  ///< Sorted array of the offsets of every used object in the table, followed by the table's own position, if it succeeds them. I.e. if the file has 4 0 obj ... endobj 10 0 obj ... endobj, the offset of object 10 comes right after that of object 4. This array is NULL until the first call to PDXTableDetermineObjectSize is made.
+    PDSize      offsIndexCount; ///< Number of entries in offsIndex.
     
     unsigned char typeSize;   ///< type size, current implementation requires this to be 1
     unsigned char offsSize;   ///< offset size
@@ -231,6 +240,13 @@ extern void PDXTableSetGenForID(PDXTableRef table, PDInteger obid, PDInteger gen
 // */
 //#define PDXTableSetOffset(xtable, id, offs) PDXSetOffsetForID(xtable->xrefs, id, (PDXOffsetType)offs)
 
+/**
+ Create a copy of the given XREF table, or a new, empty table if pdx is NULL.
+ 
+ @param pdx The table to copy, or NULL.
+ */
+extern PDXTableRef PDXTableCreate(PDXTableRef pdx);
+
 /**
  Read a PDFs XREF data by jumping to the end of the file, reading in the startxref value and jumping to every
  XREF defined via e.g. /Prev, reading the XREFs in as a series with defined domains (by byte). 
@@ -264,6 +280,19 @@ extern PDBool PDXTablePassoverXRefEntry(PDParserRef parser, pd_stack stack, PDBo
  */
 extern PDBool PDXTableInsert(PDParserRef parser);
 
+/**
+ Insert an XREF section for an incremental update, covering only the given objects.
+ 
+ The section is of the same format as the input's XREF. Its trailer refers to the previous section through /Prev, if there is one. For the stream format, the XREF stream is a new object, which is written along with the section.
+ 
+ @param parser The parser.
+ @param obids The IDs of the updated objects, in ascending order.
+ @param count The number of IDs.
+ @param prev The offset of the previous XREF section, or 0 if the section covers every object on its own.
+ @return true if the insertion was successful.
+ */
+extern PDBool PDXTableInsertUpdate(PDParserRef parser, PDInteger *obids, PDInteger count, PDSize prev);
+
 /**
  Get the W entry for the table.
  */
@@ -279,9 +308,20 @@ extern void PDXTableSetSizes(PDXTableRef table, unsigned char typeSize, unsigned
  */
 extern void PDXTableGrow(PDXTableRef table, PDSize cap);
 
+/**
+ *  Build the sorted offset index used by PDXTableDetermineObjectSize(), which otherwise builds it on its first call.
+ *
+ *  This is done up front for tables which are read from several threads at once.
+ *
+ *  @param table The table.
+ */
+extern void PDXTableGenerateOffsetIndex(PDXTableRef table);
+
 /**
  *  Determine the number of bytes between the first character in "<num> <num> obj" of the given object until the first character in the "<num> <num> obj" of the succeeding object in the file.
  *
+ *  The first call builds a sorted offset index for the table, which subsequent calls binary search. Compressed objects are sized via their container object stream. If the object has no known successor (i.e. it is the last thing in the file), a generous upper bound is returned instead.
+ *
  *  @param table PDX table
  *  @param obid  Object whose size should be determined
  *
@@ -289,6 +329,30 @@ extern void PDXTableGrow(PDXTableRef table, PDSize cap);
  */
 extern PDSize PDXTableDetermineObjectSize(PDXTableRef table, PDInteger obid);
 
+/**
+ *  Write the table's layout and entries to the given file, for later retrieval via PDXTableCreateFromFile.
+ *
+ *  @note The format is the in-memory representation, and is not portable between architectures.
+ *
+ *  @param table PDX table
+ *  @param f     File opened for writing
+ *
+ *  @return true if the table was written successfully
+ */
+extern PDBool PDXTableWriteToFile(PDXTableRef table, FILE *f);
+
+/**
+ *  Create a table from a file previously written to via PDXTableWriteToFile.
+ *
+ *  The table's capacity and counts are checked against maxCount before anything is allocated, so that a damaged or crafted file cannot cause arbitrarily large allocations.
+ *
+ *  @param f        File opened for reading, positioned at the start of the table
+ *  @param maxCount The highest capacity the table may have, e.g. from the /Size of the trailer the table belongs to; values above PDXTableMaxCount are capped
+ *
+ *  @return A new PDX table, or NULL if the file did not contain a valid table
+ */
+extern PDXTableRef PDXTableCreateFromFile(FILE *f, PDSize maxCount);
+
 #endif
 
 /** @} */
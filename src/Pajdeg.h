@@ -45,7 +45,7 @@
  
  - Stream compression/decompression (via zlib)
  - Predictors
- - Standard encryption/decryption (RC4, not AES)
+ - Standard encryption/decryption (RC4, AES-128 and AES-256)
  - Object streams (PDF 1.5+ feature)
  - PDF catalogs (page-to-object mapping)
  
@@ -376,6 +376,8 @@
 #   define PAJDEG_VERSION   "0.3.4"
 
 #   include "PDPipe.h"
+#   include "PDPipeBatch.h"
+#   include "PDDocument.h"
 #   include "PDObject.h"
 #   include "PDTask.h"
 #   include "PDParser.h"
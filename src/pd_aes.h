@@ -0,0 +1,102 @@
+//
+// pd_aes.h
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/**
+ @file pd_aes.h AES header file.
+ 
+ @ingroup pd_crypto
+ 
+ @brief AES block cipher in CBC mode, as used by the AESV2 (AES-128) and AESV3 (AES-256) crypt filters.
+ 
+ On x86 processors with the AES instruction set (AES-NI), the hardware instructions are used; elsewhere, a portable table based implementation is used. Both give identical results.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PD_AES_H
+#define INCLUDED_PD_AES_H
+
+#include "PDDefines.h"
+
+#ifdef PD_SUPPORT_CRYPTO
+
+#include <sys/types.h>
+
+#define pd_aes_block_size 16 ///< The AES block size, in bytes
+
+/* AES context. */
+typedef struct pd_aes_ctx pd_aes_ctx;
+struct pd_aes_ctx {
+    u_int32_t ek[60];               ///< encryption round keys
+    u_int32_t dk[60];               ///< decryption round keys (equivalent inverse cipher)
+    unsigned char hwek[240];        ///< encryption round keys in the byte order used by the hardware kernels
+    unsigned char hwdk[240];        ///< decryption round keys in the byte order used by the hardware kernels
+    int rounds;                     ///< number of rounds; 10 for AES-128, 14 for AES-256
+    PDBool hw;                      ///< whether the hardware kernels are used; may be cleared after pd_aes_init() to force the portable implementation
+};
+
+/**
+ Determine whether the processor supports the AES instructions.
+ 
+ @return true if the hardware kernels are available.
+ */
+extern PDBool pd_aes_hardware_available(void);
+
+/**
+ Set up a context with the given key.
+ 
+ @param ctx The context.
+ @param key The key.
+ @param keylen The length of the key in bytes, which must be 16, 24 or 32.
+ @return false if the key length is not supported.
+ */
+extern PDBool pd_aes_init(pd_aes_ctx *ctx, const unsigned char *key, int keylen);
+
+/**
+ Encrypt len bytes in CBC mode. No padding is applied, so len must be a multiple of the block size.
+ 
+ @param ctx The context.
+ @param iv The initialization vector, which is updated to the last cipher block, so that consecutive calls chain.
+ @param src The plain text.
+ @param dst The destination of the cipher text, which may be src.
+ @param len The number of bytes.
+ */
+extern void pd_aes_cbc_encrypt(pd_aes_ctx *ctx, unsigned char *iv, const unsigned char *src, unsigned char *dst, PDSize len);
+
+/**
+ Decrypt len bytes in CBC mode. No padding is removed, so len must be a multiple of the block size.
+ 
+ @param ctx The context.
+ @param iv The initialization vector, which is updated to the last cipher block, so that consecutive calls chain.
+ @param src The cipher text.
+ @param dst The destination of the plain text, which may be src, or precede it.
+ @param len The number of bytes.
+ */
+extern void pd_aes_cbc_decrypt(pd_aes_ctx *ctx, unsigned char *iv, const unsigned char *src, unsigned char *dst, PDSize len);
+
+#endif
+
+#endif
+
+/** @} */
@@ -22,6 +22,8 @@
 // THE SOFTWARE.
 //
 
+#include <unistd.h>
+
 #include "pd_crypto.h"
 #include "pd_internal.h"
 #include "PDDictionary.h"
@@ -29,7 +31,13 @@
 #include "PDString.h"
 #include "PDNumber.h"
 #include "pd_md5.h"
-#include "pd_aes256.h"
+#include "pd_aes.h"
+#include "pd_sha2.h"
+#include "PDWorkQueue.h"
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
 
 #ifdef PD_SUPPORT_CRYPTO
 
@@ -75,41 +83,105 @@ static const unsigned char pd_crypto_pad [] = {
 
 #define strdup_null(v) (v ? strdup(v) : NULL)
 
-static unsigned char S[256];
+#ifdef PD_SUPPORT_THREADS
+#   define pd_crypto_keys_lock(crypto)   pthread_mutex_lock(&(crypto)->keysLock)
+#   define pd_crypto_keys_unlock(crypto) pthread_mutex_unlock(&(crypto)->keysLock)
+#else
+#   define pd_crypto_keys_lock(crypto)
+#   define pd_crypto_keys_unlock(crypto)
+#endif
 
-void pd_crypto_rc4(pd_crypto crypto, const char *key, int keylen, char *data, long datalen)
+static void pd_crypto_rc4_schedule(unsigned char *S, const char *key, int keylen)
 {
-    // to avoid allocating S every time, this function may not be multithreaded; if issues arise, ensure that bg thread calls do not result in rc4 mangling itself
-    // to check if this is the case, put a static int rc4iter initialized to 0, ensure it's 0 on all calls, and increment it on start and decrement at end
-    long l;
     int i, j;
+    unsigned char t;
     for (i = 0; i < 256; i++) 
         S[i] = i;
     j = 0;
-    unsigned char t;
     for (i = 0; i < 256; i++) {
         j = (j + S[i] + key[i % keylen]) & 0xff;
         t = S[i]; S[i] = S[j]; S[j] = t;
     }
-    
-    i = 0;
-    j = 0;
-    l = 0;
-    while (l < datalen) {
+}
+
+static void pd_crypto_rc4_init(pd_crypto_stream cs, const char *key, int keylen)
+{
+    pd_crypto_rc4_schedule(cs->S, key, keylen);
+    cs->i = 0;
+    cs->j = 0;
+}
+
+static inline void pd_crypto_rc4_prepare(pd_crypto_stream cs, const unsigned char *S)
+{
+    memcpy(cs->S, S, 256);
+    cs->i = 0;
+    cs->j = 0;
+}
+
+static void pd_crypto_rc4_apply(pd_crypto_stream cs, const char *src, char *dst, long datalen)
+{
+    unsigned char *S = cs->S;
+    int i = cs->i;
+    int j = cs->j;
+    unsigned char t;
+    long l;
+    for (l = 0; l < datalen; l++) {
         i = (i + 1) & 0xff;
         j = (j + S[i]) & 0xff;
         t = S[i]; S[i] = S[j]; S[j] = t;
-        data[l] = data[l] ^ S[(S[i] + S[j]) & 0xff];
-        l++;
+        dst[l] = src[l] ^ S[(S[i] + S[j]) & 0xff];
     }
+    cs->i = i;
+    cs->j = j;
 }
 
-void pd_crypto_generate_enckey(pd_crypto crypto, const char *user_pass)
+void pd_crypto_rc4(pd_crypto crypto, const char *key, int keylen, char *data, long datalen)
+{
+    struct pd_crypto_stream rc4;
+    pd_crypto_rc4_init(&rc4, key, keylen);
+    pd_crypto_rc4_apply(&rc4, data, data, datalen);
+}
+/**
+ Replace the file encryption key, which invalidates any object keys derived from the previous one.
+ */
+static void pd_crypto_set_enckey(pd_crypto crypto, char *enckey, PDInteger len)
 {
-    // concat user and padding into buffer, and crop it down to 32 bytes.
-    unsigned char buf[1024];
-    memcpy(buf, user_pass, strlen(user_pass));
-    memcpy(&buf[strlen(user_pass)], pd_crypto_pad, 32);
+    PDRelease(crypto->enckey);
+    crypto->enckey = PDStringCreateBinary(enckey, len);
+    pd_crypto_keys_lock(crypto);
+    if (crypto->keys) {
+        for (int i = 0; i < pd_crypto_key_cache_size; i++) 
+            crypto->keys[i].obid = -1;
+    }
+    pd_crypto_keys_unlock(crypto);
+}
+
+/**
+ Fill buf with len random bytes. These are used as initialization vectors, which need to be unpredictable, but not secret.
+ */
+static void pd_crypto_random(unsigned char *buf, PDInteger len)
+{
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    arc4random_buf(buf, len);
+#else
+    if (len > 256 || 0 != getentropy(buf, len)) {
+        for (PDInteger i = 0; i < len; i++) 
+            buf[i] = rand() & 0xff;
+    }
+#endif
+}
+
+/**
+ Compute the file encryption key for the given password (algorithm 2, revisions 2 to 4). key must hold 16 bytes.
+ */
+static void pd_crypto_compute_rc4_key(pd_crypto crypto, const char *password, unsigned char *key)
+{
+    // concat password and padding into buffer, and crop it down to 32 bytes.
+    unsigned char buf[64];
+    size_t pwlen = strlen(password);
+    if (pwlen > 32) pwlen = 32;
+    memcpy(buf, password, pwlen);
+    memcpy(&buf[pwlen], pd_crypto_pad, 32);
     
     pd_md5_ctx md5ctx;
     pd_md5_init(&md5ctx);
@@ -143,12 +215,177 @@ void pd_crypto_generate_enckey(pd_crypto crypto, const char *user_pass)
     }
     
     // the first length/8 bytes are the encryption key
-    unsigned char *enckey = malloc(1 + eklen);
-    memcpy(enckey, buf, eklen);
+    memcpy(key, buf, eklen);
+}
+
+/**
+ Compute the user string (U) for the given file encryption key (algorithms 4 and 5). u must hold 32 bytes, of which only the first 16 are significant for revisions 3 and 4.
+ */
+static void pd_crypto_compute_rc4_user(pd_crypto crypto, const unsigned char *key, unsigned char *u)
+{
+    int eklen = (int) (crypto->length/8);
+    
+    if (crypto->revision == 2) {
+        memcpy(u, pd_crypto_pad, 32);
+        pd_crypto_rc4(crypto, (const char *)key, eklen, (char *)u, 32);
+        return;
+    }
+    
+    pd_md5_ctx md5ctx;
+    pd_md5_init(&md5ctx);
+    pd_md5_update(&md5ctx, (unsigned char *)pd_crypto_pad, 32);
+    pd_md5_update(&md5ctx, (unsigned char *) crypto->identifier->data, (unsigned int)crypto->identifier->length);
+    pd_md5_final(u, &md5ctx);
+    
+    // encrypt 20 times, XOR'ing each byte of the key with the iteration number
+    unsigned char ikey[16];
+    for (int i = 0; i < 20; i++) {
+        for (int k = 0; k < eklen; k++) 
+            ikey[k] = key[k] ^ i;
+        pd_crypto_rc4(crypto, (const char *)ikey, eklen, (char *)u, 16);
+    }
+    memset(&u[16], 0, 16);
+}
+
+#define pd_crypto_r6_password_cap 127 ///< Number of significant bytes in revision 5 and 6 passwords
+
+/**
+ Compute the revision 5 or 6 hash (algorithm 2.B) of the given password, 8 byte salt and, for owner passwords, 48 byte user string. hash must hold 32 bytes.
+ */
+static void pd_crypto_compute_r6_hash(pd_crypto crypto, const char *password, PDInteger pwlen, const unsigned char *salt, const unsigned char *udata, unsigned char *hash)
+{
+    unsigned char k[64];
+    PDInteger klen = 32;
+    PDInteger ulen = udata ? 48 : 0;
+    
+    pd_sha256_ctx sha;
+    pd_sha256_init(&sha);
+    pd_sha256_update(&sha, (const unsigned char *)password, pwlen);
+    pd_sha256_update(&sha, salt, 8);
+    if (udata) pd_sha256_update(&sha, udata, ulen);
+    pd_sha256_final(k, &sha);
+    
+    // revision 5 stops here; revision 6 goes on for at least 64 rounds, until the last byte of E is no greater than the round number minus 32
+    if (crypto->revision >= 6) {
+        unsigned char *k1 = malloc(64 * (pwlen + 64 + ulen));
+        unsigned char iv[pd_aes_block_size];
+        pd_aes_ctx aes;
+        for (int round = 0; ; round++) {
+            // K1 is the password, K and the user string, repeated 64 times
+            PDInteger seqlen = pwlen + klen + ulen;
+            for (int i = 0; i < 64; i++) {
+                unsigned char *seq = &k1[i * seqlen];
+                memcpy(seq, password, pwlen);
+                memcpy(&seq[pwlen], k, klen);
+                if (udata) memcpy(&seq[pwlen + klen], udata, ulen);
+            }
+            
+            // E is K1 encrypted with AES-128 in CBC mode, with the first 16 bytes of K as key and the next 16 as IV
+            memcpy(iv, &k[16], pd_aes_block_size);
+            pd_aes_init(&aes, k, 16);
+            pd_aes_cbc_encrypt(&aes, iv, k1, k1, 64 * seqlen);
+            
+            // the first 16 bytes of E, as a number modulo 3, pick the hash function for the next K
+            int sum = 0;
+            for (int i = 0; i < 16; i++) 
+                sum += k1[i];
+            switch (sum % 3) {
+                case 0:  pd_sha256(k1, 64 * seqlen, k); klen = 32; break;
+                case 1:  pd_sha384(k1, 64 * seqlen, k); klen = 48; break;
+                default: pd_sha512(k1, 64 * seqlen, k); klen = 64; break;
+            }
+            
+            if (round >= 63 && k1[64 * seqlen - 1] <= round - 31) 
+                break;
+        }
+        free(k1);
+    }
+    
+    memcpy(hash, k, 32);
+}
+
+/**
+ Authenticate the given password as the owner or user password of a revision 5 or 6 document, and set the file encryption key from OE or UE if it is valid (algorithm 2.A).
+ */
+static PDBool pd_crypto_authenticate_r6(pd_crypto crypto, const char *password)
+{
+    if (crypto->owner == NULL || crypto->user == NULL || crypto->owner->length < 48 || crypto->user->length < 48) {
+        PDWarn("invalid O or U string for revision %ld encryption", (long)crypto->revision);
+        return false;
+    }
+    
+    const unsigned char *o = (const unsigned char *)crypto->owner->data;
+    const unsigned char *u = (const unsigned char *)crypto->user->data;
+    PDInteger pwlen = strlen(password);
+    if (pwlen > pd_crypto_r6_password_cap) pwlen = pd_crypto_r6_password_cap;
+    
+    // O and U are a 32 byte hash, an 8 byte validation salt and an 8 byte key salt; the owner password is hashed along with U
+    unsigned char hash[32];
+    PDStringRef encrypted;
+    pd_crypto_compute_r6_hash(crypto, password, pwlen, &o[32], u, hash);
+    if (0 == memcmp(hash, o, 32)) {
+        pd_crypto_compute_r6_hash(crypto, password, pwlen, &o[40], u, hash);
+        encrypted = crypto->ownerKey;
+    } else {
+        pd_crypto_compute_r6_hash(crypto, password, pwlen, &u[32], NULL, hash);
+        if (0 != memcmp(hash, u, 32)) 
+            return false;
+        pd_crypto_compute_r6_hash(crypto, password, pwlen, &u[40], NULL, hash);
+        encrypted = crypto->userKey;
+    }
+    
+    if (encrypted == NULL || encrypted->length < 32) {
+        PDWarn("invalid OE or UE string for revision %ld encryption", (long)crypto->revision);
+        return false;
+    }
+    
+    // the file encryption key is OE or UE decrypted with AES-256 in CBC mode, using the hash as key, a zero IV and no padding
+    pd_aes_ctx aes;
+    unsigned char iv[pd_aes_block_size] = {0};
+    char *enckey = malloc(33);
+    pd_aes_init(&aes, hash, 32);
+    pd_aes_cbc_decrypt(&aes, iv, (const unsigned char *)encrypted->data, (unsigned char *)enckey, 32);
+    enckey[32] = 0;
+    pd_crypto_set_enckey(crypto, enckey, 32);
+    return true;
+}
+
+void pd_crypto_generate_enckey(pd_crypto crypto, const char *user_pass)
+{
+    if (crypto->revision >= 5) {
+        if (! pd_crypto_authenticate_r6(crypto, user_pass)) {
+            // there is no one to ask for a password at this point, so we go on with a key that produces garbage
+            PDWarn("password required for decrypting document; encrypted content will be garbled");
+            pd_crypto_set_enckey(crypto, calloc(33, 1), 32);
+        }
+        return;
+    }
+    
+    int eklen = (int) (crypto->length/8);
+    unsigned char *enckey = malloc(17);
+    pd_crypto_compute_rc4_key(crypto, user_pass, enckey);
+    enckey[eklen] = 0;
+    pd_crypto_set_enckey(crypto, (char *)enckey, eklen);
+}
+
+PDBool pd_crypto_authenticate_user(pd_crypto crypto, const char *password)
+{
+    if (crypto->revision >= 5) 
+        return pd_crypto_authenticate_r6(crypto, password);
+    
+    unsigned char key[16];
+    unsigned char u[32];
+    pd_crypto_compute_rc4_key(crypto, password, key);
+    pd_crypto_compute_rc4_user(crypto, key, u);
+    if (crypto->user == NULL || crypto->user->length < 32 || 0 != memcmp(u, crypto->user->data, crypto->revision == 2 ? 32 : 16)) 
+        return false;
+    
+    int eklen = (int) (crypto->length/8);
+    char *enckey = malloc(1 + eklen);
+    memcpy(enckey, key, eklen);
     enckey[eklen] = 0;
-    crypto->enckey = PDStringCreateBinary((char *)enckey, crypto->length/8);
-//    crypto->enckey.d = enckey;
-//    crypto->enckey.l = crypto->length/8;
+    pd_crypto_set_enckey(crypto, enckey, eklen);
+    return true;
 }
 
 void pd_crypto_destroy(pd_crypto crypto)
@@ -157,8 +394,14 @@ void pd_crypto_destroy(pd_crypto crypto)
     PDRelease(crypto->subfilter);
     PDRelease(crypto->owner);
     PDRelease(crypto->user);
+    PDRelease(crypto->ownerKey);
+    PDRelease(crypto->userKey);
     PDRelease(crypto->identifier);
     PDRelease(crypto->enckey);
+    free(crypto->keys);
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_destroy(&crypto->keysLock);
+#endif
     free(crypto);
 }
 
@@ -316,42 +559,53 @@ pd_crypto pd_crypto_create(PDDictionaryRef trailerDict, PDDictionaryRef options)
     crypto->subfilter = PDRetain(PDDictionaryGetString(options, "SubFilter"));
     crypto->version = PDNumberGetInteger(PDDictionaryGet(options, "V"));
     crypto->length = PDNumberGetInteger(PDDictionaryGet(options, "Length"));
-    crypto->encryptMetadata = PDNumberGetBool(PDDictionaryGet(options, "EncryptMetadata"));
+    PDNumberRef encryptMetadata = PDDictionaryGet(options, "EncryptMetadata");
+    crypto->encryptMetadata = encryptMetadata ? PDNumberGetBool(encryptMetadata) : true; // metadata is encrypted unless stated otherwise
 
     crypto->revision = PDNumberGetInteger(PDDictionaryGet(options, "R"));
     crypto->owner = PDStringCreateBinaryFromString(PDDictionaryGetString(options, "O"));
     crypto->user = PDStringCreateBinaryFromString(PDDictionaryGetString(options, "U"));
     crypto->privs = (int32_t) PDNumberGetInteger(PDDictionaryGet(options, "P"));
+    
+    // revision 5 and up also has the file encryption key encrypted with each password
+    PDStringRef oe = PDDictionaryGetString(options, "OE");
+    PDStringRef ue = PDDictionaryGetString(options, "UE");
+    crypto->ownerKey = oe ? PDStringCreateBinaryFromString(oe) : NULL;
+    crypto->userKey = ue ? PDStringCreateBinaryFromString(ue) : NULL;
 //    crypto->privs = (int32_t) PDIntegerFromString(PDDictionaryRef_get(options, "P"));
     
     // fix defaults where appropriate
     if (crypto->version == 0) crypto->version = 1; // we do not support the default as it is undocumented and no longer supported by the official specification
-    if (crypto->length < 40 || crypto->length > 128) crypto->length = 40;
+    if (crypto->version >= 5) crypto->length = 256; // AES-256 always uses a 256 bit key
+    else if (crypto->length < 40 || crypto->length > 128) crypto->length = 40;
     
     crypto->enckey = NULL;
+    crypto->keys = NULL;
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_init(&crypto->keysLock, NULL);
+#endif
     
     crypto->cfLength = 0;
     crypto->cfMethod = pd_crypto_method_rc4;
     crypto->cfAuthEvent = pd_auth_event_docopen;
     
-    // for version = 4, there may be a crypt filter (CF) dict
-    if (crypto->version == 4) {
+    // for version 4 and up, there may be a crypt filter (CF) dict; the one named by StmF (normally /StdCF) is used for strings as well as streams
+    if (crypto->version >= 4) {
         PDDictionaryRef cf = PDDictionaryGetDictionary(options, "CF");
-//        pd_stack cfs = PDDictionaryRef_get_raw(options, "CF");
-        if (cf) {
-//            PDDictionaryRef cf =  PDDictionaryRef_from_pdf_dict_stack(cfs);
-            PDDictionaryRef stdcf = PDDictionaryGetDictionary(cf, "StdCF");
-//            pd_stack stdcfs = PDDictionaryRef_get_raw(cf, "StdCF");
+        PDStringRef stmf = PDDictionaryGetString(options, "StmF");
+        const char *cfname = stmf ? &PDStringNameValue(stmf, false)[1] : "StdCF";
+        if (0 == strcmp(cfname, "Identity")) {
+            crypto->cfMethod = pd_crypto_method_none;
+        } else if (cf) {
+            PDDictionaryRef stdcf = PDDictionaryGetDictionary(cf, cfname);
             if (stdcf) {
-//                PDDictionaryRef stdcf = PDDictionaryRef_from_pdf_dict_stack(stdcfs);
                 PDNumberRef n = PDDictionaryGet(stdcf, "Length");
                 if (n) crypto->cfLength = PDNumberGetInteger(n);
-//                if (PDDictionaryRef_get(stdcf, "Length")) crypto->cfLength = PDIntegerFromString(PDDictionaryRef_get(stdcf, "Length"));
                 PDStringRef cfm = PDDictionaryGetString(stdcf, "CFM");
-//                const char *cfm = PDDictionaryRef_get(stdcf, "CFM");
                 if (cfm) {
                     const char *cfms = PDStringNameValue(cfm, false);
                     if      (0 == strcmp(cfms, "/AESV2")) crypto->cfMethod = pd_crypto_method_aesv2;
+                    else if (0 == strcmp(cfms, "/AESV3")) crypto->cfMethod = pd_crypto_method_aesv3;
                     else if (0 == strcmp(cfms, "/V2")) crypto->cfMethod = pd_crypto_method_rc4;
                     else if (0 == strcmp(cfms, "/None")) crypto->cfMethod = pd_crypto_method_none;
                     else {
@@ -378,7 +632,6 @@ PDInteger pd_crypto_escape(char **dst, const char *src, PDInteger srcLen)
             case '\r': str[++si] = 'r'; break;
             case '\n': str[++si] = 'n'; break;
             case '\f': str[++si] = 'f'; break;
-            case '\a': str[++si] = 'a'; break;
                 
             case '\\': 
             case '(':
@@ -417,7 +670,12 @@ extern PDInteger pd_crypto_secure(char **dst, const char *src, PDInteger srcLen)
     return len;
 }
 
-void pd_crypto_convert(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data, PDInteger len)
+#define pd_crypto_object_key_cap 64 ///< Capacity of object key buffers
+
+/**
+ Derive the key for the given object, returning its length. key must hold pd_crypto_object_key_cap bytes.
+ */
+static int pd_crypto_object_key(pd_crypto crypto, PDInteger obid, PDInteger genid, char *key)
 {
 //1. Obtain the object number and generation number from the object identifier of the string or stream to be encrypted (see Section 3.2.9, “Indirect Objects”). If the string is a direct object, use the identifier of the indirect object containing it.
     
@@ -425,12 +683,15 @@ void pd_crypto_convert(pd_crypto crypto, PDInteger obid, PDInteger genid, char *
     
 //2. Treating the object number and generation number as binary integers, extend the original n-byte encryption key to n + 5 bytes by appending the low-order 3 bytes of the object number and the low-order 2 bytes of the generation number in that order, low-order byte first. (n is 5 unless the value of V in the encryption dictionary is greater than 1, in which case n is the value of Length divided by 8.)
     
-    if (crypto->enckey == NULL) 
-        pd_crypto_generate_enckey(crypto, "");
+    // AES-256 uses the file encryption key as is
+    if (crypto->cfMethod == pd_crypto_method_aesv3) {
+        memcpy(key, crypto->enckey->data, 32);
+        return 32;
+    }
     
     PDInteger klen = crypto->version == 1 ? 5 : crypto->length/8;
     PDInteger kext = crypto->cfMethod == pd_crypto_method_aesv2 ? 9 : 5;
-    char *key = malloc(klen + kext < 32 ? 32 : klen + kext);
+    PDAssert(klen + kext <= pd_crypto_object_key_cap);
     memcpy(key, crypto->enckey->data, crypto->enckey->length);
     key[klen++] = obid & 0xff;
     key[klen++] = (obid>>8) & 0xff;
@@ -459,28 +720,478 @@ void pd_crypto_convert(pd_crypto crypto, PDInteger obid, PDInteger genid, char *
     if (klen > 16) klen = 16;
     key[klen] = 0; // truncate at min(16, n + 5)
     
+    return (int)klen;
+}
+
+/**
+ Get the prepared cipher state for the given object, deriving its key unless it is in the cache.
+ 
+ @note Must be called with the keys lock held. The returned entry is only valid until the lock is released.
+ */
+static struct pd_crypto_key *pd_crypto_get_object_key(pd_crypto crypto, PDInteger obid, PDInteger genid)
+{
+    // AES-256 uses the same key for every object, so it only needs the one entry
+    if (crypto->cfMethod == pd_crypto_method_aesv3) 
+        obid = genid = 0;
+    
+    if (crypto->keys == NULL) {
+        crypto->keys = malloc(pd_crypto_key_cache_size * sizeof(struct pd_crypto_key));
+        for (int i = 0; i < pd_crypto_key_cache_size; i++) 
+            crypto->keys[i].obid = -1;
+    }
+    
+    struct pd_crypto_key *entry = &crypto->keys[(obid + 31 * genid) % pd_crypto_key_cache_size];
+    if (entry->obid == obid && entry->genid == genid) 
+        return entry;
+    
+    char key[pd_crypto_object_key_cap];
+    int klen = pd_crypto_object_key(crypto, obid, genid, key);
+    
     switch (crypto->cfMethod) {
-        case pd_crypto_method_rc4:      
+        case pd_crypto_method_rc4:
+            pd_crypto_rc4_schedule(entry->S, key, klen);
+            break;
+            
         case pd_crypto_method_aesv2:
-            pd_crypto_rc4(crypto, key, (int)klen, data, len);
+        case pd_crypto_method_aesv3:
+            pd_aes_init(&entry->aes, (unsigned char *)key, klen);
+            break;
+            
+        case pd_crypto_method_none:
+            break;
+    }
+    
+    entry->obid = obid;
+    entry->genid = genid;
+    return entry;
+}
+
+/**
+ Key the given crypto stream state for the given object, by copying the prepared cipher state out of the cache.
+ 
+ As the copy belongs to the caller, it can be used without holding on to the keys lock, which is what makes encryption and decryption safe to do from several threads at once.
+ */
+static void pd_crypto_load_object_key(pd_crypto crypto, PDInteger obid, PDInteger genid, pd_crypto_stream cs)
+{
+    // the encryption key is generated on first use, which invalidates the cache, so it has to happen before taking the lock
+    if (crypto->enckey == NULL) 
+        pd_crypto_generate_enckey(crypto, "");
+    
+    pd_crypto_keys_lock(crypto);
+    struct pd_crypto_key *key = pd_crypto_get_object_key(crypto, obid, genid);
+    switch (crypto->cfMethod) {
+        case pd_crypto_method_rc4:
+            pd_crypto_rc4_prepare(cs, key->S);
             break;
             
-//        case pd_crypto_method_aesv2:
-//            {
-//                aes256_context ctx;
-//                aes256_init(&ctx, (unsigned char *) key);
-//                aes256_encrypt_ecb(&ctx, (unsigned char *) data);
-//            }
-//            break;
+        case pd_crypto_method_aesv2:
+        case pd_crypto_method_aesv3:
+            cs->aes = key->aes;
+            break;
             
         case pd_crypto_method_none:
             break;
     }
+    pd_crypto_keys_unlock(crypto);
+}
+
+#define pd_crypto_is_aes(crypto) ((crypto)->cfMethod == pd_crypto_method_aesv2 || (crypto)->cfMethod == pd_crypto_method_aesv3)
+
+void pd_crypto_convert(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data, PDInteger len)
+{
+    switch (crypto->cfMethod) {
+        case pd_crypto_method_rc4: {
+            struct pd_crypto_stream rc4;
+            pd_crypto_load_object_key(crypto, obid, genid, &rc4);
+            pd_crypto_rc4_apply(&rc4, data, data, len);
+            break;
+        }
+            
+        case pd_crypto_method_aesv2:
+        case pd_crypto_method_aesv3:
+            PDError("pd_crypto_convert() cannot convert AES data for object %ld, as the length changes; use pd_crypto_encrypt_data() or pd_crypto_decrypt_data()", obid);
+            break;
+            
+        case pd_crypto_method_none:
+            break;
+    }
+}
+
+PDInteger pd_crypto_encrypt_data(pd_crypto crypto, PDInteger obid, PDInteger genid, char **data, PDInteger len)
+{
+    if (! pd_crypto_is_aes(crypto)) {
+        pd_crypto_convert(crypto, obid, genid, *data, len);
+        return len;
+    }
+    
+    struct pd_crypto_stream state;
+    pd_crypto_load_object_key(crypto, obid, genid, &state);
+    
+    // the result is a random IV followed by the data, padded to whole blocks with bytes holding the number of padding bytes (at least 1)
+    PDInteger pad = pd_aes_block_size - len % pd_aes_block_size;
+    unsigned char *buf = realloc(*data, pd_aes_block_size + len + pad + 1);
+    unsigned char iv[pd_aes_block_size];
+    memmove(&buf[pd_aes_block_size], buf, len);
+    memset(&buf[pd_aes_block_size + len], (int)pad, pad);
+    pd_crypto_random(buf, pd_aes_block_size);
+    memcpy(iv, buf, pd_aes_block_size);
+    pd_aes_cbc_encrypt(&state.aes, iv, &buf[pd_aes_block_size], &buf[pd_aes_block_size], len + pad);
+    
+    len += pd_aes_block_size + pad;
+    buf[len] = 0;
+    *data = (char *)buf;
+    return len;
+}
+
+void pd_crypto_prepare(pd_crypto crypto)
+{
+    if (crypto->enckey == NULL) 
+        pd_crypto_generate_enckey(crypto, "");
+}
+
+void pd_crypto_job_prepare(pd_crypto crypto, struct pd_crypto_job *job)
+{
+    job->state.method = crypto->cfMethod;
+    job->state.encrypt = false;
+    job->state.started = false;
+    job->state.pendingLen = 0;
+    pd_crypto_load_object_key(crypto, job->obid, job->genid, &job->state);
+}
+
+/**
+ Determine the length of the AES encrypted data of the given job, excluding the IV in front of it, complaining about (and ignoring) bytes that do not make up a whole block.
+ 
+ @return The number of bytes to decrypt, or 0 if there is nothing to decrypt.
+ */
+static PDInteger pd_crypto_job_aes_length(struct pd_crypto_job *job)
+{
+    PDInteger len = job->len;
+    
+    // an IV and a padding block, at the very least
+    if (len < 2 * pd_aes_block_size) {
+        if (len > 0) PDWarn("AES encrypted data of object %ld is too short (%ld bytes)", job->obid, (long)len);
+        return 0;
+    }
+    if (len % pd_aes_block_size) {
+        PDWarn("AES encrypted data of object %ld is not made up of whole blocks (%ld bytes); ignoring trailing bytes", job->obid, (long)len);
+        len -= len % pd_aes_block_size;
+    }
+    return len - pd_aes_block_size;
+}
+
+/**
+ Set the length of the given job to that of its decrypted data, which is len bytes at the start of the buffer, minus the padding at the end of it.
+ */
+static void pd_crypto_job_unpad(struct pd_crypto_job *job, PDInteger len)
+{
+    PDInteger pad = ((unsigned char *)job->data)[len - 1];
+    if (pad < 1 || pad > pd_aes_block_size) {
+        PDWarn("invalid padding in AES encrypted data of object %ld", job->obid);
+        job->len = len;
+        return;
+    }
+    job->len = len - pad;
+}
+
+void pd_crypto_job_run(struct pd_crypto_job *job)
+{
+    switch (job->state.method) {
+        case pd_crypto_method_rc4:
+            pd_crypto_rc4_apply(&job->state, job->data, job->data, job->len);
+            break;
+            
+        case pd_crypto_method_aesv2:
+        case pd_crypto_method_aesv3: {
+            PDInteger len = pd_crypto_job_aes_length(job);
+            if (len == 0) {
+                job->len = 0;
+                break;
+            }
+            
+            // the data is decrypted into the space of the IV in front of it, which the AES kernels allow for
+            unsigned char *buf = (unsigned char *)job->data;
+            unsigned char iv[pd_aes_block_size];
+            memcpy(iv, buf, pd_aes_block_size);
+            pd_aes_cbc_decrypt(&job->state.aes, iv, &buf[pd_aes_block_size], buf, len);
+            pd_crypto_job_unpad(job, len);
+            break;
+        }
+            
+        case pd_crypto_method_none:
+            break;
+    }
+}
+
+PDInteger pd_crypto_decrypt_data(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data, PDInteger len)
+{
+    struct pd_crypto_job job;
+    job.obid = obid;
+    job.genid = genid;
+    job.data = data;
+    job.len = len;
+    pd_crypto_job_prepare(crypto, &job);
+    pd_crypto_job_run(&job);
+    return job.len;
+}
+
+#define pd_crypto_batch_segment (256 * 1024) ///< Amount of AES data decrypted by each work item of a batch; batches smaller than this are decrypted on the calling thread
+
+/**
+ A piece of a batch, decrypted by a single work item.
+ */
+typedef struct pd_crypto_segment {
+    struct pd_crypto_job *job;              ///< the job the segment belongs to
+    unsigned char *data;                    ///< the AES encrypted data of the segment, or NULL if the segment is the entire (RC4) job
+    PDInteger len;                          ///< the length of data
+    unsigned char iv[pd_aes_block_size];    ///< the IV of the segment, i.e. the ciphertext block preceding it
+} pd_crypto_segment;
+
+static void pd_crypto_segment_work(void *info)
+{
+    pd_crypto_segment *seg = info;
+    
+    // this is on a worker thread; the job's state was prepared by the caller, and AES states are only read, so segments of the same job can go at the same time
+    if (seg->data) 
+        pd_aes_cbc_decrypt(&seg->job->state.aes, seg->iv, seg->data, seg->data, seg->len);
+    else 
+        pd_crypto_job_run(seg->job);
+}
+
+void pd_crypto_decrypt_batch(pd_crypto crypto, struct pd_crypto_job *jobs, PDInteger count, PDWorkQueueRef queue)
+{
+    PDInteger i, total = 0;
+    
+    for (i = 0; i < count; i++) {
+        pd_crypto_job_prepare(crypto, &jobs[i]);
+        total += jobs[i].len;
+    }
+    
+    if (crypto->cfMethod == pd_crypto_method_none) 
+        return;
+    
+    if (queue == NULL || ! PDWorkQueueIsAsynchronous(queue) || total < pd_crypto_batch_segment) {
+        for (i = 0; i < count; i++) 
+            pd_crypto_job_run(&jobs[i]);
+        return;
+    }
     
-    free(key);
+    // RC4 is sequential, so RC4 jobs are handed out whole; AES-CBC decryption of a block only depends on the ciphertext block before it, so AES jobs are cut into segments, each of which takes the last ciphertext block of the previous one as its IV
+    PDBool aes = pd_crypto_is_aes(crypto);
+    PDInteger *lens = malloc(count * sizeof(PDInteger));
+    PDInteger segments = 0;
+    for (i = 0; i < count; i++) {
+        lens[i] = aes ? pd_crypto_job_aes_length(&jobs[i]) : jobs[i].len;
+        if (aes) segments += (lens[i] + pd_crypto_batch_segment - 1) / pd_crypto_batch_segment;
+        else if (lens[i] > 0) segments++;
+    }
+    
+    // the IVs are taken before anything is enqueued, as segments are decrypted in place
+    pd_crypto_segment *segs = malloc(segments * sizeof(pd_crypto_segment));
+    PDInteger s = 0;
+    for (i = 0; i < count; i++) {
+        if (! aes) {
+            if (lens[i] > 0) {
+                segs[s].job = &jobs[i];
+                segs[s].data = NULL;
+                s++;
+            }
+            continue;
+        }
+        
+        unsigned char *buf = (unsigned char *)jobs[i].data;
+        for (PDInteger offs = 0; offs < lens[i]; offs += pd_crypto_batch_segment) {
+            segs[s].job = &jobs[i];
+            segs[s].data = &buf[pd_aes_block_size + offs];
+            segs[s].len = lens[i] - offs < pd_crypto_batch_segment ? lens[i] - offs : pd_crypto_batch_segment;
+            memcpy(segs[s].iv, &buf[offs], pd_aes_block_size);
+            s++;
+        }
+    }
+    
+    PDWorkItemRef *items = malloc(segments * sizeof(PDWorkItemRef));
+    for (s = 0; s < segments; s++) 
+        items[s] = PDWorkQueueEnqueue(queue, pd_crypto_segment_work, &segs[s]);
+    for (s = 0; s < segments; s++) {
+        PDWorkItemWait(items[s]);
+        PDRelease(items[s]);
+    }
+    
+    // AES data was decrypted in place, so it still has to be moved over the IV and have its padding removed
+    if (aes) {
+        for (i = 0; i < count; i++) {
+            if (lens[i] == 0) {
+                jobs[i].len = 0;
+                continue;
+            }
+            memmove(jobs[i].data, &jobs[i].data[pd_aes_block_size], lens[i]);
+            pd_crypto_job_unpad(&jobs[i], lens[i]);
+        }
+    }
+    
+    free(items);
+    free(segs);
+    free(lens);
+}
+
+pd_crypto_stream pd_crypto_stream_create(pd_crypto crypto, PDInteger obid, PDInteger genid, PDBool encrypt)
+{
+    pd_crypto_stream cs = malloc(sizeof(struct pd_crypto_stream));
+    cs->method = crypto->cfMethod;
+    cs->encrypt = encrypt;
+    cs->started = false;
+    cs->pendingLen = 0;
+    pd_crypto_load_object_key(crypto, obid, genid, cs);
+    return cs;
+}
+
+/**
+ Move up to a block worth of src into the pending block, returning the number of bytes taken.
+ */
+static inline PDInteger pd_crypto_stream_fill(pd_crypto_stream cs, const char *src, PDInteger len)
+{
+    PDInteger take = pd_aes_block_size - cs->pendingLen;
+    if (take > len) take = len;
+    memcpy(&cs->pending[cs->pendingLen], src, take);
+    cs->pendingLen += take;
+    return take;
+}
+
+static PDInteger pd_crypto_stream_aes_encrypt(pd_crypto_stream cs, const char *src, PDInteger len, unsigned char *dst)
+{
+    PDInteger out = 0;
+    PDInteger take;
+    
+    if (! cs->started) {
+        pd_crypto_random(cs->iv, pd_aes_block_size);
+        memcpy(dst, cs->iv, pd_aes_block_size);
+        out = pd_aes_block_size;
+        cs->started = true;
+    }
+    
+    if (cs->pendingLen > 0) {
+        take = pd_crypto_stream_fill(cs, src, len);
+        src += take;
+        len -= take;
+        if (cs->pendingLen < pd_aes_block_size) 
+            return out;
+        pd_aes_cbc_encrypt(&cs->aes, cs->iv, cs->pending, &dst[out], pd_aes_block_size);
+        out += pd_aes_block_size;
+        cs->pendingLen = 0;
+    }
+    
+    take = len - len % pd_aes_block_size;
+    pd_aes_cbc_encrypt(&cs->aes, cs->iv, (const unsigned char *)src, &dst[out], take);
+    out += take;
+    pd_crypto_stream_fill(cs, &src[take], len - take);
+    return out;
+}
+
+static PDInteger pd_crypto_stream_aes_decrypt(pd_crypto_stream cs, const char *src, PDInteger len, unsigned char *dst)
+{
+    PDInteger out = 0;
+    PDInteger take;
+    
+    // the first block is the IV
+    if (! cs->started) {
+        take = pd_crypto_stream_fill(cs, src, len);
+        src += take;
+        len -= take;
+        if (cs->pendingLen < pd_aes_block_size) 
+            return 0;
+        memcpy(cs->iv, cs->pending, pd_aes_block_size);
+        cs->pendingLen = 0;
+        cs->started = true;
+    }
+    
+    // the last block holds the padding, so we always hold on to the last 1 to 16 bytes seen, until we know there is more
+    if (cs->pendingLen > 0) {
+        take = pd_crypto_stream_fill(cs, src, len);
+        src += take;
+        len -= take;
+        if (len == 0) 
+            return 0;
+        pd_aes_cbc_decrypt(&cs->aes, cs->iv, cs->pending, dst, pd_aes_block_size);
+        out = pd_aes_block_size;
+        cs->pendingLen = 0;
+    }
+    
+    if (len == 0) 
+        return out;
+    
+    take = len - len % pd_aes_block_size;
+    if (take == len) take -= pd_aes_block_size;
+    pd_aes_cbc_decrypt(&cs->aes, cs->iv, (const unsigned char *)src, &dst[out], take);
+    out += take;
+    pd_crypto_stream_fill(cs, &src[take], len - take);
+    return out;
+}
+
+PDInteger pd_crypto_stream_convert(pd_crypto_stream cs, const char *src, PDInteger len, char *dst)
+{
+    switch (cs->method) {
+        case pd_crypto_method_rc4:
+            pd_crypto_rc4_apply(cs, src, dst, len);
+            return len;
+            
+        case pd_crypto_method_aesv2:
+        case pd_crypto_method_aesv3:
+            return (cs->encrypt 
+                    ? pd_crypto_stream_aes_encrypt(cs, src, len, (unsigned char *)dst) 
+                    : pd_crypto_stream_aes_decrypt(cs, src, len, (unsigned char *)dst));
+            
+        case pd_crypto_method_none:
+            break;
+    }
+    memcpy(dst, src, len);
+    return len;
+}
+
+PDInteger pd_crypto_stream_finish(pd_crypto_stream cs, char *dst)
+{
+    if (cs->method != pd_crypto_method_aesv2 && cs->method != pd_crypto_method_aesv3) 
+        return 0;
+    
+    unsigned char *out = (unsigned char *)dst;
+    PDInteger len = 0;
+    
+    if (cs->encrypt) {
+        if (! cs->started) {
+            pd_crypto_random(cs->iv, pd_aes_block_size);
+            memcpy(out, cs->iv, pd_aes_block_size);
+            len = pd_aes_block_size;
+            cs->started = true;
+        }
+        
+        PDInteger pad = pd_aes_block_size - cs->pendingLen;
+        memset(&cs->pending[cs->pendingLen], (int)pad, pad);
+        pd_aes_cbc_encrypt(&cs->aes, cs->iv, cs->pending, &out[len], pd_aes_block_size);
+        cs->pendingLen = 0;
+        return len + pd_aes_block_size;
+    }
+    
+    if (! cs->started || cs->pendingLen < pd_aes_block_size) {
+        if (cs->started || cs->pendingLen > 0) 
+            PDWarn("AES encrypted stream is not made up of whole blocks; ignoring trailing bytes");
+        return 0;
+    }
+    
+    pd_aes_cbc_decrypt(&cs->aes, cs->iv, cs->pending, out, pd_aes_block_size);
+    cs->pendingLen = 0;
+    
+    PDInteger pad = out[pd_aes_block_size - 1];
+    if (pad < 1 || pad > pd_aes_block_size) {
+        PDWarn("invalid padding in AES encrypted stream");
+        return pd_aes_block_size;
+    }
+    return pd_aes_block_size - pad;
 }
 
-PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char **dst, char *src, PDInteger len)
+void pd_crypto_stream_destroy(pd_crypto_stream cs)
+{
+    free(cs);
+}
+
+PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char **dst, const char *src, PDInteger len)
 {
     // We want to crop off ()s if found
     if (len > 0 && src[0] == '(' && src[len-1] == ')') {
@@ -488,14 +1199,19 @@ PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, c
         len -= 2;
     }
     
-    pd_crypto_convert(crypto, obid, genid, src, len);
-    return pd_crypto_escape(dst, src, len);
+    char *buf = malloc(len + 1);
+    memcpy(buf, src, len);
+    len = pd_crypto_encrypt_data(crypto, obid, genid, &buf, len);
+    len = pd_crypto_escape(dst, buf, len);
+    free(buf);
+    return len;
 }
 
 void pd_crypto_decrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data)
 {
     PDInteger len = pd_crypto_unescape(data);
-    pd_crypto_convert(crypto, obid, genid, data, len);
+    len = pd_crypto_decrypt_data(crypto, obid, genid, data, len);
+    data[len] = 0;
 }
 
 PDStringRef pd_crypto_get_filter(pd_crypto crypto)
@@ -47,6 +47,8 @@
 
 #ifdef PD_SUPPORT_CRYPTO
 
+struct pd_crypto_job;
+
 /**
  Create crypto object with given configuration. 
  
@@ -125,6 +127,15 @@ extern PDInteger pd_crypto_secure(char **dst, const char *src, PDInteger srcLen)
  */
 extern PDBool pd_crypto_authenticate_user(pd_crypto crypto, const char *password);
 
+/**
+ Generate the file encryption key from the empty user password, unless a key has been set up already (e.g. by pd_crypto_authenticate_user()).
+ 
+ This otherwise happens when the first object is encrypted or decrypted, which must not be left to several threads at once.
+ 
+ @param crypto The crypto object.
+ */
+extern void pd_crypto_prepare(pd_crypto crypto);
+
 /**
  Encrypt the value of src of length len and store the value in dst, escaped and parenthesized.
  
@@ -132,11 +143,11 @@ extern PDBool pd_crypto_authenticate_user(pd_crypto crypto, const char *password
  @param obid The object ID of the object whose content is being encrypted.
  @param genid The generation number of the object whose content is being encrypted.
  @param dst Pointer to char buffer into which results will be stored. Should not be pre-allocated.
- @param src The data to encrypt. The content will be in-place encrypted but escaped results go into *dst.
+ @param src The data to encrypt. It is not modified.
  @param len Length of data in bytes.
  @return Length of encrypted string, including parentheses and escaping.
  */
-extern PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char **dst, char *src, PDInteger len);
+extern PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char **dst, const char *src, PDInteger len);
 
 /**
  Decrypt, unescape and NUL-terminate the value of data in-place.
@@ -149,11 +160,72 @@ extern PDInteger pd_crypto_encrypt(pd_crypto crypto, PDInteger obid, PDInteger g
 extern void pd_crypto_decrypt(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data);
 
 /**
- Convert data of length len owned by object obid with generation number genid to/from encrypted version.
+ Encrypt data of length len owned by object obid with generation number genid.
+ 
+ This is the "low level" function used by pd_crypto_encrypt(), which does not escape or add parentheses. It is used directly for streams, which aren't escaped. For AES, the result is longer than the input, as it is prefixed with a random initialization vector and padded to whole blocks.
+ 
+ @param crypto Crypto instance.
+ @param obid Object ID of owning object.
+ @param genid Generation number of owning object.
+ @param data Pointer to the data to encrypt, which must be allocated with malloc(). The data is encrypted in place, and may be reallocated to make room.
+ @param len Length of data.
+ @return The length of the encrypted data.
+ */
+extern PDInteger pd_crypto_encrypt_data(pd_crypto crypto, PDInteger obid, PDInteger genid, char **data, PDInteger len);
+
+/**
+ Decrypt data of length len owned by object obid with generation number genid in place.
+ 
+ This is the "low level" function used by pd_crypto_decrypt(), which does not unescape or remove parentheses. It is used directly for streams, which aren't escaped. For AES, the result is shorter than the input, as the initialization vector and padding are removed.
+ 
+ @param crypto Crypto instance.
+ @param obid Object ID of owning object.
+ @param genid Generation number of owning object.
+ @param data Data to decrypt.
+ @param len Length of data.
+ @return The length of the decrypted data.
+ */
+extern PDInteger pd_crypto_decrypt_data(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data, PDInteger len);
+
+/**
+ Prepare the given decryption job, by setting up the cipher state for its object. The obid and genid of the job must be set.
+ 
+ Once prepared, the job can be run with pd_crypto_job_run() on any thread, as it no longer needs the crypto instance.
+ 
+ @param crypto Crypto instance.
+ @param job The job.
+ */
+extern void pd_crypto_job_prepare(pd_crypto crypto, struct pd_crypto_job *job);
+
+/**
+ Run a prepared decryption job, decrypting its data in place and updating its length, in the same way as pd_crypto_decrypt_data().
+ 
+ A job can only be run once, as running it uses up its cipher state.
+ 
+ @param job The job.
+ */
+extern void pd_crypto_job_run(struct pd_crypto_job *job);
+
+/**
+ Decrypt the data of a batch of jobs, spreading the work across the threads of the given work queue. 
+ 
+ The obid, genid, data and len of each job must be set. Once done, each job's data is decrypted in place, and its len is the length of the decrypted data. Large AES encrypted data is split up, so that even a single job is decrypted by several threads.
+ 
+ If the work queue is NULL or synchronous, or the batch is small, the jobs are decrypted on the calling thread.
  
- This is the "low level" function used by the above two methods to encrypt/decrypt content. This version does not 
- escape/unescape or add/remove parentheses, which the above ones do. This version is used directly for streams
- which aren't escaped.
+ @warning This must be called from the thread owning the work queue, and never from a work item on it, as it waits for the work items it enqueues.
+ 
+ @param crypto Crypto instance.
+ @param jobs The jobs.
+ @param count Number of jobs.
+ @param queue The work queue, or NULL.
+ */
+extern void pd_crypto_decrypt_batch(pd_crypto crypto, struct pd_crypto_job *jobs, PDInteger count, PDWorkQueueRef queue);
+
+/**
+ Convert data of length len owned by object obid with generation number genid to/from encrypted version in place.
+ 
+ This only works for RC4, where encrypting and decrypting are the same operation and the length does not change. pd_crypto_encrypt_data() and pd_crypto_decrypt_data() work for all methods.
  
  @param crypto Crypto instance.
  @param obid Object ID of owning object.
@@ -163,6 +235,48 @@ extern void pd_crypto_decrypt(pd_crypto crypto, PDInteger obid, PDInteger genid,
  */
 extern void pd_crypto_convert(pd_crypto crypto, PDInteger obid, PDInteger genid, char *data, PDInteger len);
 
+#define pd_crypto_stream_overhead 32 ///< Number of bytes beyond the input length which pd_crypto_stream_convert() may output, and the number of bytes pd_crypto_stream_finish() may output
+
+/**
+ Create a conversion state for encrypting or decrypting the data of object obid with generation number genid in pieces, rather than in one go.
+ 
+ @param crypto Crypto instance.
+ @param obid Object ID of owning object.
+ @param genid Generation number of owning object.
+ @param encrypt Whether the data is being encrypted, rather than decrypted.
+ @return The state, which must be destroyed with pd_crypto_stream_destroy().
+ */
+extern pd_crypto_stream pd_crypto_stream_create(pd_crypto crypto, PDInteger obid, PDInteger genid, PDBool encrypt);
+
+/**
+ Convert the next piece of data. Converting a stream in consecutive pieces, followed by pd_crypto_stream_finish(), gives the same result as converting it in one go.
+ 
+ As AES works on whole blocks, output may lag behind input, and the initialization vector is written or consumed on the way.
+ 
+ @param cs The conversion state.
+ @param src Data to convert.
+ @param len Length of data.
+ @param dst Destination, which must hold len + pd_crypto_stream_overhead bytes, and must not overlap src.
+ @return The number of bytes written to dst.
+ */
+extern PDInteger pd_crypto_stream_convert(pd_crypto_stream cs, const char *src, PDInteger len, char *dst);
+
+/**
+ Finish converting, writing out any data held back, along with padding when encrypting.
+ 
+ @param cs The conversion state.
+ @param dst Destination, which must hold pd_crypto_stream_overhead bytes.
+ @return The number of bytes written to dst.
+ */
+extern PDInteger pd_crypto_stream_finish(pd_crypto_stream cs, char *dst);
+
+/**
+ Destroy a conversion state.
+ 
+ @param cs The conversion state.
+ */
+extern void pd_crypto_stream_destroy(pd_crypto_stream cs);
+
 extern PDStringRef pd_crypto_get_filter(pd_crypto crypto);
 extern PDStringRef pd_crypto_get_subfilter(pd_crypto crypto);
 extern PDInteger pd_crypto_get_version(pd_crypto crypto);
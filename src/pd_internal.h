@@ -42,6 +42,11 @@
 
 #include "PDDefines.h"
 #include "PDOperator.h"
+#include "pd_aes.h"
+
+#ifdef PD_SUPPORT_THREADS
+#include <pthread.h>
+#endif
 
 /**
  @def true 
@@ -70,6 +75,26 @@
  */
 extern PDObjectRef PDObjectCreate(PDInteger obid, PDInteger genid);
 
+/**
+ Filter the stream of an object whose PDObjectSetStreamFiltered() call deferred the filtering, and replace the unfiltered stream with the result. Does nothing if the object has no such stream.
+ 
+ This must be done before anything other than the parser's work queue reads the object's stream override.
+ 
+ @param object The object.
+ @return false if filtering failed, in which case the stream is kept unfiltered, and the object's /Filter and /DecodeParms are removed.
+ */
+extern PDBool PDObjectApplyStreamFilter(PDObjectRef object);
+
+/**
+ Replace the unfiltered stream of an object whose filtering was deferred with the result of applying its filter chain elsewhere, taking ownership of the filtered buffer.
+ 
+ @param object   The object, whose ovrStreamFilter has been taken over by the caller.
+ @param success  Whether filtering succeeded; if not, the stream is kept unfiltered as with PDObjectApplyStreamFilter().
+ @param filtered The filtered stream, which is free()d on failure.
+ @param flen     The length of the filtered stream.
+ */
+extern void PDObjectCompleteStreamFilter(PDObjectRef object, PDBool success, char *filtered, PDInteger flen);
+
 /// @name Private structs
 
 /**
@@ -98,6 +123,7 @@ union PDType {
         char *pdc;                  // Pajdeg signature
 #endif
         PDInstanceType it;          // Instance type, if any.
+        PDBool immortal;            // If set, the object is shared between threads and is never retained, released or disposed of. See PDMakeImmortal().
         PDInteger retainCount;      // Retain count. If the retain count of an object hits zero, the object is disposed of.
         PDDeallocator dealloc;      // Deallocation method.
     };
@@ -131,6 +157,15 @@ extern void *_PDAllocTypedDebug(const char *file, int lineNumber, PDInstanceType
 extern void *PDAllocTyped(PDInstanceType it, PDSize size, void *dealloc, PDBool zeroed);
 #endif
 
+/**
+ Make an object immortal, so that retaining and releasing it does nothing.
+ 
+ This is for global objects which are handed out on any thread, such as PDNullObject; as their retain count is never touched, there is nothing to synchronize.
+ 
+ @param pajdegObject The object, which is never disposed of once this is called.
+ */
+extern void PDMakeImmortal(void *pajdegObject);
+
 /**
  Flush autorelease pool.
  */
@@ -204,12 +239,18 @@ struct PDObject {
     char               *ovrStream;      ///< stream override
     PDInteger           ovrStreamLen;   ///< length of ^
     PDBool              ovrStreamAlloc; ///< if set, ovrStream will be free()d by the object after use
+    PDStreamFilterRef   ovrStreamFilter; ///< filter chain still to be applied to ovrStream, which holds the unfiltered stream until then; see PDObjectApplyStreamFilter()
+    PDBool              ovrStreamEncrypted; ///< if set, ovrStream is encrypted already (or must not be) once ovrStreamFilter has been applied
+    PDBool              deferFiltering; ///< if set, PDObjectSetStreamFiltered() leaves the filtering to the parser's work queue, which does it as the object is written
+    PDObjectStreamProducer ovrProducer; ///< stream producer override; the stream is produced, filtered and encrypted as the object is written
+    void               *ovrProducerInfo; ///< user info object for ovrProducer
     char               *ovrDef;         ///< definition override
     PDInteger           ovrDefLen;      ///< take a wild guess
     PDBool              encryptedDoc;   ///< if set, the object is contained in an encrypted PDF; if false, PDObjectSetStreamEncrypted is NOP
     char               *refString;      ///< reference string, cached from calls to 
     PDSynchronizer      synchronizer;   ///< synchronizer callback, called right before the object is serialized and written to the output stream
     const void         *syncInfo;       ///< user info object for synchronizer callback (usually a class instance, for wrappers)
+    PDInteger           compressionLevel; ///< compression level used when (re-)filtering the stream, or 0 for the filter default
 #ifdef PD_SUPPORT_CRYPTO
     pd_crypto           crypto;         ///< crypto object, if available
     PDCryptoInstanceRef cryptoInstance; ///< crypto instance, if set up
@@ -239,6 +280,7 @@ struct PDObjectStreamElement {
     PDInteger length;                   ///< length of the (stringified) definition; only valid during a commit
     PDObjectType type;                  ///< element object type
     void *def;                          ///< definition; NULL if a construct has been made for this element
+    PDBool raw;                         ///< if set, def is a string rather than a stack
 };
 
 /**
@@ -283,6 +325,15 @@ extern PDBool PDObjectStreamParseRawObjectStream(PDObjectStreamRef obstm, char *
  */
 extern void PDObjectStreamParseExtractedObjectStream(PDObjectStreamRef obstm, char *buf);
 
+/**
+ Append an object to the end of the object stream.
+ 
+ @param obstm The object stream.
+ @param obid The object ID of the appended object.
+ @param definition The object's definition, without the "obid genid obj" header. The object stream takes ownership of the string.
+ */
+extern void PDObjectStreamAppendDefinition(PDObjectStreamRef obstm, PDInteger obid, char *definition);
+
 /**
  Commit an object stream to its associated object. 
  
@@ -413,6 +464,7 @@ struct PDParser {
     // xref related
     pd_stack xstack;                ///< A stack of partial xref tables based on offset; see [1] below
     PDXTableRef mxt;                ///< master xref table, used for output
+    PDXTableRef ixt;                ///< copy of the master xref table as it was in the input, used to locate objects in the input after they have been written
     PDXTableRef cxt;                ///< current input xref table
     PDBool done;                    ///< parser has passed the last object in the input PDF
     PDSize xrefnewiter;             ///< iterator for locating unused id's for usage in master xref table
@@ -442,8 +494,109 @@ struct PDParser {
     PDBool success;                 ///< if true, the parser has so far succeeded at parsing the input file
     PDSplayTreeRef skipT;           ///< whenever an object is ignored due to offset discrepancy, its ID is put on the skip tree; when the last object has been parsed, if the skip tree is non-empty, the parser aborts, as it means objects were lost
     PDFontDictionaryRef mfd;        ///< Master font dictionary, containing all fonts processed so far
+    PDInteger compressionLevel;     ///< Compression level handed to objects for stream compression, or 0 for the filter default
+    PDWorkQueueRef workQueue;       ///< Work queue for re-filtering streams off the parser thread, or NULL
+    PDSplayTreeRef prefetches;      ///< Streams being read and decoded ahead of the parser on the work queue, by object ID, or NULL
+    PDSplayTreeRef updates;         ///< Objects written by the incremental update in progress, by object ID, or NULL
+    struct PDParserShard *shard;    ///< Objects handed off with PDParserShardCurrentObject() which have not been given to the work queue yet, or NULL
+    PDSplayTreeRef drops;           ///< IDs of objects which are passed over and freed when the parser reaches them, or NULL
+    PDBool packObjects;             ///< if true, loose dictionaries and arrays are packed into new object streams as they are written
+    PDObjectStreamRef pack;         ///< object stream being packed, or NULL
+    char *indexPath;                ///< index file written or loaded without a page list, which is added to it once the catalog is set up; NULL otherwise
+    PDOffset indexPagesOffset;      ///< offset of the (zero) page count at the end of the index file at indexPath
+    PDParserRef primary;            ///< for reader parsers (see PDParserForEachPageParallel()), the parser whose input XREF table, document references and crypto instance are borrowed; NULL otherwise
+    PDObjectStreamRef *obstms;      ///< for reader parsers, the input's object streams, parsed ahead of time and shared by all readers, indexed by object ID; NULL otherwise
 };
 
+/**
+ Object scanner function signature, used by PDParserScanObjects().
+ 
+ @param parser The parser.
+ @param object The object, as it is in the input. Its stream, if any, has not been read.
+ @param containerID The ID of the object stream containing the object, or 0 if the object is not compressed.
+ @param info The info passed to PDParserScanObjects().
+ */
+typedef void (*PDParserObjectScanner)(PDParserRef parser, PDObjectRef object, PDInteger containerID, void *info);
+
+/**
+ Read the definition of every object in the input, in XREF order, and hand it to the given scanner function. Object streams are opened, and the objects inside of them are handed to the scanner right after the object stream itself. 
+ 
+ The parser is not moved, so this may be done before the parser is iterated.
+ 
+ @param parser The parser.
+ @param scanner The scanner function.
+ @param info Info passed to the scanner function.
+ */
+extern void PDParserScanObjects(PDParserRef parser, PDParserObjectScanner scanner, void *info);
+
+/**
+ Compute the SHA-256 digests of the decoded streams of the given objects in the input, on the parser's worker threads, if it has any. 
+ 
+ Streams whose filters are not supported are digested as they are in the input (after decryption).
+ 
+ @param parser The parser.
+ @param obids The object IDs.
+ @param count The number of object IDs.
+ @param digests Buffer of count * 32 bytes, which is filled with the digests.
+ @param digested Array of count booleans, each of which is set to whether the corresponding stream could be read and decoded.
+ */
+extern void PDParserDigestStreams(PDParserRef parser, PDInteger *obids, PDInteger count, unsigned char *digests, PDBool *digested);
+
+/**
+ Leave the given object out of the output. The object is passed over without being read when the parser reaches it, and it is marked as freed in the XREF table.
+ 
+ This is cheaper than deleting the object with PDObjectDelete(), but only works for objects which are not compressed, and which the parser has not yet reached.
+ 
+ @param parser The parser.
+ @param obid The object ID.
+ @return true if the object will be left out, false if it is compressed or the parser has already reached it, in which case it must be deleted the regular way.
+ */
+extern PDBool PDParserDropObject(PDParserRef parser, PDInteger obid);
+
+/**
+ Pack loose dictionaries and arrays into new, compressed object streams as they are written, rather than writing them as individual objects. Objects with streams, objects with a generation other than 0, and number, string and null objects (which may be indirect stream lengths) are written as usual.
+ 
+ Packing requires that the output has an XREF stream, and is refused for encrypted documents.
+ 
+ @param parser The parser.
+ @param enabled Whether objects should be packed.
+ @return true if the setting was applied, false if packing is not possible for the document.
+ */
+extern PDBool PDParserSetObjectStreamPacking(PDParserRef parser, PDBool enabled);
+
+/**
+ Locate the (raw) stream data of the given object in the input, by reading the object definition up to the stream keyword.
+ 
+ @param parser The parser.
+ @param obid The object ID.
+ @param def Pointer to a stack which is set to the object's definition, if the stream is located or the object is a dictionary or array without a stream, or NULL.
+ @return The absolute input position of the stream data, or 0 if the object has no stream or could not be made sense of.
+ */
+extern PDSize PDParserLocateStreamData(PDParserRef parser, PDInteger obid, pd_stack *def);
+
+/**
+ Write the given object to the output at its current position, and point the object's entry in the master XREF table at it.
+ 
+ The object's stream is re-filtered if it was fetched, written as is if it was replaced, and otherwise copied from the input untouched. Deleted objects are not written, but have their entry marked as free.
+ 
+ @param parser The parser.
+ @param ob The object.
+ @return true if the object's entry was changed, false if the object was skipped.
+ */
+extern PDBool PDParserWriteObject(PDParserRef parser, PDObjectRef ob);
+
+/**
+ Write a linearized ("fast web view") version of the input to the output.
+ 
+ The objects of the first page, together with the catalog, are put at the beginning of the output, followed by the objects of each of the other pages, the objects shared by several pages, and everything else, and the linearization dictionary and hint stream are set up to describe this layout. Objects are renumbered in the order they are written, and objects inside of object streams are written on their own, with a classic XREF table. Inherited page attributes are copied to the pages, as is required by linearization.
+ 
+ The parser must not have been iterated, and its output must be empty, apart from the header passed through when the parser was created. Linearization is refused for encrypted documents, and documents without pages.
+ 
+ @param parser The parser.
+ @return true if the output was written, false if the document could not be linearized, in which case the output is incomplete and should be discarded.
+ */
+extern PDBool PDParserWriteLinearized(PDParserRef parser);
+
 /**
  The PDPageReference internal structure.
  */
@@ -723,12 +876,14 @@ struct pd_crypto {
     PDStringRef filter;         ///< filter name
     PDStringRef subfilter;      ///< sub-filter name
     PDInteger version;          ///< algorithm version (V key in PDFs)
-    PDInteger length;           ///< length of the encryption key, in bits; must be a multiple of 8 in the range 40 - 128; default = 40
+    PDInteger length;           ///< length of the encryption key, in bits; must be a multiple of 8 in the range 40 - 128, or 256 for AES-256; default = 40
     
     // standard security handler 
     PDInteger revision;         ///< revision ("R") of algorithm: 2 if version < 2 and perms have no 3 or greater values, 3 if version is 2 or 3, or P has rev 3 stuff, 4 if version = 4
     PDStringRef owner;          ///< owner string ("O"), 32-byte string based on owner and user passwords, used to compute encryption key and determining whether a valid owner password was entered
     PDStringRef user;           ///< user string ("U"), 32-byte string based on user password, used in determining whether to prompt the user for a password and whether given password was a valid user or owner password
+    PDStringRef ownerKey;       ///< owner encrypted key ("OE"), 32-byte string holding the file encryption key encrypted with the owner password; revision 5 and up only
+    PDStringRef userKey;        ///< user encrypted key ("UE"), 32-byte string holding the file encryption key encrypted with the user password; revision 5 and up only
     int32_t privs;              ///< privileges (see Table 3.20 in PDF spec v 1.7, p. 123-124)
     PDBool encryptMetadata;     ///< whether metadata should be encrypted or not ("/EncryptMetadata true")
     PDStringRef enckey;         ///< encryption key
@@ -737,6 +892,52 @@ struct pd_crypto {
     PDInteger cfLength;         ///< crypt filter length, e.g. 16 for AESV2
     pd_crypto_method cfMethod;  ///< crypt filter method
     pd_auth_event cfAuthEvent;  ///< when authentication occurs; currently only supports '/DocOpen'
+    
+    struct pd_crypto_key *keys; ///< cache of derived object keys, indexed by object ID and generation number, or NULL until first needed
+#ifdef PD_SUPPORT_THREADS
+    pthread_mutex_t keysLock;   ///< lock for the key cache, so that objects can be encrypted and decrypted from several threads at once
+#endif
+};
+
+#define pd_crypto_key_cache_size 64 ///< Number of derived object keys cached by each crypto object
+
+/**
+ A derived object key, in the form of the prepared cipher state, as cached by the crypto object.
+ */
+struct pd_crypto_key {
+    PDInteger obid;             ///< object ID, or -1 if the entry is unused
+    PDInteger genid;            ///< generation number
+    unsigned char S[256];       ///< RC4 permutation, after the key schedule
+    pd_aes_ctx aes;             ///< AES key schedule
+};
+
+/**
+ The internal crypto stream structure, which is an RC4 or AES state keyed for a specific object.
+ */
+struct pd_crypto_stream {
+    pd_crypto_method method;    ///< crypt filter method
+    PDBool encrypt;             ///< whether data is being encrypted, rather than decrypted
+    unsigned char S[256];       ///< RC4 permutation
+    int i;                      ///< RC4 index i
+    int j;                      ///< RC4 index j
+    pd_aes_ctx aes;             ///< AES key schedule
+    unsigned char iv[16];       ///< AES chaining value
+    unsigned char pending[16];  ///< AES input held back until it makes up a whole block; when decrypting, this is the IV at first, and later the last block seen, as it may be the padding
+    PDInteger pendingLen;       ///< number of bytes in pending
+    PDBool started;             ///< whether the IV has been written or read
+};
+
+/**
+ A decryption job, i.e. the data of an object, along with the cipher state needed to decrypt it.
+ 
+ @see pd_crypto_decrypt_batch
+ */
+struct pd_crypto_job {
+    PDInteger obid;             ///< object ID of owning object
+    PDInteger genid;            ///< generation number of owning object
+    char *data;                 ///< the data, which is decrypted in place
+    PDInteger len;              ///< length of data; once decrypted, the length of the decrypted data
+    struct pd_crypto_stream state; ///< the cipher state, set up by pd_crypto_job_prepare()
 };
 
 #else
@@ -797,6 +998,7 @@ struct PDTask {
     PDTaskRef       child;          ///< The task's child task; child tasks are called in order.
     PDDeallocator   deallocator;    ///< The deallocator for the task.
     void           *info;           ///< The (user) info object.
+    PDBool          isIndependent;  ///< Whether the task only touches the object it is given, and may thus be run on a worker thread
 };
 
 /// @name Twin streams
@@ -821,6 +1023,14 @@ struct PDTwinStream {
     char    *sidebuf;               ///< temporary buffer (e.g. for Fetch)
     
     PDBool   outgrown;              ///< if true, a buffer with growth disallowed attempted to grow and failed
+
+    struct PDTwinStreamSegment *reorderHead; ///< oldest pending deferred output segment, if any
+    struct PDTwinStreamSegment *reorderTail; ///< newest pending deferred output segment, if any
+    PDSize   reorderBytes;          ///< bytes held in the literal buffers of pending segments (included in offso but not yet written)
+    PDInteger reorderCount;         ///< number of pending segments
+    PDBool   emitting;              ///< if true, a deferred segment is being emitted, and content goes straight to output
+    PDTwinStreamOffsetResolver offsetResolver; ///< resolver for deferred offsets
+    void    *offsetResolverInfo;    ///< info passed to the offset resolver
 };
 
 /**
@@ -834,6 +1044,20 @@ struct PDPipe {
     PDBool          typedTasks;         ///< Whether type tasks (excluding unfiltered tasks) are activated; activation results in a slight decrease in performance due to all dictionary objects needing to be resolved in order to check their Type dictionary key
     char           *pi;                 ///< The path of the input file
     char           *po;                 ///< The path of the output file
+    char           *px;                 ///< The path of the index file, if any
+    PDInteger       compressionLevel;   ///< The compression level for streams compressed during execution, or 0 for the filter default
+    PDInteger       workerCount;        ///< The number of worker threads used to re-filter streams, or 0 to re-filter on the calling thread
+    PDBool          prefetchStreams;    ///< Whether the streams of objects targeted by tasks are read and decoded on the worker threads ahead of time
+    PDBool          incrementalUpdate;  ///< Whether the output is the input with only the modified objects appended to it, rather than a rewrite
+    PDBool          sharding;           ///< Whether objects whose tasks are all independent are handed to the worker threads in shards
+    PDBool          deduplicate;        ///< Whether objects which are identical to other objects are left out of the output
+    struct PDPipeDedup *dedup;          ///< Deduplication state during execution, or NULL
+    PDSize          dedupBytes;         ///< Approximate number of bytes saved by deduplication
+    PDInteger       dedupObjects;       ///< Number of objects left out by deduplication
+    PDBool          collectGarbage;     ///< Whether objects which cannot be reached from the trailer are left out of the output
+    PDBool         *unreachable;        ///< Whether each object in the input was found to be unreachable, by object ID, during execution, or NULL
+    PDBool          packObjects;        ///< Whether loose dictionaries and arrays are packed into new object streams in the output
+    PDBool          linearize;          ///< Whether the output is linearized once it has been written
     FILE           *fi;                 ///< Reader
     FILE           *fo;                 ///< Writer
     PDInteger       filterCount;        ///< Number of filters in the pipe
@@ -843,12 +1067,57 @@ struct PDPipe {
     pd_stack
     typeTasks[_PDFTypeCount];           ///< Tasks which run depending on all objects of the given type; the 0'th element (type NULL) is triggered for all objects, and not just objects without a /Type dictionary key
     PDSplayTreeRef      attachments;        ///< PDParserAttachment entries
+    PDSplayTreeRef      deferred;           ///< Tasks for objects which had already been written when the tasks were added, in a tree with the object ID as key, or NULL; they are applied in an incremental update at the end
+};
+
+/**
+ Internal document structure for pipe batches.
+ 
+ @ingroup PDPIPEBATCH
+ */
+struct PDPipeBatchDocument {
+    PDPipeBatchRef  batch;              ///< The batch (not retained)
+    PDInteger       index;              ///< The index of the document in the batch
+    char           *pi;                 ///< The path of the input file
+    char           *po;                 ///< The path of the output file
+    PDPipeBatchStatus status;           ///< The outcome
+    PDInteger       objects;            ///< The number of objects seen, as returned by PDPipeExecute(), or -1
+};
+
+/**
+ Internal structure.
+ 
+ @ingroup PDPIPEBATCH
+ */
+struct PDPipeBatch {
+    PDInteger       threads;            ///< Number of documents executed at the same time, on separate threads, or 0 to execute them on the calling thread
+    struct PDPipeBatchDocument *docs;   ///< The documents
+    PDInteger       count;              ///< Number of documents
+    PDInteger       cap;                ///< Capacity of docs
+    PDTaskRef      *tasks;              ///< Task templates, copied into each pipe
+    PDInteger       taskCount;          ///< Number of task templates
+    PDPipeBatchSetupFunc setup;         ///< Setup function, or NULL
+    void           *setupInfo;          ///< Info passed to the setup function
 };
 
 extern void PDPipeCloseFileStream(FILE *stream);
 extern FILE *PDPipeOpenInputStream(const char *path);
 extern FILE *PDPipeOpenOutputStream(const char *path);
 
+/**
+ Internal structure.
+ 
+ @ingroup PDDOCUMENT
+ */
+struct PDDocument {
+    char           *pi;                 ///< The path of the input file
+    FILE           *fi;                 ///< Reader
+    PDTwinStreamRef stream;             ///< Stream over the input; it has no output except while the document is being written
+    PDParserRef     parser;             ///< The parser, from which objects are fetched at random
+    PDSplayTreeRef  dirty;              ///< Objects which are serialized when the document is written, in a tree with the object ID as key
+    PDBool          written;            ///< Whether the document has been written
+};
+
 /// @name Reference
 
 /**
@@ -948,7 +1217,7 @@ extern void _PDBreak();
             _PDBreak();\
         } while (0)
 #   else
-#       define PDError(args...) 
+#       define PDError(args...) do {} while (0)
 #   endif
 #endif
 
@@ -967,7 +1236,7 @@ extern void _PDBreak();
             fprintf(stderr, "\n"); \
         } while (0)
 #   else
-#       define PDWarn(args...) 
+#       define PDWarn(args...) do {} while (0)
 #   endif
 #endif
 
@@ -985,7 +1254,7 @@ extern void _PDBreak();
             fprintf(stderr, "\n"); \
         } while (0)
 #   else
-#       define PDNotice(args...) 
+#       define PDNotice(args...) do {} while (0)
 #   endif
 #endif
 
@@ -32,6 +32,10 @@
 #include "PDStaticHash.h"
 #include "PDStreamFilterFlateDecode.h"
 #include "PDStreamFilterPrediction.h"
+#include "PDStreamFilterASCIIHexDecode.h"
+#include "PDStreamFilterASCII85Decode.h"
+#include "PDStreamFilterRunLengthDecode.h"
+#include "PDStreamFilterLZWDecode.h"
 #include "PDReference.h"
 #include "PDString.h"
 #include "PDDictionary.h"
@@ -45,6 +49,17 @@
 void PDDeallocatorNullFunc(void *ob) {}
 
 PDInteger users = 0;
+
+#ifdef PD_SUPPORT_THREADS
+// pipes on separate threads set up and tear down the implementation concurrently
+static pthread_mutex_t usersLock = PTHREAD_MUTEX_INITIALIZER;
+#   define pd_pdf_implementation_lock()     pthread_mutex_lock(&usersLock)
+#   define pd_pdf_implementation_unlock()   pthread_mutex_unlock(&usersLock)
+#else
+#   define pd_pdf_implementation_lock()
+#   define pd_pdf_implementation_unlock()
+#endif
+
 PDStateRef pdfRoot, xrefSeeker, stringStream, arbStream;
 
 const char * PD_META       = "meta";
@@ -94,6 +109,8 @@ void PDPDFClearConverters();
 
 void pd_pdf_implementation_use()
 {
+    pd_pdf_implementation_lock();
+    
     static PDBool first = true;
     if (first) {
         first = false;
@@ -103,11 +120,18 @@ void pd_pdf_implementation_use()
         // register FlateDecode handler
         PDStreamFilterRegisterDualFilter("FlateDecode", PDStreamFilterFlateDecodeConstructor);
 #endif
+        // register the remaining standard lossless filters, which have no external dependencies
+        PDStreamFilterRegisterDualFilter("ASCIIHexDecode", PDStreamFilterASCIIHexDecodeConstructor);
+        PDStreamFilterRegisterDualFilter("ASCII85Decode", PDStreamFilterASCII85DecodeConstructor);
+        PDStreamFilterRegisterDualFilter("RunLengthDecode", PDStreamFilterRunLengthDecodeConstructor);
+        PDStreamFilterRegisterDualFilter("LZWDecode", PDStreamFilterLZWDecodeConstructor);
         // set null deallocator
         PDDeallocatorNull = PDDeallocatorNullFunc;
         // set null number
         PDNullObject = PDNumberCreateWithBool(false);
         PDFlagGlobalObject(PDNullObject);
+        // the null object is retained and released by every thread, so its retain count is left alone altogether
+        PDMakeImmortal(PDNullObject);
     }
     
     if (users == 0) {
@@ -518,10 +542,14 @@ void pd_pdf_implementation_use()
 #endif
     }
     users++;
+    
+    pd_pdf_implementation_unlock();
 }
 
 void pd_pdf_implementation_discard()
 {
+    pd_pdf_implementation_lock();
+    
     users--;
     if (users == 0) {
         PDRelease(pdfRoot);
@@ -529,9 +557,13 @@ void pd_pdf_implementation_discard()
         PDRelease(arbStream);
         PDRelease(stringStream);
         
+        PDStreamFilterDrainPools();
+        
 //        PDOperatorSymbolGlobClear();
         pd_pdf_conversion_discard();
     }
+    
+    pd_pdf_implementation_unlock();
 }
 
 PDInteger ctusers = 0;
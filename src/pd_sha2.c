@@ -0,0 +1,261 @@
+//
+// pd_sha2.c
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <string.h>
+#include "pd_sha2.h"
+
+// FIPS 180-4
+
+static const u_int32_t pd_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const u_int64_t pd_sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define CH(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static void pd_sha256_transform(u_int32_t *state, const unsigned char *block)
+{
+    u_int32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+    
+    for (i = 0; i < 16; i++) 
+        w[i] = (u_int32_t)block[i*4] << 24 | (u_int32_t)block[i*4+1] << 16 | (u_int32_t)block[i*4+2] << 8 | block[i*4+3];
+    for (; i < 64; i++) 
+        w[i] = (ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10)) + w[i-7] + (ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3)) + w[i-16];
+    
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    
+    for (i = 0; i < 64; i++) {
+        t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + CH(e, f, g) + pd_sha256_k[i] + w[i];
+        t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + MAJ(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+static void pd_sha512_transform(u_int64_t *state, const unsigned char *block)
+{
+    u_int64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+    int i, j;
+    
+    for (i = 0; i < 16; i++) 
+        for (w[i] = 0, j = 0; j < 8; j++) 
+            w[i] = w[i] << 8 | block[i*8+j];
+    for (; i < 80; i++) 
+        w[i] = (ROR64(w[i-2], 19) ^ ROR64(w[i-2], 61) ^ (w[i-2] >> 6)) + w[i-7] + (ROR64(w[i-15], 1) ^ ROR64(w[i-15], 8) ^ (w[i-15] >> 7)) + w[i-16];
+    
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    
+    for (i = 0; i < 80; i++) {
+        t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) + CH(e, f, g) + pd_sha512_k[i] + w[i];
+        t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) + MAJ(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void pd_sha256_init(pd_sha256_ctx *ctx)
+{
+    static const u_int32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void pd_sha256_update(pd_sha256_ctx *ctx, const unsigned char *data, PDSize len)
+{
+    PDSize used = ctx->count & 63;
+    ctx->count += len;
+    
+    if (used > 0) {
+        PDSize fill = 64 - used;
+        if (len < fill) {
+            memcpy(&ctx->buffer[used], data, len);
+            return;
+        }
+        memcpy(&ctx->buffer[used], data, fill);
+        pd_sha256_transform(ctx->state, ctx->buffer);
+        data += fill;
+        len -= fill;
+    }
+    
+    for (; len >= 64; data += 64, len -= 64) 
+        pd_sha256_transform(ctx->state, data);
+    
+    memcpy(ctx->buffer, data, len);
+}
+
+void pd_sha256_final(unsigned char *md, pd_sha256_ctx *ctx)
+{
+    unsigned char pad[72];
+    u_int64_t bits = ctx->count << 3;
+    PDSize padlen = 64 - ((ctx->count + 8) & 63);
+    int i;
+    
+    // 0x80, zeroes, and the bit count (big endian), ending on a block boundary
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++) 
+        pad[padlen + i] = (unsigned char)(bits >> (56 - 8 * i));
+    pd_sha256_update(ctx, pad, padlen + 8);
+    
+    for (i = 0; i < 32; i++) 
+        md[i] = (unsigned char)(ctx->state[i >> 2] >> (24 - 8 * (i & 3)));
+}
+
+void pd_sha256(const unsigned char *data, PDSize len, unsigned char *result)
+{
+    pd_sha256_ctx ctx;
+    pd_sha256_init(&ctx);
+    pd_sha256_update(&ctx, data, len);
+    pd_sha256_final(result, &ctx);
+}
+
+void pd_sha512_init(pd_sha512_ctx *ctx)
+{
+    static const u_int64_t iv[8] = {
+        0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+        0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void pd_sha384_init(pd_sha512_ctx *ctx)
+{
+    static const u_int64_t iv[8] = {
+        0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL, 0x152fecd8f70e5939ULL,
+        0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL, 0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->count = 0;
+}
+
+void pd_sha512_update(pd_sha512_ctx *ctx, const unsigned char *data, PDSize len)
+{
+    PDSize used = ctx->count & 127;
+    ctx->count += len;
+    
+    if (used > 0) {
+        PDSize fill = 128 - used;
+        if (len < fill) {
+            memcpy(&ctx->buffer[used], data, len);
+            return;
+        }
+        memcpy(&ctx->buffer[used], data, fill);
+        pd_sha512_transform(ctx->state, ctx->buffer);
+        data += fill;
+        len -= fill;
+    }
+    
+    for (; len >= 128; data += 128, len -= 128) 
+        pd_sha512_transform(ctx->state, data);
+    
+    memcpy(ctx->buffer, data, len);
+}
+
+static void pd_sha512_finish(pd_sha512_ctx *ctx)
+{
+    unsigned char pad[144];
+    u_int64_t bits = ctx->count << 3;
+    PDSize padlen = 128 - ((ctx->count + 16) & 127);
+    int i;
+    
+    // as SHA-256, except the bit count is 128 bits wide; we never hash more than 2^61 bytes, so its upper half is always 0
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++) 
+        pad[padlen + 8 + i] = (unsigned char)(bits >> (56 - 8 * i));
+    pd_sha512_update(ctx, pad, padlen + 16);
+}
+
+void pd_sha512_final(unsigned char *md, pd_sha512_ctx *ctx)
+{
+    pd_sha512_finish(ctx);
+    for (int i = 0; i < 64; i++) 
+        md[i] = (unsigned char)(ctx->state[i >> 3] >> (56 - 8 * (i & 7)));
+}
+
+void pd_sha384_final(unsigned char *md, pd_sha512_ctx *ctx)
+{
+    pd_sha512_finish(ctx);
+    for (int i = 0; i < 48; i++) 
+        md[i] = (unsigned char)(ctx->state[i >> 3] >> (56 - 8 * (i & 7)));
+}
+
+void pd_sha512(const unsigned char *data, PDSize len, unsigned char *result)
+{
+    pd_sha512_ctx ctx;
+    pd_sha512_init(&ctx);
+    pd_sha512_update(&ctx, data, len);
+    pd_sha512_final(result, &ctx);
+}
+
+void pd_sha384(const unsigned char *data, PDSize len, unsigned char *result)
+{
+    pd_sha512_ctx ctx;
+    pd_sha384_init(&ctx);
+    pd_sha512_update(&ctx, data, len);
+    pd_sha384_final(result, &ctx);
+}
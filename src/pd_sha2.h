@@ -0,0 +1,87 @@
+//
+// pd_sha2.h
+// Copyright (c) 2012 - 2015 Karl-Johan Alm (http://github.com/kallewoof)
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+/**
+ @file pd_sha2.h SHA-2 header file.
+ 
+ @ingroup pd_crypto
+ 
+ @brief SHA-256, SHA-384 and SHA-512 message digests, as needed by the AES-256 (revision 5 and 6) standard security handler, and for telling identical objects apart when deduplicating.
+ 
+ @{
+ */
+
+#ifndef INCLUDED_PD_SHA2_H
+#define INCLUDED_PD_SHA2_H
+
+#include "PDDefines.h"
+
+#include <sys/types.h>
+
+/* SHA-256 context. */
+typedef struct pd_sha256_ctx pd_sha256_ctx;
+struct pd_sha256_ctx {
+    u_int32_t state[8];             ///< hash state
+    u_int64_t count;                ///< number of bytes hashed
+    unsigned char buffer[64];       ///< input buffer
+};
+
+/* SHA-512 context, also used for SHA-384. */
+typedef struct pd_sha512_ctx pd_sha512_ctx;
+struct pd_sha512_ctx {
+    u_int64_t state[8];             ///< hash state
+    u_int64_t count;                ///< number of bytes hashed
+    unsigned char buffer[128];      ///< input buffer
+};
+
+extern void pd_sha256_init(pd_sha256_ctx *ctx);
+extern void pd_sha256_update(pd_sha256_ctx *ctx, const unsigned char *data, PDSize len);
+extern void pd_sha256_final(unsigned char *md, pd_sha256_ctx *ctx);
+
+/**
+ Hash len bytes of data into the 32 byte result.
+ */
+extern void pd_sha256(const unsigned char *data, PDSize len, unsigned char *result);
+
+extern void pd_sha384_init(pd_sha512_ctx *ctx);
+#define pd_sha384_update pd_sha512_update
+extern void pd_sha384_final(unsigned char *md, pd_sha512_ctx *ctx);
+
+/**
+ Hash len bytes of data into the 48 byte result.
+ */
+extern void pd_sha384(const unsigned char *data, PDSize len, unsigned char *result);
+
+extern void pd_sha512_init(pd_sha512_ctx *ctx);
+extern void pd_sha512_update(pd_sha512_ctx *ctx, const unsigned char *data, PDSize len);
+extern void pd_sha512_final(unsigned char *md, pd_sha512_ctx *ctx);
+
+/**
+ Hash len bytes of data into the 64 byte result.
+ */
+extern void pd_sha512(const unsigned char *data, PDSize len, unsigned char *result);
+
+#endif
+
+/** @} */
@@ -28,8 +28,8 @@
 #include "PDState.h"
 #include "pd_pdf_implementation.h"
 
-static PDInteger pd_stack_preserve_users = 0;
-PDDeallocator pd_stack_dealloc = free;
+static PD_THREAD_LOCAL PDInteger pd_stack_preserve_users = 0;
+PD_THREAD_LOCAL PDDeallocator pd_stack_dealloc = free;
 void pd_stack_preserve(void *ptr)
 {}
 
@@ -51,6 +51,8 @@
  @param preserve Whether preserve should be enabled or not.
  
  @note Nests truths.
+ 
+ @note The flag applies to stacks destroyed on the calling thread only.
  */
 extern void pd_stack_set_global_preserve_flag(PDBool preserve);
 
@@ -311,11 +313,11 @@ extern void pd_stack_show(pd_stack stack);
 /** @} */
 
 /**
- The global deallocator for stacks. Defaults to the built-in free() function, but is overridden when global preserve flag is set.
+ The global deallocator for stacks, kept per thread. Defaults to the built-in free() function, but is overridden when global preserve flag is set.
  
  @see pd_stack_set_global_preserve_flag
  */
-extern PDDeallocator pd_stack_dealloc;
+extern PD_THREAD_LOCAL PDDeallocator pd_stack_dealloc;
 
 /**
  Deallocate something using stack deallocator.